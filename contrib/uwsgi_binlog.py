@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+"""
+reader for the uWSGI binary request logs
+
+  --log-req-encoder binary  (stream of length-prefixed records)
+  --log-rotate-columnar     (.ucol files, generated on rotation)
+
+usage: python uwsgi_binlog.py <file> [...]
+
+every request is printed as a json object (one per line), text records
+are printed as {"text": ...}
+"""
+import json
+import struct
+import sys
+import zlib
+
+STRINGS = ('method', 'uri', 'host', 'addr', 'proto', 'user', 'uagent', 'referer')
+HEADER = struct.Struct('<BHHHIQQQQQH')
+
+
+def decode(b):
+    return b.decode('utf-8', 'replace')
+
+
+def parse_request(payload):
+    (version, status, wid, core, pid, start, micros, rsize, hsize, cl, n) = HEADER.unpack_from(payload)
+    pos = HEADER.size
+    lengths = struct.unpack_from('<%dH' % n, payload, pos)
+    pos += 2 * n
+    req = {'status': status, 'wid': wid, 'core': core, 'pid': pid, 'start': start,
+           'micros': micros, 'rsize': rsize, 'hsize': hsize, 'cl': cl}
+    for name, length in zip(STRINGS, lengths):
+        req[name] = decode(payload[pos:pos + length])
+        pos += length
+    return req
+
+
+def read_stream(data):
+    pos = 0
+    while pos < len(data):
+        if pos + 5 <= len(data):
+            (length,) = struct.unpack_from('<I', data, pos)
+            rtype = data[pos + 4]
+            if 0 < length <= len(data) - pos - 4 and rtype in (0, 1):
+                payload = data[pos + 5:pos + 4 + length]
+                pos += 4 + length
+                if rtype == 0:
+                    yield parse_request(payload)
+                else:
+                    yield {'text': decode(payload)}
+                continue
+        # not a frame (like the rotation message)
+        nl = data.find(b'\n', pos)
+        end = nl if nl >= 0 else len(data)
+        yield {'text': decode(data[pos:end])}
+        pos = end + 1
+
+
+def read_columnar(data):
+    rows, ncols = struct.unpack_from('<IH', data, 8)
+    pos = 14
+    columns = {}
+    texts = []
+    for i in range(ncols):
+        name_len = data[pos]
+        name = decode(data[pos + 1:pos + 1 + name_len])
+        pos += 1 + name_len
+        ctype, codec, raw_len, stored_len = struct.unpack_from('<BBQQ', data, pos)
+        pos += 18
+        blob = data[pos:pos + stored_len]
+        pos += stored_len
+        if codec == 1:
+            blob = zlib.decompress(blob)
+        if ctype in (1, 2, 3, 4):
+            fmt = {1: 'H', 2: 'I', 3: 'Q', 4: 'Q'}[ctype]
+            values = list(struct.unpack('<%d%s' % (rows, fmt), blob))
+            if ctype == 4:
+                for j in range(1, rows):
+                    values[j] = (values[j] + values[j - 1]) & 0xffffffffffffffff
+            columns[name] = values
+        elif ctype == 5:
+            (items,) = struct.unpack_from('<I', blob)
+            p = 4
+            dictionary = []
+            for j in range(items):
+                (length,) = struct.unpack_from('<I', blob, p)
+                dictionary.append(decode(blob[p + 4:p + 4 + length]))
+                p += 4 + length
+            ids = struct.unpack_from('<%dI' % rows, blob, p)
+            columns[name] = [dictionary[x] for x in ids]
+        elif ctype == 6:
+            (lines,) = struct.unpack_from('<I', blob)
+            p = 4
+            for j in range(lines):
+                (length,) = struct.unpack_from('<I', blob, p)
+                texts.append(decode(blob[p + 4:p + 4 + length]))
+                p += 4 + length
+    for j in range(rows):
+        yield dict((name, values[j]) for name, values in columns.items())
+    for text in texts:
+        yield {'text': text}
+
+
+def main():
+    for filename in sys.argv[1:]:
+        with open(filename, 'rb') as f:
+            data = f.read()
+        reader = read_columnar if data[:8] == b'UWSGICL1' else read_stream
+        for record in reader(data):
+            print(json.dumps(record, sort_keys=True))
+
+
+if __name__ == '__main__':
+    main()
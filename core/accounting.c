@@ -0,0 +1,159 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	per-request resource accounting
+
+	with --request-accounting the cpu time of the thread (CLOCK_THREAD_CPUTIME_ID), the voluntary
+	and involuntary context switches and the minor page faults (getrusage() of the thread) are
+	sampled at the start and at the end of every request. The deltas are available to the logger
+	(%(cpu), %(offcpu), %(vcsw), %(ivcsw), %(minflt)), are summed in the core of the request and
+	in shared memory per worker and route label (slot 0 accounts all of the requests, the others
+	are the route labels, like the latency histograms).
+
+	a request spending most of its time off-cpu (offcpu = micros - cpu) is waiting for I/O
+	(or for the other threads), a lot of voluntary switches means blocking syscalls.
+
+	in async modes the requests of a core share the thread, so the deltas include the work of the
+	other requests running in the meantime.
+
+	Without RUSAGE_THREAD (non-Linux systems) the counters of the whole process are used.
+
+*/
+
+#ifdef RUSAGE_THREAD
+#define UWSGI_RUSAGE_WHO RUSAGE_THREAD
+#else
+#define UWSGI_RUSAGE_WHO RUSAGE_SELF
+#endif
+
+static struct uwsgi_request_accounting *request_accounting_slot(int wid, int slot) {
+	return &uwsgi.request_acct[(wid * uwsgi.latency_slots) + slot];
+}
+
+void uwsgi_setup_request_accounting() {
+	if (!uwsgi.request_accounting) return;
+
+	uwsgi_setup_route_labels();
+	uwsgi.request_acct = uwsgi_calloc_shared(sizeof(struct uwsgi_request_accounting) * (uwsgi.numproc + 1) * uwsgi.latency_slots);
+	uwsgi_log("per-request resource accounting enabled (%d slots)\n", uwsgi.latency_slots);
+}
+
+static uint64_t request_accounting_cpu() {
+	struct timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) return 0;
+	return (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void uwsgi_request_accounting_start(struct wsgi_request *wsgi_req) {
+	if (!uwsgi.request_acct) return;
+	struct rusage ru;
+	if (getrusage(UWSGI_RUSAGE_WHO, &ru)) return;
+	wsgi_req->acct_cpu = request_accounting_cpu();
+	wsgi_req->acct_vcsw = ru.ru_nvcsw;
+	wsgi_req->acct_ivcsw = ru.ru_nivcsw;
+	wsgi_req->acct_minflt = ru.ru_minflt;
+	wsgi_req->acct_running = 1;
+}
+
+static void request_accounting_add(struct uwsgi_request_accounting *ura, struct wsgi_request *wsgi_req, uint64_t micros) {
+	__sync_add_and_fetch(&ura->cpu, wsgi_req->acct_cpu);
+	__sync_add_and_fetch(&ura->micros, micros);
+	__sync_add_and_fetch(&ura->vcsw, wsgi_req->acct_vcsw);
+	__sync_add_and_fetch(&ura->ivcsw, wsgi_req->acct_ivcsw);
+	__sync_add_and_fetch(&ura->minflt, wsgi_req->acct_minflt);
+	// requests is updated as the last one, readers use it as the total
+	__sync_add_and_fetch(&ura->requests, 1);
+}
+
+// called after end_of_request has been set
+void uwsgi_request_accounting_end(struct wsgi_request *wsgi_req) {
+	if (!wsgi_req->acct_running) return;
+	wsgi_req->acct_running = 0;
+	struct rusage ru;
+	if (getrusage(UWSGI_RUSAGE_WHO, &ru)) {
+		wsgi_req->acct_cpu = wsgi_req->acct_vcsw = wsgi_req->acct_ivcsw = wsgi_req->acct_minflt = 0;
+		return;
+	}
+	uint64_t cpu = request_accounting_cpu();
+	wsgi_req->acct_cpu = cpu > wsgi_req->acct_cpu ? cpu - wsgi_req->acct_cpu : 0;
+	wsgi_req->acct_vcsw = ru.ru_nvcsw - wsgi_req->acct_vcsw;
+	wsgi_req->acct_ivcsw = ru.ru_nivcsw - wsgi_req->acct_ivcsw;
+	wsgi_req->acct_minflt = ru.ru_minflt - wsgi_req->acct_minflt;
+
+	if (wsgi_req->do_not_account || uwsgi.mywid <= 0) return;
+
+	// the core is used only by this thread
+	struct uwsgi_core *uc = &uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id];
+	uc->cpu_time += wsgi_req->acct_cpu;
+	uc->vcsw += wsgi_req->acct_vcsw;
+	uc->ivcsw += wsgi_req->acct_ivcsw;
+	uc->minflt += wsgi_req->acct_minflt;
+
+	uint64_t micros = wsgi_req->end_of_request - wsgi_req->start_of_request;
+	request_accounting_add(request_accounting_slot(uwsgi.mywid, 0), wsgi_req, micros);
+	if (wsgi_req->route_label_id > 0 && wsgi_req->route_label_id < uwsgi.latency_slots) {
+		request_accounting_add(request_accounting_slot(uwsgi.mywid, wsgi_req->route_label_id), wsgi_req, micros);
+	}
+}
+
+static void request_accounting_merge(struct uwsgi_request_accounting *out, int slot) {
+	int i;
+	memset(out, 0, sizeof(struct uwsgi_request_accounting));
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		struct uwsgi_request_accounting *ura = request_accounting_slot(i, slot);
+		out->requests += ura->requests;
+		out->cpu += ura->cpu;
+		out->micros += ura->micros;
+		out->vcsw += ura->vcsw;
+		out->ivcsw += ura->ivcsw;
+		out->minflt += ura->minflt;
+	}
+}
+
+static int request_accounting_stats(struct uwsgi_stats *us, struct uwsgi_request_accounting *ura) {
+	if (uwsgi_stats_keylong_comma(us, "requests", (unsigned long long) ura->requests)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "cpu", (unsigned long long) ura->cpu)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "offcpu", (unsigned long long) (ura->micros > ura->cpu ? ura->micros - ura->cpu : 0))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "avg_cpu", (unsigned long long) (ura->requests ? ura->cpu / ura->requests : 0))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "vcsw", (unsigned long long) ura->vcsw)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "ivcsw", (unsigned long long) ura->ivcsw)) return -1;
+	return uwsgi_stats_keylong(us, "minflt", (unsigned long long) ura->minflt);
+}
+
+/*
+	"request_accounting": {"requests": N, "cpu": N, "offcpu": N, ..., "labels": [{"name": "foo", "requests": N, ...}]},
+*/
+int uwsgi_stats_request_accounting(struct uwsgi_stats *us) {
+	if (!uwsgi.request_acct) return 0;
+	struct uwsgi_request_accounting ura;
+
+	if (uwsgi_stats_key(us, "request_accounting")) return -1;
+	if (uwsgi_stats_object_open(us)) return -1;
+
+	request_accounting_merge(&ura, 0);
+	if (request_accounting_stats(us, &ura)) return -1;
+	if (uwsgi_stats_comma(us)) return -1;
+
+	if (uwsgi_stats_key(us, "labels")) return -1;
+	if (uwsgi_stats_list_open(us)) return -1;
+	int slot = 1;
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, uwsgi.latency_labels) {
+		if (slot > 1) {
+			if (uwsgi_stats_comma(us)) return -1;
+		}
+		if (uwsgi_stats_object_open(us)) return -1;
+		if (uwsgi_stats_keyval_comma(us, "name", usl->value)) return -1;
+		request_accounting_merge(&ura, slot);
+		if (request_accounting_stats(us, &ura)) return -1;
+		if (uwsgi_stats_object_close(us)) return -1;
+		slot++;
+	}
+	if (uwsgi_stats_list_close(us)) return -1;
+
+	if (uwsgi_stats_object_close(us)) return -1;
+	return uwsgi_stats_comma(us);
+}
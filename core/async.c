@@ -329,6 +329,9 @@ static int async_wait_fd_write(int fd, int timeout) {
 }
 
 void async_schedule_to_req(void) {
+	// called again on every resume (UWSGI_OK marks the first run)
+	if (uwsgi.wsgi_req->async_status == UWSGI_OK && uwsgi_deadline_set(uwsgi.wsgi_req))
+		goto end;
 #ifdef UWSGI_ROUTING
         if (uwsgi_apply_routes(uwsgi.wsgi_req) == UWSGI_ROUTE_BREAK) {
 		goto end;
@@ -354,6 +357,8 @@ end:
 
 void async_schedule_to_req_green(void) {
 	struct wsgi_request *wsgi_req = uwsgi.wsgi_req;
+	if (uwsgi_deadline_set(wsgi_req))
+		goto end;
 #ifdef UWSGI_ROUTING
         if (uwsgi_apply_routes(wsgi_req) == UWSGI_ROUTE_BREAK) {
                 goto end;
@@ -373,9 +378,7 @@ void async_schedule_to_req_green(void) {
                 	uwsgi.schedule_to_main(wsgi_req);
         }
 
-#ifdef UWSGI_ROUTING
 end:
-#endif
 	// re-set the global state
 	uwsgi.wsgi_req = wsgi_req;
         async_reset_request(wsgi_req);
@@ -0,0 +1,565 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	binary request logging
+
+	when the "binary" log-req-encoder is in the chain, workers stop generating
+	text lines and emit a compact record for each request:
+
+	u8	0 (marks a binary record, text lines never start with a NUL byte)
+	u8	version
+	u16	status
+	u16	worker id
+	u16	core id
+	u32	pid
+	u64	start of the request (microseconds since the epoch)
+	u64	response time (microseconds)
+	u64	response body size
+	u64	response headers size
+	u64	request body size
+	u16	number of strings
+	u16	length of each string
+	...	the string table (method, uri, host, addr, proto, user, uagent, referer)
+
+	all of the numbers are little endian.
+
+	The encoder (running in the log master) frames each record with an u32 length
+	prefix, followed by the record type (0 request, 1 text). Text lines reaching the
+	request logger (if any) are framed as type 1 records, so the stream is always
+	parseable.
+
+	With --log-rotate-columnar the rotated files of the request loggers (like --req-logger file:...)
+	are converted (in a background thread) to a columnar file (<rotated>.ucol) and the original
+	is removed. Files without request records (or failed conversions) are left untouched.
+
+*/
+
+#define UWSGI_BINLOG_VERSION 1
+#define UWSGI_BINLOG_STRINGS 8
+#define UWSGI_BINLOG_HEADER (1 + 1 + 2 + 2 + 2 + 4 + (8 * 5) + 2 + (2 * UWSGI_BINLOG_STRINGS))
+
+static char *binlog_strings_names[UWSGI_BINLOG_STRINGS] = {
+	"method", "uri", "host", "addr", "proto", "user", "uagent", "referer",
+};
+
+static char *binlog_put16(char *ptr, uint16_t n) {
+	*ptr++ = (uint8_t) (n & 0xff);
+	*ptr++ = (uint8_t) ((n >> 8) & 0xff);
+	return ptr;
+}
+
+static char *binlog_put32(char *ptr, uint32_t n) {
+	ptr = binlog_put16(ptr, n & 0xffff);
+	return binlog_put16(ptr, (n >> 16) & 0xffff);
+}
+
+static char *binlog_put64(char *ptr, uint64_t n) {
+	ptr = binlog_put32(ptr, n & 0xffffffff);
+	return binlog_put32(ptr, (n >> 32) & 0xffffffff);
+}
+
+static uint16_t binlog_get16(char *ptr) {
+	uint8_t *p = (uint8_t *) ptr;
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t binlog_get32(char *ptr) {
+	return (uint32_t) binlog_get16(ptr) | ((uint32_t) binlog_get16(ptr + 2) << 16);
+}
+
+static uint64_t binlog_get64(char *ptr) {
+	return (uint64_t) binlog_get32(ptr) | ((uint64_t) binlog_get32(ptr + 4) << 32);
+}
+
+void uwsgi_setup_log_binary() {
+	int i;
+	uwsgi.log_binary_buf = uwsgi_malloc(sizeof(char *) * uwsgi.cores);
+	for (i = 0; i < uwsgi.cores; i++) {
+		uwsgi.log_binary_buf[i] = uwsgi_malloc(uwsgi.log_master_bufsize);
+	}
+}
+
+void uwsgi_logit_binary(struct wsgi_request *wsgi_req) {
+	char *buf = uwsgi.log_binary_buf[wsgi_req->async_id];
+	char *ptr = buf;
+	int i;
+
+	*ptr++ = 0;
+	*ptr++ = UWSGI_BINLOG_VERSION;
+	ptr = binlog_put16(ptr, wsgi_req->status);
+	ptr = binlog_put16(ptr, uwsgi.mywid);
+	ptr = binlog_put16(ptr, wsgi_req->async_id);
+	ptr = binlog_put32(ptr, uwsgi.mypid);
+	ptr = binlog_put64(ptr, wsgi_req->start_of_request);
+	ptr = binlog_put64(ptr, wsgi_req->end_of_request - wsgi_req->start_of_request);
+	ptr = binlog_put64(ptr, wsgi_req->response_size);
+	ptr = binlog_put64(ptr, wsgi_req->headers_size);
+	ptr = binlog_put64(ptr, wsgi_req->post_cl);
+	ptr = binlog_put16(ptr, UWSGI_BINLOG_STRINGS);
+
+	char *strings[UWSGI_BINLOG_STRINGS] = {
+		wsgi_req->method, wsgi_req->uri, wsgi_req->host, wsgi_req->remote_addr,
+		wsgi_req->protocol, wsgi_req->remote_user, wsgi_req->user_agent, wsgi_req->referer,
+	};
+	uint16_t strings_len[UWSGI_BINLOG_STRINGS] = {
+		wsgi_req->method_len, wsgi_req->uri_len, wsgi_req->host_len, wsgi_req->remote_addr_len,
+		wsgi_req->protocol_len, wsgi_req->remote_user_len, wsgi_req->user_agent_len, wsgi_req->referer_len,
+	};
+
+	// the record cannot be bigger than the log master buffer (strings are truncated)
+	size_t available = uwsgi.log_master_bufsize - UWSGI_BINLOG_HEADER;
+	char *table = ptr;
+	ptr += 2 * UWSGI_BINLOG_STRINGS;
+	for (i = 0; i < UWSGI_BINLOG_STRINGS; i++) {
+		size_t len = strings[i] ? strings_len[i] : 0;
+		if (len > available) len = available;
+		table = binlog_put16(table, len);
+		if (len > 0) {
+			memcpy(ptr, strings[i], len);
+			ptr += len;
+			available -= len;
+		}
+	}
+
+	struct iovec iov;
+	iov.iov_base = buf;
+	iov.iov_len = ptr - buf;
+	// do not check for errors
+	uwsgi_req_log_writev(&iov, 1);
+}
+
+char *uwsgi_log_encoder_binary(struct uwsgi_log_encoder *ule, char *msg, size_t len, size_t *rlen) {
+	int is_text = (len < UWSGI_BINLOG_HEADER || msg[0] != 0);
+	size_t payload = is_text ? len : len - 1;
+	char *buf = uwsgi_malloc(4 + 1 + payload);
+	binlog_put32(buf, 1 + payload);
+	if (is_text) {
+		buf[4] = 1;
+		memcpy(buf + 5, msg, len);
+	}
+	else {
+		buf[4] = 0;
+		// skip the marker
+		memcpy(buf + 5, msg + 1, payload);
+	}
+	*rlen = 4 + 1 + payload;
+	return buf;
+}
+
+/*
+
+	columnar conversion
+
+	the .ucol file starts with the "UWSGICL1" magic, followed by
+	u32 rows (request records), u16 number of columns and the columns:
+
+	u8	name length
+	...	name
+	u8	type (1 u16, 2 u32, 3 u64, 4 u64 delta encoded, 5 strings dictionary, 6 text lines)
+	u8	codec (0 raw, 1 zlib)
+	u64	raw size
+	u64	stored size
+	...	data
+
+	a strings dictionary column is: u32 items, items (u32 len + bytes), u32 index for each row.
+	a text lines column is: u32 lines, lines (u32 len + bytes).
+
+*/
+
+#define UWSGI_BINLOG_DICT_BUCKETS 4096
+
+struct binlog_dict_item {
+	uint32_t id;
+	char *ptr;
+	uint32_t len;
+	struct binlog_dict_item *next;
+};
+
+struct binlog_dict {
+	struct binlog_dict_item *buckets[UWSGI_BINLOG_DICT_BUCKETS];
+	uint32_t items;
+	struct uwsgi_buffer *values;
+	struct uwsgi_buffer *ids;
+};
+
+struct binlog_columns {
+	uint32_t rows;
+	uint64_t last_start;
+	struct uwsgi_buffer *status;
+	struct uwsgi_buffer *wid;
+	struct uwsgi_buffer *core;
+	struct uwsgi_buffer *pid;
+	struct uwsgi_buffer *start;
+	struct uwsgi_buffer *micros;
+	struct uwsgi_buffer *rsize;
+	struct uwsgi_buffer *hsize;
+	struct uwsgi_buffer *cl;
+	struct binlog_dict strings[UWSGI_BINLOG_STRINGS];
+	uint32_t texts;
+	struct uwsgi_buffer *text;
+};
+
+static int binlog_dict_add(struct binlog_dict *bd, char *ptr, uint32_t len) {
+	uint32_t slot = djb33x_hash(ptr, len) % UWSGI_BINLOG_DICT_BUCKETS;
+	struct binlog_dict_item *bdi = bd->buckets[slot];
+	while (bdi) {
+		if (bdi->len == len && !memcmp(bdi->ptr, ptr, len)) {
+			return uwsgi_buffer_u32le(bd->ids, bdi->id);
+		}
+		bdi = bdi->next;
+	}
+	bdi = uwsgi_malloc(sizeof(struct binlog_dict_item));
+	// the pointer references the mmap()'ed file
+	bdi->ptr = ptr;
+	bdi->len = len;
+	bdi->id = bd->items++;
+	bdi->next = bd->buckets[slot];
+	bd->buckets[slot] = bdi;
+	if (uwsgi_buffer_u32le(bd->values, len)) return -1;
+	if (uwsgi_buffer_append(bd->values, ptr, len)) return -1;
+	return uwsgi_buffer_u32le(bd->ids, bdi->id);
+}
+
+static void binlog_dict_free(struct binlog_dict *bd) {
+	int i;
+	for (i = 0; i < UWSGI_BINLOG_DICT_BUCKETS; i++) {
+		struct binlog_dict_item *bdi = bd->buckets[i];
+		while (bdi) {
+			struct binlog_dict_item *next = bdi->next;
+			free(bdi);
+			bdi = next;
+		}
+	}
+	uwsgi_buffer_destroy(bd->values);
+	uwsgi_buffer_destroy(bd->ids);
+}
+
+static int binlog_add_text(struct binlog_columns *bc, char *ptr, size_t len) {
+	bc->texts++;
+	if (uwsgi_buffer_u32le(bc->text, len)) return -1;
+	return uwsgi_buffer_append(bc->text, ptr, len);
+}
+
+// parse a request record (without the marker byte)
+static int binlog_add_request(struct binlog_columns *bc, char *ptr, size_t len) {
+	// version
+	if (len < UWSGI_BINLOG_HEADER - 1 || (uint8_t) ptr[0] != UWSGI_BINLOG_VERSION) return -1;
+	// validate the record before touching the columns
+	char *table = ptr + (UWSGI_BINLOG_HEADER - 1) - (2 * UWSGI_BINLOG_STRINGS);
+	if (binlog_get16(table - 2) != UWSGI_BINLOG_STRINGS) return -1;
+	size_t strings_len = 0;
+	int i;
+	for (i = 0; i < UWSGI_BINLOG_STRINGS; i++) {
+		strings_len += binlog_get16(table + (i * 2));
+	}
+	if ((UWSGI_BINLOG_HEADER - 1) + strings_len != len) return -1;
+	ptr++;
+	if (uwsgi_buffer_u16le(bc->status, binlog_get16(ptr))) return -1;
+	ptr += 2;
+	if (uwsgi_buffer_u16le(bc->wid, binlog_get16(ptr))) return -1;
+	ptr += 2;
+	if (uwsgi_buffer_u16le(bc->core, binlog_get16(ptr))) return -1;
+	ptr += 2;
+	if (uwsgi_buffer_u32le(bc->pid, binlog_get32(ptr))) return -1;
+	ptr += 4;
+	// timestamps are (mostly) increasing, deltas compress a lot better
+	uint64_t start = binlog_get64(ptr);
+	if (uwsgi_buffer_u64le(bc->start, start - bc->last_start)) return -1;
+	bc->last_start = start;
+	ptr += 8;
+	if (uwsgi_buffer_u64le(bc->micros, binlog_get64(ptr))) return -1;
+	ptr += 8;
+	if (uwsgi_buffer_u64le(bc->rsize, binlog_get64(ptr))) return -1;
+	ptr += 8;
+	if (uwsgi_buffer_u64le(bc->hsize, binlog_get64(ptr))) return -1;
+	ptr += 8;
+	if (uwsgi_buffer_u64le(bc->cl, binlog_get64(ptr))) return -1;
+	ptr += 8 + 2 + (2 * UWSGI_BINLOG_STRINGS);
+	for (i = 0; i < UWSGI_BINLOG_STRINGS; i++) {
+		uint16_t slen = binlog_get16(table + (i * 2));
+		if (binlog_dict_add(&bc->strings[i], ptr, slen)) return -1;
+		ptr += slen;
+	}
+	bc->rows++;
+	return 0;
+}
+
+static int binlog_write_column(int fd, char *name, uint8_t type, struct uwsgi_buffer *data) {
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	char *stored = data->buf;
+	size_t stored_len = data->pos;
+	uint8_t codec = 0;
+	int ret = -1;
+#ifdef UWSGI_ZLIB
+	uLongf c_len = compressBound(data->pos);
+	char *compressed = uwsgi_malloc(c_len);
+	if (compress2((Bytef *) compressed, &c_len, (Bytef *) data->buf, data->pos, Z_DEFAULT_COMPRESSION) == Z_OK && c_len < data->pos) {
+		stored = compressed;
+		stored_len = c_len;
+		codec = 1;
+	}
+#endif
+	if (uwsgi_buffer_u8(ub, strlen(name))) goto end;
+	if (uwsgi_buffer_append(ub, name, strlen(name))) goto end;
+	if (uwsgi_buffer_u8(ub, type)) goto end;
+	if (uwsgi_buffer_u8(ub, codec)) goto end;
+	if (uwsgi_buffer_u64le(ub, data->pos)) goto end;
+	if (uwsgi_buffer_u64le(ub, stored_len)) goto end;
+	if (uwsgi_buffer_append(ub, stored, stored_len)) goto end;
+	if (write(fd, ub->buf, ub->pos) != (ssize_t) ub->pos) {
+		uwsgi_error("binlog_write_column()/write()");
+		goto end;
+	}
+	ret = 0;
+end:
+#ifdef UWSGI_ZLIB
+	free(compressed);
+#endif
+	uwsgi_buffer_destroy(ub);
+	return ret;
+}
+
+static int binlog_write_dict(int fd, char *name, struct binlog_dict *bd) {
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(4 + bd->values->pos + bd->ids->pos);
+	int ret = -1;
+	if (uwsgi_buffer_u32le(ub, bd->items)) goto end;
+	if (uwsgi_buffer_append(ub, bd->values->buf, bd->values->pos)) goto end;
+	if (uwsgi_buffer_append(ub, bd->ids->buf, bd->ids->pos)) goto end;
+	ret = binlog_write_column(fd, name, 5, ub);
+end:
+	uwsgi_buffer_destroy(ub);
+	return ret;
+}
+
+static int binlog_write_columns(int fd, struct binlog_columns *bc) {
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(16);
+	int ret = -1;
+	int i;
+	if (uwsgi_buffer_append(ub, "UWSGICL1", 8)) goto end;
+	if (uwsgi_buffer_u32le(ub, bc->rows)) goto end;
+	if (uwsgi_buffer_u16le(ub, 9 + UWSGI_BINLOG_STRINGS + 1)) goto end;
+	if (write(fd, ub->buf, ub->pos) != (ssize_t) ub->pos) {
+		uwsgi_error("binlog_write_columns()/write()");
+		goto end;
+	}
+
+	if (binlog_write_column(fd, "status", 1, bc->status)) goto end;
+	if (binlog_write_column(fd, "wid", 1, bc->wid)) goto end;
+	if (binlog_write_column(fd, "core", 1, bc->core)) goto end;
+	if (binlog_write_column(fd, "pid", 2, bc->pid)) goto end;
+	if (binlog_write_column(fd, "start", 4, bc->start)) goto end;
+	if (binlog_write_column(fd, "micros", 3, bc->micros)) goto end;
+	if (binlog_write_column(fd, "rsize", 3, bc->rsize)) goto end;
+	if (binlog_write_column(fd, "hsize", 3, bc->hsize)) goto end;
+	if (binlog_write_column(fd, "cl", 3, bc->cl)) goto end;
+	for (i = 0; i < UWSGI_BINLOG_STRINGS; i++) {
+		if (binlog_write_dict(fd, binlog_strings_names[i], &bc->strings[i])) goto end;
+	}
+	// the number of text lines is prepended
+	struct uwsgi_buffer *text = uwsgi_buffer_new(4 + bc->text->pos);
+	if (uwsgi_buffer_u32le(text, bc->texts) || uwsgi_buffer_append(text, bc->text->buf, bc->text->pos)) {
+		uwsgi_buffer_destroy(text);
+		goto end;
+	}
+	ret = binlog_write_column(fd, "text", 6, text);
+	uwsgi_buffer_destroy(text);
+end:
+	uwsgi_buffer_destroy(ub);
+	return ret;
+}
+
+static int binlog_parse(struct binlog_columns *bc, char *ptr, size_t len) {
+	char *end = ptr + len;
+	while (ptr < end) {
+		size_t remains = end - ptr;
+		if (remains >= 5) {
+			uint32_t rlen = binlog_get32(ptr);
+			uint8_t type = ptr[4];
+			if (rlen > 0 && rlen <= remains - 4) {
+				if (type == 0 && !binlog_add_request(bc, ptr + 5, rlen - 1)) {
+					ptr += 4 + rlen;
+					continue;
+				}
+				else if (type == 1) {
+					if (binlog_add_text(bc, ptr + 5, rlen - 1)) return -1;
+					ptr += 4 + rlen;
+					continue;
+				}
+			}
+		}
+		// not a valid frame (like the rotation message), consume a text line
+		char *nl = memchr(ptr, '\n', remains);
+		size_t tlen = nl ? (size_t) (nl - ptr) : remains;
+		if (binlog_add_text(bc, ptr, tlen)) return -1;
+		ptr += nl ? tlen + 1 : tlen;
+	}
+	return 0;
+}
+
+/*
+	the rotated file could be replaced by another rotation (the name is based
+	on the current second) while we are working on it, so the caller passes an
+	already opened descriptor and the original is removed only if it is still the same file.
+	The columnar file is published atomically with link() and never overwritten.
+*/
+int uwsgi_log_binary_columnar(int fd, char *filename) {
+	int ret = -1;
+	int i;
+	char *tmp_name = uwsgi_concat2(filename, ".ucol.tmp");
+	char *col_name = NULL;
+
+	struct stat st;
+	if (fstat(fd, &st)) {
+		uwsgi_error("uwsgi_log_binary_columnar()/fstat()");
+		goto end;
+	}
+
+	char *addr = NULL;
+	if (st.st_size > 0) {
+		addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			uwsgi_error("uwsgi_log_binary_columnar()/mmap()");
+			goto end;
+		}
+	}
+
+	struct binlog_columns *bc = uwsgi_calloc(sizeof(struct binlog_columns));
+	size_t rows_hint = (st.st_size / UWSGI_BINLOG_HEADER) + 1;
+	bc->status = uwsgi_buffer_new(rows_hint * 2);
+	bc->wid = uwsgi_buffer_new(rows_hint * 2);
+	bc->core = uwsgi_buffer_new(rows_hint * 2);
+	bc->pid = uwsgi_buffer_new(rows_hint * 4);
+	bc->start = uwsgi_buffer_new(rows_hint * 8);
+	bc->micros = uwsgi_buffer_new(rows_hint * 8);
+	bc->rsize = uwsgi_buffer_new(rows_hint * 8);
+	bc->hsize = uwsgi_buffer_new(rows_hint * 8);
+	bc->cl = uwsgi_buffer_new(rows_hint * 8);
+	for (i = 0; i < UWSGI_BINLOG_STRINGS; i++) {
+		bc->strings[i].values = uwsgi_buffer_new(uwsgi.page_size);
+		bc->strings[i].ids = uwsgi_buffer_new(rows_hint * 4);
+	}
+	bc->text = uwsgi_buffer_new(uwsgi.page_size);
+
+	if (binlog_parse(bc, addr, st.st_size)) goto clear;
+	// not a binary request log
+	if (bc->status->pos == 0) goto clear;
+
+	// the temp file name must be unique too
+	char *suffix = uwsgi_num2str(fd);
+	char *tmp_unique = uwsgi_concat3(tmp_name, ".", suffix);
+	free(suffix);
+	free(tmp_name);
+	tmp_name = tmp_unique;
+
+	int col_fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+	if (col_fd < 0) {
+		uwsgi_error_open(tmp_name);
+		goto clear;
+	}
+	if (binlog_write_columns(col_fd, bc)) {
+		close(col_fd);
+		unlink(tmp_name);
+		goto clear;
+	}
+	close(col_fd);
+
+	// <file>.ucol, <file>.1.ucol, <file>.2.ucol ...
+	for (i = 0; i < 1000; i++) {
+		if (i == 0) {
+			col_name = uwsgi_concat2(filename, ".ucol");
+		}
+		else {
+			char *num = uwsgi_num2str(i);
+			col_name = uwsgi_concat4(filename, ".", num, ".ucol");
+			free(num);
+		}
+		if (!link(tmp_name, col_name)) break;
+		if (errno != EEXIST) {
+			uwsgi_error("uwsgi_log_binary_columnar()/link()");
+			i = 1000;
+			break;
+		}
+		free(col_name);
+		col_name = NULL;
+	}
+	unlink(tmp_name);
+	if (i >= 1000) goto clear;
+
+	struct stat st2;
+	if (!stat(filename, &st2) && st2.st_dev == st.st_dev && st2.st_ino == st.st_ino) {
+		if (unlink(filename)) {
+			uwsgi_error("uwsgi_log_binary_columnar()/unlink()");
+		}
+	}
+	ret = 0;
+
+clear:
+	uwsgi_buffer_destroy(bc->status);
+	uwsgi_buffer_destroy(bc->wid);
+	uwsgi_buffer_destroy(bc->core);
+	uwsgi_buffer_destroy(bc->pid);
+	uwsgi_buffer_destroy(bc->start);
+	uwsgi_buffer_destroy(bc->micros);
+	uwsgi_buffer_destroy(bc->rsize);
+	uwsgi_buffer_destroy(bc->hsize);
+	uwsgi_buffer_destroy(bc->cl);
+	for (i = 0; i < UWSGI_BINLOG_STRINGS; i++) {
+		binlog_dict_free(&bc->strings[i]);
+	}
+	uwsgi_buffer_destroy(bc->text);
+	free(bc);
+	if (addr) munmap(addr, st.st_size);
+end:
+	if (col_name) free(col_name);
+	free(tmp_name);
+	return ret;
+}
+
+struct binlog_columnar_job {
+	int fd;
+	char *filename;
+};
+
+static void binlog_columnar_job_run(struct binlog_columnar_job *job) {
+	if (uwsgi_log_binary_columnar(job->fd, job->filename)) {
+		uwsgi_log("[binlog] unable to convert %s to the columnar format, the file is kept\n", job->filename);
+	}
+	close(job->fd);
+	free(job->filename);
+	free(job);
+}
+
+static void *binlog_columnar_thread(void *arg) {
+	// block all signals
+	sigset_t smask;
+	sigfillset(&smask);
+	pthread_sigmask(SIG_BLOCK, &smask, NULL);
+	binlog_columnar_job_run((struct binlog_columnar_job *) arg);
+	return NULL;
+}
+
+// the conversion could be slow, do not block the logger
+void uwsgi_log_binary_columnar_bg(char *filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		uwsgi_error_open(filename);
+		return;
+	}
+	struct binlog_columnar_job *job = uwsgi_malloc(sizeof(struct binlog_columnar_job));
+	job->fd = fd;
+	job->filename = uwsgi_str(filename);
+
+	pthread_t t;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&t, &attr, binlog_columnar_thread, job)) {
+		uwsgi_error("uwsgi_log_binary_columnar_bg()/pthread_create()");
+		// do it synchronously
+		binlog_columnar_job_run(job);
+	}
+	pthread_attr_destroy(&attr);
+}
@@ -349,6 +349,11 @@ void uwsgi_cache_init(struct uwsgi_cache *uc) {
 	uc->hashtable = uwsgi_calloc_shared(sizeof(uint64_t) * uc->hashsize);
 	uc->unused_blocks_stack = uwsgi_calloc_shared(sizeof(uint64_t) * uc->max_items);
 	uc->unused_blocks_stack_ptr = 0;
+	// items can be streamed by the offload threads
+	if (uwsgi.offload_threads > 0) {
+		uc->refs = uwsgi_calloc_shared(sizeof(uint64_t) * uc->max_items);
+		uc->orphans = uwsgi_calloc_shared(sizeof(uint64_t) * uc->max_items);
+	}
 	uc->filesize = ( (sizeof(struct uwsgi_cache_item)+uc->keysize) * uc->max_items) + (uc->blocksize * uc->blocks);
 
 	uint64_t i;
@@ -653,6 +658,59 @@ char *uwsgi_cache_get4(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint6
 }
 
 
+/*
+	references to items (taken by offloaded transfers)
+
+	the caller must hold the cache lock (a write lock for lru caches), a referenced item can be
+	deleted or updated, but its slot and blocks are released only when the last reference is dropped
+*/
+char *uwsgi_cache_get_ref(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t *valsize, uint64_t *expires, uint64_t *ref) {
+
+	if (!uc->refs) return NULL;
+
+	uint64_t index = uwsgi_cache_get_index(uc, key, keylen);
+
+	if (index) {
+		struct uwsgi_cache_item *uci = cache_item(index);
+		if (uci->flags & UWSGI_CACHE_FLAG_UNGETTABLE)
+			return NULL;
+		*valsize = uci->valsize;
+		if (expires)
+			*expires = uci->expires;
+		if (uc->purge_lru) {
+			lru_remove_item(uc, index);
+			lru_add_item(uc, index);
+		}
+		uci->hits++;
+		uc->hits++;
+		__sync_add_and_fetch(&uc->refs[index], 1);
+		*ref = index;
+		return uc->data + (uci->first_block * uc->blocksize);
+	}
+
+	uc->miss++;
+
+	return NULL;
+}
+
+static void cache_release_item(struct uwsgi_cache *uc, uint64_t index, uint64_t valsize) {
+	struct uwsgi_cache_item *uci = cache_item(index);
+	// unmark blocks
+	if (uc->blocks_bitmap) cache_unmark_blocks(uc, uci->first_block, valsize);
+	// put back the block in unused stack
+	uc->unused_blocks_stack_ptr++;
+	uc->unused_blocks_stack[uc->unused_blocks_stack_ptr] = index;
+}
+
+void uwsgi_cache_unref(struct uwsgi_cache *uc, uint64_t index) {
+	uwsgi_wlock(uc->lock);
+	if (__sync_sub_and_fetch(&uc->refs[index], 1) == 0 && uc->orphans[index]) {
+		cache_release_item(uc, index, uc->orphans[index]);
+		uc->orphans[index] = 0;
+	}
+	uwsgi_rwunlock(uc->lock);
+}
+
 int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_t index, uint16_t flags) {
 
 
@@ -664,11 +722,13 @@ int uwsgi_cache_del2(struct uwsgi_cache *uc, char *key, uint16_t keylen, uint64_
 	if (index) {
 		uci = cache_item(index);
 		if (uci->keysize > 0) {
-			// unmark blocks
-			if (uc->blocks_bitmap) cache_unmark_blocks(uc, uci->first_block, uci->valsize);
-			// put back the block in unused stack
-			uc->unused_blocks_stack_ptr++;
-			uc->unused_blocks_stack[uc->unused_blocks_stack_ptr] = index;
+			// still in use by an offloaded transfer, it will be released by the last uwsgi_cache_unref()
+			if (uc->refs && uc->refs[index]) {
+				uc->orphans[index] = uci->valsize;
+			}
+			else {
+				cache_release_item(uc, index, uci->valsize);
+			}
 
 			// unlink prev and next (if any)
 			if (uci->prev) {
@@ -774,6 +834,20 @@ int uwsgi_cache_set2(struct uwsgi_cache *uc, char *key, uint16_t keylen, char *v
 
 	//uwsgi_log("putting cache data in key %.*s %d\n", keylen, key, vallen);
 	index = uwsgi_cache_get_index(uc, key, keylen);
+	// the value is being transferred, store the new one in a fresh slot (math values are updated in place)
+	if (index && (flags & UWSGI_CACHE_FLAG_UPDATE) && !(flags & UWSGI_CACHE_FLAG_MATH) && uc->refs && uc->refs[index]) {
+		if (!uc->unused_blocks_stack_ptr) {
+			cache_full(uc);
+			goto end;
+		}
+		if (flags & UWSGI_CACHE_FLAG_FIXEXPIRE) {
+			uci = cache_item(index);
+			expires = uci->expires;
+			flags |= UWSGI_CACHE_FLAG_ABSEXPIRE;
+		}
+		uwsgi_cache_del2(uc, NULL, 0, index, UWSGI_CACHE_FLAG_LOCAL);
+		index = 0;
+	}
 	if (!index) {
 		if (!uc->unused_blocks_stack_ptr) {
 			cache_full(uc);
@@ -1166,14 +1240,20 @@ static void *cache_sweeper_loop(void *ucache) {
         return NULL;
 }
 
+// flush the store of a cache to disk (run by the master every store_sync cycles)
+void uwsgi_cache_sync(void *data) {
+	struct uwsgi_cache *uc = (struct uwsgi_cache *) data;
+	if (msync(uc->items, uc->filesize, MS_ASYNC)) {
+		uwsgi_error("uwsgi_cache_sync()/msync()");
+	}
+}
+
 void uwsgi_cache_sync_all() {
 
 	struct uwsgi_cache *uc = uwsgi.caches;
 	while(uc) {
-		if (uc->store && (uwsgi.master_cycles == 0 || (uc->store_sync > 0 && (uwsgi.master_cycles % uc->store_sync) == 0))) {
-                	if (msync(uc->items, uc->filesize, MS_ASYNC)) {
-                        	uwsgi_error("uwsgi_cache_sync_all()/msync()");
-                        }
+		if (uc->store) {
+			uwsgi_cache_sync(uc);
 		}
 		uc = uc->next;
 	}
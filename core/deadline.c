@@ -0,0 +1,229 @@
+#include <uwsgi.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+/*
+
+	uWSGI per-request deadlines
+
+	harakiri is enforced by the master with a one second resolution. --request-deadline
+	(milliseconds) and/or a time budget sent by the client (--request-deadline-header) give
+	every request an absolute deadline (wsgi_req->deadline, in microseconds).
+
+	the deadlines of the running requests (one per core) are kept in an rb-tree and a thread
+	in each worker sleeps until the nearest one (on a timerfd on Linux, with poll() elsewhere).
+	When a deadline expires the worker is destroyed as on harakiri.
+
+	requests whose budget is already exhausted on arrival are refused with a 504.
+
+*/
+
+extern struct uwsgi_server uwsgi;
+
+static struct uwsgi_deadlines {
+	pthread_mutex_t lock;
+	struct uwsgi_rbtree *tree;
+	// the timer of each core
+	struct uwsgi_rb_timer **timers;
+	// used to wake up the thread when a nearer deadline is added
+	int pipe[2];
+	int timerfd;
+	uint64_t armed;
+} *ud = NULL;
+
+static void uwsgi_deadline_expired(int core, uint64_t late) {
+	struct wsgi_request *wsgi_req = &uwsgi.workers[uwsgi.mywid].cores[core].req;
+	uwsgi_log_verbose("*** DEADLINE EXCEEDED ON WORKER %d CORE %d (pid: %d, late: %llu usecs, request: %.*s %.*s) ***\n",
+		uwsgi.mywid, core, (int) getpid(), (unsigned long long) late,
+		wsgi_req->method_len, wsgi_req->method, wsgi_req->uri_len, wsgi_req->uri);
+	uwsgi.workers[uwsgi.mywid].harakiri_count++;
+	// like harakiri, the master will respawn us
+	kill(getpid(), SIGKILL);
+}
+
+static void *uwsgi_deadlines_loop(void *arg) {
+
+	// block all signals
+	sigset_t smask;
+	sigfillset(&smask);
+	pthread_sigmask(SIG_BLOCK, &smask, NULL);
+
+	struct pollfd pfd[2];
+	pfd[0].fd = ud->pipe[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd = ud->timerfd;
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+
+	for (;;) {
+		int timeout = -1;
+		pthread_mutex_lock(&ud->lock);
+		uint64_t now = uwsgi_micros();
+		struct uwsgi_rb_timer *urbt = uwsgi_min_rb_timer(ud->tree, NULL);
+		if (urbt && urbt->value <= now) {
+			uwsgi_deadline_expired((int) (long) urbt->data, now - urbt->value);
+		}
+		ud->armed = urbt ? urbt->value : 0;
+		pthread_mutex_unlock(&ud->lock);
+
+		if (urbt) {
+#ifdef __linux__
+			struct itimerspec its;
+			memset(&its, 0, sizeof(struct itimerspec));
+			its.it_value.tv_sec = (urbt->value - now) / 1000000;
+			its.it_value.tv_nsec = ((urbt->value - now) % 1000000) * 1000;
+			if (timerfd_settime(ud->timerfd, 0, &its, NULL)) {
+				uwsgi_error("uwsgi_deadlines_loop()/timerfd_settime()");
+			}
+#else
+			timeout = ((urbt->value - now) + 999) / 1000;
+#endif
+		}
+
+		int ret = poll(pfd, ud->timerfd > -1 ? 2 : 1, timeout);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				uwsgi_error("uwsgi_deadlines_loop()/poll()");
+			}
+			continue;
+		}
+		char buf[64];
+		if (pfd[0].revents & POLLIN) {
+			if (read(ud->pipe[0], buf, 64) < 0) {
+				uwsgi_error("uwsgi_deadlines_loop()/read()");
+			}
+		}
+		if (pfd[1].revents & POLLIN) {
+			uint64_t expirations;
+			if (read(ud->timerfd, &expirations, sizeof(uint64_t)) < 0) {
+				uwsgi_error("uwsgi_deadlines_loop()/read()");
+			}
+		}
+	}
+
+	return NULL;
+}
+
+// called in each worker (after the post-fork hooks)
+void uwsgi_deadlines_start() {
+	if (!uwsgi.request_deadline && !uwsgi.request_deadline_header) return;
+
+	ud = uwsgi_calloc(sizeof(struct uwsgi_deadlines));
+	pthread_mutex_init(&ud->lock, NULL);
+	ud->tree = uwsgi_init_rb_timer();
+	ud->timers = uwsgi_calloc(sizeof(struct uwsgi_rb_timer *) * uwsgi.cores);
+	ud->timerfd = -1;
+
+	if (pipe(ud->pipe)) {
+		uwsgi_error("uwsgi_deadlines_start()/pipe()");
+		exit(1);
+	}
+	uwsgi_socket_nb(ud->pipe[0]);
+	uwsgi_socket_nb(ud->pipe[1]);
+
+#ifdef __linux__
+	ud->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (ud->timerfd < 0) {
+		uwsgi_error("uwsgi_deadlines_start()/timerfd_create()");
+		exit(1);
+	}
+#endif
+
+	pthread_t t;
+	if (pthread_create(&t, NULL, uwsgi_deadlines_loop, NULL)) {
+		uwsgi_error("uwsgi_deadlines_start()/pthread_create()");
+		exit(1);
+	}
+}
+
+/*
+	parse a budget in milliseconds (fractions are allowed, e.g. "2.5") returning microseconds,
+	a value <= 0 means the budget is already exhausted (1 is returned), 0 is returned for invalid values
+*/
+uint64_t uwsgi_deadline_parse(char *value, uint16_t len) {
+	uint64_t ms = 0, frac = 0, scale = 1000;
+	uint16_t i = 0;
+	if (len == 0) return 0;
+	if (value[0] == '-') return 1;
+	if (!isdigit((int) value[0])) return 0;
+	for (; i < len && isdigit((int) value[i]); i++) {
+		ms = (ms * 10) + (value[i] - '0');
+	}
+	if (i < len && value[i] == '.') {
+		for (i++; i < len && isdigit((int) value[i]) && scale > 1; i++) {
+			scale /= 10;
+			frac += (value[i] - '0') * scale;
+		}
+	}
+	uint64_t usecs = (ms * 1000) + frac;
+	if (!usecs) return 1;
+	return usecs;
+}
+
+/*
+	compute and arm the deadline of a request, -1 is returned if the request must not be
+	managed (invalid or with the budget of the client already exhausted, a 504 is sent)
+*/
+int uwsgi_deadline_set(struct wsgi_request *wsgi_req) {
+	if (!ud) return 0;
+
+	uint64_t budget = uwsgi.request_deadline * 1000;
+	if (uwsgi.request_deadline_var) {
+		// (like the internal routing) the vars are needed before calling the plugin
+		if (uwsgi_parse_vars(wsgi_req)) return -1;
+		uint16_t len = 0;
+		char *value = uwsgi_get_var(wsgi_req, uwsgi.request_deadline_var, uwsgi.request_deadline_var_len, &len);
+		if (value) {
+			uint64_t client_budget = uwsgi_deadline_parse(value, len);
+			if (client_budget && (!budget || client_budget < budget)) budget = client_budget;
+		}
+	}
+	if (!budget) return 0;
+
+	wsgi_req->deadline = wsgi_req->start_of_request + budget;
+	if (wsgi_req->deadline <= uwsgi_micros()) {
+		wsgi_req->deadline = 0;
+		uwsgi_504(wsgi_req);
+		return -1;
+	}
+
+	int wake = 0;
+	pthread_mutex_lock(&ud->lock);
+	if (ud->timers[wsgi_req->async_id]) {
+		uwsgi_del_rb_timer(ud->tree, ud->timers[wsgi_req->async_id]);
+		free(ud->timers[wsgi_req->async_id]);
+	}
+	ud->timers[wsgi_req->async_id] = uwsgi_add_rb_timer(ud->tree, wsgi_req->deadline, (void *) (long) wsgi_req->async_id);
+	if (!ud->armed || wsgi_req->deadline < ud->armed) {
+		ud->armed = wsgi_req->deadline;
+		wake = 1;
+	}
+	pthread_mutex_unlock(&ud->lock);
+
+	if (wake && write(ud->pipe[1], "", 1) < 0 && errno != EAGAIN) {
+		uwsgi_error("uwsgi_deadline_set()/write()");
+	}
+	return 0;
+}
+
+// the request is over (the thread does not need to be woken up, a spurious wakeup is harmless)
+void uwsgi_deadline_clear(struct wsgi_request *wsgi_req) {
+	if (!ud) return;
+	pthread_mutex_lock(&ud->lock);
+	if (ud->timers[wsgi_req->async_id]) {
+		uwsgi_del_rb_timer(ud->tree, ud->timers[wsgi_req->async_id]);
+		free(ud->timers[wsgi_req->async_id]);
+		ud->timers[wsgi_req->async_id] = NULL;
+	}
+	pthread_mutex_unlock(&ud->lock);
+	wsgi_req->deadline = 0;
+}
+
+// remaining budget of the request in microseconds (-1 if the request has no deadline)
+int64_t uwsgi_deadline_remaining(struct wsgi_request *wsgi_req) {
+	if (!wsgi_req || !wsgi_req->deadline) return -1;
+	uint64_t now = uwsgi_micros();
+	if (now >= wsgi_req->deadline) return 0;
+	return wsgi_req->deadline - now;
+}
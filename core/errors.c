@@ -53,6 +53,13 @@ void uwsgi_405(struct wsgi_request *wsgi_req) {
         uwsgi_response_write_body_do(wsgi_req, "Method Not Allowed", 18);
 }
 
+void uwsgi_504(struct wsgi_request *wsgi_req) {
+	if (uwsgi_response_prepare_headers(wsgi_req, "504 Gateway Timeout", 19)) return;
+	if (uwsgi_response_add_connection_close(wsgi_req)) return;
+	if (uwsgi_response_add_content_type(wsgi_req, "text/plain", 10)) return;
+	uwsgi_response_write_body_do(wsgi_req, "Gateway Timeout", 15);
+}
+
 void uwsgi_redirect_to_slash(struct wsgi_request *wsgi_req) {
 
 	char *redirect = NULL;
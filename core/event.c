@@ -62,10 +62,14 @@ static void uwsgi_poll_queue_rebuild(struct uwsgi_poll_event *upe) {
 }
 
 int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+	return event_queue_wait_ms(eq, timeout > 0 ? timeout * 1000 : timeout, interesting_fd);
+}
+
+int event_queue_wait_ms(int eq, int timeout, int *interesting_fd) {
 	struct uwsgi_poll_event *upe = uwsgi_poll_event_queue[eq];
 	pthread_mutex_lock(&upe->lock);
 	uwsgi_poll_queue_rebuild(upe);
-	int ret = poll(upe->poll, upe->nevents, timeout * 1000);
+	int ret = poll(upe->poll, upe->nevents, timeout);
 	if (ret > 0) {
 		int i;
 		for(i=0;i<upe->nevents;i++) {
@@ -442,14 +446,19 @@ int event_queue_wait_multi(int eq, int timeout, void *events, int nevents) {
 
 
 int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+	// 0 has always meant "no timeout" for event ports
+	return event_queue_wait_ms(eq, timeout > 0 ? timeout * 1000 : -1, interesting_fd);
+}
+
+int event_queue_wait_ms(int eq, int timeout, int *interesting_fd) {
 
 	int ret;
 	port_event_t pe;
 	timespec_t ts;
 
-	if (timeout > 0) {
-		ts.tv_sec = timeout;
-		ts.tv_nsec = 0;
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
 		ret = port_get(eq, &pe, &ts);
 	}
 	else {
@@ -711,14 +720,14 @@ int event_queue_wait_multi(int eq, int timeout, void *events, int nevents) {
 }
 
 int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+	return event_queue_wait_ms(eq, timeout > 0 ? timeout * 1000 : timeout, interesting_fd);
+}
+
+int event_queue_wait_ms(int eq, int timeout, int *interesting_fd) {
 
 	int ret;
 	struct epoll_event ee;
 
-	if (timeout > 0) {
-		timeout = timeout * 1000;
-	}
-
 	ret = epoll_wait(eq, &ee, 1, timeout);
 	if (ret < 0) {
 		if (errno != EINTR)
@@ -945,6 +954,10 @@ int event_queue_interesting_fd_is_write(void *events, int id) {
 }
 
 int event_queue_wait(int eq, int timeout, int *interesting_fd) {
+	return event_queue_wait_ms(eq, timeout > 0 ? timeout * 1000 : timeout, interesting_fd);
+}
+
+int event_queue_wait_ms(int eq, int timeout, int *interesting_fd) {
 
 	int ret;
 	struct timespec ts;
@@ -955,7 +968,8 @@ int event_queue_wait(int eq, int timeout, int *interesting_fd) {
 	}
 	else {
 		memset(&ts, 0, sizeof(struct timespec));
-		ts.tv_sec = timeout;
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
 		ret = kevent(eq, NULL, 0, &ev, 1, &ts);
 	}
 
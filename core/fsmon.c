@@ -70,8 +70,11 @@ static void fsmon_signal(struct uwsgi_fsmon *fs) {
 	uwsgi_route_signal(atoi((char *) fs->data));
 }
 
+static int fsmon_started = 0;
+
 void uwsgi_fsmon_setup() {
 	struct uwsgi_string_list *usl = NULL;
+	uwsgi_static_file_cache_monitor();
 	uwsgi_foreach(usl, uwsgi.fs_reload) {
 		uwsgi_register_fsmon(usl->value, fsmon_reload, NULL);
 	}
@@ -100,6 +103,7 @@ void uwsgi_fsmon_setup() {
 		}
 		fs = fs->next;
 	}
+	fsmon_started = 1;
 }
 
 
@@ -125,58 +129,114 @@ struct uwsgi_fsmon *uwsgi_register_fsmon(char *path, void (*func) (struct uwsgi_
 	return fs;
 }
 
-static struct uwsgi_fsmon *uwsgi_fsmon_ack(int interesting_fd) {
-	struct uwsgi_fsmon *found_fs = NULL;
+/*
+	register a directory and all of its subdirectories (already monitored ones are skipped).
+
+	It can be called again at runtime (for example by the monitor function itself, to
+	catch newly created directories): new monitors are immediately activated.
+*/
+int uwsgi_register_fsmon_tree(char *path, void (*func) (struct uwsgi_fsmon *), void *data) {
+	int count = 0;
 	struct uwsgi_fsmon *fs = uwsgi.fsmon;
-	while (fs) {
-		if (fs->fd == interesting_fd) {
-			found_fs = fs;
-			break;
+	while(fs) {
+		if (fs->func == func && !strcmp(fs->path, path)) break;
+		fs = fs->next;
+	}
+
+	if (!fs) {
+		fs = uwsgi_register_fsmon(uwsgi_str(path), func, data);
+		fs->tree = 1;
+		if (fsmon_started && fsmon_add(fs)) {
+			uwsgi_log("[uwsgi-fsmon] unable to register monitor for \"%s\"\n", fs->path);
+		}
+		count++;
+	}
+
+	DIR *dir = opendir(path);
+	if (!dir) return count;
+	struct dirent *de;
+	while ((de = readdir(dir)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+		char *subdir = uwsgi_concat3(path, "/", de->d_name);
+		struct stat st;
+		// symlinks are not followed
+		if (!lstat(subdir, &st) && S_ISDIR(st.st_mode)) {
+			count += uwsgi_register_fsmon_tree(subdir, func, data);
 		}
+		free(subdir);
+	}
+	closedir(dir);
+	return count;
+}
+
+static void fsmon_run(struct uwsgi_fsmon *fs) {
+	uwsgi_log_verbose("[uwsgi-fsmon] detected event on \"%s\"\n", fs->path);
+	fs->func(fs);
+}
+
+int uwsgi_fsmon_event(int interesting_fd) {
+
+	struct uwsgi_fsmon *fs = uwsgi.fsmon;
+	while (fs) {
+		if (fs->fd == interesting_fd) break;
 		fs = fs->next;
 	}
+	if (!fs)
+		return 0;
 
 #ifdef UWSGI_EVENT_FILEMONITOR_USE_INOTIFY
 #ifndef OBSOLETE_LINUX_KERNEL
-	if (!found_fs)
-		return NULL;
-	found_fs = NULL;
 	unsigned int isize = 0;
 	if (ioctl(interesting_fd, FIONREAD, &isize) < 0) {
-		uwsgi_error("uwsgi_fsmon_ack()/ioctl()");
-		return NULL;
+		uwsgi_error("uwsgi_fsmon_event()/ioctl()");
+		return 0;
 	}
 	if (isize == 0)
-		return NULL;
-	struct inotify_event *ie = uwsgi_malloc(isize);
+		return 0;
+	char *buf = uwsgi_malloc(isize);
 	// read from the inotify descriptor
-	ssize_t len = read(interesting_fd, ie, isize);
+	ssize_t len = read(interesting_fd, buf, isize);
 	if (len < 0) {
-		free(ie);
-		uwsgi_error("uwsgi_fsmon_ack()/read()");
-		return NULL;
+		free(buf);
+		uwsgi_error("uwsgi_fsmon_event()/read()");
+		return 0;
 	}
-	fs = uwsgi.fsmon;
-	while (fs) {
-		if (fs->fd == interesting_fd && fs->id == ie->wd) {
-			found_fs = fs;
-			break;
+	// a single read could return multiple events (even for different monitors)
+	char *ptr = buf;
+	while (ptr + sizeof(struct inotify_event) <= buf + len) {
+		struct inotify_event *ie = (struct inotify_event *) ptr;
+		ptr += sizeof(struct inotify_event) + ie->len;
+		if (ie->mask & IN_Q_OVERFLOW) {
+			uwsgi_log("[uwsgi-fsmon] inotify queue overflow, some event has been lost\n");
+			for (fs = uwsgi.fsmon; fs; fs = fs->next) {
+				if (fs->fd == interesting_fd) fs->pending = 1;
+			}
+			continue;
+		}
+		// the same path could be monitored multiple times (the watch descriptor is shared)
+		for (fs = uwsgi.fsmon; fs; fs = fs->next) {
+			if (fs->fd != interesting_fd || fs->id != ie->wd) continue;
+			fs->pending = 1;
+			// new directories in a monitored tree
+			if (fs->tree && ie->len > 0 && (ie->mask & IN_ISDIR) && (ie->mask & (IN_CREATE | IN_MOVED_TO))) {
+				char *subdir = uwsgi_concat3(fs->path, "/", ie->name);
+				uwsgi_register_fsmon_tree(subdir, fs->func, fs->data);
+				free(subdir);
+			}
 		}
-		fs = fs->next;
 	}
-	free(ie);
+	free(buf);
+	// every monitor is triggered only once
+	int found = 0;
+	for (fs = uwsgi.fsmon; fs; fs = fs->next) {
+		if (!fs->pending) continue;
+		fs->pending = 0;
+		fsmon_run(fs);
+		found = 1;
+	}
+	return found;
 #endif
 #endif
-	return found_fs;
-}
-
-int uwsgi_fsmon_event(int interesting_fd) {
-
-	struct uwsgi_fsmon *fs = uwsgi_fsmon_ack(interesting_fd);
-	if (!fs)
-		return 0;
-
-	uwsgi_log_verbose("[uwsgi-fsmon] detected event on \"%s\"\n", fs->path);
-	fs->func(fs);
+	fsmon_run(fs);
 	return 1;
 }
@@ -101,6 +101,7 @@ void uwsgi_init_default() {
 	uwsgi.rpc_max = 64;
 
 	uwsgi.offload_threads_events = 64;
+	uwsgi.offload_threads_queue = 1024;
 
 	uwsgi.default_app = -1;
 
@@ -116,6 +117,7 @@ void uwsgi_init_default() {
 
 	uwsgi.cheaper_overload = 3;
 	uwsgi.cheaper_idle = 10;
+	uwsgi.cheaper_predictive_utilization = 75;
 
 	uwsgi.log_master_bufsize = 8192;
 
@@ -150,6 +152,10 @@ void uwsgi_init_default() {
 
 	uwsgi.req_log_fd = 2;
 
+	uwsgi.req_log_ring_fd[0] = -1;
+	uwsgi.req_log_ring_fd[1] = -1;
+	uwsgi.req_log_ring_wait = 100;
+
 #ifdef UWSGI_SSL
 	// 1 day of tolerance
 	uwsgi.subscriptions_sign_check_tolerance = 3600 * 24;
@@ -359,10 +365,15 @@ void uwsgi_commandline_config() {
 
 void uwsgi_setup_workers() {
 	int i, j;
-	// allocate shared memory for workers + master
-	uwsgi.workers = (struct uwsgi_worker *) uwsgi_calloc_shared(sizeof(struct uwsgi_worker) * (uwsgi.numproc + 1));
+	if (uwsgi.warm_spares > 0 && (uwsgi.worker_exec || uwsgi.worker_exec2)) {
+		uwsgi_log("warm spares cannot be used with worker-exec\n");
+		exit(1);
+	}
+
+	// allocate shared memory for workers + master (+ warm spares)
+	uwsgi.workers = (struct uwsgi_worker *) uwsgi_calloc_shared(sizeof(struct uwsgi_worker) * (uwsgi.numproc + uwsgi.warm_spares + 1));
 
-	for (i = 0; i <= uwsgi.numproc; i++) {
+	for (i = 0; i <= uwsgi.numproc + uwsgi.warm_spares; i++) {
 		// allocate memory for apps
 		uwsgi.workers[i].apps = (struct uwsgi_app *) uwsgi_calloc_shared(sizeof(struct uwsgi_app) * uwsgi.max_apps);
 
@@ -377,6 +388,10 @@ void uwsgi_setup_workers() {
 		void *post_buf = NULL;
 		if (uwsgi.post_buffering > 0)
 			post_buf = uwsgi_malloc_shared(uwsgi.post_buffering_bufsize * uwsgi.cores);
+		void *wvec = uwsgi_malloc_shared(sizeof(struct iovec) * IOV_MAX * uwsgi.cores);
+		void *coalesce_buf = NULL;
+		if (uwsgi.response_coalesce > 0)
+			coalesce_buf = uwsgi_malloc_shared(uwsgi.response_coalesce * uwsgi.cores);
 
 
 		for (j = 0; j < uwsgi.cores; j++) {
@@ -388,6 +403,10 @@ void uwsgi_setup_workers() {
 			uwsgi.workers[i].cores[j].hvec = hvec + ((sizeof(struct iovec) * uwsgi.vec_size) * j);
 			if (post_buf)
 				uwsgi.workers[i].cores[j].post_buf = post_buf + (uwsgi.post_buffering_bufsize * j);
+			// iovec for responses
+			uwsgi.workers[i].cores[j].wvec = wvec + ((sizeof(struct iovec) * IOV_MAX) * j);
+			if (coalesce_buf)
+				uwsgi.workers[i].cores[j].coalesce_buf = coalesce_buf + (uwsgi.response_coalesce * j);
 		}
 
 		// master does not need to following steps...
@@ -395,6 +414,10 @@ void uwsgi_setup_workers() {
 			continue;
 		uwsgi.workers[i].signal_pipe[0] = -1;
 		uwsgi.workers[i].signal_pipe[1] = -1;
+		if (i > uwsgi.numproc) {
+			snprintf(uwsgi.workers[i].name, 0xff, "uWSGI warm spare %d", i - uwsgi.numproc);
+			continue;
+		}
 		snprintf(uwsgi.workers[i].name, 0xff, "uWSGI worker %d", i);
 	}
 
@@ -402,13 +425,26 @@ void uwsgi_setup_workers() {
 	if (uwsgi.post_buffering > 0) {
 		total_memory += (uwsgi.post_buffering_bufsize * uwsgi.cores);
 	}
+	total_memory += (sizeof(struct iovec) * IOV_MAX * uwsgi.cores) + (uwsgi.response_coalesce * uwsgi.cores);
 
 	total_memory *= (uwsgi.numproc + uwsgi.master_process);
 	if (uwsgi.numproc > 0)
 		uwsgi_log("mapped %llu bytes (%llu KB) for %d cores\n", (unsigned long long) total_memory, (unsigned long long) (total_memory / 1024), uwsgi.cores * uwsgi.numproc);
 
 	// allocate signal table
-        uwsgi.shared->signal_table = uwsgi_calloc_shared(sizeof(struct uwsgi_signal_entry) * 256 * (uwsgi.numproc + 1));
+        uwsgi.shared->signal_table = uwsgi_calloc_shared(sizeof(struct uwsgi_signal_entry) * 256 * (uwsgi.numproc + uwsgi.warm_spares + 1));
+
+	// allocate request log rings
+	if (uwsgi.req_log_ring_size > 0)
+		uwsgi_setup_req_log_rings();
+
+	uwsgi_setup_latency();
+	uwsgi_setup_request_accounting();
+	uwsgi_setup_profiler();
+	uwsgi_setup_offload();
+	uwsgi_websockets_setup_mask();
+	uwsgi_websockets_setup_offload();
+	uwsgi_websockets_setup_hub();
 
 #ifdef UWSGI_ROUTING
 	uwsgi_fixup_routes(uwsgi.routes);
@@ -468,6 +504,22 @@ void sanitize_args() {
                 }
         }
 
+	// the header is looked up as a request var (X-Request-Deadline -> HTTP_X_REQUEST_DEADLINE)
+	if (uwsgi.request_deadline_header) {
+		size_t len = strlen(uwsgi.request_deadline_header);
+		uwsgi.request_deadline_var = uwsgi_concat2("HTTP_", uwsgi.request_deadline_header);
+		size_t i;
+		for (i = 5; i < len + 5; i++) {
+			if (uwsgi.request_deadline_var[i] == '-') {
+				uwsgi.request_deadline_var[i] = '_';
+			}
+			else {
+				uwsgi.request_deadline_var[i] = toupper((int) uwsgi.request_deadline_var[i]);
+			}
+		}
+		uwsgi.request_deadline_var_len = len + 5;
+	}
+
         if (uwsgi.write_errors_exception_only) {
                 uwsgi.ignore_sigpipe = 1;
                 uwsgi.ignore_write_errors = 1;
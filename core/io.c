@@ -2,6 +2,25 @@
 
 extern struct uwsgi_server uwsgi;
 
+/*
+	poll() restarted on EINTR (signals like the SIGPROF of the sampling profiler
+	must not abort the waits of the requests), the timeout (in milliseconds,
+	negative for infinite) is not extended by the restarts
+*/
+int uwsgi_poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+	uint64_t deadline = 0;
+	if (timeout > 0) deadline = uwsgi_micros() + ((uint64_t) timeout * 1000);
+	for (;;) {
+		int ret = poll(fds, nfds, timeout);
+		if (ret >= 0 || errno != EINTR) return ret;
+		if (timeout > 0) {
+			uint64_t now = uwsgi_micros();
+			if (now >= deadline) return 0;
+			timeout = ((deadline - now) + 999) / 1000;
+		}
+	}
+}
+
 /*
 
 	poll based fd waiter.
@@ -24,7 +43,7 @@ int uwsgi_waitfd_event(int fd, int timeout, int event) {
 	upoll.fd = fd;
 	upoll.events = event;
 	upoll.revents = 0;
-	ret = poll(&upoll, 1, timeout);
+	ret = uwsgi_poll(&upoll, 1, timeout);
 
 	if (ret < 0) {
 		uwsgi_error("uwsgi_waitfd_event()/poll()");
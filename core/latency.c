@@ -0,0 +1,439 @@
+#include <uwsgi.h>
+
+extern struct uwsgi_server uwsgi;
+
+/*
+
+	latency histograms and slow requests sampling
+
+	each worker has a set of histograms in shared memory: slot 0 accounts all of
+	the requests, the others are mapped to the labels of the request routes
+	(the last label reached by a request is the one used).
+
+	The master merges them on demand (stats server and metrics collector).
+
+	With --latency-traces N, every worker keeps the N slowest requests (with their vars)
+	of the current interval. Two banks are used (even and odd intervals) so the master
+	can report the last completed interval without locking.
+
+*/
+
+static pthread_mutex_t latency_traces_lock = PTHREAD_MUTEX_INITIALIZER;
+// process-local fast path: requests faster than this are not sampled
+static uint64_t latency_traces_threshold;
+static uint64_t latency_traces_current;
+
+struct uwsgi_latency_metric {
+	int slot;
+	// 1000 is the max value
+	int permille;
+};
+
+// log-linear buckets (used by the summary metrics too)
+int uwsgi_latency_bucket(uint64_t value) {
+	if (value < (2 << UWSGI_LATENCY_SUB_BITS)) return value;
+	int msb = 63 - __builtin_clzll(value);
+	if (msb > UWSGI_LATENCY_MAX_BITS) return UWSGI_LATENCY_BUCKETS - 1;
+	int shift = msb - UWSGI_LATENCY_SUB_BITS;
+	int sub = (value >> shift) - (1 << UWSGI_LATENCY_SUB_BITS);
+	return ((shift + 1) << UWSGI_LATENCY_SUB_BITS) + sub;
+}
+
+// the highest value accounted in the bucket
+uint64_t uwsgi_latency_bucket_value(int bucket) {
+	if (bucket < (2 << UWSGI_LATENCY_SUB_BITS)) return bucket;
+	int shift = (bucket >> UWSGI_LATENCY_SUB_BITS) - 1;
+	uint64_t sub = (bucket & ((1 << UWSGI_LATENCY_SUB_BITS) - 1)) + (1 << UWSGI_LATENCY_SUB_BITS);
+	return ((sub + 1) << shift) - 1;
+}
+
+static struct uwsgi_latency_histogram *latency_histogram(int wid, int slot) {
+	return &uwsgi.latency_hist[(wid * uwsgi.latency_slots) + slot];
+}
+
+static struct uwsgi_latency_trace *latency_traces_bank(int wid, uint64_t interval) {
+	return &uwsgi.latency_traces_shm[((wid * 2) + (interval % 2)) * uwsgi.latency_traces];
+}
+
+// map the route labels to slots (shared with the request accounting)
+void uwsgi_setup_route_labels() {
+	if (uwsgi.latency_slots) return;
+
+	uwsgi.latency_slots = 1;
+#ifdef UWSGI_ROUTING
+	struct uwsgi_route *routes = uwsgi.routes;
+	while (routes) {
+		if (routes->label && uwsgi.latency_slots < 0xffff) {
+			routes->label_id = uwsgi.latency_slots++;
+			uwsgi_string_new_list(&uwsgi.latency_labels, routes->label);
+		}
+		routes = routes->next;
+	}
+#endif
+}
+
+void uwsgi_setup_latency() {
+	if (!uwsgi.latency_histograms && !uwsgi.latency_traces) return;
+
+	uwsgi_setup_route_labels();
+
+	uwsgi.latency_hist = uwsgi_calloc_shared(sizeof(struct uwsgi_latency_histogram) * (uwsgi.numproc + 1) * uwsgi.latency_slots);
+
+	if (uwsgi.latency_traces > 0) {
+		if (uwsgi.latency_traces_interval <= 0) uwsgi.latency_traces_interval = 60;
+		uwsgi.latency_traces_shm = uwsgi_calloc_shared(sizeof(struct uwsgi_latency_trace) * (uwsgi.numproc + 1) * 2 * uwsgi.latency_traces);
+	}
+
+	uwsgi_log("latency histograms enabled (%d slots, %d slow requests traced every %d seconds)\n", uwsgi.latency_slots, uwsgi.latency_traces, uwsgi.latency_traces_interval);
+}
+
+static void latency_histogram_add(struct uwsgi_latency_histogram *ulh, uint64_t micros) {
+	__sync_add_and_fetch(&ulh->buckets[uwsgi_latency_bucket(micros)], 1);
+	__sync_add_and_fetch(&ulh->sum, micros);
+	uint64_t max = ulh->max;
+	while (micros > max) {
+		if (__sync_bool_compare_and_swap(&ulh->max, max, micros)) break;
+		max = ulh->max;
+	}
+	// count is updated as the last one, readers use it as the total
+	__sync_add_and_fetch(&ulh->count, 1);
+}
+
+static void latency_trace(struct wsgi_request *wsgi_req, uint64_t micros) {
+	uint64_t interval = uwsgi_now() / uwsgi.latency_traces_interval;
+	// fast path (no locking)
+	if (interval == latency_traces_current && micros <= latency_traces_threshold) return;
+
+	if (uwsgi.threads > 1) pthread_mutex_lock(&latency_traces_lock);
+
+	if (interval != latency_traces_current) {
+		latency_traces_current = interval;
+		latency_traces_threshold = 0;
+	}
+
+	struct uwsgi_latency_trace *bank = latency_traces_bank(uwsgi.mywid, interval);
+	struct uwsgi_latency_trace *ult = NULL;
+	int i;
+	// get a free (or stale) slot, or the fastest request
+	for (i = 0; i < uwsgi.latency_traces; i++) {
+		if (bank[i].interval != interval + 1) {
+			ult = &bank[i];
+			break;
+		}
+		if (!ult || bank[i].micros < ult->micros) {
+			ult = &bank[i];
+		}
+	}
+
+	if (ult->interval == interval + 1 && ult->micros >= micros) goto end;
+
+	// invalidate the slot while it is updated
+	ult->interval = 0;
+	__sync_synchronize();
+	ult->start = wsgi_req->start_of_request;
+	ult->micros = micros;
+	ult->size = wsgi_req->response_size;
+	ult->status = wsgi_req->status;
+	ult->core = wsgi_req->async_id;
+	ult->label_id = wsgi_req->route_label_id;
+
+	// store the vars (uwsgi packet encoded) until there is space
+	char *ptr = ult->vars;
+	char *watermark = ult->vars + UWSGI_LATENCY_TRACE_VARS;
+	for (i = 0; i + 1 < wsgi_req->var_cnt; i += 2) {
+		struct iovec *key = &wsgi_req->hvec[i];
+		struct iovec *val = &wsgi_req->hvec[i + 1];
+		if (ptr + 4 + key->iov_len + val->iov_len > watermark) break;
+		*ptr++ = (uint8_t) (key->iov_len & 0xff);
+		*ptr++ = (uint8_t) ((key->iov_len >> 8) & 0xff);
+		memcpy(ptr, key->iov_base, key->iov_len);
+		ptr += key->iov_len;
+		*ptr++ = (uint8_t) (val->iov_len & 0xff);
+		*ptr++ = (uint8_t) ((val->iov_len >> 8) & 0xff);
+		memcpy(ptr, val->iov_base, val->iov_len);
+		ptr += val->iov_len;
+	}
+	ult->vars_len = ptr - ult->vars;
+	__sync_synchronize();
+	// 0 means unused, so the stored value is shifted by one
+	ult->interval = interval + 1;
+
+	// if all of the slots are in use, the fastest one is the new threshold
+	uint64_t threshold = micros;
+	for (i = 0; i < uwsgi.latency_traces; i++) {
+		if (bank[i].interval != interval + 1) {
+			threshold = 0;
+			break;
+		}
+		if (bank[i].micros < threshold) threshold = bank[i].micros;
+	}
+	latency_traces_threshold = threshold;
+end:
+	if (uwsgi.threads > 1) pthread_mutex_unlock(&latency_traces_lock);
+}
+
+void uwsgi_latency_account(struct wsgi_request *wsgi_req, uint64_t micros) {
+	if (uwsgi.mywid <= 0) return;
+	latency_histogram_add(latency_histogram(uwsgi.mywid, 0), micros);
+	if (wsgi_req->route_label_id > 0 && wsgi_req->route_label_id < uwsgi.latency_slots) {
+		latency_histogram_add(latency_histogram(uwsgi.mywid, wsgi_req->route_label_id), micros);
+	}
+	if (uwsgi.latency_traces > 0) {
+		latency_trace(wsgi_req, micros);
+	}
+}
+
+// wid 0 means all of the workers
+static void latency_merge(struct uwsgi_latency_histogram *out, int wid, int slot) {
+	int i, j;
+	memset(out, 0, sizeof(struct uwsgi_latency_histogram));
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		if (wid > 0 && i != wid) continue;
+		struct uwsgi_latency_histogram *ulh = latency_histogram(i, slot);
+		out->count += ulh->count;
+		out->sum += ulh->sum;
+		if (ulh->max > out->max) out->max = ulh->max;
+		for (j = 0; j < UWSGI_LATENCY_BUCKETS; j++) {
+			out->buckets[j] += ulh->buckets[j];
+		}
+	}
+}
+
+static uint64_t latency_percentile(struct uwsgi_latency_histogram *ulh, int permille) {
+	if (permille >= 1000) return ulh->max;
+	// buckets could be a bit ahead of count
+	uint64_t total = 0;
+	int i;
+	for (i = 0; i < UWSGI_LATENCY_BUCKETS; i++) {
+		total += ulh->buckets[i];
+	}
+	if (total == 0) return 0;
+	uint64_t target = ((total * permille) + 999) / 1000;
+	if (target == 0) target = 1;
+	uint64_t seen = 0;
+	for (i = 0; i < UWSGI_LATENCY_BUCKETS; i++) {
+		seen += ulh->buckets[i];
+		if (seen >= target) {
+			uint64_t value = uwsgi_latency_bucket_value(i);
+			return value > ulh->max ? ulh->max : value;
+		}
+	}
+	return ulh->max;
+}
+
+int64_t uwsgi_metric_collector_latency(struct uwsgi_metric *um) {
+	struct uwsgi_latency_metric *ulm = (struct uwsgi_latency_metric *) um->custom;
+	if (!ulm || !uwsgi.latency_hist) return 0;
+	struct uwsgi_latency_histogram *ulh = uwsgi_malloc(sizeof(struct uwsgi_latency_histogram));
+	latency_merge(ulh, 0, ulm->slot);
+	int64_t ret = latency_percentile(ulh, ulm->permille);
+	free(ulh);
+	return ret;
+}
+
+static int latency_percentiles[] = {500, 900, 990, 999, 1000};
+static char *latency_percentiles_names[] = {"p50", "p90", "p99", "p999", "max"};
+
+static void latency_register_slot_metrics(char *prefix, int slot) {
+	char buf[4096];
+	int i;
+	for (i = 0; i < 5; i++) {
+		int ret = snprintf(buf, 4096, "%s.latency.%s", prefix, latency_percentiles_names[i]);
+		if (ret <= 0 || ret >= 4096) continue;
+		struct uwsgi_latency_metric *ulm = uwsgi_malloc(sizeof(struct uwsgi_latency_metric));
+		ulm->slot = slot;
+		ulm->permille = latency_percentiles[i];
+		uwsgi_register_metric(buf, NULL, UWSGI_METRIC_GAUGE, "latency", NULL, 0, ulm);
+	}
+}
+
+void uwsgi_latency_register_metrics() {
+	if (!uwsgi.latency_hist) return;
+	latency_register_slot_metrics("core", 0);
+	int slot = 1;
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, uwsgi.latency_labels) {
+		// metric names only allow a subset of chars
+		char *name = uwsgi_concat2("route.", usl->value);
+		char *ptr = name + 6;
+		while (*ptr) {
+			if (!isalnum((int) *ptr) && *ptr != '-' && *ptr != '_') *ptr = '_';
+			ptr++;
+		}
+		latency_register_slot_metrics(name, slot);
+		free(name);
+		slot++;
+	}
+}
+
+static int latency_stats_histogram(struct uwsgi_stats *us, struct uwsgi_latency_histogram *ulh) {
+	int i;
+	if (uwsgi_stats_keylong_comma(us, "requests", (unsigned long long) ulh->count)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "avg", (unsigned long long) (ulh->count ? ulh->sum / ulh->count : 0))) return -1;
+	for (i = 0; i < 5; i++) {
+		if (i > 0) {
+			if (uwsgi_stats_comma(us)) return -1;
+		}
+		if (uwsgi_stats_keylong(us, latency_percentiles_names[i], (unsigned long long) latency_percentile(ulh, latency_percentiles[i]))) return -1;
+	}
+	return 0;
+}
+
+static char *latency_label_name(int slot) {
+	int i = 1;
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, uwsgi.latency_labels) {
+		if (i == slot) return usl->value;
+		i++;
+	}
+	return "";
+}
+
+static int latency_stats_trace_var(struct uwsgi_stats *us, char *ptr, size_t *pos, size_t len) {
+	char *vars = ptr;
+	if (*pos + 2 > len) return -1;
+	uint16_t klen = (uint8_t) vars[*pos] | ((uint8_t) vars[*pos + 1] << 8);
+	char *key = vars + *pos + 2;
+	*pos += 2 + klen;
+	if (*pos + 2 > len) return -1;
+	uint16_t vlen = (uint8_t) vars[*pos] | ((uint8_t) vars[*pos + 1] << 8);
+	char *val = vars + *pos + 2;
+	*pos += 2 + vlen;
+	if (*pos > len) return -1;
+	char *kv = uwsgi_concat3n(key, klen, "=", 1, val, vlen);
+	char *escaped = uwsgi_malloc(((klen + vlen + 1) * 2) + 1);
+	escape_json(kv, klen + vlen + 1, escaped);
+	free(kv);
+	int ret = uwsgi_stats_str(us, escaped);
+	free(escaped);
+	return ret;
+}
+
+static int latency_stats_traces(struct uwsgi_stats *us) {
+	// only the last completed interval is reported
+	uint64_t interval = (uwsgi_now() / uwsgi.latency_traces_interval) - 1;
+	int n = uwsgi.latency_traces * uwsgi.numproc;
+	struct uwsgi_latency_trace **traces = uwsgi_calloc(sizeof(struct uwsgi_latency_trace *) * n);
+	int found = 0;
+	int i, j;
+	int ret = -1;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		struct uwsgi_latency_trace *bank = latency_traces_bank(i, interval);
+		for (j = 0; j < uwsgi.latency_traces; j++) {
+			if (bank[j].interval != interval + 1) continue;
+			traces[found++] = &bank[j];
+		}
+	}
+
+	if (uwsgi_stats_keylong_comma(us, "interval", (unsigned long long) uwsgi.latency_traces_interval)) goto end;
+	if (uwsgi_stats_key(us, "slow_requests")) goto end;
+	if (uwsgi_stats_list_open(us)) goto end;
+	int reported = 0;
+	while (reported < uwsgi.latency_traces) {
+		// selection of the slowest (the list is small)
+		int slowest = -1;
+		for (i = 0; i < found; i++) {
+			if (!traces[i]) continue;
+			if (slowest < 0 || traces[i]->micros > traces[slowest]->micros) slowest = i;
+		}
+		if (slowest < 0) break;
+		struct uwsgi_latency_trace ult;
+		int wid = (traces[slowest] - uwsgi.latency_traces_shm) / (2 * uwsgi.latency_traces);
+		memcpy(&ult, traces[slowest], sizeof(struct uwsgi_latency_trace));
+		traces[slowest] = NULL;
+		// changed while copying
+		if (ult.interval != interval + 1 || ult.vars_len > UWSGI_LATENCY_TRACE_VARS) continue;
+		if (reported > 0) {
+			if (uwsgi_stats_comma(us)) goto end;
+		}
+		if (uwsgi_stats_object_open(us)) goto end;
+		if (uwsgi_stats_keylong_comma(us, "worker", (unsigned long long) wid)) goto end;
+		if (uwsgi_stats_keylong_comma(us, "start", (unsigned long long) ult.start)) goto end;
+		if (uwsgi_stats_keylong_comma(us, "micros", (unsigned long long) ult.micros)) goto end;
+		if (uwsgi_stats_keylong_comma(us, "status", (unsigned long long) ult.status)) goto end;
+		if (uwsgi_stats_keylong_comma(us, "size", (unsigned long long) ult.size)) goto end;
+		if (uwsgi_stats_keylong_comma(us, "core", (unsigned long long) ult.core)) goto end;
+		if (uwsgi_stats_keyval_comma(us, "label", latency_label_name(ult.label_id))) goto end;
+		if (uwsgi_stats_key(us, "vars")) goto end;
+		if (uwsgi_stats_list_open(us)) goto end;
+		size_t pos = 0;
+		int first = 1;
+		while (pos < ult.vars_len) {
+			if (!first) {
+				if (uwsgi_stats_comma(us)) goto end;
+			}
+			first = 0;
+			if (latency_stats_trace_var(us, ult.vars, &pos, ult.vars_len)) goto end;
+		}
+		if (uwsgi_stats_list_close(us)) goto end;
+		if (uwsgi_stats_object_close(us)) goto end;
+		reported++;
+	}
+	if (uwsgi_stats_list_close(us)) goto end;
+	ret = 0;
+end:
+	free(traces);
+	return ret;
+}
+
+/*
+	"latency": {"requests": N, "avg": N, "p50": N, ..., "labels": [...], "interval": N, "slow_requests": [...]},
+*/
+int uwsgi_stats_latency(struct uwsgi_stats *us) {
+	if (!uwsgi.latency_hist) return 0;
+	int ret = -1;
+	struct uwsgi_latency_histogram *ulh = uwsgi_malloc(sizeof(struct uwsgi_latency_histogram));
+
+	if (uwsgi_stats_key(us, "latency")) goto end;
+	if (uwsgi_stats_object_open(us)) goto end;
+
+	latency_merge(ulh, 0, 0);
+	if (latency_stats_histogram(us, ulh)) goto end;
+	if (uwsgi_stats_comma(us)) goto end;
+
+	if (uwsgi_stats_key(us, "labels")) goto end;
+	if (uwsgi_stats_list_open(us)) goto end;
+	int slot = 1;
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, uwsgi.latency_labels) {
+		if (slot > 1) {
+			if (uwsgi_stats_comma(us)) goto end;
+		}
+		if (uwsgi_stats_object_open(us)) goto end;
+		if (uwsgi_stats_keyval_comma(us, "name", usl->value)) goto end;
+		latency_merge(ulh, 0, slot);
+		if (latency_stats_histogram(us, ulh)) goto end;
+		if (uwsgi_stats_object_close(us)) goto end;
+		slot++;
+	}
+	if (uwsgi_stats_list_close(us)) goto end;
+
+	if (uwsgi.latency_traces > 0) {
+		if (uwsgi_stats_comma(us)) goto end;
+		if (latency_stats_traces(us)) goto end;
+	}
+
+	if (uwsgi_stats_object_close(us)) goto end;
+	if (uwsgi_stats_comma(us)) goto end;
+	ret = 0;
+end:
+	free(ulh);
+	return ret;
+}
+
+// "latency": {...}, in the worker object
+int uwsgi_stats_latency_worker(struct uwsgi_stats *us, int wid) {
+	if (!uwsgi.latency_hist) return 0;
+	int ret = -1;
+	struct uwsgi_latency_histogram *ulh = uwsgi_malloc(sizeof(struct uwsgi_latency_histogram));
+	if (uwsgi_stats_key(us, "latency")) goto end;
+	if (uwsgi_stats_object_open(us)) goto end;
+	latency_merge(ulh, wid, 0);
+	if (latency_stats_histogram(us, ulh)) goto end;
+	if (uwsgi_stats_object_close(us)) goto end;
+	if (uwsgi_stats_comma(us)) goto end;
+	ret = 0;
+end:
+	free(ulh);
+	return ret;
+}
@@ -18,6 +18,10 @@
 #include <uwsgi.h>
 #endif
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 extern struct uwsgi_server uwsgi;
 
 //use this instead of fprintf to avoid buffering mess with udp logging
@@ -529,6 +533,17 @@ void uwsgi_check_logrotate(void) {
 	}
 }
 
+// the fd is owned by a request logger receiving binary records
+static int uwsgi_log_fd_is_binary_req(int log_fd) {
+	if (!uwsgi.log_req_binary) return 0;
+	struct uwsgi_logger *ul = uwsgi.choosen_req_logger;
+	while (ul) {
+		if (ul->configured && ul->fd == log_fd) return 1;
+		ul = ul->next;
+	}
+	return 0;
+}
+
 void uwsgi_log_do_rotate(char *logfile, char *rotatedfile, off_t logsize, int log_fd) {
 	int need_free = 0;
 	char *rot_name = rotatedfile;
@@ -557,6 +572,10 @@ void uwsgi_log_do_rotate(char *logfile, char *rotatedfile, off_t logsize, int lo
 			}
 			close(fd);
 		}
+		// text logs are never converted
+		if (uwsgi.log_rotate_columnar && uwsgi_log_fd_is_binary_req(log_fd)) {
+			uwsgi_log_binary_columnar_bg(rot_name);
+		}
 	}
 	else {
 		uwsgi_error("unable to rotate log: rename()");
@@ -756,7 +775,7 @@ void uwsgi_logit_simple(struct wsgi_request *wsgi_req) {
 	logvec[logvecpos].iov_len = rlen;
 
 	// do not check for errors
-	rlen = writev(uwsgi.req_log_fd, logvec, logvecpos + 1);
+	rlen = uwsgi_req_log_writev(logvec, logvecpos + 1);
 }
 
 void get_memusage(uint64_t * rss, uint64_t * vsz) {
@@ -879,14 +898,31 @@ void get_memusage(uint64_t * rss, uint64_t * vsz) {
 }
 
 #ifdef __linux__
-void get_memusage_extra(uint64_t * uss, uint64_t * pss) {
-	FILE *file = fopen("/proc/self/smaps", "r");
+/*
+	private (uss), proportional (pss), shared and swapped memory of a process (0 for the current one),
+	smaps_rollup (Linux 4.14) is way cheaper than summing the whole smaps (used as fallback)
+*/
+void get_memusage_extra(pid_t pid, uint64_t * uss, uint64_t * pss, uint64_t * shared, uint64_t * swap) {
+	char path[64];
+	if (pid > 0) {
+		snprintf(path, 64, "/proc/%d/smaps_rollup", (int) pid);
+	}
+	else {
+		snprintf(path, 64, "/proc/self/smaps_rollup");
+	}
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		// drop "_rollup"
+		path[strlen(path) - 7] = 0;
+		file = fopen(path, "r");
+		if (!file) return;
+	}
 
 	char line [BUFSIZ];
 	while (fgets(line, sizeof line, file)) {
 		char substr[32];
-		int n;
-		if (sscanf(line, "%31[^:]: %d", substr, &n) == 2)
+		unsigned long long n;
+		if (sscanf(line, "%31[^:]: %llu", substr, &n) == 2)
 		{
 			if (strcmp(substr, "Private_Clean") == 0)
 				*uss += n * 1024;
@@ -894,6 +930,10 @@ void get_memusage_extra(uint64_t * uss, uint64_t * pss) {
 				*uss += n * 1024;
 			else if (strcmp(substr, "Pss") == 0)
 				*pss += n * 1024;
+			else if (shared && (strcmp(substr, "Shared_Clean") == 0 || strcmp(substr, "Shared_Dirty") == 0))
+				*shared += n * 1024;
+			else if (swap && strcmp(substr, "Swap") == 0)
+				*swap += n * 1024;
 		}
 	}
 	fclose(file);
@@ -994,85 +1034,193 @@ struct uwsgi_logger *uwsgi_get_logger_from_id(char *id) {
 }
 
 
+/*
+	write a signed number in the scratch area (it must be at least 21 bytes)
+*/
+static size_t logformat_num(int64_t num, char *buf) {
+	char tmp[24];
+	size_t len = 0;
+	uint64_t n = num < 0 ? -(uint64_t) num : (uint64_t) num;
+	do {
+		tmp[len++] = '0' + (n % 10);
+		n /= 10;
+	} while (n);
+	if (num < 0) tmp[len++] = '-';
+	size_t i;
+	for (i = 0; i < len; i++) {
+		buf[i] = tmp[len - 1 - i];
+	}
+	return len;
+}
+
 void uwsgi_logit_lf(struct wsgi_request *wsgi_req) {
-	struct uwsgi_logchunk *logchunk = uwsgi.logchunks;
+	struct iovec *iov = uwsgi.logvectors[wsgi_req->async_id];
+	char *scratch = uwsgi.logformat_scratch[wsgi_req->async_id];
 	ssize_t rlen = 0;
 	const char *empty_var = "-";
-	while (logchunk) {
-		int pos = logchunk->vec;
-		// raw string
-		if (logchunk->type == 0) {
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = logchunk->ptr;
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = logchunk->len;
-		}
-		// offsetof
-		else if (logchunk->type == 1) {
-			char **var = (char **) (((char *) wsgi_req) + logchunk->pos);
-			uint16_t *varlen = (uint16_t *) (((char *) wsgi_req) + logchunk->pos_len);
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = *var;
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = *varlen;
-		}
-		// logvar
-		else if (logchunk->type == 2) {
-			struct uwsgi_logvar *lv = uwsgi_logvar_get(wsgi_req, logchunk->ptr, logchunk->len);
-			if (lv) {
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = lv->val;
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = lv->vallen;
+	int i;
+
+	// literals are already in place, only the dynamic parts are filled
+	for (i = 0; i < uwsgi.logformat_ops_cnt; i++) {
+		struct uwsgi_logchunk *op = &uwsgi.logformat_ops[i];
+		struct iovec *vec = &iov[op->vec];
+		switch (op->type) {
+			// offsetof
+			case 1: {
+				char **var = (char **) (((char *) wsgi_req) + op->pos);
+				uint16_t *varlen = (uint16_t *) (((char *) wsgi_req) + op->pos_len);
+				vec->iov_base = *var;
+				vec->iov_len = *varlen;
+				break;
 			}
-			else {
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = NULL;
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = 0;
+			// logvar
+			case 2: {
+				struct uwsgi_logvar *lv = uwsgi_logvar_get(wsgi_req, op->ptr, op->len);
+				if (lv) {
+					vec->iov_base = lv->val;
+					vec->iov_len = lv->vallen;
+				}
+				else {
+					vec->iov_len = 0;
+				}
+				break;
 			}
-		}
-		// func
-		else if (logchunk->type == 3) {
-			rlen = logchunk->func(wsgi_req, (char **) &uwsgi.logvectors[wsgi_req->async_id][pos].iov_base);
-			if (rlen > 0) {
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = rlen;
+			// func
+			case 3:
+				rlen = op->func(wsgi_req, (char **) &vec->iov_base);
+				vec->iov_len = rlen > 0 ? rlen : 0;
+				break;
+			// metric
+			case 4:
+				vec->iov_base = scratch + op->scratch;
+				vec->iov_len = logformat_num(uwsgi_metric_get(op->ptr, NULL), vec->iov_base);
+				break;
+			// var
+			case 5: {
+				uint16_t value_len = 0;
+				// could be NULL
+				vec->iov_base = uwsgi_get_var(wsgi_req, op->ptr, op->len, &value_len);
+				vec->iov_len = (size_t) value_len;
+				break;
 			}
-			else {
-				uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = 0;
+			// number
+			case 6:
+				vec->iov_base = scratch + op->scratch;
+				vec->iov_len = logformat_num(op->num(wsgi_req), vec->iov_base);
+				break;
+			// date (cached per-second)
+			case 7: {
+				struct uwsgi_logchunk_date *ld = (struct uwsgi_logchunk_date *) (scratch + op->scratch);
+				time_t t = wsgi_req->start_of_request_in_sec;
+				if (ld->len == 0 || ld->t != t) {
+					ld->t = t;
+					ld->len = op->date(t, ld->buf, sizeof(ld->buf));
+				}
+				vec->iov_base = ld->buf;
+				vec->iov_len = ld->len;
+				break;
 			}
-		}
-		// var
-		else if (logchunk->type == 5) {
-			uint16_t value_len = 0;
-			char *value = uwsgi_get_var(wsgi_req, logchunk->ptr, logchunk->len, &value_len);
-			// could be NULL
-                        uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = value;
-                        uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = (size_t) value_len;
-                }
-		// metric
-		else if (logchunk->type == 4) {
-			int64_t metric = uwsgi_metric_get(logchunk->ptr, NULL);
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = uwsgi_64bit2str(metric);
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = strlen(uwsgi.logvectors[wsgi_req->async_id][pos].iov_base);
+			default:
+				vec->iov_len = 0;
+				break;
 		}
 
-		if (uwsgi.logvectors[wsgi_req->async_id][pos].iov_len == 0 && logchunk->type != 0) {
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_base = (char *) empty_var;
-			uwsgi.logvectors[wsgi_req->async_id][pos].iov_len = 1;	
+		if (vec->iov_len == 0) {
+			vec->iov_base = (char *) empty_var;
+			vec->iov_len = 1;
 		}
-		logchunk = logchunk->next;
 	}
 
 	// do not check for errors
-	rlen = writev(uwsgi.req_log_fd, uwsgi.logvectors[wsgi_req->async_id], uwsgi.logformat_vectors);
+	rlen = uwsgi_req_log_writev(iov, uwsgi.logformat_vectors);
 
 	// free allocated memory
-	logchunk = uwsgi.logchunks;
-	while (logchunk) {
-		if (logchunk->free) {
-			if (uwsgi.logvectors[wsgi_req->async_id][logchunk->vec].iov_len > 0) {
-				if (uwsgi.logvectors[wsgi_req->async_id][logchunk->vec].iov_base != empty_var) {
-					free(uwsgi.logvectors[wsgi_req->async_id][logchunk->vec].iov_base);
-				}
-			}
+	for (i = 0; i < uwsgi.logformat_ops_cnt; i++) {
+		struct uwsgi_logchunk *op = &uwsgi.logformat_ops[i];
+		if (op->free && iov[op->vec].iov_base != empty_var) {
+			free(iov[op->vec].iov_base);
 		}
-		logchunk = logchunk->next;
 	}
 }
 
+/*
+	turn the chunks list in a flat array of dynamic ops.
+
+	literal chunks (and the final newline) are merged and written only once in the
+	per-core iovecs, numbers and dates are rendered in a per-core scratch area.
+*/
+static void uwsgi_compile_log_format(void) {
+	struct uwsgi_logchunk *logchunk;
+	int j;
+	int ops = 0;
+	int vectors = 0;
+	size_t scratch = 0;
+
+	uwsgi_foreach(logchunk, uwsgi.logchunks) {
+		if (logchunk->type != 0) ops++;
+	}
+
+	uwsgi.logformat_ops = uwsgi_calloc(sizeof(struct uwsgi_logchunk) * (ops + 1));
+	// worst case: every chunk has its own vector + the newline
+	struct iovec *literals = uwsgi_calloc(sizeof(struct iovec) * (ops * 2 + 2));
+	struct uwsgi_buffer *ub = NULL;
+
+	uwsgi_foreach(logchunk, uwsgi.logchunks) {
+		if (logchunk->type == 0) {
+			if (logchunk->len == 0) continue;
+			if (!ub) ub = uwsgi_buffer_new(logchunk->len + 1);
+			if (uwsgi_buffer_append(ub, logchunk->ptr, logchunk->len)) goto error;
+			continue;
+		}
+		if (ub) {
+			literals[vectors].iov_base = ub->buf;
+			literals[vectors].iov_len = ub->pos;
+			ub->buf = NULL;
+			uwsgi_buffer_destroy(ub);
+			ub = NULL;
+			vectors++;
+		}
+		struct uwsgi_logchunk *op = &uwsgi.logformat_ops[uwsgi.logformat_ops_cnt];
+		memcpy(op, logchunk, sizeof(struct uwsgi_logchunk));
+		op->next = NULL;
+		op->vec = vectors++;
+		if (op->type == 4 || op->type == 6) {
+			op->scratch = scratch;
+			scratch += 24;
+		}
+		else if (op->type == 7) {
+			op->scratch = scratch;
+			scratch += sizeof(struct uwsgi_logchunk_date);
+		}
+		uwsgi.logformat_ops_cnt++;
+	}
+
+	// the newline is attached to the last literal
+	if (!ub) ub = uwsgi_buffer_new(1);
+	if (uwsgi_buffer_byte(ub, '\n')) goto error;
+	literals[vectors].iov_base = ub->buf;
+	literals[vectors].iov_len = ub->pos;
+	ub->buf = NULL;
+	uwsgi_buffer_destroy(ub);
+	vectors++;
+
+	uwsgi.logformat_vectors = vectors;
+
+	uwsgi.logvectors = uwsgi_malloc(sizeof(struct iovec *) * uwsgi.cores);
+	uwsgi.logformat_scratch = uwsgi_malloc(sizeof(char *) * uwsgi.cores);
+	for (j = 0; j < uwsgi.cores; j++) {
+		uwsgi.logvectors[j] = uwsgi_malloc(sizeof(struct iovec) * vectors);
+		memcpy(uwsgi.logvectors[j], literals, sizeof(struct iovec) * vectors);
+		// keep at least 1 byte to always have a valid pointer
+		uwsgi.logformat_scratch[j] = uwsgi_calloc(scratch + 1);
+	}
+	free(literals);
+	return;
+error:
+	uwsgi_log("unable to compile the log format\n");
+	exit(1);
+}
+
 void uwsgi_build_log_format(char *format) {
 	int state = 0;
 	char *ptr = format;
@@ -1117,103 +1265,71 @@ void uwsgi_build_log_format(char *format) {
 		uwsgi.logformat_vectors++;
 	}
 
-	// +1 for "\n"
-
-	uwsgi.logformat_vectors++;
-
+	uwsgi_compile_log_format();
 }
 
-static ssize_t uwsgi_lf_status(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->status);
-	return strlen(*buf);
+static int64_t uwsgi_lf_status(struct wsgi_request *wsgi_req) {
+	return wsgi_req->status;
 }
 
-
-static ssize_t uwsgi_lf_rsize(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->response_size);
-	return strlen(*buf);
+static int64_t uwsgi_lf_rsize(struct wsgi_request *wsgi_req) {
+	return wsgi_req->response_size;
 }
 
-static ssize_t uwsgi_lf_hsize(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->headers_size);
-	return strlen(*buf);
+static int64_t uwsgi_lf_hsize(struct wsgi_request *wsgi_req) {
+	return wsgi_req->headers_size;
 }
 
-static ssize_t uwsgi_lf_size(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->headers_size+wsgi_req->response_size);
-	return strlen(*buf);
+static int64_t uwsgi_lf_size(struct wsgi_request *wsgi_req) {
+	return wsgi_req->headers_size+wsgi_req->response_size;
 }
 
-static ssize_t uwsgi_lf_cl(struct wsgi_request *wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->post_cl);
-	return strlen(*buf);
+static int64_t uwsgi_lf_cl(struct wsgi_request *wsgi_req) {
+	return wsgi_req->post_cl;
 }
 
-
-static ssize_t uwsgi_lf_epoch(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi_now());
-	return strlen(*buf);
+static int64_t uwsgi_lf_epoch(struct wsgi_request * wsgi_req) {
+	return uwsgi_now();
 }
 
-static ssize_t uwsgi_lf_ctime(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_malloc(26);
+static size_t uwsgi_lf_ctime(time_t t, char *buf, size_t len) {
 #if defined(__sun__) && !defined(__clang__)
-	ctime_r((const time_t *) &wsgi_req->start_of_request_in_sec, *buf, 26);
+	ctime_r((const time_t *) &t, buf, 26);
 #else
-	ctime_r((const time_t *) &wsgi_req->start_of_request_in_sec, *buf);
+	ctime_r((const time_t *) &t, buf);
 #endif
 	return 24;
 }
 
-static ssize_t uwsgi_lf_time(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->start_of_request / 1000000);
-	return strlen(*buf);
+static int64_t uwsgi_lf_time(struct wsgi_request * wsgi_req) {
+	return wsgi_req->start_of_request / 1000000;
 }
 
-
-static ssize_t uwsgi_lf_ltime(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_malloc(64);
-	time_t now = wsgi_req->start_of_request / 1000000;
-	size_t ret = strftime(*buf, 64, "%d/%b/%Y:%H:%M:%S %z", localtime(&now));
-	if (ret == 0) {
-		*buf[0] = 0;
-		return 0;
-	}
-	return ret;
+static size_t uwsgi_lf_ltime(time_t t, char *buf, size_t len) {
+	return strftime(buf, len, "%d/%b/%Y:%H:%M:%S %z", localtime(&t));
 }
 
-static ssize_t uwsgi_lf_ftime(struct wsgi_request * wsgi_req, char **buf) {
+static size_t uwsgi_lf_ftime(time_t t, char *buf, size_t len) {
 	if (!uwsgi.logformat_strftime || !uwsgi.log_strftime) {
-		return uwsgi_lf_ltime(wsgi_req, buf);
-	}
-	*buf = uwsgi_malloc(64);
-	time_t now = wsgi_req->start_of_request / 1000000;
-	size_t ret = strftime(*buf, 64, uwsgi.log_strftime, localtime(&now));
-	if (ret == 0) {
-		*buf[0] = 0;
-		return 0;
+		return uwsgi_lf_ltime(t, buf, len);
 	}
-	return ret;
+	return strftime(buf, len, uwsgi.log_strftime, localtime(&t));
 }
 
-static ssize_t uwsgi_lf_tmsecs(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_64bit2str(wsgi_req->start_of_request / (int64_t) 1000);
-	return strlen(*buf);
+static int64_t uwsgi_lf_tmsecs(struct wsgi_request * wsgi_req) {
+	return wsgi_req->start_of_request / (int64_t) 1000;
 }
 
-static ssize_t uwsgi_lf_tmicros(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_64bit2str(wsgi_req->start_of_request);
-	return strlen(*buf);
+static int64_t uwsgi_lf_tmicros(struct wsgi_request * wsgi_req) {
+	return wsgi_req->start_of_request;
 }
 
-static ssize_t uwsgi_lf_micros(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->end_of_request - wsgi_req->start_of_request);
-	return strlen(*buf);
+static int64_t uwsgi_lf_micros(struct wsgi_request * wsgi_req) {
+	return wsgi_req->end_of_request - wsgi_req->start_of_request;
 }
 
-static ssize_t uwsgi_lf_msecs(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str((wsgi_req->end_of_request - wsgi_req->start_of_request) / 1000);
-	return strlen(*buf);
+static int64_t uwsgi_lf_msecs(struct wsgi_request * wsgi_req) {
+	return (wsgi_req->end_of_request - wsgi_req->start_of_request) / 1000;
 }
 
 static ssize_t uwsgi_lf_secs(struct wsgi_request * wsgi_req, char **buf) {
@@ -1221,90 +1337,96 @@ static ssize_t uwsgi_lf_secs(struct wsgi_request * wsgi_req, char **buf) {
 	return strlen(*buf);
 }
 
-static ssize_t uwsgi_lf_pid(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.mypid);
-	return strlen(*buf);
+static int64_t uwsgi_lf_pid(struct wsgi_request * wsgi_req) {
+	return uwsgi.mypid;
 }
 
-static ssize_t uwsgi_lf_wid(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.mywid);
-	return strlen(*buf);
+static int64_t uwsgi_lf_wid(struct wsgi_request * wsgi_req) {
+	return uwsgi.mywid;
 }
 
-static ssize_t uwsgi_lf_switches(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->switches);
-	return strlen(*buf);
+static int64_t uwsgi_lf_switches(struct wsgi_request * wsgi_req) {
+	return wsgi_req->switches;
 }
 
-static ssize_t uwsgi_lf_vars(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->var_cnt);
-	return strlen(*buf);
+static int64_t uwsgi_lf_vars(struct wsgi_request * wsgi_req) {
+	return wsgi_req->var_cnt;
 }
 
-static ssize_t uwsgi_lf_core(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->async_id);
-	return strlen(*buf);
+static int64_t uwsgi_lf_core(struct wsgi_request * wsgi_req) {
+	return wsgi_req->async_id;
 }
 
-static ssize_t uwsgi_lf_vsz(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.workers[uwsgi.mywid].vsz_size);
-	return strlen(*buf);
+static int64_t uwsgi_lf_vsz(struct wsgi_request * wsgi_req) {
+	return uwsgi.workers[uwsgi.mywid].vsz_size;
 }
 
-static ssize_t uwsgi_lf_rss(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.workers[uwsgi.mywid].rss_size);
-	return strlen(*buf);
+static int64_t uwsgi_lf_rss(struct wsgi_request * wsgi_req) {
+	return uwsgi.workers[uwsgi.mywid].rss_size;
 }
 
-static ssize_t uwsgi_lf_vszM(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.workers[uwsgi.mywid].vsz_size / 1024 / 1024);
-	return strlen(*buf);
+static int64_t uwsgi_lf_vszM(struct wsgi_request * wsgi_req) {
+	return uwsgi.workers[uwsgi.mywid].vsz_size / 1024 / 1024;
 }
 
-static ssize_t uwsgi_lf_rssM(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(uwsgi.workers[uwsgi.mywid].rss_size / 1024 / 1024);
-	return strlen(*buf);
+static int64_t uwsgi_lf_rssM(struct wsgi_request * wsgi_req) {
+	return uwsgi.workers[uwsgi.mywid].rss_size / 1024 / 1024;
 }
 
-static ssize_t uwsgi_lf_pktsize(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->len);
-	return strlen(*buf);
+static int64_t uwsgi_lf_pktsize(struct wsgi_request * wsgi_req) {
+	return wsgi_req->len;
 }
 
-static ssize_t uwsgi_lf_modifier1(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->uh->modifier1);
-	return strlen(*buf);
+static int64_t uwsgi_lf_modifier1(struct wsgi_request * wsgi_req) {
+	return wsgi_req->uh->modifier1;
 }
 
-static ssize_t uwsgi_lf_modifier2(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->uh->modifier2);
-	return strlen(*buf);
+static int64_t uwsgi_lf_modifier2(struct wsgi_request * wsgi_req) {
+	return wsgi_req->uh->modifier2;
 }
 
-static ssize_t uwsgi_lf_headers(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str(wsgi_req->header_cnt);
-	return strlen(*buf);
+static int64_t uwsgi_lf_headers(struct wsgi_request * wsgi_req) {
+	return wsgi_req->header_cnt;
 }
 
-static ssize_t uwsgi_lf_werr(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str((int) wsgi_req->write_errors);
-	return strlen(*buf);
+static int64_t uwsgi_lf_werr(struct wsgi_request * wsgi_req) {
+	return wsgi_req->write_errors;
 }
 
-static ssize_t uwsgi_lf_rerr(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str((int) wsgi_req->read_errors);
-	return strlen(*buf);
+static int64_t uwsgi_lf_rerr(struct wsgi_request * wsgi_req) {
+	return wsgi_req->read_errors;
 }
 
-static ssize_t uwsgi_lf_ioerr(struct wsgi_request * wsgi_req, char **buf) {
-	*buf = uwsgi_num2str((int) (wsgi_req->write_errors + wsgi_req->read_errors));
-	return strlen(*buf);
+static int64_t uwsgi_lf_ioerr(struct wsgi_request * wsgi_req) {
+	return wsgi_req->write_errors + wsgi_req->read_errors;
 }
 
-struct uwsgi_logchunk *uwsgi_register_logchunk(char *name, ssize_t (*func)(struct wsgi_request *, char **), int need_free) {
+// --request-accounting
+static int64_t uwsgi_lf_cpu(struct wsgi_request * wsgi_req) {
+	return wsgi_req->acct_cpu;
+}
+
+static int64_t uwsgi_lf_offcpu(struct wsgi_request * wsgi_req) {
+	uint64_t micros = wsgi_req->end_of_request - wsgi_req->start_of_request;
+	return micros > wsgi_req->acct_cpu ? micros - wsgi_req->acct_cpu : 0;
+}
+
+static int64_t uwsgi_lf_vcsw(struct wsgi_request * wsgi_req) {
+	return wsgi_req->acct_vcsw;
+}
+
+static int64_t uwsgi_lf_ivcsw(struct wsgi_request * wsgi_req) {
+	return wsgi_req->acct_ivcsw;
+}
+
+static int64_t uwsgi_lf_minflt(struct wsgi_request * wsgi_req) {
+	return wsgi_req->acct_minflt;
+}
+
+static struct uwsgi_logchunk *uwsgi_logchunk_get_or_create(char *name) {
 	struct uwsgi_logchunk *old_logchunk = NULL, *logchunk = uwsgi.registered_logchunks;
 	while(logchunk) {
-		if (!strcmp(logchunk->name, name)) goto found;
+		if (!strcmp(logchunk->name, name)) return logchunk;
 		old_logchunk = logchunk;
 		logchunk = logchunk->next;
 	}
@@ -1316,13 +1438,35 @@ struct uwsgi_logchunk *uwsgi_register_logchunk(char *name, ssize_t (*func)(struc
 	else {
 		uwsgi.registered_logchunks = logchunk;
 	}
-found:
+	return logchunk;
+}
+
+struct uwsgi_logchunk *uwsgi_register_logchunk(char *name, ssize_t (*func)(struct wsgi_request *, char **), int need_free) {
+	struct uwsgi_logchunk *logchunk = uwsgi_logchunk_get_or_create(name);
 	logchunk->func = func;
 	logchunk->free = need_free;
 	logchunk->type = 3;
 	return logchunk;	
 }
 
+// numeric logchunks are rendered without allocations
+struct uwsgi_logchunk *uwsgi_register_logchunk_num(char *name, int64_t (*num)(struct wsgi_request *)) {
+	struct uwsgi_logchunk *logchunk = uwsgi_logchunk_get_or_create(name);
+	logchunk->num = num;
+	logchunk->free = 0;
+	logchunk->type = 6;
+	return logchunk;	
+}
+
+// date logchunks are rendered once per-second (and per-core)
+struct uwsgi_logchunk *uwsgi_register_logchunk_date(char *name, size_t (*date)(time_t, char *, size_t)) {
+	struct uwsgi_logchunk *logchunk = uwsgi_logchunk_get_or_create(name);
+	logchunk->date = date;
+	logchunk->free = 0;
+	logchunk->type = 7;
+	return logchunk;	
+}
+
 struct uwsgi_logchunk *uwsgi_get_logchunk_by_name(char *name, size_t name_len) {
 	struct uwsgi_logchunk *logchunk = uwsgi.registered_logchunks;
 	while(logchunk) {
@@ -1360,6 +1504,8 @@ void uwsgi_add_logchunk(int variable, int pos, char *ptr, size_t len) {
 	   3 -> func
 	   4 -> metric
 	   5 -> request variable
+	   6 -> number
+	   7 -> date
 	 */
 
 	logchunk->type = variable;
@@ -1380,6 +1526,14 @@ void uwsgi_add_logchunk(int variable, int pos, char *ptr, size_t len) {
 				logchunk->func = rlc->func;
 				logchunk->free = rlc->free;
 			}
+			else if (rlc->type == 6) {
+				logchunk->type = 6;
+				logchunk->num = rlc->num;
+			}
+			else if (rlc->type == 7) {
+				logchunk->type = 7;
+				logchunk->date = rlc->date;
+			}
 		}
 		// var
 		else if (!uwsgi_starts_with(ptr, len, "var.", 4)) {
@@ -1392,7 +1546,7 @@ void uwsgi_add_logchunk(int variable, int pos, char *ptr, size_t len) {
 		else if (!uwsgi_starts_with(ptr, len, "metric.", 7)) {
 			logchunk->type = 4;
 			logchunk->ptr = uwsgi_concat2n(ptr+7, len - 7, "", 0);
-			logchunk->free = 1;
+			logchunk->free = 0;
 		}
 		// logvar
 		else {
@@ -1506,52 +1660,262 @@ next:
         return -1;
 }
 
-int uwsgi_master_req_log(void) {
-
-        ssize_t rlen = read(uwsgi.shared->worker_req_log_pipe[0], uwsgi.log_master_buf, uwsgi.log_master_bufsize);
-        if (rlen > 0) {
+static void uwsgi_master_req_log_do(char *buf, size_t rlen) {
 #ifdef UWSGI_PCRE
-                struct uwsgi_regexp_list *url = uwsgi.log_req_route;
-                int finish = 0;
-                while (url) {
-                        if (uwsgi_regexp_match(url->pattern, url->pattern_extra, uwsgi.log_master_buf, rlen) >= 0) {
-                                struct uwsgi_logger *ul_route = (struct uwsgi_logger *) url->custom_ptr;
-                                if (ul_route) {
-                                        uwsgi_log_func_do(uwsgi.requested_log_req_encoders, ul_route, uwsgi.log_master_buf, rlen);
-                                        finish = 1;
-                                }
+        struct uwsgi_regexp_list *url = uwsgi.log_req_route;
+        int finish = 0;
+        while (url) {
+                if (uwsgi_regexp_match(url->pattern, url->pattern_extra, buf, rlen) >= 0) {
+                        struct uwsgi_logger *ul_route = (struct uwsgi_logger *) url->custom_ptr;
+                        if (ul_route) {
+                                uwsgi_log_func_do(uwsgi.requested_log_req_encoders, ul_route, buf, rlen);
+                                finish = 1;
                         }
-                        url = url->next;
                 }
-                if (finish)
-                        return 0;
+                url = url->next;
+        }
+        if (finish)
+                return;
 #endif
 
-                int raw_log = 1;
+        int raw_log = 1;
 
-                struct uwsgi_logger *ul = uwsgi.choosen_req_logger;
-                while (ul) {
-                        // check for named logger
-                        if (ul->id) {
-                                goto next;
-                        }
-                        uwsgi_log_func_do(uwsgi.requested_log_req_encoders, ul, uwsgi.log_master_buf, rlen);
-                        raw_log = 0;
-next:
-                        ul = ul->next;
+        struct uwsgi_logger *ul = uwsgi.choosen_req_logger;
+        while (ul) {
+                // check for named logger
+                if (ul->id) {
+                        goto next;
                 }
+                uwsgi_log_func_do(uwsgi.requested_log_req_encoders, ul, buf, rlen);
+                raw_log = 0;
+next:
+                ul = ul->next;
+        }
 
-                if (raw_log) {
-			uwsgi_log_func_do(uwsgi.requested_log_req_encoders, NULL, uwsgi.log_master_buf, rlen);
-                }
+        if (raw_log) {
+		uwsgi_log_func_do(uwsgi.requested_log_req_encoders, NULL, buf, rlen);
+        }
+}
+
+int uwsgi_master_req_log(void) {
+
+        ssize_t rlen = read(uwsgi.shared->worker_req_log_pipe[0], uwsgi.log_master_buf, uwsgi.log_master_bufsize);
+        if (rlen > 0) {
+		uwsgi_master_req_log_do(uwsgi.log_master_buf, rlen);
                 return 0;
         }
 
         return -1;
 }
 
+/*
+
+	request log rings
+
+	each worker gets a ring in shared memory. Loglines are copied in it
+	and the log master (or the threaded logger) is woken up only when the ring
+	goes from empty to non-empty. The consumer drains all of the rings in one shot.
+
+*/
+
+static void log_ring_copy_in(struct uwsgi_log_ring *ring, uint64_t pos, char *src, size_t len) {
+	uint64_t off = pos % ring->size;
+	size_t chunk = ring->size - off;
+	if (chunk > len) chunk = len;
+	memcpy(ring->buf + off, src, chunk);
+	if (len > chunk) {
+		memcpy(ring->buf, src + chunk, len - chunk);
+	}
+}
+
+static void log_ring_copy_out(struct uwsgi_log_ring *ring, uint64_t pos, char *dst, size_t len) {
+	uint64_t off = pos % ring->size;
+	size_t chunk = ring->size - off;
+	if (chunk > len) chunk = len;
+	memcpy(dst, ring->buf + off, chunk);
+	if (len > chunk) {
+		memcpy(dst + chunk, ring->buf, len - chunk);
+	}
+}
+
+static void log_ring_doorbell(void) {
+#ifdef __linux__
+	uint64_t one = 1;
+	// EAGAIN means the consumer has already been notified
+	if (write(uwsgi.req_log_ring_fd[1], &one, sizeof(uint64_t)) < 0) {
+#else
+	char one = 1;
+	if (write(uwsgi.req_log_ring_fd[1], &one, 1) < 0) {
+#endif
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			uwsgi_error("log_ring_doorbell()/write()");
+		}
+	}
+}
+
+void uwsgi_setup_req_log_rings() {
+	int i;
+	if (!uwsgi.req_log_master) return;
+
+	if (uwsgi.req_log_ring_size < sizeof(uint32_t) + uwsgi.log_master_bufsize) {
+		uwsgi.req_log_ring_size = sizeof(uint32_t) + uwsgi.log_master_bufsize;
+	}
+
+#ifdef __linux__
+	uwsgi.req_log_ring_fd[0] = eventfd(0, EFD_NONBLOCK);
+	if (uwsgi.req_log_ring_fd[0] < 0) {
+		uwsgi_error("uwsgi_setup_req_log_rings()/eventfd()");
+		exit(1);
+	}
+	uwsgi.req_log_ring_fd[1] = uwsgi.req_log_ring_fd[0];
+#else
+	if (pipe(uwsgi.req_log_ring_fd)) {
+		uwsgi_error("uwsgi_setup_req_log_rings()/pipe()");
+		exit(1);
+	}
+	uwsgi_socket_nb(uwsgi.req_log_ring_fd[0]);
+	uwsgi_socket_nb(uwsgi.req_log_ring_fd[1]);
+#endif
+
+	pthread_mutex_init(&uwsgi.req_log_ring_lock, NULL);
+
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		struct uwsgi_log_ring *ring = uwsgi_calloc_shared(sizeof(struct uwsgi_log_ring));
+		ring->size = uwsgi.req_log_ring_size;
+		ring->buf = uwsgi_malloc_shared(ring->size);
+		uwsgi.workers[i].req_log_ring = ring;
+	}
+
+	uwsgi_log("request log rings enabled (%llu bytes per worker)\n", (unsigned long long) uwsgi.req_log_ring_size);
+}
+
+static ssize_t log_ring_push(struct uwsgi_log_ring *ring, struct iovec *iov, int iovcnt) {
+	int i;
+	size_t len = 0;
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	// the consumer will never read more than log_master_bufsize bytes
+	if (len > uwsgi.log_master_bufsize) {
+		len = uwsgi.log_master_bufsize;
+	}
+
+	size_t needed = sizeof(uint32_t) + len;
+	uint64_t tail = ring->tail;
+	int waited = 0;
+
+	while (ring->size - (tail - ring->head) < needed) {
+		if (waited == 0) {
+			ring->blocked++;
+			log_ring_doorbell();
+		}
+		if (waited >= uwsgi.req_log_ring_wait) {
+			ring->dropped++;
+			return -1;
+		}
+		usleep(1000);
+		waited++;
+	}
+
+	uint32_t rlen = len;
+	log_ring_copy_in(ring, tail, (char *) &rlen, sizeof(uint32_t));
+	uint64_t pos = tail + sizeof(uint32_t);
+	size_t remains = len;
+	for (i = 0; i < iovcnt && remains > 0; i++) {
+		size_t chunk = iov[i].iov_len;
+		if (chunk > remains) chunk = remains;
+		log_ring_copy_in(ring, pos, iov[i].iov_base, chunk);
+		pos += chunk;
+		remains -= chunk;
+	}
+
+	// the record must be visible before the new tail
+	__sync_synchronize();
+	ring->tail = tail + needed;
+	ring->lines++;
+	// the new tail must be visible before checking the consumer position
+	__sync_synchronize();
+	if (ring->head == tail) {
+		log_ring_doorbell();
+	}
+
+	return len;
+}
+
+ssize_t uwsgi_req_log_writev(struct iovec *iov, int iovcnt) {
+	if (uwsgi.mywid > 0 && uwsgi.workers[uwsgi.mywid].req_log_ring) {
+		if (uwsgi.threads > 1) pthread_mutex_lock(&uwsgi.req_log_ring_lock);
+		ssize_t rlen = log_ring_push(uwsgi.workers[uwsgi.mywid].req_log_ring, iov, iovcnt);
+		if (uwsgi.threads > 1) pthread_mutex_unlock(&uwsgi.req_log_ring_lock);
+		return rlen;
+	}
+	return writev(uwsgi.req_log_fd, iov, iovcnt);
+}
+
+static void log_ring_drain(struct uwsgi_log_ring *ring) {
+	// lines can be coalesced only when they are blindly written to the logfile
+	int raw = 1;
+	if (uwsgi.requested_log_req_encoders || uwsgi.choosen_req_logger) raw = 0;
+#ifdef UWSGI_PCRE
+	if (uwsgi.log_req_route) raw = 0;
+#endif
+	uint64_t head = ring->head;
+	for (;;) {
+		uint64_t tail = ring->tail;
+		// records must be read after the tail
+		__sync_synchronize();
+		if (head == tail) break;
+		size_t pos = 0;
+		while (head < tail) {
+			uint32_t rlen;
+			log_ring_copy_out(ring, head, (char *) &rlen, sizeof(uint32_t));
+			if (pos > 0 && pos + rlen > uwsgi.log_master_bufsize) {
+				uwsgi_master_req_log_do(uwsgi.log_master_buf, pos);
+				pos = 0;
+			}
+			log_ring_copy_out(ring, head + sizeof(uint32_t), uwsgi.log_master_buf + pos, rlen);
+			head += sizeof(uint32_t) + rlen;
+			if (raw) {
+				pos += rlen;
+				continue;
+			}
+			uwsgi_master_req_log_do(uwsgi.log_master_buf, rlen);
+		}
+		if (pos > 0) {
+			uwsgi_master_req_log_do(uwsgi.log_master_buf, pos);
+		}
+		// give back the space to the producer
+		__sync_synchronize();
+		ring->head = head;
+		__sync_synchronize();
+	}
+}
+
+int uwsgi_master_req_log_ring(void) {
+	int i;
+#ifdef __linux__
+	uint64_t counter;
+	if (read(uwsgi.req_log_ring_fd[0], &counter, sizeof(uint64_t)) < 0) {
+#else
+	char counter[64];
+	if (read(uwsgi.req_log_ring_fd[0], counter, 64) < 0) {
+#endif
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			uwsgi_error("uwsgi_master_req_log_ring()/read()");
+			return -1;
+		}
+	}
+
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		if (uwsgi.workers[i].req_log_ring) {
+			log_ring_drain(uwsgi.workers[i].req_log_ring);
+		}
+	}
+	return 0;
+}
+
 static void *logger_thread_loop(void *noarg) {
-        struct pollfd logpoll[2];
+        struct pollfd logpoll[3];
 
         // block all signals
         sigset_t smask;
@@ -1569,6 +1933,14 @@ static void *logger_thread_loop(void *noarg) {
 		logpolls++;
         }
 
+	int ringpoll = -1;
+	if (uwsgi.req_log_ring_size > 0 && uwsgi.req_log_master) {
+		ringpoll = logpolls;
+		logpoll[ringpoll].events = POLLIN;
+		logpoll[ringpoll].fd = uwsgi.req_log_ring_fd[0];
+		logpolls++;
+	}
+
 
         for (;;) {
                 int ret = poll(logpoll, logpolls, -1);
@@ -1578,11 +1950,16 @@ static void *logger_thread_loop(void *noarg) {
                                 uwsgi_master_log();
                                 pthread_mutex_unlock(&uwsgi.threaded_logger_lock);
                         }
-                        else if (logpolls > 1 && logpoll[1].revents & POLLIN) {
+                        else if (uwsgi.req_log_master && logpoll[1].revents & POLLIN) {
                                 pthread_mutex_lock(&uwsgi.threaded_logger_lock);
                                 uwsgi_master_req_log();
                                 pthread_mutex_unlock(&uwsgi.threaded_logger_lock);
                         }
+			else if (ringpoll > -1 && logpoll[ringpoll].revents & POLLIN) {
+                                pthread_mutex_lock(&uwsgi.threaded_logger_lock);
+                                uwsgi_master_req_log_ring();
+                                pthread_mutex_unlock(&uwsgi.threaded_logger_lock);
+			}
 
                 }
         }
@@ -1601,6 +1978,9 @@ void uwsgi_threaded_logger_spawn() {
                 event_queue_add_fd_read(uwsgi.master_queue, uwsgi.shared->worker_log_pipe[0]);
                 if (uwsgi.req_log_master) {
                 	event_queue_add_fd_read(uwsgi.master_queue, uwsgi.shared->worker_req_log_pipe[0]);
+			if (uwsgi.req_log_ring_size > 0) {
+				event_queue_add_fd_read(uwsgi.master_queue, uwsgi.req_log_ring_fd[0]);
+			}
                 }
                 uwsgi.threaded_logger = 0;
 	}
@@ -1708,6 +2088,10 @@ void uwsgi_setup_log_encoders() {
                         ule2->args = uwsgi_str("");
                 }
                 usl->custom_ptr = ule2;
+		// workers will generate binary records instead of text lines
+		if (ule->func == uwsgi_log_encoder_binary) {
+			uwsgi.log_req_binary = 1;
+		}
 		uwsgi_log("[log-req-encoder] registered %s\n", usl->value);
         }
 }
@@ -1982,6 +2366,8 @@ end:
 }
 
 #define r_logchunk(x) uwsgi_register_logchunk(#x, uwsgi_lf_ ## x, 1)
+#define r_logchunk_num(x) uwsgi_register_logchunk_num(#x, uwsgi_lf_ ## x)
+#define r_logchunk_date(x) uwsgi_register_logchunk_date(#x, uwsgi_lf_ ## x)
 #define r_logchunk_offset(x, y) { struct uwsgi_logchunk *lc = uwsgi_register_logchunk(#x, NULL, 0); lc->pos = offsetof(struct wsgi_request, y); lc->pos_len = offsetof(struct wsgi_request, y ## _len); lc->type = 1; lc->free=0;}
 void uwsgi_register_logchunks() {
 	// offsets
@@ -1994,38 +2380,47 @@ void uwsgi_register_logchunks() {
 	r_logchunk_offset(uagent, user_agent);
 	r_logchunk_offset(referer, referer);
 
+	// numbers
+	r_logchunk_num(status);
+	r_logchunk_num(rsize);
+	r_logchunk_num(hsize);
+	r_logchunk_num(size);
+	r_logchunk_num(cl);
+	r_logchunk_num(micros);
+	r_logchunk_num(msecs);
+	r_logchunk_num(tmsecs);
+	r_logchunk_num(tmicros);
+	r_logchunk_num(time);
+	r_logchunk_num(epoch);
+	r_logchunk_num(pid);
+	r_logchunk_num(wid);
+	r_logchunk_num(switches);
+	r_logchunk_num(vars);
+	r_logchunk_num(core);
+	r_logchunk_num(vsz);
+	r_logchunk_num(rss);
+	r_logchunk_num(vszM);
+	r_logchunk_num(rssM);
+	r_logchunk_num(pktsize);
+	r_logchunk_num(modifier1);
+	r_logchunk_num(modifier2);
+	r_logchunk_num(headers);
+	r_logchunk_num(werr);
+	r_logchunk_num(rerr);
+	r_logchunk_num(ioerr);
+	r_logchunk_num(cpu);
+	r_logchunk_num(offcpu);
+	r_logchunk_num(vcsw);
+	r_logchunk_num(ivcsw);
+	r_logchunk_num(minflt);
+
+	// dates
+	r_logchunk_date(ltime);
+	r_logchunk_date(ftime);
+	r_logchunk_date(ctime);
+
 	// funcs
-	r_logchunk(status);
-	r_logchunk(rsize);
-	r_logchunk(hsize);
-	r_logchunk(size);
-	r_logchunk(cl);
-	r_logchunk(micros);
-	r_logchunk(msecs);
 	r_logchunk(secs);
-	r_logchunk(tmsecs);
-	r_logchunk(tmicros);
-	r_logchunk(time);
-	r_logchunk(ltime);
-	r_logchunk(ftime);
-	r_logchunk(ctime);
-	r_logchunk(epoch);
-	r_logchunk(pid);
-	r_logchunk(wid);
-	r_logchunk(switches);
-	r_logchunk(vars);
-	r_logchunk(core);
-	r_logchunk(vsz);
-	r_logchunk(rss);
-	r_logchunk(vszM);
-	r_logchunk(rssM);
-	r_logchunk(pktsize);
-	r_logchunk(modifier1);
-	r_logchunk(modifier2);
-	r_logchunk(headers);
-	r_logchunk(werr);
-	r_logchunk(rerr);
-	r_logchunk(ioerr);
 }
 
 void uwsgi_log_encoders_register_embedded() {
@@ -2034,6 +2429,7 @@ void uwsgi_log_encoders_register_embedded() {
 	uwsgi_register_log_encoder("nl", uwsgi_log_encoder_nl);
 	uwsgi_register_log_encoder("format", uwsgi_log_encoder_format);
 	uwsgi_register_log_encoder("json", uwsgi_log_encoder_json);
+	uwsgi_register_log_encoder("binary", uwsgi_log_encoder_binary);
 #ifdef UWSGI_ZLIB
 	uwsgi_register_log_encoder("gzip", uwsgi_log_encoder_gzip);
 	uwsgi_register_log_encoder("compress", uwsgi_log_encoder_compress);
@@ -89,6 +89,8 @@ void uwsgi_setup_thread_req(long core_id, struct wsgi_request *wsgi_req) {
 #ifdef UWSGI_DEBUG
 		sigdelset(&smask, SIGSEGV);
 #endif
+		// the sampling profiler forwards SIGPROF to the busy threads
+		if (uwsgi.sampling_profiler) sigdelset(&smask, SIGPROF);
 		pthread_sigmask(SIG_BLOCK, &smask, NULL);
 
 		// run per-thread socket hook
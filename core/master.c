@@ -326,6 +326,150 @@ static void master_check_listen_queue() {
 	}
 }
 
+// interrupts the wait for events, so the dead workers are reaped immediately
+static void master_wakeup(int signum) {
+}
+
+/*
+	the periodic checks of the master, registered as tasks (see core/master_tasks.c)
+	in master_loop()
+*/
+
+static void master_task_logrotate() {
+	uwsgi_check_logrotate();
+}
+
+static void master_task_cycle() {
+	// this will be incremented at (more or less) regular intervals
+	uwsgi.master_cycles++;
+	// recalculate requests counter on race conditions risky configurations
+	// a bit of inaccuracy is better than locking;)
+	uwsgi_master_fix_request_counters();
+}
+
+static void master_task_deadlines() {
+	// check if some worker has to die (harakiri, evil checks...)
+	uwsgi_master_check_workers_deadline();
+	uwsgi_master_check_gateways_deadline();
+	uwsgi_master_check_mules_deadline();
+	uwsgi_master_check_spoolers_deadline();
+	uwsgi_master_check_crons_deadline();
+}
+
+#ifdef __linux__
+#ifdef MADV_MERGEABLE
+static void master_task_ksm() {
+	uwsgi_linux_ksm_map();
+}
+#endif
+#endif
+
+static void master_task_subscriptions() {
+	if (uwsgi_instance_is_reloading || uwsgi_instance_is_dying || uwsgi.workers[0].suspended) return;
+	uwsgi_subscribe_all(0, 0);
+}
+
+static void master_task_queue_sync() {
+	if (msync(uwsgi.queue_header, uwsgi.queue_filesize, MS_ASYNC)) {
+		uwsgi_error("msync()");
+	}
+}
+
+static void master_task_spooler_cheap() {
+	uwsgi_spooler_cheap_check();
+}
+
+static void master_task_cron() {
+	// check uwsgi-cron table
+	if (ushared->cron_cnt) {
+		uwsgi_manage_signal_cron(uwsgi_now());
+	}
+
+	if (uwsgi.crons) {
+		uwsgi_manage_command_cron(uwsgi_now());
+	}
+}
+
+static void master_task_touches() {
+	if (uwsgi_instance_is_reloading || uwsgi_instance_is_dying) return;
+
+	char *touched = uwsgi_check_touches(uwsgi.touch_reload);
+	if (touched) {
+		uwsgi_log_verbose("*** %s has been touched... grace them all !!! ***\n", touched);
+		uwsgi_block_signal(SIGHUP);
+		grace_them_all(0);
+		uwsgi_unblock_signal(SIGHUP);
+		return;
+	}
+	touched = uwsgi_check_touches(uwsgi.touch_workers_reload);
+	if (touched) {
+		uwsgi_log_verbose("*** %s has been touched... workers reload !!! ***\n", touched);
+		uwsgi_reload_workers();
+		return;
+	}
+	touched = uwsgi_check_touches(uwsgi.touch_mules_reload);
+	if (touched) {
+		uwsgi_log_verbose("*** %s has been touched... mules reload !!! ***\n", touched);
+		uwsgi_reload_mules();
+		return;
+	}
+	touched = uwsgi_check_touches(uwsgi.touch_spoolers_reload);
+	if (touched) {
+		uwsgi_log_verbose("*** %s has been touched... spoolers reload !!! ***\n", touched);
+		uwsgi_reload_spoolers();
+		return;
+	}
+	touched = uwsgi_check_touches(uwsgi.touch_chain_reload);
+	if (touched) {
+		if (uwsgi.status.chain_reloading == 0) {
+			uwsgi_log_verbose("*** %s has been touched... chain reload !!! ***\n", touched);
+			uwsgi_warm_spares_kill();
+			uwsgi.status.chain_reloading = 1;
+		}
+		else {
+			uwsgi_log_verbose("*** %s has been touched... but chain reload is already running ***\n", touched);
+		}
+	}
+
+	// be sure to run it as the last touch check
+	touched = uwsgi_check_touches(uwsgi.touch_exec);
+	if (touched) {
+		if (uwsgi_run_command(touched, NULL, -1) >= 0) {
+			uwsgi_log_verbose("[uwsgi-touch-exec] running %s\n", touched);
+		}
+	}
+	touched = uwsgi_check_touches(uwsgi.touch_signal);
+	if (touched) {
+		uint8_t signum = atoi(touched);
+		uwsgi_route_signal(signum);
+		uwsgi_log_verbose("[uwsgi-touch-signal] raising %u\n", signum);
+	}
+
+	// daemon touches
+	struct uwsgi_daemon *ud = uwsgi.daemons;
+	while (ud) {
+		if (ud->pid > 0 && ud->touch) {
+			touched = uwsgi_check_touches(ud->touch);
+			if (touched) {
+				uwsgi_log_verbose("*** %s has been touched... reloading daemon \"%s\" (pid: %d) !!! ***\n", touched, ud->command, (int) ud->pid);
+				if (kill(-ud->pid, ud->stop_signal)) {
+					// killing process group failed, try to kill by process id
+					if (kill(ud->pid, ud->stop_signal)) {
+						uwsgi_error("[uwsgi-daemon/touch] kill()");
+					}
+				}
+			}
+		}
+		ud = ud->next;
+	}
+
+	// hook touches
+	touched = uwsgi_check_touches(uwsgi.hook_touch);
+	if (touched) {
+		uwsgi_hooks_run((struct uwsgi_string_list *) touched, "touch", 0);
+	}
+}
+
 void vassal_sos() {
 	if (!uwsgi.has_emperor) {
 		uwsgi_log("[broodlord] instance not governed by an Emperor !!!\n");
@@ -345,13 +489,10 @@ int master_loop(char **argv, char **environ) {
 	pid_t diedpid;
 	int waitpid_status;
 
-	time_t now = 0;
 
 	int i = 0;
 	int rlen;
 
-	int check_interval = 1;
-
 	struct uwsgi_rb_timer *min_timeout;
 	struct uwsgi_rbtree *rb_timers = uwsgi_init_rb_timer();
 
@@ -415,6 +556,9 @@ int master_loop(char **argv, char **environ) {
 			event_queue_add_fd_read(uwsgi.master_queue, uwsgi.shared->worker_log_pipe[0]);
 			if (uwsgi.req_log_master) {
 				event_queue_add_fd_read(uwsgi.master_queue, uwsgi.shared->worker_req_log_pipe[0]);
+				if (uwsgi.req_log_ring_fd[0] > -1) {
+					event_queue_add_fd_read(uwsgi.master_queue, uwsgi.req_log_ring_fd[0]);
+				}
 			}
 		}
 		else {
@@ -481,7 +625,14 @@ int master_loop(char **argv, char **environ) {
 			uwsgi.stats_fd = bind_to_unix(uwsgi.stats, uwsgi.listen_queue, uwsgi.chmod_socket, uwsgi.abstract_socket);
 		}
 
-		event_queue_add_fd_read(uwsgi.master_queue, uwsgi.stats_fd);
+		// the stats server runs in its own thread
+		uwsgi.stats_thread = uwsgi_thread_new(uwsgi_stats_server_loop);
+		if (!uwsgi.stats_thread) {
+			uwsgi_log("!!! unable to spawn the stats server thread !!!\n");
+			exit(1);
+		}
+		// the json document is generated by the master on request
+		event_queue_add_fd_read(uwsgi.master_queue, uwsgi.stats_thread->pipe[0]);
 		uwsgi_log("*** Stats server enabled on %s fd: %d ***\n", uwsgi.stats, uwsgi.stats_fd);
 	}
 
@@ -639,6 +790,70 @@ int master_loop(char **argv, char **environ) {
 
 	}
 
+	/*
+		the master sleeps until the next task is due, the dead processes have to be noticed
+		immediately (a warm spare can replace a dead worker, the killed ones are not checked again)
+	*/
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = master_wakeup;
+	// only the wait for events has to be interrupted
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGCHLD, &sa, NULL)) {
+		uwsgi_error("master_loop()/sigaction()");
+	}
+
+	// register the periodic tasks (intervals are in milliseconds)
+	if (!uwsgi.master_interval) uwsgi.master_interval = 1;
+	uint64_t master_interval = uwsgi.master_interval * 1000;
+
+	uwsgi_master_task_register("cycle", master_interval, master_interval, master_task_cycle);
+	if (uwsgi.logfile) {
+		uwsgi_master_task_register("logrotate", master_interval, master_interval, master_task_logrotate);
+	}
+	if (uwsgi.idle) {
+		uwsgi_master_task_register("idle", master_interval, master_interval, uwsgi_master_check_idle);
+	}
+#ifdef __linux__
+	if (uwsgi.memory_sharing_report) {
+		uwsgi_master_task_register("memory-sharing", master_interval, master_interval, uwsgi_master_check_memory_sharing);
+	}
+#endif
+	uwsgi_master_task_register("listen-queue", master_interval, master_interval, master_check_listen_queue);
+	uwsgi_master_task_register("deadlines", master_interval, master_interval, master_task_deadlines);
+	if (uwsgi.mountpoints_check) {
+		// this could trigger a complete exit...
+		uwsgi_master_task_register("mountpoints", master_interval, master_interval, uwsgi_master_check_mountpoints);
+	}
+#ifdef __linux__
+#ifdef MADV_MERGEABLE
+	if (uwsgi.linux_ksm > 0) {
+		uwsgi_master_task_register("ksm", master_interval * uwsgi.linux_ksm, master_interval * uwsgi.linux_ksm, master_task_ksm);
+	}
+#endif
+#endif
+	if (uwsgi.subscriptions || uwsgi.subscriptions2) {
+		// resubscribe every 10 cycles by default
+		uwsgi_master_task_register("subscriptions", master_interval, master_interval * uwsgi.subscribe_freq, master_task_subscriptions);
+	}
+	struct uwsgi_cache *uc;
+	for (uc = uwsgi.caches; uc; uc = uc->next) {
+		if (uc->store && uc->store_sync > 0) {
+			uwsgi_master_task_register_data(uwsgi_concat2("cache-sync-", uc->name), master_interval * uc->store_sync, master_interval * uc->store_sync, uwsgi_cache_sync, uc);
+		}
+	}
+	if (uwsgi.queue_store && uwsgi.queue_filesize && uwsgi.queue_store_sync) {
+		uwsgi_master_task_register("queue-sync", master_interval * uwsgi.queue_store_sync, master_interval * uwsgi.queue_store_sync, master_task_queue_sync);
+	}
+	if (uwsgi.spooler_cheap) {
+		uwsgi_master_task_register("spooler-cheap", master_interval * uwsgi.spooler_frequency, master_interval * uwsgi.spooler_frequency, master_task_spooler_cheap);
+	}
+	uwsgi_master_task_register("touches", master_interval, master_interval, master_task_touches);
+	// crons have a resolution of one second (signals can be added at runtime)
+	uwsgi_master_task_register("cron", 1000, 1000, master_task_cron);
+	uwsgi_profiler_register_task();
+
 	// here really starts the master loop
 	uwsgi_hooks_run(uwsgi.hook_master_start, "master-start", 1);
 
@@ -679,11 +894,10 @@ int master_loop(char **argv, char **environ) {
 				return 0;
 		}
 
-		// spooler cheap management
-		if (uwsgi.spooler_cheap) {
-			if ((uwsgi.master_cycles % uwsgi.spooler_frequency) == 0) {
-				uwsgi_spooler_cheap_check();
-			}
+		// refill the warm spares pool
+		if (uwsgi.warm_spares && !uwsgi_instance_is_reloading && !uwsgi_instance_is_dying && !uwsgi.workers[0].suspended) {
+			if (uwsgi_master_check_warm_spares())
+				return 0;
 		}
 
 
@@ -707,13 +921,6 @@ int master_loop(char **argv, char **environ) {
 		// no one died just run all of the standard master tasks
 		if (diedpid == 0) {
 
-			/* all processes ok, doing status scan after N seconds */
-			check_interval = uwsgi.master_interval;
-			if (!check_interval) {
-				check_interval = 1;
-				uwsgi.master_interval = 1;
-			}
-
 
 			// add unregistered file monitors
 			// locking is not needed as monitors can only increase
@@ -745,6 +952,9 @@ int master_loop(char **argv, char **environ) {
 
 			int interesting_fd = -1;
 
+			// sleep until the next periodic task is due
+			int timeout = uwsgi_master_tasks_timeout();
+
 			if (ushared->rb_timers_cnt > 0) {
 				min_timeout = uwsgi_min_rb_timer(rb_timers, NULL);
 				if (min_timeout) {
@@ -752,15 +962,15 @@ int master_loop(char **argv, char **environ) {
 					if (delta <= 0) {
 						expire_rb_timeouts(rb_timers);
 					}
-					// if the timer expires before the check_interval, override it
-					else if (delta < check_interval) {
-						check_interval = delta;
+					// if the timer expires before the next task, override it
+					else if (timeout < 0 || delta * 1000 < timeout) {
+						timeout = delta * 1000;
 					}
 				}
 			}
 
 			// wait for event
-			rlen = event_queue_wait(uwsgi.master_queue, check_interval, &interesting_fd);
+			rlen = event_queue_wait_ms(uwsgi.master_queue, timeout, &interesting_fd);
 
 			if (rlen == 0) {
 				if (ushared->rb_timers_cnt > 0) {
@@ -773,16 +983,6 @@ int master_loop(char **argv, char **environ) {
 
 			master_check_processes();
 
-
-			// check uwsgi-cron table
-			if (ushared->cron_cnt) {
-				uwsgi_manage_signal_cron(uwsgi_now());
-			}
-
-			if (uwsgi.crons) {
-				uwsgi_manage_command_cron(uwsgi_now());
-			}
-
 			// some event returned
 			if (rlen > 0) {
 				// if the following function returns -1, a new worker has just spawned
@@ -791,150 +991,10 @@ int master_loop(char **argv, char **environ) {
 				}
 			}
 
-			now = uwsgi_now();
-			if (now - uwsgi.current_time < 1) {
-				continue;
-			}
-			uwsgi.current_time = now;
-
-			// checking logsize
-			if (uwsgi.logfile) {
-				uwsgi_check_logrotate();
-			}
-
-			// this will be incremented at (more or less) regular intervals
-			uwsgi.master_cycles++;
-
-			// recalculate requests counter on race conditions risky configurations
-			// a bit of inaccuracy is better than locking;)
-			uwsgi_master_fix_request_counters();
-
-			// check for idle
-			uwsgi_master_check_idle();
-
-			check_interval = uwsgi.master_interval;
-			if (!check_interval) {
-				check_interval = 1;
-				uwsgi.master_interval = 1;
-			}
-
-
-			// check listen_queue status
-			master_check_listen_queue();
-
-			int someone_killed = 0;
-			// check if some worker has to die (harakiri, evil checks...)
-			if (uwsgi_master_check_workers_deadline()) someone_killed++;
-			if (uwsgi_master_check_gateways_deadline()) someone_killed++;
-			if (uwsgi_master_check_mules_deadline()) someone_killed++;
-			if (uwsgi_master_check_spoolers_deadline()) someone_killed++;
-			if (uwsgi_master_check_crons_deadline()) someone_killed++;
-
-			// this could trigger a complete exit...
-			uwsgi_master_check_mountpoints();
-
-#ifdef __linux__
-#ifdef MADV_MERGEABLE
-			if (uwsgi.linux_ksm > 0 && (uwsgi.master_cycles % uwsgi.linux_ksm) == 0) {
-				uwsgi_linux_ksm_map();
-			}
-#endif
-#endif
-
-			// resubscribe every 10 cycles by default
-			if (((uwsgi.subscriptions || uwsgi.subscriptions2) && ((uwsgi.master_cycles % uwsgi.subscribe_freq) == 0 || uwsgi.master_cycles == 1)) && !uwsgi_instance_is_reloading && !uwsgi_instance_is_dying && !uwsgi.workers[0].suspended) {
-				uwsgi_subscribe_all(0, 0);
-			}
-
-			uwsgi_cache_sync_all();
-
-			if (uwsgi.queue_store && uwsgi.queue_filesize && uwsgi.queue_store_sync && ((uwsgi.master_cycles % uwsgi.queue_store_sync) == 0)) {
-				if (msync(uwsgi.queue_header, uwsgi.queue_filesize, MS_ASYNC)) {
-					uwsgi_error("msync()");
-				}
-			}
-
-			// check touch_reload
-			if (!uwsgi_instance_is_reloading && !uwsgi_instance_is_dying) {
-				char *touched = uwsgi_check_touches(uwsgi.touch_reload);
-				if (touched) {
-					uwsgi_log_verbose("*** %s has been touched... grace them all !!! ***\n", touched);
-					uwsgi_block_signal(SIGHUP);
-					grace_them_all(0);
-					uwsgi_unblock_signal(SIGHUP);
-					continue;
-				}
-				touched = uwsgi_check_touches(uwsgi.touch_workers_reload);
-				if (touched) {
-					uwsgi_log_verbose("*** %s has been touched... workers reload !!! ***\n", touched);
-					uwsgi_reload_workers();
-					continue;
-				}
-				touched = uwsgi_check_touches(uwsgi.touch_mules_reload);
-				if (touched) {
-					uwsgi_log_verbose("*** %s has been touched... mules reload !!! ***\n", touched);
-					uwsgi_reload_mules();
-					continue;
-				}
-				touched = uwsgi_check_touches(uwsgi.touch_spoolers_reload);
-				if (touched) {
-					uwsgi_log_verbose("*** %s has been touched... spoolers reload !!! ***\n", touched);
-					uwsgi_reload_spoolers();
-					continue;
-				}
-				touched = uwsgi_check_touches(uwsgi.touch_chain_reload);
-				if (touched) {
-					if (uwsgi.status.chain_reloading == 0) {
-						uwsgi_log_verbose("*** %s has been touched... chain reload !!! ***\n", touched);
-						uwsgi.status.chain_reloading = 1;
-					}
-					else {
-						uwsgi_log_verbose("*** %s has been touched... but chain reload is already running ***\n", touched);
-					}
-				}
-
-				// be sure to run it as the last touch check
-				touched = uwsgi_check_touches(uwsgi.touch_exec);
-				if (touched) {
-					if (uwsgi_run_command(touched, NULL, -1) >= 0) {
-						uwsgi_log_verbose("[uwsgi-touch-exec] running %s\n", touched);
-					}
-				}
-				touched = uwsgi_check_touches(uwsgi.touch_signal);
-				if (touched) {
-					uint8_t signum = atoi(touched);
-					uwsgi_route_signal(signum);
-					uwsgi_log_verbose("[uwsgi-touch-signal] raising %u\n", signum);
-				}
-
-				// daemon touches
-        			struct uwsgi_daemon *ud = uwsgi.daemons;
-        			while (ud) {
-                			if (ud->pid > 0 && ud->touch) {
-                        			touched = uwsgi_check_touches(ud->touch);
-						if (touched) {
-							uwsgi_log_verbose("*** %s has been touched... reloading daemon \"%s\" (pid: %d) !!! ***\n", touched, ud->command, (int) ud->pid);
-							if (kill(-ud->pid, ud->stop_signal)) {
-								// killing process group failed, try to kill by process id
-								if (kill(ud->pid, ud->stop_signal)) {
-									uwsgi_error("[uwsgi-daemon/touch] kill()");
-								}
-							}
-						}
-                			}
-					ud = ud->next;
-                		}
-
-				// hook touches
-				touched = uwsgi_check_touches(uwsgi.hook_touch);
-				if (touched) {
-					uwsgi_hooks_run((struct uwsgi_string_list *) touched, "touch", 0);
-				}
+			uwsgi.current_time = uwsgi_now();
 
-			}
-
-			// allows the KILL signal to be delivered;
-			if (someone_killed > 0) sleep(1);
+			// run the due periodic tasks
+			uwsgi_master_tasks_run();
 			continue;
 
 		}
@@ -1004,6 +1064,9 @@ int master_loop(char **argv, char **environ) {
 			if (uwsgi_daemon_check_pid_death(diedpid))
 				goto next;
 
+			if (uwsgi_master_check_warm_spares_death(diedpid, waitpid_status))
+				goto next;
+
 			if (WIFEXITED(waitpid_status)) {
 				uwsgi_log("subprocess %d exited with code %d\n", (int) diedpid, WEXITSTATUS(waitpid_status));
 			}
@@ -1092,7 +1155,7 @@ next:
 
 		// avoid fork bombing
 		gettimeofday(&last_respawn, NULL);
-		if (last_respawn.tv_sec <= uwsgi.respawn_delta + check_interval) {
+		if (last_respawn.tv_sec <= uwsgi.respawn_delta + uwsgi.master_interval) {
 			last_respawn_rate++;
 			if (last_respawn_rate > uwsgi.numproc) {
 				if (uwsgi.forkbomb_delay > 0) {
@@ -1126,6 +1189,7 @@ next:
 
 void uwsgi_reload_workers() {
 	int i;
+	uwsgi_warm_spares_kill();
 	uwsgi_block_signal(SIGHUP);
 	for (i = 1; i <= uwsgi.numproc; i++) {
 		if (uwsgi.workers[i].pid > 0) {
@@ -1164,6 +1228,7 @@ void uwsgi_reload_spoolers() {
 void uwsgi_chain_reload() {
 	if (!uwsgi.status.chain_reloading) {
 		uwsgi_log_verbose("chain reload starting...\n");
+		uwsgi_warm_spares_kill();
 		uwsgi.status.chain_reloading = 1;
 	}
 	else {
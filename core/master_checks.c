@@ -428,3 +428,25 @@ void uwsgi_master_check_mountpoints() {
 		}
 	}
 }
+
+#ifdef __linux__
+/*
+	refresh the memory breakdown of every worker from the master (the workers only update it
+	after a request, so idle ones would report stale values), shared and swapped memory show
+	how much of the copy-on-write sharing survived
+*/
+void uwsgi_master_check_memory_sharing() {
+	if (!uwsgi.memory_sharing_report) return;
+	int i;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		struct uwsgi_worker *uw = &uwsgi.workers[i];
+		if (uw->pid <= 0 || uw->cheaped) continue;
+		uint64_t uss = 0, pss = 0, shared = 0, swap = 0;
+		get_memusage_extra(uw->pid, &uss, &pss, &shared, &swap);
+		uw->uss_size = uss;
+		uw->pss_size = pss;
+		uw->shared_size = shared;
+		uw->swap_size = swap;
+	}
+}
+#endif
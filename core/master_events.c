@@ -16,6 +16,11 @@ int uwsgi_master_manage_events(int interesting_fd) {
 			uwsgi_master_req_log();
 			return 0;
 		}
+		// req log ring doorbell ?
+		if (uwsgi.req_log_ring_fd[0] > -1 && interesting_fd == uwsgi.req_log_ring_fd[0]) {
+			uwsgi_master_req_log_ring();
+			return 0;
+		}
 	}
 
 	if (uwsgi.master_fifo_fd > -1 && interesting_fd == uwsgi.master_fifo_fd) {
@@ -26,12 +31,10 @@ int uwsgi_master_manage_events(int interesting_fd) {
 		return uwsgi_notify_socket_manage(interesting_fd);
 	}
 
-	// stats server ?
-	if (uwsgi.stats && uwsgi.stats_fd > -1) {
-		if (interesting_fd == uwsgi.stats_fd) {
-			uwsgi_send_stats(uwsgi.stats_fd, uwsgi_master_generate_stats);
-			return 0;
-		}
+	// the stats server thread asks for the json document
+	if (uwsgi.stats_thread && interesting_fd == uwsgi.stats_thread->pipe[0]) {
+		uwsgi_stats_server_generate(uwsgi.stats_thread);
+		return 0;
 	}
 
 	// a zerg connection ?
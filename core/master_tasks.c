@@ -0,0 +1,251 @@
+#include <uwsgi.h>
+
+/*
+
+	uWSGI master tasks
+
+	the periodic work of the master (harakiri checks, crons, touches, subscriptions...) is
+	registered as a list of tasks scheduled on a hierarchical timer wheel, so the master loop
+	can sleep exactly until the next task is due (instead of waking up at fixed intervals and
+	checking everything).
+
+	the wheel has 4 levels of 64 slots with a tick of 1 millisecond (the first level covers
+	64 milliseconds, the last one ~4.6 hours). Tasks are moved (cascaded) to the lower levels
+	when the wheel reaches their slot.
+
+	the time (and the number of runs) of each task is accounted and exported by the stats server.
+
+*/
+
+extern struct uwsgi_server uwsgi;
+
+#define UWSGI_WHEEL_BITS 6
+#define UWSGI_WHEEL_SLOTS (1 << UWSGI_WHEEL_BITS)
+#define UWSGI_WHEEL_MASK (UWSGI_WHEEL_SLOTS - 1)
+#define UWSGI_WHEEL_LEVELS 4
+#define UWSGI_WHEEL_MAX (((uint64_t) 1 << (UWSGI_WHEEL_BITS * UWSGI_WHEEL_LEVELS)) - 1)
+
+static struct uwsgi_master_wheel {
+	// the next tick to process (milliseconds)
+	uint64_t current;
+	struct uwsgi_master_task *slots[UWSGI_WHEEL_LEVELS][UWSGI_WHEEL_SLOTS];
+	// non-empty slots of each level
+	uint64_t bitmap[UWSGI_WHEEL_LEVELS];
+} *umw = NULL;
+
+// the wheel is not affected by changes of the system time
+static uint64_t uwsgi_master_tasks_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static void uwsgi_master_wheel_add(struct uwsgi_master_task *umt) {
+	uint64_t expires = umt->expires;
+	if (expires < umw->current) expires = umw->current;
+	uint64_t delta = expires - umw->current;
+	if (delta > UWSGI_WHEEL_MAX) {
+		expires = umw->current + UWSGI_WHEEL_MAX;
+		delta = UWSGI_WHEEL_MAX;
+	}
+
+	int level = 0;
+	while (level < UWSGI_WHEEL_LEVELS - 1 && delta >= ((uint64_t) 1 << (UWSGI_WHEEL_BITS * (level + 1)))) {
+		level++;
+	}
+	int slot = (expires >> (UWSGI_WHEEL_BITS * level)) & UWSGI_WHEEL_MASK;
+
+	umt->level = level;
+	umt->slot = slot;
+	umt->wheel_prev = NULL;
+	umt->wheel_next = umw->slots[level][slot];
+	if (umt->wheel_next) umt->wheel_next->wheel_prev = umt;
+	umw->slots[level][slot] = umt;
+	umw->bitmap[level] |= (uint64_t) 1 << slot;
+}
+
+static void uwsgi_master_wheel_del(struct uwsgi_master_task *umt) {
+	if (umt->wheel_prev) {
+		umt->wheel_prev->wheel_next = umt->wheel_next;
+	}
+	else {
+		umw->slots[umt->level][umt->slot] = umt->wheel_next;
+		if (!umt->wheel_next) {
+			umw->bitmap[umt->level] &= ~((uint64_t) 1 << umt->slot);
+		}
+	}
+	if (umt->wheel_next) umt->wheel_next->wheel_prev = umt->wheel_prev;
+	umt->wheel_next = NULL;
+	umt->wheel_prev = NULL;
+}
+
+// move the tasks of a slot of an upper level to the lower ones
+static void uwsgi_master_wheel_cascade(int level, int slot) {
+	struct uwsgi_master_task *umt = umw->slots[level][slot];
+	umw->slots[level][slot] = NULL;
+	umw->bitmap[level] &= ~((uint64_t) 1 << slot);
+	while (umt) {
+		struct uwsgi_master_task *next = umt->wheel_next;
+		uwsgi_master_wheel_add(umt);
+		umt = next;
+	}
+}
+
+/*
+	register a periodic task (interval and delay of the first run in milliseconds),
+	must be called in the master
+*/
+struct uwsgi_master_task *uwsgi_master_task_register(char *name, uint64_t delay, uint64_t interval, void (*func) (void)) {
+	if (!umw) {
+		umw = uwsgi_calloc(sizeof(struct uwsgi_master_wheel));
+		umw->current = uwsgi_master_tasks_now();
+	}
+
+	struct uwsgi_master_task *umt = uwsgi_calloc(sizeof(struct uwsgi_master_task));
+	umt->name = name;
+	umt->interval = interval ? interval : 1;
+	umt->func = func;
+	umt->expires = uwsgi_master_tasks_now() + delay;
+
+	struct uwsgi_master_task *tasks = uwsgi.master_tasks;
+	if (!tasks) {
+		uwsgi.master_tasks = umt;
+	}
+	else {
+		while (tasks->next) tasks = tasks->next;
+		tasks->next = umt;
+	}
+
+	uwsgi_master_wheel_add(umt);
+	return umt;
+}
+
+// register a periodic task whose function receives the given object
+struct uwsgi_master_task *uwsgi_master_task_register_data(char *name, uint64_t delay, uint64_t interval, void (*func) (void *), void *data) {
+	struct uwsgi_master_task *umt = uwsgi_master_task_register(name, delay, interval, NULL);
+	umt->func_data = func;
+	umt->data = data;
+	return umt;
+}
+
+// milliseconds before the next task is due (-1 if there are no tasks)
+int uwsgi_master_tasks_timeout() {
+	if (!umw) return -1;
+
+	uint64_t now = uwsgi_master_tasks_now();
+	uint64_t next = 0;
+	int level;
+	for (level = 0; level < UWSGI_WHEEL_LEVELS; level++) {
+		if (!umw->bitmap[level]) continue;
+		int shift = UWSGI_WHEEL_BITS * level;
+		uint64_t pos = (umw->current >> shift) & UWSGI_WHEEL_MASK;
+		// rotate the bitmap so the slot of the current tick is the first one
+		uint64_t bitmap = umw->bitmap[level];
+		if (pos) bitmap = (bitmap >> pos) | (bitmap << (UWSGI_WHEEL_SLOTS - pos));
+		// the slot of the current tick of the upper levels has already been cascaded (it is a full round away)
+		if (level > 0) bitmap = (bitmap >> 1) | ((bitmap & 1) << (UWSGI_WHEEL_SLOTS - 1));
+		uint64_t distance = __builtin_ctzll(bitmap) + (level > 0 ? 1 : 0);
+		// when the slot will be processed (the first tick of its range for the upper levels)
+		uint64_t tick = level ? (((umw->current >> shift) + distance) << shift) : umw->current + distance;
+		if (!next || tick < next) next = tick;
+	}
+
+	if (!next) return -1;
+	if (next <= now) return 0;
+	uint64_t delta = next - now;
+	if (delta > INT_MAX) return INT_MAX;
+	return (int) delta;
+}
+
+// run the due tasks
+void uwsgi_master_tasks_run() {
+	if (!umw) return;
+
+	uint64_t now = uwsgi_master_tasks_now();
+	// the master has been stopped for a long time (e.g. SIGSTOP), do not walk every tick
+	if (now > umw->current + UWSGI_WHEEL_SLOTS * UWSGI_WHEEL_SLOTS) {
+		struct uwsgi_master_task *umt;
+		for (umt = uwsgi.master_tasks; umt; umt = umt->next) {
+			uwsgi_master_wheel_del(umt);
+		}
+		umw->current = now;
+		for (umt = uwsgi.master_tasks; umt; umt = umt->next) {
+			uwsgi_master_wheel_add(umt);
+		}
+	}
+
+	while (umw->current <= now) {
+		int slot = umw->current & UWSGI_WHEEL_MASK;
+		int level;
+		// entering a new range of the upper levels
+		for (level = 1; level < UWSGI_WHEEL_LEVELS; level++) {
+			int shift = UWSGI_WHEEL_BITS * level;
+			if (umw->current & (((uint64_t) 1 << shift) - 1)) break;
+			uwsgi_master_wheel_cascade(level, (umw->current >> shift) & UWSGI_WHEEL_MASK);
+		}
+
+		struct uwsgi_master_task *umt = umw->slots[0][slot];
+		umw->slots[0][slot] = NULL;
+		umw->bitmap[0] &= ~((uint64_t) 1 << slot);
+		while (umt) {
+			struct uwsgi_master_task *next = umt->wheel_next;
+			umt->wheel_next = NULL;
+			umt->wheel_prev = NULL;
+			uint64_t start = uwsgi_micros();
+			if (umt->func_data) {
+				umt->func_data(umt->data);
+			}
+			else {
+				umt->func();
+			}
+			uint64_t elapsed = uwsgi_micros() - start;
+			umt->runs++;
+			umt->total_usecs += elapsed;
+			umt->last_usecs = elapsed;
+			if (elapsed > umt->max_usecs) umt->max_usecs = elapsed;
+			// avoid drifting, but skip the missed runs
+			umt->expires += umt->interval;
+			uint64_t after = uwsgi_master_tasks_now();
+			if (umt->expires <= after) umt->expires = after + umt->interval;
+			uwsgi_master_wheel_add(umt);
+			umt = next;
+		}
+		umw->current++;
+		// a long task could have moved the clock
+		if (umw->current > now) {
+			uint64_t after = uwsgi_master_tasks_now();
+			if (after > now) now = after;
+		}
+	}
+}
+
+// reschedule a task (e.g. after a change of its interval)
+void uwsgi_master_task_reschedule(struct uwsgi_master_task *umt, uint64_t delay) {
+	if (!umw) return;
+	uwsgi_master_wheel_del(umt);
+	umt->expires = uwsgi_master_tasks_now() + delay;
+	uwsgi_master_wheel_add(umt);
+}
+
+// the "master_tasks" list of the stats json
+int uwsgi_stats_master_tasks(struct uwsgi_stats *us) {
+	if (!uwsgi.master_tasks) return 0;
+
+	if (uwsgi_stats_key(us, "master_tasks")) return -1;
+	if (uwsgi_stats_list_open(us)) return -1;
+	struct uwsgi_master_task *umt = uwsgi.master_tasks;
+	while(umt) {
+		if (uwsgi_stats_object_open(us)) return -1;
+		if (uwsgi_stats_keyval_comma(us, "name", umt->name)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "interval", (unsigned long long) umt->interval)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "runs", (unsigned long long) umt->runs)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "total_usecs", (unsigned long long) umt->total_usecs)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "last_usecs", (unsigned long long) umt->last_usecs)) return -1;
+		if (uwsgi_stats_keylong(us, "max_usecs", (unsigned long long) umt->max_usecs)) return -1;
+		if (uwsgi_stats_object_close(us)) return -1;
+		umt = umt->next;
+		if (umt && uwsgi_stats_comma(us)) return -1;
+	}
+	if (uwsgi_stats_list_close(us)) return -1;
+	return uwsgi_stats_comma(us);
+}
@@ -50,6 +50,8 @@ void uwsgi_destroy_processes() {
 	int i;
 	int waitpid_status;
 
+	uwsgi_warm_spares_kill();
+
         uwsgi_signal_spoolers(SIGKILL);
 
         uwsgi_detach_daemons();
@@ -461,6 +463,199 @@ int uwsgi_cheaper_algo_backlog(int can_spawn) {
 }
 
 
+/*
+	-- Cheaper, predictive algorithm --
+
+	The other algorithms react when the workers are already busy (or the listen queue is growing), while
+	new workers need time (app loading) before accepting requests.
+
+	At every check the arrival rate of requests (completed requests plus the growth of the listen queue
+	and of the busy cores) is smoothed with an EWMA and its trend is followed with Holt's linear method.
+	The rate is forecasted at the time a new worker would be ready (the measured spawn time of the workers
+	plus a check cycle, or --cheaper-predictive-horizon) and Little's law (busy cores = rate * service time,
+	the service time is measured from the running time of the workers) gives the cores needed to keep them
+	under --cheaper-predictive-utilization. The missing workers are spawned (at most cheaper-step for each check)
+	before the load arrives.
+
+	When all of the workers are busy a worker is always spawned (the forecast could be wrong).
+	Workers are cheaped one at a time when the target stays under the active workers for cheaper-idle checks.
+
+	The forecasts are exposed in the stats ("cheaper_predictive").
+*/
+
+#define UWSGI_CHEAPER_PREDICTIVE_ALPHA 0.5
+#define UWSGI_CHEAPER_PREDICTIVE_BETA 0.3
+
+static struct uwsgi_cheaper_predictive {
+	uint64_t *requests;
+	uint64_t *running_time;
+	time_t *spawned;
+	int ready;
+	uint64_t last_check;
+	uint64_t last_pending;
+	// requests per second
+	double rate;
+	double level;
+	// requests per second, per second
+	double trend;
+	double forecast;
+	// seconds
+	double service_time;
+	double spawn_time;
+	double horizon;
+	int target;
+	int active;
+	int idle_count;
+} cheaper_predictive;
+
+static void cheaper_predictive_spawn_time(int wid, time_t now) {
+	struct uwsgi_worker *uw = &uwsgi.workers[wid];
+	if (uw->cheaped || uw->pid <= 0) {
+		cheaper_predictive.spawned[wid] = 0;
+		return;
+	}
+	// the time between the fork() and the first accept
+	if (uw->last_spawn != cheaper_predictive.spawned[wid]) {
+		if (!uw->accepting) return;
+		double spawn_time = now - uw->last_spawn;
+		if (spawn_time < 0) spawn_time = 0;
+		cheaper_predictive.spawn_time = cheaper_predictive.spawn_time ?
+			(UWSGI_CHEAPER_PREDICTIVE_ALPHA * spawn_time) + ((1 - UWSGI_CHEAPER_PREDICTIVE_ALPHA) * cheaper_predictive.spawn_time) : spawn_time;
+		cheaper_predictive.spawned[wid] = uw->last_spawn;
+	}
+}
+
+int uwsgi_cheaper_algo_predictive(int can_spawn) {
+	struct uwsgi_cheaper_predictive *ucp = &cheaper_predictive;
+	int i, j;
+	uint64_t now = uwsgi_micros();
+
+	if (!ucp->requests) {
+		ucp->requests = uwsgi_calloc(sizeof(uint64_t) * (uwsgi.numproc + 1));
+		ucp->running_time = uwsgi_calloc(sizeof(uint64_t) * (uwsgi.numproc + 1));
+		ucp->spawned = uwsgi_calloc(sizeof(time_t) * (uwsgi.numproc + 1));
+	}
+
+	uint64_t completed = 0;
+	uint64_t running_time = 0;
+	uint64_t pending = 0;
+	int active_workers = 0;
+	int busy_workers = 0;
+	int cheaped_workers = 0;
+
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		struct uwsgi_worker *uw = &uwsgi.workers[i];
+		// the counters restart after a respawn
+		completed += uw->requests >= ucp->requests[i] ? uw->requests - ucp->requests[i] : uw->requests;
+		running_time += uw->running_time >= ucp->running_time[i] ? uw->running_time - ucp->running_time[i] : uw->running_time;
+		ucp->requests[i] = uw->requests;
+		ucp->running_time[i] = uw->running_time;
+		cheaper_predictive_spawn_time(i, now / 1000000);
+		if (uw->cheaped == 1 && uw->pid == 0) {
+			cheaped_workers++;
+			continue;
+		}
+		if (uw->cheaped || uw->pid <= 0) continue;
+		active_workers++;
+		if (uwsgi_worker_is_busy(i)) busy_workers++;
+		for (j = 0; j < uwsgi.cores; j++) {
+			if (uw->cores[j].in_request) pending++;
+		}
+	}
+#ifdef __linux__
+	pending += uwsgi.shared->backlog;
+#endif
+
+	ucp->active = active_workers;
+
+	if (!ucp->ready) {
+		ucp->ready = 1;
+		ucp->last_check = now;
+		ucp->last_pending = pending;
+		return 0;
+	}
+
+	double elapsed = (now - ucp->last_check) / 1000000.0;
+	if (elapsed <= 0) return 0;
+	ucp->last_check = now;
+
+	// arrivals = completed requests + growth of the queued/running ones
+	double arrivals = (double) completed + (double) pending - (double) ucp->last_pending;
+	ucp->last_pending = pending;
+	ucp->rate = arrivals > 0 ? arrivals / elapsed : 0;
+
+	// Holt's linear method
+	double previous_level = ucp->level;
+	ucp->level = (UWSGI_CHEAPER_PREDICTIVE_ALPHA * ucp->rate) + ((1 - UWSGI_CHEAPER_PREDICTIVE_ALPHA) * (ucp->level + (ucp->trend * elapsed)));
+	ucp->trend = (UWSGI_CHEAPER_PREDICTIVE_BETA * ((ucp->level - previous_level) / elapsed)) + ((1 - UWSGI_CHEAPER_PREDICTIVE_BETA) * ucp->trend);
+
+	if (completed > 0) {
+		double service_time = (running_time / 1000000.0) / completed;
+		ucp->service_time = ucp->service_time ?
+			(UWSGI_CHEAPER_PREDICTIVE_ALPHA * service_time) + ((1 - UWSGI_CHEAPER_PREDICTIVE_ALPHA) * ucp->service_time) : service_time;
+	}
+
+	ucp->horizon = uwsgi.cheaper_predictive_horizon > 0 ? uwsgi.cheaper_predictive_horizon : ucp->spawn_time + elapsed;
+	ucp->forecast = ucp->level + (ucp->trend * ucp->horizon);
+	if (ucp->forecast < 0) ucp->forecast = 0;
+
+	// Little's law
+	int utilization = uwsgi.cheaper_predictive_utilization > 0 && uwsgi.cheaper_predictive_utilization <= 100 ? uwsgi.cheaper_predictive_utilization : 75;
+	double cores = (ucp->forecast * ucp->service_time) / (utilization / 100.0);
+	ucp->target = (int) ceil(cores / uwsgi.cores);
+	if (ucp->target < uwsgi.cheaper_count) ucp->target = uwsgi.cheaper_count;
+	if (ucp->target > uwsgi.numproc) ucp->target = uwsgi.numproc;
+
+#ifdef UWSGI_DEBUG
+	uwsgi_log("cheaper-predictive: rate=%.2f level=%.2f trend=%.2f forecast=%.2f service_time=%.4f horizon=%.1f target=%d active=%d\n",
+		ucp->rate, ucp->level, ucp->trend, ucp->forecast, ucp->service_time, ucp->horizon, ucp->target, active_workers);
+#endif
+
+	if (ucp->target > active_workers || (active_workers > 0 && busy_workers >= active_workers)) {
+		ucp->idle_count = 0;
+		if (!can_spawn) return 0;
+		int spawn = ucp->target - active_workers;
+		int step = uwsgi.cheaper_step > 0 ? uwsgi.cheaper_step : 1;
+		if (spawn < 1) spawn = 1;
+		if (spawn > step) spawn = step;
+		if (spawn > cheaped_workers) spawn = cheaped_workers;
+		return spawn;
+	}
+
+	if (ucp->target == active_workers) {
+		ucp->idle_count = 0;
+		return 0;
+	}
+
+	ucp->idle_count++;
+	if (ucp->idle_count < uwsgi.cheaper_idle) return 0;
+	ucp->idle_count = 0;
+	return -1;
+}
+
+/*
+	"cheaper_predictive": {"rate_rpm": N, "trend_rpm": N, "forecast_rpm": N, ...},
+*/
+static int uwsgi_stats_cheaper_predictive(struct uwsgi_stats *us) {
+	if (uwsgi.cheaper_algo != uwsgi_cheaper_algo_predictive) return 0;
+	struct uwsgi_cheaper_predictive *ucp = &cheaper_predictive;
+	if (uwsgi_stats_key(us, "cheaper_predictive")) return -1;
+	if (uwsgi_stats_object_open(us)) return -1;
+	// requests per minute, to keep some precision with integers
+	if (uwsgi_stats_keylong_comma(us, "rate_rpm", (unsigned long long) (ucp->rate * 60))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "level_rpm", (unsigned long long) (ucp->level * 60))) return -1;
+	if (uwsgi_stats_keyslong_comma(us, "trend_rpm", (long long) (ucp->trend * 60))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "forecast_rpm", (unsigned long long) (ucp->forecast * 60))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "service_time_us", (unsigned long long) (ucp->service_time * 1000000))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "spawn_time_ms", (unsigned long long) (ucp->spawn_time * 1000))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "horizon_ms", (unsigned long long) (ucp->horizon * 1000))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "target_workers", (unsigned long long) ucp->target)) return -1;
+	if (uwsgi_stats_keylong(us, "active_workers", (unsigned long long) ucp->active)) return -1;
+	if (uwsgi_stats_object_close(us)) return -1;
+	return uwsgi_stats_comma(us);
+}
+
+
 // reload uWSGI, close unneded file descriptor, restore the original environment and re-exec the binary
 
 void uwsgi_reload(char **argv) {
@@ -642,11 +837,13 @@ void uwsgi_fixup_fds(int wid, int muleid, struct uwsgi_gateway *ug) {
 		for (i = 1; i <= uwsgi.numproc; i++) {
 			if (uwsgi.workers[i].signal_pipe[0] != -1)
 				close(uwsgi.workers[i].signal_pipe[0]);
-			if (i != wid) {
+			// a warm spare does not know which worker it will become, it closes the others when promoted
+			if (i != wid && wid <= uwsgi.numproc) {
 				if (uwsgi.workers[i].signal_pipe[1] != -1)
 					close(uwsgi.workers[i].signal_pipe[1]);
 			}
 		}
+		uwsgi_warm_spares_close_pipes();
 
 		
 		if (uwsgi.shared->spooler_signal_pipe[0] != -1)
@@ -710,6 +907,283 @@ void uwsgi_fixup_fds(int wid, int muleid, struct uwsgi_gateway *ug) {
 
 }
 
+/*
+	--freeze-heaps: before forking a worker the language plugins collect the garbage and move the
+	surviving objects out of the reach of their collectors (e.g. gc.freeze() in python), so the
+	workers do not dirty the pages inherited from the master while scanning them
+*/
+void uwsgi_freeze_heaps() {
+	int i;
+	for (i = 0; i < 256; i++) {
+		if (uwsgi.p[i]->freeze_heap) {
+			uwsgi.p[i]->freeze_heap();
+		}
+	}
+	for (i = 0; i < uwsgi.gp_cnt; i++) {
+		if (uwsgi.gp[i]->freeze_heap) {
+			uwsgi.gp[i]->freeze_heap();
+		}
+	}
+}
+
+/*
+	warm spares
+
+	--warm-spares N keeps N workers forked in advance: they run the post-fork hooks, load the apps
+	(in lazy mode) and park on a socketpair with the master. When a worker has to be respawned
+	(recycled, harakiri, cheaper...) the master hands its id to a ready spare instead of forking,
+	so the capacity is restored instantly (the pool is refilled in the background).
+
+	spares live in the worker slots after numproc. On promotion the master swaps the apps and
+	cores memory areas of the two slots (the pointers stored in the spare process remain valid)
+	and sends the worker id to the spare. Spares are destroyed on every reload (their code
+	could be outdated).
+
+	the master side of the socketpairs is tracked in process memory (not in the shared slots),
+	so every child closes exactly the descriptors it inherited.
+*/
+
+static int *uwsgi_warm_spares_pipes = NULL;
+// the spare side of the socketpair (valid only in spares)
+static int uwsgi_warm_spare_fd = -1;
+
+void uwsgi_warm_spares_close_pipes() {
+	int i;
+	if (!uwsgi_warm_spares_pipes) return;
+	for (i = 0; i < uwsgi.warm_spares; i++) {
+		if (uwsgi_warm_spares_pipes[i] != -1) {
+			close(uwsgi_warm_spares_pipes[i]);
+			uwsgi_warm_spares_pipes[i] = -1;
+		}
+	}
+}
+
+static void uwsgi_warm_spare_release(int slot) {
+	struct uwsgi_worker *spare = &uwsgi.workers[slot];
+	int *fd = &uwsgi_warm_spares_pipes[slot - uwsgi.numproc - 1];
+	if (*fd != -1) {
+		close(*fd);
+		*fd = -1;
+	}
+	spare->pid = 0;
+	spare->accepting = 0;
+}
+
+static int uwsgi_warm_spare_promote(int wid) {
+	int i, j;
+	if (!uwsgi.warm_spares) return 0;
+	struct uwsgi_worker *uw = &uwsgi.workers[wid];
+	for (i = uwsgi.numproc + 1; i <= uwsgi.numproc + uwsgi.warm_spares; i++) {
+		struct uwsgi_worker *spare = &uwsgi.workers[i];
+		// still loading
+		if (spare->pid <= 0 || !spare->accepting) continue;
+		// the counters of the cores survive the respawn
+		for (j = 0; j < uwsgi.cores; j++) {
+			struct uwsgi_core *uc = &uw->cores[j];
+			struct uwsgi_core *sc = &spare->cores[j];
+			sc->requests = uc->requests;
+			sc->failed_requests = uc->failed_requests;
+			sc->static_requests = uc->static_requests;
+			sc->routed_requests = uc->routed_requests;
+			sc->offloaded_requests = uc->offloaded_requests;
+			sc->write_errors = uc->write_errors;
+			sc->read_errors = uc->read_errors;
+			sc->exceptions = uc->exceptions;
+		}
+		struct uwsgi_core *cores = uw->cores;
+		struct uwsgi_app *apps = uw->apps;
+		uw->cores = spare->cores;
+		uw->apps = spare->apps;
+		uw->apps_cnt = spare->apps_cnt;
+		spare->cores = cores;
+		spare->apps = apps;
+		if (write(uwsgi_warm_spares_pipes[i - uwsgi.numproc - 1], &wid, sizeof(int)) != sizeof(int)) {
+			uwsgi_error("uwsgi_warm_spare_promote()/write()");
+			spare->apps = uw->apps;
+			spare->cores = uw->cores;
+			uw->apps = apps;
+			uw->cores = cores;
+			kill(spare->pid, SIGKILL);
+			continue;
+		}
+		uw->pid = spare->pid;
+		if (uw->respawn_count > 1) {
+			uwsgi_log("Respawned uWSGI worker %d (warm spare %d promoted, pid: %d)\n", wid, i - uwsgi.numproc, (int) spare->pid);
+		}
+		else {
+			uwsgi_log("spawned uWSGI worker %d (warm spare %d promoted, pid: %d, cores: %d)\n", wid, i - uwsgi.numproc, (int) spare->pid, uwsgi.cores);
+		}
+		uwsgi_warm_spare_release(i);
+		return 1;
+	}
+	return 0;
+}
+
+static int uwsgi_warm_spare_spawn(int slot) {
+	int i;
+	int fds[2];
+	struct uwsgi_worker *spare = &uwsgi.workers[slot];
+
+	if (!uwsgi_warm_spares_pipes) {
+		uwsgi_warm_spares_pipes = uwsgi_malloc(sizeof(int) * uwsgi.warm_spares);
+		for (i = 0; i < uwsgi.warm_spares; i++) {
+			uwsgi_warm_spares_pipes[i] = -1;
+		}
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		uwsgi_error("uwsgi_warm_spare_spawn()/socketpair()");
+		return 0;
+	}
+
+	if (uwsgi.freeze_heaps) {
+		uwsgi_freeze_heaps();
+	}
+
+	// set before forking, so the spare closes it with the others
+	uwsgi_warm_spares_pipes[slot - uwsgi.numproc - 1] = fds[0];
+	spare->accepting = 0;
+	spare->last_spawn = uwsgi.current_time;
+	spare->respawn_count++;
+
+	if (uwsgi.threaded_logger) {
+		pthread_mutex_lock(&uwsgi.threaded_logger_lock);
+	}
+
+	pid_t pid = uwsgi_fork(spare->name);
+	if (pid == 0) {
+		uwsgi.mywid = slot;
+		uwsgi.mypid = getpid();
+		uwsgi.i_am_a_warm_spare = slot;
+		uwsgi_warm_spare_fd = fds[1];
+		spare->id = slot;
+		spare->apps_cnt = uwsgi.workers[0].apps_cnt;
+		for (i = 0; i < uwsgi.cores; i++) {
+			spare->cores[i].in_request = 0;
+			memset(&spare->cores[i].req, 0, sizeof(struct wsgi_request));
+			memset(spare->cores[i].buffer, 0, sizeof(struct uwsgi_header));
+		}
+
+		uwsgi_fixup_fds(slot, 0, NULL);
+
+		// the master handlers are meaningless here, a parked spare can simply die
+		signal(SIGHUP, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+
+		for (i = 0; i < 256; i++) {
+			if (uwsgi.p[i]->master_fixup) {
+				uwsgi.p[i]->master_fixup(1);
+			}
+		}
+
+		if (uwsgi.threaded_logger) {
+			pthread_mutex_unlock(&uwsgi.threaded_logger_lock);
+		}
+		return 1;
+	}
+
+	close(fds[1]);
+	if (pid < 0) {
+		uwsgi_error("uwsgi_warm_spare_spawn()/fork()");
+		uwsgi_warm_spare_release(slot);
+	}
+	else {
+		spare->pid = pid;
+		uwsgi_log("spawned uWSGI warm spare %d (pid: %d)\n", slot - uwsgi.numproc, (int) pid);
+	}
+
+	if (uwsgi.threaded_logger) {
+		pthread_mutex_unlock(&uwsgi.threaded_logger_lock);
+	}
+	return 0;
+}
+
+// refill the pool, returns 1 in the new spare
+int uwsgi_master_check_warm_spares() {
+	int i;
+	for (i = uwsgi.numproc + 1; i <= uwsgi.numproc + uwsgi.warm_spares; i++) {
+		if (uwsgi.workers[i].pid > 0) continue;
+		// do not respawn a failing spare more than once per second
+		if (uwsgi.workers[i].last_spawn >= uwsgi_now()) continue;
+		if (uwsgi_warm_spare_spawn(i)) return 1;
+	}
+	return 0;
+}
+
+int uwsgi_master_check_warm_spares_death(pid_t diedpid, int waitpid_status) {
+	int i;
+	for (i = uwsgi.numproc + 1; i <= uwsgi.numproc + uwsgi.warm_spares; i++) {
+		if (uwsgi.workers[i].pid != diedpid) continue;
+		if (WIFEXITED(waitpid_status) && WEXITSTATUS(waitpid_status) == UWSGI_FAILED_APP_CODE) {
+			uwsgi_log("OOPS ! failed loading app in warm spare %d (pid %d) :( trying again...\n", i - uwsgi.numproc, (int) diedpid);
+		}
+		else {
+			uwsgi_log("warm spare %d (pid: %d) died\n", i - uwsgi.numproc, (int) diedpid);
+		}
+		uwsgi_warm_spare_release(i);
+		return 1;
+	}
+	return 0;
+}
+
+// the spares could run outdated code after a reload
+void uwsgi_warm_spares_kill() {
+	int i;
+	int waitpid_status;
+	for (i = uwsgi.numproc + 1; i <= uwsgi.numproc + uwsgi.warm_spares; i++) {
+		struct uwsgi_worker *spare = &uwsgi.workers[i];
+		if (spare->pid <= 0) continue;
+		kill(spare->pid, SIGKILL);
+		if (waitpid(spare->pid, &waitpid_status, 0) < 0) {
+			uwsgi_error("uwsgi_warm_spares_kill()/waitpid()");
+		}
+		uwsgi_log("warm spare %d (pid: %d) destroyed\n", i - uwsgi.numproc, (int) spare->pid);
+		uwsgi_warm_spare_release(i);
+	}
+}
+
+// run by the spare when ready, it returns when promoted to worker
+void uwsgi_warm_spare_wait() {
+	int i;
+	int wid = 0;
+	int slot = uwsgi.mywid;
+
+	uwsgi.workers[slot].accepting = 1;
+
+	for (;;) {
+		ssize_t rlen = read(uwsgi_warm_spare_fd, &wid, sizeof(int));
+		if (rlen == sizeof(int)) break;
+		if (rlen < 0 && errno == EINTR) continue;
+		// the master is gone
+		exit(0);
+	}
+	close(uwsgi_warm_spare_fd);
+	uwsgi_warm_spare_fd = -1;
+
+	// from now on the apps and cores areas of the slot are the ones of the worker
+	uwsgi.mywid = wid;
+	uwsgi.workers[wid].id = wid;
+	uwsgi.workers[wid].manage_next_request = 1;
+
+	uwsgi_rpc_copy(slot, wid);
+	uwsgi_signal_table_copy(slot, wid);
+
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		if (i != wid && uwsgi.workers[i].signal_pipe[1] != -1)
+			close(uwsgi.workers[i].signal_pipe[1]);
+	}
+	uwsgi.my_signal_socket = uwsgi.workers[wid].signal_pipe[1];
+
+	signal(SIGWINCH, worker_wakeup);
+	signal(SIGTSTP, worker_wakeup);
+
+	if (uwsgi.auto_procname && !uwsgi.procname) {
+		uwsgi_set_processname(uwsgi.workers[wid].name);
+	}
+}
+
 int uwsgi_respawn_worker(int wid) {
 	int i;
 	int respawns = uwsgi.workers[wid].respawn_count;
@@ -743,6 +1217,14 @@ int uwsgi_respawn_worker(int wid) {
 	// this is required for various checks
 	uwsgi.workers[wid].delta_requests = 0;
 
+	// a ready warm spare becomes the new worker without forking
+	if (uwsgi_warm_spare_promote(wid))
+		return 0;
+
+	if (uwsgi.freeze_heaps) {
+		uwsgi_freeze_heaps();
+	}
+
 	if (uwsgi.threaded_logger) {
 		pthread_mutex_lock(&uwsgi.threaded_logger_lock);
 	}
@@ -1043,6 +1525,11 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 				goto end;
 			} 
 
+			if (um->dist && uwsgi_stats_metric_distribution(us, um)) {
+				uwsgi_rwunlock(uwsgi.metrics_lock);
+				goto end;
+			}
+
 			if (uwsgi_stats_object_close(us)) {
                                 uwsgi_rwunlock(uwsgi.metrics_lock);
                                 goto end;
@@ -1065,6 +1552,29 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 		goto end;
 	}
 
+	if (uwsgi_stats_latency(us))
+		goto end;
+
+	if (uwsgi_stats_request_accounting(us))
+		goto end;
+	if (uwsgi_stats_profiler(us))
+		goto end;
+
+	if (uwsgi_stats_master_tasks(us))
+		goto end;
+
+	if (uwsgi_stats_cheaper_predictive(us))
+		goto end;
+
+	if (uwsgi_stats_static_store(us))
+		goto end;
+
+	if (uwsgi_stats_offload(us))
+		goto end;
+
+	if (uwsgi_stats_websockets_hub(us))
+		goto end;
+
 	if (uwsgi_stats_key(us, "sockets"))
 		goto end;
 
@@ -1174,6 +1684,10 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 			goto end;
 		if (uwsgi_stats_keylong_comma(us, "pss", (unsigned long long) uwsgi.workers[i + 1].pss_size))
 			goto end;
+		if (uwsgi_stats_keylong_comma(us, "shared", (unsigned long long) uwsgi.workers[i + 1].shared_size))
+			goto end;
+		if (uwsgi_stats_keylong_comma(us, "swap", (unsigned long long) uwsgi.workers[i + 1].swap_size))
+			goto end;
 
 		if (uwsgi_stats_keylong_comma(us, "running_time", (unsigned long long) uwsgi.workers[i + 1].running_time))
 			goto end;
@@ -1187,6 +1701,19 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 		if (uwsgi_stats_keylong_comma(us, "avg_rt", (unsigned long long) uwsgi.workers[i + 1].avg_response_time))
 			goto end;
 
+		if (uwsgi_stats_latency_worker(us, i + 1))
+			goto end;
+
+		struct uwsgi_log_ring *ring = uwsgi.workers[i + 1].req_log_ring;
+		if (ring) {
+			if (uwsgi_stats_keylong_comma(us, "req_log_lines", (unsigned long long) ring->lines))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "req_log_dropped", (unsigned long long) ring->dropped))
+				goto end;
+			if (uwsgi_stats_keylong_comma(us, "req_log_blocked", (unsigned long long) ring->blocked))
+				goto end;
+		}
+
 		// applications list
 		if (uwsgi_stats_key(us, "apps"))
 			goto end;
@@ -1273,6 +1800,17 @@ struct uwsgi_stats *uwsgi_master_generate_stats() {
 			if (uwsgi_stats_keylong_comma(us, "read_errors", (unsigned long long) uc->read_errors))
 				goto end;
 
+			if (uwsgi.request_acct) {
+				if (uwsgi_stats_keylong_comma(us, "cpu_time", (unsigned long long) uc->cpu_time))
+					goto end;
+				if (uwsgi_stats_keylong_comma(us, "vcsw", (unsigned long long) uc->vcsw))
+					goto end;
+				if (uwsgi_stats_keylong_comma(us, "ivcsw", (unsigned long long) uc->ivcsw))
+					goto end;
+				if (uwsgi_stats_keylong_comma(us, "minflt", (unsigned long long) uc->minflt))
+					goto end;
+			}
+
 			if (uwsgi_stats_keylong_comma(us, "in_request", (unsigned long long) uc->in_request))
 				goto end;
 
@@ -53,7 +53,20 @@ extern struct uwsgi_server uwsgi;
 
 	uwsgi.metric_get("worker.1.requests")
 
-	Updating metrics from your app MUST BE ATOMIC, for such a reason a uWSGI rwlock is initialized on startup and used for each operation (simple reading from a metric does not require locking)
+	Updating metrics from your app MUST BE ATOMIC: the metrics without a collector are sharded, every worker core (worker 0 is used by
+	the other processes) has its own slots in shared memory updated with atomic ops (increments and observations never take a lock).
+	The value of the metric is the sum of its base and of the shards, it is aggregated by the metrics collector thread (uwsgi_metric_get()
+	computes it on demand). The operations needing the whole value (set, mul, div...) take the uWSGI rwlock and move the base.
+
+	Lookups by name use a hash index built on startup, hot paths can resolve a metric once with uwsgi_metric_handle()
+	and use the uwsgi_metric_handle_*() functions.
+
+	Two more types collect distributions of values (uwsgi.metric_observe("foo", N)):
+
+	histogram	the count of the values lower or equal than each bound (--metric name=foo,type=histogram,buckets=10;50;100)
+	summary		the quantiles of the values (--metric name=foo,type=summary,quantiles=0.5;0.9;0.99)
+
+	their value is the number of observations, the sum, max, buckets and quantiles are exported by the stats server.
 
 	Metrics can be updated from the internal routing subsystem too:
 
@@ -63,6 +76,8 @@ extern struct uwsgi_server uwsgi;
 
 	The stats server exports the metrics list in the "metrics" attribute (obviously some info could be redundant)
 
+	--metrics-http exposes them in the OpenMetrics format, served directly by the collector thread (see core/openmetrics.c)
+
 */
 
 
@@ -306,6 +321,55 @@ struct uwsgi_metric *uwsgi_register_metric(char *name, char *oid, uint8_t value_
 	return uwsgi_register_metric_do(name, oid, value_type, collector, ptr, freq, custom, 0);
 }
 
+// parse the buckets of an histogram or the quantiles of a summary (semicolon separated)
+static struct uwsgi_metric_distribution *uwsgi_metric_distribution(uint8_t type, char *buckets, char *quantiles) {
+	struct uwsgi_metric_distribution *umd = uwsgi_calloc(sizeof(struct uwsgi_metric_distribution));
+	char *p, *ctx = NULL;
+	if (type == UWSGI_METRIC_HISTOGRAM) {
+		char *list = uwsgi_str(buckets ? buckets : "5;10;25;50;100;250;500;1000;2500;5000;10000");
+		char *tmp = uwsgi_str(list);
+		uwsgi_foreach_token(tmp, ";", p, ctx) {
+			umd->bounds_cnt++;
+		}
+		free(tmp);
+		umd->bounds = uwsgi_calloc(sizeof(int64_t) * umd->bounds_cnt);
+		uint64_t i = 0;
+		ctx = NULL;
+		uwsgi_foreach_token(list, ";", p, ctx) {
+			umd->bounds[i] = strtoll(p, NULL, 10);
+			if (i > 0 && umd->bounds[i] <= umd->bounds[i-1]) {
+				uwsgi_log("the buckets of an histogram metric must be increasing: %s\n", buckets);
+				exit(1);
+			}
+			i++;
+		}
+		free(list);
+		umd->values = uwsgi_calloc(sizeof(int64_t) * umd->bounds_cnt);
+		return umd;
+	}
+
+	char *list = uwsgi_str(quantiles ? quantiles : "0.5;0.9;0.99");
+	char *tmp = uwsgi_str(list);
+	uwsgi_foreach_token(tmp, ";", p, ctx) {
+		umd->quantiles_cnt++;
+	}
+	free(tmp);
+	umd->quantiles = uwsgi_calloc(sizeof(int) * umd->quantiles_cnt);
+	uint64_t i = 0;
+	ctx = NULL;
+	uwsgi_foreach_token(list, ";", p, ctx) {
+		double q = strtod(p, NULL);
+		if (q <= 0 || q > 1) {
+			uwsgi_log("invalid quantile for a summary metric: %s\n", p);
+			exit(1);
+		}
+		umd->quantiles[i++] = (int) ((q * 1000) + 0.5);
+	}
+	free(list);
+	umd->values = uwsgi_calloc(sizeof(int64_t) * umd->quantiles_cnt);
+	return umd;
+}
+
 struct uwsgi_metric *uwsgi_register_keyval_metric(char *arg) {
 	char *m_name = NULL;
 	char *m_oid = NULL;
@@ -322,6 +386,8 @@ struct uwsgi_metric *uwsgi_register_keyval_metric(char *arg) {
 	char *m_children = NULL;
 	char *m_alias = NULL;
 	char *m_reset_after_push = NULL;
+	char *m_buckets = NULL;
+	char *m_quantiles = NULL;
 
 	if (!strchr(arg, '=')) {
 		m_name = uwsgi_str(arg);
@@ -342,6 +408,8 @@ struct uwsgi_metric *uwsgi_register_keyval_metric(char *arg) {
 		"children", &m_children,
 		"alias", &m_alias,
 		"reset_after_push", &m_reset_after_push,
+		"buckets", &m_buckets,
+		"quantiles", &m_quantiles,
 		NULL)) {
 		uwsgi_log("invalid metric keyval syntax: %s\n", arg);
 		exit(1);
@@ -367,6 +435,12 @@ struct uwsgi_metric *uwsgi_register_keyval_metric(char *arg) {
 		else if (!strcmp(m_type, "alias")) {
 			type = UWSGI_METRIC_ALIAS;
 		}
+		else if (!strcmp(m_type, "histogram")) {
+			type = UWSGI_METRIC_HISTOGRAM;
+		}
+		else if (!strcmp(m_type, "summary")) {
+			type = UWSGI_METRIC_SUMMARY;
+		}
 	}
 
 	if (m_collector) {
@@ -387,6 +461,14 @@ struct uwsgi_metric *uwsgi_register_keyval_metric(char *arg) {
 		um->reset_after_push = 1;
 	}
 
+	if (type == UWSGI_METRIC_HISTOGRAM || type == UWSGI_METRIC_SUMMARY) {
+		if (collector) {
+			uwsgi_log("histogram and summary metrics cannot have a collector: %s\n", arg);
+			exit(1);
+		}
+		um->dist = uwsgi_metric_distribution(type, m_buckets, m_quantiles);
+	}
+
 	if (m_children) {
 		char *p, *ctx = NULL;
         	uwsgi_foreach_token(m_children, ";", p, ctx) {
@@ -434,9 +516,160 @@ struct uwsgi_metric *uwsgi_register_keyval_metric(char *arg) {
 	if (m_children) free(m_children);
 	if (m_alias) free(m_alias);
 	if (m_reset_after_push) free(m_reset_after_push);
+	if (m_buckets) free(m_buckets);
+	if (m_quantiles) free(m_quantiles);
 	return um;
 }
 
+/*
+	the hash index is built on startup, metrics registered later are found
+	walking the list
+*/
+static void uwsgi_metrics_build_index() {
+	uint64_t size = 16;
+	while (size < uwsgi.metrics_cnt * 2) size *= 2;
+	uwsgi.metrics_index = uwsgi_calloc(sizeof(struct uwsgi_metric *) * size);
+	uwsgi.metrics_index_mask = size - 1;
+	struct uwsgi_metric *um = uwsgi.metrics;
+	while(um) {
+		uint64_t pos = djb33x_hash(um->name, um->name_len) & uwsgi.metrics_index_mask;
+		while (uwsgi.metrics_index[pos]) {
+			pos = (pos + 1) & uwsgi.metrics_index_mask;
+		}
+		uwsgi.metrics_index[pos] = um;
+		um = um->next;
+	}
+}
+
+static struct uwsgi_metric *uwsgi_metric_index_find(char *name, size_t len) {
+	uint64_t pos = djb33x_hash(name, len) & uwsgi.metrics_index_mask;
+	while (uwsgi.metrics_index[pos]) {
+		struct uwsgi_metric *um = uwsgi.metrics_index[pos];
+		if (!uwsgi_strncmp(um->name, um->name_len, name, len)) return um;
+		pos = (pos + 1) & uwsgi.metrics_index_mask;
+	}
+	return NULL;
+}
+
+// count, sum and the buckets of histograms, count, sum, max and the log-linear buckets of summaries
+static uint64_t uwsgi_metric_shard_slots(struct uwsgi_metric *um) {
+	if (um->type == UWSGI_METRIC_HISTOGRAM) return 2 + um->dist->bounds_cnt;
+	if (um->type == UWSGI_METRIC_SUMMARY) return 3 + UWSGI_LATENCY_BUCKETS;
+	return 1;
+}
+
+/*
+	each worker core has a block of slots (padded to a cache line), the other
+	processes (master, mules, spoolers...) use the ones of worker 0
+*/
+static void uwsgi_metrics_setup_shards() {
+	uint64_t stride = 0;
+	struct uwsgi_metric *um = uwsgi.metrics;
+	while(um) {
+		if (!um->collector && um->type != UWSGI_METRIC_ALIAS) {
+			um->shard = stride;
+			um->shard_slots = uwsgi_metric_shard_slots(um);
+			stride += um->shard_slots;
+		}
+		um = um->next;
+	}
+	if (!stride) return;
+	stride = (stride + 7) & ~((uint64_t) 7);
+	uwsgi.metrics_shards_stride = stride;
+	uwsgi.metrics_shards = uwsgi_calloc_shared(sizeof(int64_t) * stride * (uwsgi.numproc + 1) * uwsgi.cores);
+
+	int64_t *bases = uwsgi_calloc_shared(sizeof(int64_t) * uwsgi.metrics_cnt);
+	uint64_t pos = 0;
+	um = uwsgi.metrics;
+	while(um) {
+		if (um->shard_slots) {
+			um->base = &bases[pos++];
+			*um->base = um->initial_value;
+		}
+		um = um->next;
+	}
+}
+
+static int64_t *uwsgi_metric_shard(struct uwsgi_metric *um) {
+	int wid = uwsgi.mywid;
+	int core = 0;
+	if (wid < 0 || wid > uwsgi.numproc) wid = 0;
+	if (wid > 0 && uwsgi.threads > 1) {
+		struct wsgi_request *wsgi_req = current_wsgi_req();
+		if (wsgi_req && wsgi_req->async_id < uwsgi.cores) core = wsgi_req->async_id;
+	}
+	return &uwsgi.metrics_shards[((((uint64_t) wid * uwsgi.cores) + core) * uwsgi.metrics_shards_stride) + um->shard];
+}
+
+static int64_t uwsgi_metric_shards_sum(struct uwsgi_metric *um, uint64_t slot) {
+	int64_t total = 0;
+	uint64_t i, shards = (uwsgi.numproc + 1) * uwsgi.cores;
+	for(i=0;i<shards;i++) {
+		total += uwsgi.metrics_shards[(i * uwsgi.metrics_shards_stride) + um->shard + slot];
+	}
+	return total;
+}
+
+static int64_t uwsgi_metric_shards_max(struct uwsgi_metric *um, uint64_t slot) {
+	int64_t max = 0;
+	uint64_t i, shards = (uwsgi.numproc + 1) * uwsgi.cores;
+	for(i=0;i<shards;i++) {
+		int64_t value = uwsgi.metrics_shards[(i * uwsgi.metrics_shards_stride) + um->shard + slot];
+		if (value > max) max = value;
+	}
+	return max;
+}
+
+// the current value of a sharded metric
+static int64_t uwsgi_metric_sharded_value(struct uwsgi_metric *um) {
+	if (um->dist) return uwsgi_metric_shards_sum(um, 0);
+	return *um->base + uwsgi_metric_shards_sum(um, 0);
+}
+
+// merge the shards of a metric (called by the collector thread)
+static void uwsgi_metric_aggregate(struct uwsgi_metric *um) {
+	*um->value = uwsgi_metric_sharded_value(um);
+	struct uwsgi_metric_distribution *umd = um->dist;
+	if (!umd) return;
+	uint64_t i;
+	umd->count = *um->value;
+	umd->sum = uwsgi_metric_shards_sum(um, 1);
+	if (um->type == UWSGI_METRIC_HISTOGRAM) {
+		int64_t cumulative = 0;
+		for(i=0;i<umd->bounds_cnt;i++) {
+			cumulative += uwsgi_metric_shards_sum(um, 2 + i);
+			umd->values[i] = cumulative;
+		}
+		umd->max = 0;
+		return;
+	}
+	umd->max = uwsgi_metric_shards_max(um, 2);
+	// only the collector thread aggregates the metrics
+	static int64_t buckets[UWSGI_LATENCY_BUCKETS];
+	int64_t total = 0;
+	int b;
+	for(b=0;b<UWSGI_LATENCY_BUCKETS;b++) {
+		buckets[b] = uwsgi_metric_shards_sum(um, 3 + b);
+		total += buckets[b];
+	}
+	for(i=0;i<umd->quantiles_cnt;i++) {
+		umd->values[i] = 0;
+		if (total == 0) continue;
+		int64_t target = ((total * umd->quantiles[i]) + 999) / 1000;
+		if (target == 0) target = 1;
+		int64_t seen = 0;
+		umd->values[i] = umd->max;
+		for(b=0;b<UWSGI_LATENCY_BUCKETS;b++) {
+			seen += buckets[b];
+			if (seen >= target) {
+				int64_t value = uwsgi_latency_bucket_value(b);
+				umd->values[i] = value > umd->max ? umd->max : value;
+				break;
+			}
+		}
+	}
+}
+
 static void *uwsgi_metrics_loop(void *arg) {
 
 	// block signals on this thread
@@ -450,6 +683,7 @@ static void *uwsgi_metrics_loop(void *arg) {
 	for(;;) {
 		struct uwsgi_metric *metric = uwsgi.metrics;
 		// every second scan the whole metrics tree
+		uint64_t start = uwsgi_micros();
 		time_t now = uwsgi_now();
 		while(metric) {
 			if (!metric->last_update) {
@@ -464,6 +698,9 @@ static void *uwsgi_metrics_loop(void *arg) {
 			if (metric->collector) {
 				*metric->value = metric->initial_value + metric->collector->func(metric);
 			}
+			else if (metric->shard_slots) {
+				uwsgi_metric_aggregate(metric);
+			}
 			int64_t new_value = *metric->value;
 			uwsgi_rwunlock(uwsgi.metrics_lock);
 
@@ -483,9 +720,7 @@ static void *uwsgi_metrics_loop(void *arg) {
 			while(umt) {
 				if (new_value >= umt->value) {
 					if (umt->reset) {
-						uwsgi_wlock(uwsgi.metrics_lock);
-						*metric->value = umt->reset_value;
-						uwsgi_rwunlock(uwsgi.metrics_lock);
+						uwsgi_metric_store(metric, umt->reset_value);
 					}
 
 					if (umt->alarm) {
@@ -505,7 +740,9 @@ static void *uwsgi_metrics_loop(void *arg) {
 next:
 			metric = metric->next;
 		}
-		sleep(1);
+		// the OpenMetrics endpoint (if enabled) is served until the next pass
+		uwsgi_openmetrics_render();
+		uwsgi_openmetrics_serve(start + 1000000);
 	}
 
 	return NULL;
@@ -514,12 +751,17 @@ next:
 
 void uwsgi_metrics_start_collector() {
 	if (!uwsgi.has_metrics) return;
+	uwsgi_openmetrics_bind();
 	pthread_t t;
         pthread_create(&t, NULL, uwsgi_metrics_loop, NULL);
 	uwsgi_log("metrics collector thread started\n");
 }
 
 struct uwsgi_metric *uwsgi_metric_find_by_name(char *name) {
+	if (uwsgi.metrics_index) {
+		struct uwsgi_metric *um = uwsgi_metric_index_find(name, strlen(name));
+		if (um) return um;
+	}
 	struct uwsgi_metric *um = uwsgi.metrics;
 	while(um) {
 		if (!strcmp(um->name, name)) {
@@ -532,6 +774,10 @@ struct uwsgi_metric *uwsgi_metric_find_by_name(char *name) {
 }
 
 struct uwsgi_metric *uwsgi_metric_find_by_namen(char *name, size_t len) {
+	if (uwsgi.metrics_index) {
+		struct uwsgi_metric *um = uwsgi_metric_index_find(name, len);
+		if (um) return um;
+	}
         struct uwsgi_metric *um = uwsgi.metrics;
         while(um) {
                 if (!uwsgi_strncmp(um->name, um->name_len, name, len)) {
@@ -607,45 +853,115 @@ struct uwsgi_metric *uwsgi_metric_find_by_asn(char *asn, size_t len) {
 	metric_dec
 	metric_mul
 	metric_div
+	metric_observe
 
 */
 
-#define um_op struct uwsgi_metric *um = NULL;\
-	if (!uwsgi.has_metrics) return -1;\
-	if (name) {\
-                um = uwsgi_metric_find_by_name(name);\
-        }\
-        else if (oid) {\
-                um = uwsgi_metric_find_by_oid(oid);\
-        }\
+static struct uwsgi_metric *uwsgi_metric_lookup(char *name, char *oid) {
+	if (!uwsgi.has_metrics) return NULL;
+	if (name) {
+		return uwsgi_metric_find_by_name(name);
+	}
+	if (oid) {
+		return uwsgi_metric_find_by_oid(oid);
+	}
+	return NULL;
+}
+
+// resolve a metric once (only the metrics without a collector can be updated)
+struct uwsgi_metric *uwsgi_metric_handle(char *name, char *oid) {
+	struct uwsgi_metric *um = uwsgi_metric_lookup(name, oid);
+	if (!um || !um->shard_slots) return NULL;
+	return um;
+}
+
+// set the value of a metric moving its base (the metrics lock must be held)
+static void uwsgi_metric_store_locked(struct uwsgi_metric *um, int64_t value) {
+	if (um->shard_slots && !um->dist) {
+		*um->base = value - uwsgi_metric_shards_sum(um, 0);
+	}
+	*um->value = value;
+}
+
+void uwsgi_metric_store(struct uwsgi_metric *um, int64_t value) {
+	// the distributions are never reset
+	if (um->dist) return;
+	uwsgi_wlock(uwsgi.metrics_lock);
+	uwsgi_metric_store_locked(um, value);
+	uwsgi_rwunlock(uwsgi.metrics_lock);
+}
+
+int uwsgi_metric_handle_inc(struct uwsgi_metric *um, int64_t value) {
+	if (!um || !um->shard_slots || um->dist) return -1;
+	__sync_add_and_fetch(uwsgi_metric_shard(um), value);
+	return 0;
+}
+
+int uwsgi_metric_handle_dec(struct uwsgi_metric *um, int64_t value) {
+	if (!um || !um->shard_slots || um->dist) return -1;
+	__sync_sub_and_fetch(uwsgi_metric_shard(um), value);
+	return 0;
+}
+
+int uwsgi_metric_handle_set(struct uwsgi_metric *um, int64_t value) {
+	if (!um || !um->shard_slots || um->dist) return -1;
+	uwsgi_metric_store(um, value);
+	return 0;
+}
+
+int uwsgi_metric_handle_observe(struct uwsgi_metric *um, int64_t value) {
+	if (!um || !um->dist) return -1;
+	int64_t *shard = uwsgi_metric_shard(um);
+	struct uwsgi_metric_distribution *umd = um->dist;
+	if (um->type == UWSGI_METRIC_HISTOGRAM) {
+		uint64_t i;
+		for(i=0;i<umd->bounds_cnt;i++) {
+			if (value <= umd->bounds[i]) {
+				__sync_add_and_fetch(&shard[2 + i], 1);
+				break;
+			}
+		}
+	}
+	else {
+		int64_t max = shard[2];
+		while (value > max) {
+			if (__sync_bool_compare_and_swap(&shard[2], max, value)) break;
+			max = shard[2];
+		}
+		__sync_add_and_fetch(&shard[3 + uwsgi_latency_bucket(value > 0 ? value : 0)], 1);
+	}
+	__sync_add_and_fetch(&shard[1], value);
+	// count is updated as the last one
+	__sync_add_and_fetch(&shard[0], 1);
+	return 0;
+}
+
+// the operations needing the whole value are serialized by the metrics lock
+#define um_op struct uwsgi_metric *um = uwsgi_metric_lookup(name, oid);\
         if (!um) return -1;\
-	if (um->collector || um->type == UWSGI_METRIC_ALIAS) return -1;\
-	uwsgi_wlock(uwsgi.metrics_lock)
+	if (um->collector || um->type == UWSGI_METRIC_ALIAS || um->dist) return -1;\
+	uwsgi_wlock(uwsgi.metrics_lock);\
+	int64_t current = um->shard_slots ? uwsgi_metric_sharded_value(um) : *um->value
 
 int uwsgi_metric_set(char *name, char *oid, int64_t value) {
 	um_op;
-	*um->value = value;
+	(void) current;
+	uwsgi_metric_store_locked(um, value);
 	uwsgi_rwunlock(uwsgi.metrics_lock);
 	return 0;
 }
 
 int uwsgi_metric_inc(char *name, char *oid, int64_t value) {
-        um_op;
-	*um->value += value;
-	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return 0;
+	return uwsgi_metric_handle_inc(uwsgi_metric_lookup(name, oid), value);
 }
 
 int uwsgi_metric_dec(char *name, char *oid, int64_t value) {
-        um_op;
-	*um->value -= value;
-	uwsgi_rwunlock(uwsgi.metrics_lock);
-	return 0;
+	return uwsgi_metric_handle_dec(uwsgi_metric_lookup(name, oid), value);
 }
 
 int uwsgi_metric_mul(char *name, char *oid, int64_t value) {
         um_op;
-	*um->value *= value;
+	uwsgi_metric_store_locked(um, current * value);
 	uwsgi_rwunlock(uwsgi.metrics_lock);
 	return 0;
 }
@@ -654,35 +970,33 @@ int uwsgi_metric_div(char *name, char *oid, int64_t value) {
 	// avoid division by zero
 	if (value == 0) return -1;
         um_op;
-	*um->value /= value;
+	uwsgi_metric_store_locked(um, current / value);
 	uwsgi_rwunlock(uwsgi.metrics_lock);
 	return 0;
 }
 
-int64_t uwsgi_metric_get(char *name, char *oid) {
-	if (!uwsgi.has_metrics) return 0;
-	int64_t ret = 0;
-	struct uwsgi_metric *um = NULL;
-	if (name) {
-		um = uwsgi_metric_find_by_name(name);
-	}
-	else if (oid) {
-		um = uwsgi_metric_find_by_oid(oid);
-	}
-	if (!um) return 0;
+int uwsgi_metric_observe(char *name, char *oid, int64_t value) {
+	return uwsgi_metric_handle_observe(uwsgi_metric_lookup(name, oid), value);
+}
 
+static int64_t uwsgi_metric_value(struct uwsgi_metric *um) {
 	// now (in rlocked context) we get the value from
-	// the map
+	// the map (or from the shards)
 	uwsgi_rlock(uwsgi.metrics_lock);
-	ret = *um->value;
+	int64_t ret = um->shard_slots ? uwsgi_metric_sharded_value(um) : *um->value;
 	// unlock
 	uwsgi_rwunlock(uwsgi.metrics_lock);
 	return ret;
 }
 
+int64_t uwsgi_metric_get(char *name, char *oid) {
+	struct uwsgi_metric *um = uwsgi_metric_lookup(name, oid);
+	if (!um) return 0;
+	return uwsgi_metric_value(um);
+}
+
 int64_t uwsgi_metric_getn(char *name, size_t nlen, char *oid, size_t olen) {
         if (!uwsgi.has_metrics) return 0;
-        int64_t ret = 0;
         struct uwsgi_metric *um = NULL;
         if (name) {
                 um = uwsgi_metric_find_by_namen(name, nlen);
@@ -691,28 +1005,21 @@ int64_t uwsgi_metric_getn(char *name, size_t nlen, char *oid, size_t olen) {
                 um = uwsgi_metric_find_by_oidn(oid, olen);
         }
         if (!um) return 0;
-
-        // now (in rlocked context) we get the value from
-        // the map
-        uwsgi_rlock(uwsgi.metrics_lock);
-        ret = *um->value;
-        // unlock
-        uwsgi_rwunlock(uwsgi.metrics_lock);
-        return ret;
+	return uwsgi_metric_value(um);
 }
 
 int uwsgi_metric_set_max(char *name, char *oid, int64_t value) {
 	um_op;
-    if (value > *um->value)
-        *um->value = value;
+	if (value > current)
+		uwsgi_metric_store_locked(um, value);
 	uwsgi_rwunlock(uwsgi.metrics_lock);
 	return 0;
 }
 
 int uwsgi_metric_set_min(char *name, char *oid, int64_t value) {
 	um_op;
-    if ((value > um->initial_value || 0) && value < *um->value)
-        *um->value = value;
+	if ((value > um->initial_value || 0) && value < current)
+		uwsgi_metric_store_locked(um, value);
 	uwsgi_rwunlock(uwsgi.metrics_lock);
 	return 0;
 }
@@ -844,6 +1151,9 @@ void uwsgi_setup_metrics() {
 		uwsgi_sock = uwsgi_sock->next;
 	}
 
+	// latency histograms
+	uwsgi_latency_register_metrics();
+
 	// create aliases
 	uwsgi_register_metric("rss_size", NULL, UWSGI_METRIC_ALIAS, NULL, total_rss, 0, NULL);
 	uwsgi_register_metric("vsz_size", NULL, UWSGI_METRIC_ALIAS, NULL, total_vsz, 0, NULL);
@@ -886,6 +1196,9 @@ void uwsgi_setup_metrics() {
 		metric = metric->next;
 	}
 
+	uwsgi_metrics_setup_shards();
+	uwsgi_metrics_build_index();
+
 	// setup thresholds
 	uwsgi_foreach(usl, uwsgi.metrics_threshold) {
 		char *m_key = NULL;
@@ -966,6 +1279,7 @@ void uwsgi_setup_metrics() {
         		while(metric) {
 				if (metric->map) {
 					metric->initial_value = strtoll(metric->map, NULL, 10);
+					if (metric->base) *metric->base = metric->initial_value;
 				}
 				metric = metric->next;
 			}
@@ -1078,6 +1392,7 @@ static int64_t uwsgi_metric_collector_func(struct uwsgi_metric *um) {
 void uwsgi_metrics_collectors_setup() {
 	uwsgi_register_metric_collector("ptr", uwsgi_metric_collector_ptr);
 	uwsgi_register_metric_collector("file", uwsgi_metric_collector_file);
+	uwsgi_register_metric_collector("latency", uwsgi_metric_collector_latency);
 	uwsgi_register_metric_collector("sum", uwsgi_metric_collector_sum);
 	uwsgi_register_metric_collector("accumulator", uwsgi_metric_collector_accumulator);
 	uwsgi_register_metric_collector("adder", uwsgi_metric_collector_adder);
@@ -1085,3 +1400,35 @@ void uwsgi_metrics_collectors_setup() {
 	uwsgi_register_metric_collector("avg", uwsgi_metric_collector_avg);
 	uwsgi_register_metric_collector("func", uwsgi_metric_collector_func);
 }
+
+// the aggregated distribution of an histogram/summary in the stats json (the metrics lock must be held)
+int uwsgi_stats_metric_distribution(struct uwsgi_stats *us, struct uwsgi_metric *um) {
+	struct uwsgi_metric_distribution *umd = um->dist;
+	uint64_t i;
+	if (uwsgi_stats_comma(us)) return -1;
+	if (uwsgi_stats_keyslong_comma(us, "count", (long long) umd->count)) return -1;
+	if (uwsgi_stats_keyslong_comma(us, "sum", (long long) umd->sum)) return -1;
+	if (um->type == UWSGI_METRIC_HISTOGRAM) {
+		if (uwsgi_stats_key(us, "buckets")) return -1;
+		if (uwsgi_stats_list_open(us)) return -1;
+		for(i=0;i<umd->bounds_cnt;i++) {
+			if (i > 0 && uwsgi_stats_comma(us)) return -1;
+			if (uwsgi_stats_object_open(us)) return -1;
+			if (uwsgi_stats_keyslong_comma(us, "le", (long long) umd->bounds[i])) return -1;
+			if (uwsgi_stats_keyslong(us, "count", (long long) umd->values[i])) return -1;
+			if (uwsgi_stats_object_close(us)) return -1;
+		}
+		return uwsgi_stats_list_close(us);
+	}
+	if (uwsgi_stats_keyslong_comma(us, "max", (long long) umd->max)) return -1;
+	if (uwsgi_stats_key(us, "quantiles")) return -1;
+	if (uwsgi_stats_list_open(us)) return -1;
+	for(i=0;i<umd->quantiles_cnt;i++) {
+		if (i > 0 && uwsgi_stats_comma(us)) return -1;
+		if (uwsgi_stats_object_open(us)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "permille", (unsigned long long) umd->quantiles[i])) return -1;
+		if (uwsgi_stats_keyslong(us, "value", (long long) umd->values[i])) return -1;
+		if (uwsgi_stats_object_close(us)) return -1;
+	}
+	return uwsgi_stats_list_close(us);
+}
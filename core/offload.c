@@ -40,27 +40,177 @@ void uwsgi_offload_setup(struct uwsgi_offload_engine *uoe, struct uwsgi_offload_
 
 }
 
+/*
+
+	tasks are not sent to a specific thread: they are pushed to a lock-free bounded queue
+	shared by the offload threads of the worker, and a wakeup token is sent to the thread
+	with the lowest load (active transfers + tasks dispatched but not yet started). When its
+	socket is full the token goes to the next thread, and when every socket is full the task
+	is taken by the first thread consuming its tokens.
+
+	Once started a transfer is bound to the event queue of its thread, so the balancing
+	happens when tasks are picked: a thread with a load lower than the average takes
+	pending tasks even if they have been dispatched to another (busy) thread.
+
+*/
+
+struct uwsgi_offload_queue_cell {
+	uint64_t seq;
+	struct uwsgi_offload_request *uor;
+};
+
+struct uwsgi_offload_queue {
+	uint64_t mask;
+	struct uwsgi_offload_queue_cell *cells;
+	// producers and consumers work on different cache lines
+	uint64_t tail __attribute__ ((aligned (64)));
+	uint64_t head __attribute__ ((aligned (64)));
+	// tasks whose wakeup token could not be sent
+	uint64_t orphans;
+};
+
+static struct uwsgi_offload_queue *uwsgi_offload_queue_new(uint64_t size) {
+	uint64_t slots = 2;
+	while (slots < size) slots <<= 1;
+	struct uwsgi_offload_queue *q = uwsgi_calloc(sizeof(struct uwsgi_offload_queue));
+	q->cells = uwsgi_calloc(sizeof(struct uwsgi_offload_queue_cell) * slots);
+	q->mask = slots - 1;
+	uint64_t i;
+	for (i = 0; i < slots; i++) {
+		q->cells[i].seq = i;
+	}
+	return q;
+}
+
+static int uwsgi_offload_queue_push(struct uwsgi_offload_queue *q, struct uwsgi_offload_request *uor) {
+	uint64_t pos = q->tail;
+	for (;;) {
+		struct uwsgi_offload_queue_cell *cell = &q->cells[pos & q->mask];
+		int64_t diff = (int64_t) __sync_add_and_fetch(&cell->seq, 0) - (int64_t) pos;
+		if (diff == 0) {
+			if (__sync_bool_compare_and_swap(&q->tail, pos, pos + 1)) {
+				cell->uor = uor;
+				__sync_synchronize();
+				cell->seq = pos + 1;
+				return 0;
+			}
+		}
+		// full
+		else if (diff < 0) {
+			return -1;
+		}
+		pos = __sync_add_and_fetch(&q->tail, 0);
+	}
+}
+
+static struct uwsgi_offload_request *uwsgi_offload_queue_pop(struct uwsgi_offload_queue *q) {
+	uint64_t pos = q->head;
+	for (;;) {
+		struct uwsgi_offload_queue_cell *cell = &q->cells[pos & q->mask];
+		int64_t diff = (int64_t) __sync_add_and_fetch(&cell->seq, 0) - (int64_t) (pos + 1);
+		if (diff == 0) {
+			if (__sync_bool_compare_and_swap(&q->head, pos, pos + 1)) {
+				struct uwsgi_offload_request *uor = cell->uor;
+				__sync_synchronize();
+				cell->seq = pos + q->mask + 1;
+				return uor;
+			}
+		}
+		// empty
+		else if (diff < 0) {
+			return NULL;
+		}
+		pos = __sync_add_and_fetch(&q->head, 0);
+	}
+}
+
+// the number of threads (and stats slots) configured for each worker
+static int offload_threads_slots;
+
+static struct uwsgi_offload_thread_stats *uwsgi_offload_thread_stats(int id) {
+	return &uwsgi.offload_threads_stats[(uwsgi.mywid * offload_threads_slots) + id];
+}
+
+static struct uwsgi_offload_engine_stats *uwsgi_offload_engine_stats(int wid, struct uwsgi_offload_engine *uoe) {
+	// engines registered after the setup of the shared memory are not accounted
+	if (!uwsgi.offload_engines_stats || uoe->id >= uwsgi.offload_engines_cnt) return NULL;
+	return &uwsgi.offload_engines_stats[(wid * uwsgi.offload_engines_cnt) + uoe->id];
+}
+
+static uint64_t uwsgi_offload_thread_load(struct uwsgi_offload_thread_stats *uots) {
+	return uots->active + uots->queued;
+}
+
+static int uwsgi_offload_dispatch(struct uwsgi_offload_request *uor, int *rr) {
+	// the least loaded thread (round robin between the equally loaded ones)
+	if (*rr >= uwsgi.offload_threads) {
+		*rr = 0;
+	}
+	int i, best = *rr;
+	uint64_t best_load = uwsgi_offload_thread_load(uwsgi_offload_thread_stats(best));
+	for (i = 1; i < uwsgi.offload_threads && best_load > 0; i++) {
+		int id = (*rr + i) % uwsgi.offload_threads;
+		uint64_t load = uwsgi_offload_thread_load(uwsgi_offload_thread_stats(id));
+		if (load < best_load) {
+			best = id;
+			best_load = load;
+		}
+	}
+	(*rr)++;
+
+	struct uwsgi_offload_request *task = uwsgi_malloc(sizeof(struct uwsgi_offload_request));
+	memcpy(task, uor, sizeof(struct uwsgi_offload_request));
+	if (uwsgi_offload_queue_push(uwsgi.offload_queue, task)) {
+		uwsgi_log("[offload] task queue full (%d tasks), consider raising --offload-threads-queue\n", uwsgi.offload_threads_queue);
+		goto error;
+	}
+
+	// a full socket means the thread has already plenty of wakeups to manage, try with the next ones
+	char token = 0;
+	for (i = 0; i < uwsgi.offload_threads; i++) {
+		int id = (best + i) % uwsgi.offload_threads;
+		struct uwsgi_offload_thread_stats *uots = uwsgi_offload_thread_stats(id);
+		__sync_add_and_fetch(&uots->queued, 1);
+		if (write(uwsgi.offload_thread[id]->pipe[0], &token, 1) == 1) goto done;
+		__sync_sub_and_fetch(&uots->queued, 1);
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			uwsgi_error("uwsgi_offload_dispatch()/write()");
+			break;
+		}
+	}
+	// no thread can be woken up, the task will be taken by the first one consuming its tokens
+	__sync_add_and_fetch(&uwsgi.offload_queue->orphans, 1);
+done:
+#ifdef UWSGI_DEBUG
+        uwsgi_log("[offload] created session %p\n", task);
+#endif
+	return 0;
+error:
+	free(task);
+	return -1;
+}
+
 static int uwsgi_offload_enqueue(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor) {
 	struct uwsgi_core *uc = &uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id];
 	uc->offloaded_requests++;
-	// round robin
-	if (uc->offload_rr >= uwsgi.offload_threads) {
-		uc->offload_rr = 0;
-	}
-	struct uwsgi_thread *ut = uwsgi.offload_thread[uc->offload_rr];
-	uc->offload_rr++;
-	if (write(ut->pipe[0], uor, sizeof(struct uwsgi_offload_request)) != sizeof(struct uwsgi_offload_request)) {
+	if (uwsgi_offload_dispatch(uor, &uc->offload_rr)) {
 		if (uor->takeover) {
 			wsgi_req->fd_closed = 0;
 		}
 		return -1;
 	}
-#ifdef UWSGI_DEBUG
-        uwsgi_log("[offload] created session %p\n", uor);
-#endif
 	return 0;
 }
 
+/*
+	run an already prepared task not bound to a request (the socket must be owned by the task),
+	it can be called by the offload threads too
+*/
+int uwsgi_offload_push(struct uwsgi_offload_request *uor) {
+	static int rr = 0;
+	return uwsgi_offload_dispatch(uor, &rr);
+}
+
 /*
 
 	pipe offload engine:
@@ -94,6 +244,35 @@ static int u_offload_memory_prepare(struct wsgi_request *wsgi_req, struct uwsgi_
 }
 
 
+/*
+
+	cache offload engine:
+		data -> the cache
+		custom1 -> index of the referenced item (released at the end)
+		custom2 -> offset of the value in the cache data
+		len -> size of the value
+
+	sharedarea offload engine:
+		data -> the sharedarea
+		custom1 -> pinned range slot (the free hook must unpin it)
+		custom2 -> position in the area
+		len -> amount of data to transfer
+		ubuf -> (optional) data to send before the range
+
+	websocket offload engine:
+		buf -> struct uwsgi_websocket_hub_delivery, the (already framed) hub messages to send
+		len -> size of the messages
+
+*/
+
+static int u_offload_region_prepare(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor) {
+
+	if (!uor->data || !uor->len) {
+		return -1;
+	}
+	return 0;
+}
+
 /*
 
 	transfer offload engine:
@@ -163,6 +342,15 @@ static int u_offload_sendfile_prepare(struct wsgi_request *wsgi_req, struct uwsg
 
 static void uwsgi_offload_close(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor) {
 
+	struct uwsgi_offload_thread_stats *uots = (struct uwsgi_offload_thread_stats *) ut->data;
+	__sync_sub_and_fetch(&uots->active, 1);
+	struct uwsgi_offload_engine_stats *uoes = uwsgi_offload_engine_stats(uwsgi.mywid, uor->engine);
+	if (uoes) {
+		__sync_sub_and_fetch(&uoes->active, 1);
+		__sync_add_and_fetch(&uoes->bytes, uor->written);
+		__sync_add_and_fetch(&uoes->usecs, uwsgi_micros() - uor->started_at);
+	}
+
 	// call the free function asap
 	if (uor->free) {
 		uor->free(uor);
@@ -269,10 +457,61 @@ static struct uwsgi_offload_request *uwsgi_offload_get_by_fd(struct uwsgi_thread
 	return NULL;
 }
 
+// start up to max tasks from the queue
+static void uwsgi_offload_take(struct uwsgi_thread *ut, uint64_t max, int stolen) {
+	struct uwsgi_offload_thread_stats *uots = (struct uwsgi_offload_thread_stats *) ut->data;
+	while (max > 0) {
+		struct uwsgi_offload_request *uor = uwsgi_offload_queue_pop(uwsgi.offload_queue);
+		if (!uor) break;
+		max--;
+		uor->started_at = uwsgi_micros();
+		__sync_add_and_fetch(&uots->active, 1);
+		__sync_add_and_fetch(&uots->tasks, 1);
+		if (stolen) {
+			__sync_add_and_fetch(&uots->stolen, 1);
+		}
+		struct uwsgi_offload_engine_stats *uoes = uwsgi_offload_engine_stats(uwsgi.mywid, uor->engine);
+		if (uoes) {
+			__sync_add_and_fetch(&uoes->tasks, 1);
+			__sync_add_and_fetch(&uoes->active, 1);
+		}
+		// call the event function for the first time
+		if (uor->engine->event_func(ut, uor, -1)) {
+			uwsgi_offload_close(ut, uor);
+			continue;
+		}
+		uwsgi_offload_append(ut, uor);
+	}
+}
+
+// take pending tasks if the thread is less loaded than the average
+static void uwsgi_offload_steal(struct uwsgi_thread *ut) {
+	if (uwsgi.offload_queue->head == uwsgi.offload_queue->tail) return;
+	struct uwsgi_offload_thread_stats *uots = (struct uwsgi_offload_thread_stats *) ut->data;
+	int i;
+	uint64_t total = 0;
+	for (i = 0; i < uwsgi.offload_threads; i++) {
+		total += uwsgi_offload_thread_load(uwsgi_offload_thread_stats(i));
+	}
+	if (uots->active * uwsgi.offload_threads > total) return;
+	uwsgi_offload_take(ut, 1, 1);
+}
+
 static void uwsgi_offload_loop(struct uwsgi_thread *ut) {
 
 	int i;
 	void *events = event_queue_alloc(uwsgi.offload_threads_events);
+	struct uwsgi_offload_thread_stats *uots = (struct uwsgi_offload_thread_stats *) ut->data;
+	char tokens[64];
+
+	// the first thread dispatches the websockets hub messages
+	int hub_fd = -1;
+	if (uwsgi.websockets_hub && uots == uwsgi_offload_thread_stats(0)) {
+		hub_fd = uwsgi.websockets_hub->pipes[(uwsgi.mywid * 2) + 1];
+		if (event_queue_add_fd_read(ut->queue, hub_fd)) {
+			hub_fd = -1;
+		}
+	}
 
 	for (;;) {
 		// TODO make timeout tunable
@@ -280,19 +519,20 @@ static void uwsgi_offload_loop(struct uwsgi_thread *ut) {
 		for (i = 0; i < nevents; i++) {
 			int interesting_fd = event_queue_interesting_fd(events, i);
 			if (interesting_fd == ut->pipe[1]) {
-				struct uwsgi_offload_request *uor = uwsgi_malloc(sizeof(struct uwsgi_offload_request));
-				ssize_t len = read(ut->pipe[1], uor, sizeof(struct uwsgi_offload_request));
-				if (len != sizeof(struct uwsgi_offload_request)) {
-					uwsgi_error("read()");
-					free(uor);
-					continue;
-				}
-				// cal the event function for the first time
-				if (uor->engine->event_func(ut, uor, -1)) {
-					uwsgi_offload_close(ut, uor);
-					continue;
+				// every token is a task dispatched to this thread
+				uint64_t dispatched = 0;
+				for (;;) {
+					ssize_t len = read(ut->pipe[1], tokens, sizeof(tokens));
+					if (len <= 0) break;
+					dispatched += len;
 				}
-				uwsgi_offload_append(ut, uor);
+				__sync_sub_and_fetch(&uots->queued, dispatched);
+				uwsgi_offload_take(ut, dispatched + __sync_fetch_and_and(&uwsgi.offload_queue->orphans, 0), 0);
+				continue;
+			}
+
+			if (interesting_fd == hub_fd) {
+				uwsgi_websockets_hub_dispatch();
 				continue;
 			}
 
@@ -305,11 +545,21 @@ static void uwsgi_offload_loop(struct uwsgi_thread *ut) {
 				uwsgi_offload_close(ut, uor);
 			}
 		}
+		uwsgi_offload_steal(ut);
 	}
 }
 
 struct uwsgi_thread *uwsgi_offload_thread_start() {
-	return uwsgi_thread_new(uwsgi_offload_loop);
+	// the threads of the worker are started in sequence
+	static int started = 0;
+	if (!uwsgi.offload_queue) {
+		uwsgi.offload_queue = uwsgi_offload_queue_new(uwsgi.offload_threads_queue);
+	}
+	struct uwsgi_offload_thread_stats *uots = uwsgi_offload_thread_stats(started);
+	memset(uots, 0, sizeof(struct uwsgi_offload_thread_stats));
+	struct uwsgi_thread *ut = uwsgi_thread_new_with_data(uwsgi_offload_loop, uots);
+	if (ut) started++;
+	return ut;
 }
 
 /*
@@ -345,6 +595,116 @@ static int u_offload_memory_do(struct uwsgi_thread *ut, struct uwsgi_offload_req
 }
 
 
+/*
+
+	offload of a memory region not owned by the task (optional ubuf prefix + region)
+
+	uor->pos -> bytes of the prefix + region sent
+
+*/
+
+static int u_offload_region_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd, char *region) {
+	if (fd == -1) {
+		if (event_queue_add_fd_write(ut->queue, uor->s)) return -1;
+		return 0;
+	}
+	struct iovec iov[2];
+	int iovcnt = 0;
+	size_t prefix = uor->ubuf ? uor->ubuf->pos : 0;
+	size_t sent = uor->pos;
+	if (sent < prefix) {
+		iov[iovcnt].iov_base = uor->ubuf->buf + sent;
+		iov[iovcnt].iov_len = prefix - sent;
+		iovcnt++;
+		sent = prefix;
+	}
+	iov[iovcnt].iov_base = region + (sent - prefix);
+	iov[iovcnt].iov_len = uor->len - (sent - prefix);
+	iovcnt++;
+	ssize_t rlen = writev(uor->s, iov, iovcnt);
+	if (rlen > 0) {
+		uor->pos += rlen;
+		uor->written += rlen;
+		if ((size_t) uor->pos >= prefix + uor->len) {
+			return -1;
+		}
+		return 0;
+	}
+	else if (rlen < 0) {
+		uwsgi_offload_retry
+		uwsgi_error("u_offload_region_do()");
+	}
+	return -1;
+}
+
+static int u_offload_cache_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+	struct uwsgi_cache *uc = (struct uwsgi_cache *) uor->data;
+	return u_offload_region_do(ut, uor, fd, ((char *) uc->data) + uor->custom2);
+}
+
+static void u_offload_cache_free(struct uwsgi_offload_request *uor) {
+	uwsgi_cache_unref((struct uwsgi_cache *) uor->data, uor->custom1);
+}
+
+// the socket is a dup() of the one still owned by the core, close() would not remove it from the queue
+static int u_offload_dup_done(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd, int ret) {
+	if (ret < 0 && fd != -1) {
+		event_queue_del_fd(ut->queue, uor->s, event_queue_write());
+	}
+	return ret;
+}
+
+static int u_offload_sharedarea_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+	struct uwsgi_sharedarea *sa = (struct uwsgi_sharedarea *) uor->data;
+	// a writer cannot wait anymore, the peer would receive inconsistent data
+	if (sa->pins[uor->custom1].revoked) {
+		shutdown(uor->s, SHUT_RDWR);
+		return u_offload_dup_done(ut, uor, fd, -1);
+	}
+	return u_offload_dup_done(ut, uor, fd, u_offload_region_do(ut, uor, fd, sa->area + uor->custom2));
+}
+
+static int u_offload_websocket_do(struct uwsgi_thread *ut, struct uwsgi_offload_request *uor, int fd) {
+	if (fd == -1) {
+		if (event_queue_add_fd_write(ut->queue, uor->s)) return -1;
+		return 0;
+	}
+	struct uwsgi_websocket_hub_delivery *uwhd = (struct uwsgi_websocket_hub_delivery *) uor->buf;
+	struct iovec iov[UWSGI_WEBSOCKET_HUB_BATCH];
+	int i, iovcnt = 0;
+	size_t skip = uor->pos;
+	for (i = 0; i < uwhd->count; i++) {
+		struct uwsgi_websocket_hub_message *uwhm = uwhd->messages[i];
+		// the slot has been reused by a publisher (a zero sequence means it is waiting for us)
+		if (uwhm->seq != uwhd->seqs[i] && uwhm->seq != 0) {
+			shutdown(uor->s, SHUT_RDWR);
+			return u_offload_dup_done(ut, uor, fd, -1);
+		}
+		if (skip >= uwhm->len) {
+			skip -= uwhm->len;
+			continue;
+		}
+		iov[iovcnt].iov_base = uwhm->buf + skip;
+		iov[iovcnt].iov_len = uwhm->len - skip;
+		iovcnt++;
+		skip = 0;
+	}
+	ssize_t rlen = writev(uor->s, iov, iovcnt);
+	if (rlen > 0) {
+		uor->pos += rlen;
+		uor->written += rlen;
+		if ((size_t) uor->pos >= uor->len) {
+			return u_offload_dup_done(ut, uor, fd, -1);
+		}
+		return 0;
+	}
+	else if (rlen < 0) {
+		uwsgi_offload_retry
+		uwsgi_error("u_offload_websocket_do()");
+	}
+	return u_offload_dup_done(ut, uor, fd, -1);
+}
+
 /*
 
 the offload task starts after having acquired the file fd
@@ -440,6 +800,7 @@ static int u_offload_pipe_do(struct uwsgi_thread *ut, struct uwsgi_offload_reque
 		case 1:
 			rlen = write(uor->s, uor->buf + uor->pos, uor->to_write);
 			if (rlen > 0) {
+				uor->written += rlen;
 				uor->to_write -= rlen;
 				uor->pos += rlen;
 				if (uor->to_write == 0) {
@@ -556,6 +917,7 @@ static int u_offload_transfer_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 		case 3:
 			rlen = write(uor->s, uor->buf + uor->pos, uor->to_write);
 			if (rlen > 0) {
+				uor->written += rlen;
 				uor->to_write -= rlen;
 				uor->pos += rlen;
 				if (uor->to_write == 0) {
@@ -597,6 +959,11 @@ static int u_offload_transfer_do(struct uwsgi_thread *ut, struct uwsgi_offload_r
 
 int uwsgi_offload_run(struct wsgi_request *wsgi_req, struct uwsgi_offload_request *uor, int *wait) {
 
+	// the offload thread takes the socket, coalesced data must be written before
+	if (uwsgi_response_flush(wsgi_req)) {
+		return -1;
+	}
+
 	if (uor->engine->prepare_func(wsgi_req, uor)) {
 		return -1;
 	}
@@ -637,6 +1004,7 @@ struct uwsgi_offload_engine *uwsgi_offload_engine_by_name(char *name) {
 		if (!strcmp(name, uoe->name)) {
 			return uoe;
 		}
+		uoe = uoe->next;
 	}
 	return NULL;
 }
@@ -656,6 +1024,7 @@ struct uwsgi_offload_engine *uwsgi_offload_register_engine(char *name, int (*pre
 	engine->name = name;
 	engine->prepare_func = prepare_func;
 	engine->event_func = event_func;
+	engine->id = old_engine ? old_engine->id + 1 : 0;
 
 	if (old_engine) {
 		old_engine->next = engine;
@@ -672,6 +1041,89 @@ void uwsgi_offload_engines_register_all() {
 	uwsgi.offload_engine_transfer = uwsgi_offload_register_engine("transfer", u_offload_transfer_prepare, u_offload_transfer_do);
 	uwsgi.offload_engine_memory = uwsgi_offload_register_engine("memory", u_offload_memory_prepare, u_offload_memory_do);
 	uwsgi.offload_engine_pipe = uwsgi_offload_register_engine("pipe", u_offload_pipe_prepare, u_offload_pipe_do);
+	uwsgi.offload_engine_cache = uwsgi_offload_register_engine("cache", u_offload_region_prepare, u_offload_cache_do);
+	uwsgi.offload_engine_sharedarea = uwsgi_offload_register_engine("sharedarea", u_offload_region_prepare, u_offload_sharedarea_do);
+	uwsgi.offload_engine_websocket = uwsgi_offload_register_engine("websocket", u_offload_region_prepare, u_offload_websocket_do);
+}
+
+// allocate the shared counters of engines and threads (before fork)
+void uwsgi_setup_offload() {
+	if (uwsgi.offload_threads <= 0) return;
+	if (uwsgi.offload_threads_queue <= 0) uwsgi.offload_threads_queue = 1024;
+	offload_threads_slots = uwsgi.offload_threads;
+	struct uwsgi_offload_engine *uoe = uwsgi.offload_engines;
+	while(uoe) {
+		uwsgi.offload_engines_cnt = uoe->id + 1;
+		uoe = uoe->next;
+	}
+	uwsgi.offload_engines_stats = uwsgi_calloc_shared(sizeof(struct uwsgi_offload_engine_stats) * (uwsgi.numproc + 1) * uwsgi.offload_engines_cnt);
+	uwsgi.offload_threads_stats = uwsgi_calloc_shared(sizeof(struct uwsgi_offload_thread_stats) * (uwsgi.numproc + 1) * offload_threads_slots);
+}
+
+/*
+	"offload": {"queue_size": N, "engines": [{"name": "sendfile", "tasks": N, "active": N, "bytes": N, "usecs": N}, ...],
+		"threads": [{"worker": N, "id": N, "active": N, "queued": N, "tasks": N, "stolen": N}, ...]},
+*/
+int uwsgi_stats_offload(struct uwsgi_stats *us) {
+	if (!uwsgi.offload_threads_stats) return 0;
+	int i, j;
+
+	if (uwsgi_stats_key(us, "offload")) return -1;
+	if (uwsgi_stats_object_open(us)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "queue_size", (unsigned long long) uwsgi.offload_threads_queue)) return -1;
+
+	if (uwsgi_stats_key(us, "engines")) return -1;
+	if (uwsgi_stats_list_open(us)) return -1;
+	struct uwsgi_offload_engine *uoe = uwsgi.offload_engines;
+	while(uoe) {
+		if (uoe->id >= uwsgi.offload_engines_cnt) break;
+		if (uoe->id > 0) {
+			if (uwsgi_stats_comma(us)) return -1;
+		}
+		struct uwsgi_offload_engine_stats total;
+		memset(&total, 0, sizeof(struct uwsgi_offload_engine_stats));
+		for (i = 1; i <= uwsgi.numproc; i++) {
+			struct uwsgi_offload_engine_stats *uoes = uwsgi_offload_engine_stats(i, uoe);
+			total.tasks += uoes->tasks;
+			total.active += uoes->active;
+			total.bytes += uoes->bytes;
+			total.usecs += uoes->usecs;
+		}
+		if (uwsgi_stats_object_open(us)) return -1;
+		if (uwsgi_stats_keyval_comma(us, "name", uoe->name)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "tasks", (unsigned long long) total.tasks)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "active", (unsigned long long) total.active)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "bytes", (unsigned long long) total.bytes)) return -1;
+		if (uwsgi_stats_keylong(us, "usecs", (unsigned long long) total.usecs)) return -1;
+		if (uwsgi_stats_object_close(us)) return -1;
+		uoe = uoe->next;
+	}
+	if (uwsgi_stats_list_close(us)) return -1;
+	if (uwsgi_stats_comma(us)) return -1;
+
+	if (uwsgi_stats_key(us, "threads")) return -1;
+	if (uwsgi_stats_list_open(us)) return -1;
+	for (i = 1; i <= uwsgi.numproc; i++) {
+		for (j = 0; j < offload_threads_slots; j++) {
+			struct uwsgi_offload_thread_stats *uots = &uwsgi.offload_threads_stats[(i * offload_threads_slots) + j];
+			if (i > 1 || j > 0) {
+				if (uwsgi_stats_comma(us)) return -1;
+			}
+			if (uwsgi_stats_object_open(us)) return -1;
+			if (uwsgi_stats_keylong_comma(us, "worker", (unsigned long long) i)) return -1;
+			if (uwsgi_stats_keylong_comma(us, "id", (unsigned long long) j)) return -1;
+			if (uwsgi_stats_keylong_comma(us, "active", (unsigned long long) uots->active)) return -1;
+			if (uwsgi_stats_keylong_comma(us, "queued", (unsigned long long) uots->queued)) return -1;
+			if (uwsgi_stats_keylong_comma(us, "tasks", (unsigned long long) uots->tasks)) return -1;
+			if (uwsgi_stats_keylong(us, "stolen", (unsigned long long) uots->stolen)) return -1;
+			if (uwsgi_stats_object_close(us)) return -1;
+		}
+	}
+	if (uwsgi_stats_list_close(us)) return -1;
+
+	if (uwsgi_stats_object_close(us)) return -1;
+	if (uwsgi_stats_comma(us)) return -1;
+	return 0;
 }
 
 int uwsgi_offload_request_sendfile_do(struct wsgi_request *wsgi_req, int fd, size_t pos, size_t len) {
@@ -699,6 +1151,21 @@ int uwsgi_offload_request_memory_do(struct wsgi_request *wsgi_req, char *buf, si
         return uwsgi_offload_run(wsgi_req, &uor, NULL);
 }
 
+/*
+	stream a referenced cache item (see uwsgi_cache_get_ref()),
+	on success the reference is released by the offload thread
+*/
+int uwsgi_offload_request_cache_do(struct wsgi_request *wsgi_req, struct uwsgi_cache *uc, uint64_t index, char *value, size_t len) {
+        struct uwsgi_offload_request uor;
+        uwsgi_offload_setup(uwsgi.offload_engine_cache, &uor, wsgi_req, 1);
+        uor.data = uc;
+        uor.custom1 = index;
+        uor.custom2 = value - (char *) uc->data;
+        uor.len = len;
+        uor.free = u_offload_cache_free;
+        return uwsgi_offload_run(wsgi_req, &uor, NULL);
+}
+
 int uwsgi_offload_request_pipe_do(struct wsgi_request *wsgi_req, int fd, size_t len) {
         struct uwsgi_offload_request uor;
         uwsgi_offload_setup(uwsgi.offload_engine_pipe, &uor, wsgi_req, 1);
@@ -0,0 +1,471 @@
+#include <uwsgi.h>
+
+/*
+
+	uWSGI OpenMetrics endpoint
+
+	--metrics-http <addr> exposes all of the registered metrics (collectors and children included)
+	in the OpenMetrics text format. The endpoint is served by the metrics collector thread: after
+	each collection pass the whole response (headers included) is rendered once, and every scrape
+	of that interval gets the same buffer with a single write.
+
+	the families and the labels are derived from the metric names, the numeric parts become
+	labels named after the previous part:
+
+		worker.1.core.0.requests -> uwsgi_worker_core_requests_total{worker="1",core="0"}
+		core.busy_workers -> uwsgi_core_busy_workers
+
+	counters get the _total suffix, histograms and summaries are exported with their buckets
+	(or quantiles), _count and _sum.
+
+*/
+
+extern struct uwsgi_server uwsgi;
+
+#define UWSGI_OPENMETRICS_CLIENT_BUFSIZE 4096
+
+// a rendered response, kept alive until the last client using it is done
+struct uwsgi_openmetrics_page {
+	struct uwsgi_buffer *ub;
+	int refs;
+};
+
+struct uwsgi_openmetrics_client {
+	int fd;
+	// 0 reading the request, 1 sending the response
+	int status;
+	char buf[UWSGI_OPENMETRICS_CLIENT_BUFSIZE];
+	size_t buf_pos;
+	struct uwsgi_openmetrics_page *page;
+	size_t written;
+	time_t deadline;
+	struct uwsgi_openmetrics_client *prev;
+	struct uwsgi_openmetrics_client *next;
+};
+
+// the family and the labels of a metric (computed once, the metrics list does not change after the setup)
+struct uwsgi_openmetrics_entry {
+	struct uwsgi_metric *um;
+	char *family;
+	char *labels;
+	size_t labels_len;
+	// the first metric of a family prints the TYPE line
+	int header;
+};
+
+static struct uwsgi_openmetrics {
+	int fd;
+	struct uwsgi_openmetrics_entry *entries;
+	uint64_t entries_cnt;
+	struct uwsgi_buffer *body;
+	struct uwsgi_openmetrics_page *page;
+	struct uwsgi_openmetrics_client *clients;
+	uint64_t clients_cnt;
+	struct pollfd *pfd;
+	uint64_t pfd_cnt;
+} *uom = NULL;
+
+static char *uwsgi_openmetrics_type(struct uwsgi_metric *um) {
+	switch(um->type) {
+		case UWSGI_METRIC_COUNTER:
+			return "counter";
+		case UWSGI_METRIC_HISTOGRAM:
+			return "histogram";
+		case UWSGI_METRIC_SUMMARY:
+			return "summary";
+		default:
+			return "gauge";
+	}
+}
+
+static void uwsgi_openmetrics_sanitize(struct uwsgi_buffer *ub, char *token, size_t len) {
+	size_t i;
+	for(i=0;i<len;i++) {
+		char c = isalnum((int) token[i]) ? token[i] : '_';
+		uwsgi_buffer_append(ub, &c, 1);
+	}
+}
+
+static int uwsgi_openmetrics_numeric(char *token, size_t len) {
+	size_t i;
+	for(i=0;i<len;i++) {
+		if (!isdigit((int) token[i])) return 0;
+	}
+	return 1;
+}
+
+// split the name of a metric in the family and the labels
+static void uwsgi_openmetrics_entry(struct uwsgi_openmetrics_entry *uoe, struct uwsgi_metric *um) {
+	struct uwsgi_buffer *family = uwsgi_buffer_new(64);
+	struct uwsgi_buffer *labels = uwsgi_buffer_new(64);
+	uwsgi_buffer_append(family, "uwsgi", 5);
+
+	char *last = NULL;
+	size_t last_len = 0;
+	// consecutive numeric parts get a progressive suffix
+	int repeated = 0;
+	char *name = um->name;
+	size_t name_len = um->name_len;
+	while(name_len > 0) {
+		char *dot = memchr(name, '.', name_len);
+		size_t len = dot ? (size_t) (dot - name) : name_len;
+		if (len > 0) {
+			if (uwsgi_openmetrics_numeric(name, len)) {
+				if (labels->pos) uwsgi_buffer_append(labels, ",", 1);
+				if (last) {
+					if (isdigit((int) last[0])) uwsgi_buffer_append(labels, "_", 1);
+					uwsgi_openmetrics_sanitize(labels, last, last_len);
+				}
+				else {
+					uwsgi_buffer_append(labels, "id", 2);
+				}
+				if (repeated) {
+					uwsgi_buffer_append(labels, "_", 1);
+					uwsgi_buffer_num64(labels, repeated + 1);
+				}
+				uwsgi_buffer_append(labels, "=\"", 2);
+				uwsgi_buffer_append(labels, name, len);
+				uwsgi_buffer_append(labels, "\"", 1);
+				repeated++;
+			}
+			else {
+				uwsgi_buffer_append(family, "_", 1);
+				uwsgi_openmetrics_sanitize(family, name, len);
+				last = name;
+				last_len = len;
+				repeated = 0;
+			}
+		}
+		if (!dot) break;
+		name_len -= len + 1;
+		name = dot + 1;
+	}
+
+	// the _total suffix is added to the samples
+	if (um->type == UWSGI_METRIC_COUNTER && family->pos > 11 && !memcmp(family->buf + family->pos - 6, "_total", 6)) {
+		family->pos -= 6;
+	}
+	uwsgi_buffer_append(family, "\0", 1);
+
+	uoe->um = um;
+	uoe->family = family->buf;
+	uoe->labels = labels->buf;
+	uoe->labels_len = labels->pos;
+	family->buf = NULL;
+	labels->buf = NULL;
+	uwsgi_buffer_destroy(family);
+	uwsgi_buffer_destroy(labels);
+}
+
+// map the metrics to families, the samples of a family must be contiguous
+static void uwsgi_openmetrics_setup_entries() {
+	struct uwsgi_metric *um = uwsgi.metrics;
+	uint64_t cnt = 0;
+	while(um) {
+		cnt++;
+		um = um->next;
+	}
+
+	struct uwsgi_openmetrics_entry *entries = uwsgi_calloc(sizeof(struct uwsgi_openmetrics_entry) * (cnt + 1));
+	uint64_t i = 0, j;
+	um = uwsgi.metrics;
+	while(um) {
+		uwsgi_openmetrics_entry(&entries[i], um);
+		i++;
+		um = um->next;
+	}
+
+	// the same family with a different type is a different family
+	for(i=0;i<cnt;i++) {
+		for(j=0;j<i;j++) {
+			if (!strcmp(entries[i].family, entries[j].family) && entries[i].um->type != entries[j].um->type) {
+				char *family = uwsgi_concat3(entries[i].family, "_", uwsgi_openmetrics_type(entries[i].um));
+				free(entries[i].family);
+				entries[i].family = family;
+				break;
+			}
+		}
+	}
+
+	uom->entries = uwsgi_calloc(sizeof(struct uwsgi_openmetrics_entry) * (cnt + 1));
+	uint64_t pos = 0;
+	int *done = uwsgi_calloc(sizeof(int) * (cnt + 1));
+	for(i=0;i<cnt;i++) {
+		if (done[i]) continue;
+		for(j=i;j<cnt;j++) {
+			if (done[j] || strcmp(entries[i].family, entries[j].family)) continue;
+			uom->entries[pos] = entries[j];
+			uom->entries[pos].header = (j == i);
+			done[j] = 1;
+			pos++;
+		}
+	}
+	uom->entries_cnt = pos;
+	free(done);
+	free(entries);
+}
+
+static int uwsgi_openmetrics_sample(struct uwsgi_buffer *ub, struct uwsgi_openmetrics_entry *uoe, char *suffix, char *extra, size_t extra_len, int64_t value) {
+	if (uwsgi_buffer_append(ub, uoe->family, strlen(uoe->family))) return -1;
+	if (suffix && uwsgi_buffer_append(ub, suffix, strlen(suffix))) return -1;
+	if (uoe->labels_len || extra_len) {
+		if (uwsgi_buffer_append(ub, "{", 1)) return -1;
+		if (uwsgi_buffer_append(ub, uoe->labels, uoe->labels_len)) return -1;
+		if (uoe->labels_len && extra_len && uwsgi_buffer_append(ub, ",", 1)) return -1;
+		if (uwsgi_buffer_append(ub, extra, extra_len)) return -1;
+		if (uwsgi_buffer_append(ub, "}", 1)) return -1;
+	}
+	if (uwsgi_buffer_append(ub, " ", 1)) return -1;
+	if (uwsgi_buffer_num64(ub, value)) return -1;
+	return uwsgi_buffer_append(ub, "\n", 1);
+}
+
+static int uwsgi_openmetrics_distribution(struct uwsgi_buffer *ub, struct uwsgi_openmetrics_entry *uoe) {
+	struct uwsgi_metric_distribution *umd = uoe->um->dist;
+	char extra[64];
+	uint64_t i;
+	if (uoe->um->type == UWSGI_METRIC_HISTOGRAM) {
+		for(i=0;i<umd->bounds_cnt;i++) {
+			int ret = snprintf(extra, 64, "le=\"%lld.0\"", (long long) umd->bounds[i]);
+			if (ret <= 0 || ret >= 64) return -1;
+			if (uwsgi_openmetrics_sample(ub, uoe, "_bucket", extra, ret, umd->values[i])) return -1;
+		}
+		if (uwsgi_openmetrics_sample(ub, uoe, "_bucket", "le=\"+Inf\"", 9, umd->count)) return -1;
+	}
+	else {
+		for(i=0;i<umd->quantiles_cnt;i++) {
+			int permille = umd->quantiles[i];
+			int ret = snprintf(extra, 64, "quantile=\"%d.%03d", permille / 1000, permille % 1000);
+			if (ret <= 0 || ret >= 63) return -1;
+			// canonical representation (0.5 instead of 0.500)
+			while(extra[ret-1] == '0' && extra[ret-2] != '.') ret--;
+			extra[ret++] = '"';
+			if (uwsgi_openmetrics_sample(ub, uoe, NULL, extra, ret, umd->values[i])) return -1;
+		}
+	}
+	if (uwsgi_openmetrics_sample(ub, uoe, "_count", NULL, 0, umd->count)) return -1;
+	return uwsgi_openmetrics_sample(ub, uoe, "_sum", NULL, 0, umd->sum);
+}
+
+static void uwsgi_openmetrics_page_release(struct uwsgi_openmetrics_page *page) {
+	page->refs--;
+	if (page->refs > 0) return;
+	uwsgi_buffer_destroy(page->ub);
+	free(page);
+}
+
+// render the response for the next interval (called by the collector after each pass)
+void uwsgi_openmetrics_render() {
+	if (!uom) return;
+	if (!uom->entries) uwsgi_openmetrics_setup_entries();
+
+	struct uwsgi_buffer *body = uom->body;
+	body->pos = 0;
+	uint64_t i;
+	uwsgi_rlock(uwsgi.metrics_lock);
+	for(i=0;i<uom->entries_cnt;i++) {
+		struct uwsgi_openmetrics_entry *uoe = &uom->entries[i];
+		if (uoe->header) {
+			if (uwsgi_buffer_append(body, "# TYPE ", 7)) goto error;
+			if (uwsgi_buffer_append(body, uoe->family, strlen(uoe->family))) goto error;
+			if (uwsgi_buffer_append(body, " ", 1)) goto error;
+			char *type = uwsgi_openmetrics_type(uoe->um);
+			if (uwsgi_buffer_append(body, type, strlen(type))) goto error;
+			if (uwsgi_buffer_append(body, "\n", 1)) goto error;
+		}
+		if (uoe->um->dist) {
+			if (uwsgi_openmetrics_distribution(body, uoe)) goto error;
+			continue;
+		}
+		if (uwsgi_openmetrics_sample(body, uoe, uoe->um->type == UWSGI_METRIC_COUNTER ? "_total" : NULL, NULL, 0, *uoe->um->value)) goto error;
+	}
+	uwsgi_rwunlock(uwsgi.metrics_lock);
+	if (uwsgi_buffer_append(body, "# EOF\n", 6)) return;
+
+	struct uwsgi_openmetrics_page *page = uwsgi_calloc(sizeof(struct uwsgi_openmetrics_page));
+	page->ub = uwsgi_buffer_new(body->pos + 256);
+	if (uwsgi_buffer_append(page->ub, "HTTP/1.0 200 OK\r\nConnection: close\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\nContent-Length: ", 126)) goto error2;
+	if (uwsgi_buffer_num64(page->ub, body->pos)) goto error2;
+	if (uwsgi_buffer_append(page->ub, "\r\n\r\n", 4)) goto error2;
+	if (uwsgi_buffer_append(page->ub, body->buf, body->pos)) goto error2;
+	page->refs = 1;
+	if (uom->page) uwsgi_openmetrics_page_release(uom->page);
+	uom->page = page;
+	return;
+
+error:
+	uwsgi_rwunlock(uwsgi.metrics_lock);
+	return;
+error2:
+	uwsgi_buffer_destroy(page->ub);
+	free(page);
+}
+
+static void uwsgi_openmetrics_client_close(struct uwsgi_openmetrics_client *uoc) {
+	close(uoc->fd);
+	if (uoc->page) uwsgi_openmetrics_page_release(uoc->page);
+	if (uoc->prev) uoc->prev->next = uoc->next;
+	else uom->clients = uoc->next;
+	if (uoc->next) uoc->next->prev = uoc->prev;
+	uom->clients_cnt--;
+	free(uoc);
+}
+
+// returns 0 when the whole response has been sent
+static int uwsgi_openmetrics_client_write(struct uwsgi_openmetrics_client *uoc) {
+	struct uwsgi_buffer *ub = uoc->page->ub;
+	while(uoc->written < ub->pos) {
+		ssize_t wlen = write(uoc->fd, ub->buf + uoc->written, ub->pos - uoc->written);
+		if (wlen < 0) {
+			if (uwsgi_is_again()) return 1;
+			uwsgi_error("uwsgi_openmetrics_client_write()/write()");
+			return -1;
+		}
+		if (wlen == 0) return -1;
+		uoc->written += wlen;
+	}
+	return 0;
+}
+
+static void uwsgi_openmetrics_client_read(struct uwsgi_openmetrics_client *uoc) {
+	ssize_t rlen = read(uoc->fd, uoc->buf + uoc->buf_pos, UWSGI_OPENMETRICS_CLIENT_BUFSIZE - uoc->buf_pos);
+	if (rlen < 0 && uwsgi_is_again()) return;
+	if (rlen <= 0) {
+		uwsgi_openmetrics_client_close(uoc);
+		return;
+	}
+	// the end of the headers (they are not parsed, every request gets the metrics)
+	size_t i = uoc->buf_pos > 3 ? uoc->buf_pos : 3;
+	uoc->buf_pos += rlen;
+	int complete = uoc->buf_pos >= UWSGI_OPENMETRICS_CLIENT_BUFSIZE;
+	for(;i<uoc->buf_pos && !complete;i++) {
+		if (!memcmp(uoc->buf + i - 3, "\r\n\r\n", 4)) complete = 1;
+	}
+	if (!complete) return;
+	if (!uom->page) {
+		uwsgi_openmetrics_client_close(uoc);
+		return;
+	}
+	uoc->page = uom->page;
+	uoc->page->refs++;
+	uoc->status = 1;
+	if (uwsgi_openmetrics_client_write(uoc) <= 0) {
+		uwsgi_openmetrics_client_close(uoc);
+	}
+}
+
+static void uwsgi_openmetrics_accept() {
+	struct sockaddr_un client_src;
+	socklen_t client_src_len = sizeof(struct sockaddr_un);
+	int client_fd = accept(uom->fd, (struct sockaddr *) &client_src, &client_src_len);
+	if (client_fd < 0) {
+		if (!uwsgi_is_again()) uwsgi_error("uwsgi_openmetrics_accept()/accept()");
+		return;
+	}
+	uwsgi_socket_nb(client_fd);
+	struct uwsgi_openmetrics_client *uoc = uwsgi_calloc(sizeof(struct uwsgi_openmetrics_client));
+	uoc->fd = client_fd;
+	uoc->deadline = uwsgi_now() + uwsgi.socket_timeout;
+	uoc->next = uom->clients;
+	if (uom->clients) uom->clients->prev = uoc;
+	uom->clients = uoc;
+	uom->clients_cnt++;
+}
+
+// serve the scrapes until the next collection pass (the collector sleeps here)
+void uwsgi_openmetrics_serve(uint64_t until) {
+	if (!uom) {
+		uint64_t now = uwsgi_micros();
+		if (until > now) usleep(until - now);
+		return;
+	}
+
+	for(;;) {
+		uint64_t now = uwsgi_micros();
+		if (now >= until) break;
+
+		if (uom->clients_cnt + 1 > uom->pfd_cnt) {
+			uom->pfd_cnt = (uom->clients_cnt + 1) * 2;
+			free(uom->pfd);
+			uom->pfd = uwsgi_malloc(sizeof(struct pollfd) * uom->pfd_cnt);
+		}
+
+		uom->pfd[0].fd = uom->fd;
+		uom->pfd[0].events = POLLIN;
+		uom->pfd[0].revents = 0;
+		uint64_t n = 1;
+		struct uwsgi_openmetrics_client *uoc = uom->clients;
+		while(uoc) {
+			uom->pfd[n].fd = uoc->fd;
+			uom->pfd[n].events = uoc->status ? POLLOUT : POLLIN;
+			uom->pfd[n].revents = 0;
+			n++;
+			uoc = uoc->next;
+		}
+
+		int ret = poll(uom->pfd, n, ((until - now) + 999) / 1000);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				uwsgi_error("uwsgi_openmetrics_serve()/poll()");
+				usleep(until - now);
+				return;
+			}
+			continue;
+		}
+
+		// the list could change while serving, the clients are matched by fd
+		uint64_t i;
+		for(i=1;i<n && ret > 0;i++) {
+			if (!uom->pfd[i].revents) continue;
+			ret--;
+			uoc = uom->clients;
+			while(uoc) {
+				if (uoc->fd == uom->pfd[i].fd) break;
+				uoc = uoc->next;
+			}
+			if (!uoc) continue;
+			if (uoc->status == 0) {
+				uwsgi_openmetrics_client_read(uoc);
+			}
+			else if (uwsgi_openmetrics_client_write(uoc) <= 0) {
+				uwsgi_openmetrics_client_close(uoc);
+			}
+		}
+
+		if (uom->pfd[0].revents) {
+			uwsgi_openmetrics_accept();
+		}
+
+		// slow clients
+		time_t now_secs = uwsgi_now();
+		uoc = uom->clients;
+		while(uoc) {
+			struct uwsgi_openmetrics_client *next = uoc->next;
+			if (uoc->deadline <= now_secs) {
+				uwsgi_openmetrics_client_close(uoc);
+			}
+			uoc = next;
+		}
+	}
+}
+
+// bind the endpoint (called by the master before starting the collector)
+void uwsgi_openmetrics_bind() {
+	if (!uwsgi.metrics_http) return;
+
+	uom = uwsgi_calloc(sizeof(struct uwsgi_openmetrics));
+	char *tcp_port = strrchr(uwsgi.metrics_http, ':');
+	if (tcp_port) {
+		// disable deferred accept for this socket
+		int current_defer_accept = uwsgi.no_defer_accept;
+		uwsgi.no_defer_accept = 1;
+		uom->fd = bind_to_tcp(uwsgi.metrics_http, uwsgi.listen_queue, tcp_port);
+		uwsgi.no_defer_accept = current_defer_accept;
+	}
+	else {
+		uom->fd = bind_to_unix(uwsgi.metrics_http, uwsgi.listen_queue, uwsgi.chmod_socket, uwsgi.abstract_socket);
+	}
+	uwsgi_socket_nb(uom->fd);
+	uom->body = uwsgi_buffer_new(uwsgi.page_size);
+	uwsgi_log("*** OpenMetrics endpoint enabled on %s fd: %d ***\n", uwsgi.metrics_http, uom->fd);
+}
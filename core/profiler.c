@@ -0,0 +1,322 @@
+#include <uwsgi.h>
+
+/*
+
+	uWSGI sampling profiler
+
+	--sampling-profiler <hz> makes the master send SIGPROF to the busy workers <hz> times per second (a
+	master task). The signal handler of the worker takes the native stack of every core running
+	a request (the signal is forwarded to the threads of the busy cores) plus the language-level
+	frame given by the plugin of the request (the profiler_frame hook, it must only read memory).
+
+	the stacks are aggregated (as raw addresses) in a shared memory hash table, every slot is
+	claimed with a compare-and-swap and its counter is atomically incremented, so the workers
+	never take a lock. When the table is full the samples are dropped (and counted).
+
+	the stats server resolves the addresses (dladdr() in the master, the code loaded after fork
+	is reported as raw addresses) and serves the folded stacks (the format of flamegraph.pl)
+	at /profile (with --stats-http):
+
+		curl "http://127.0.0.1:9191/profile?reset=1"	(the samples taken after this request only)
+		curl "http://127.0.0.1:9191/profile?rate=200"	(change the rate at runtime, 0 pauses the profiler)
+
+	--sampling-profiler-stacks <n> sets the size of the table (default 4096), setting it without --sampling-profiler
+	allocates the profiler paused (it can be enabled at runtime).
+
+*/
+
+#if (!defined(__UCLIBC__) && defined(__GLIBC__)) || (defined(__APPLE__) && !defined(NO_EXECINFO)) || defined(UWSGI_HAS_EXECINFO)
+#include <execinfo.h>
+#define UWSGI_PROFILER_NATIVE
+#endif
+
+extern struct uwsgi_server uwsgi;
+
+// the frames of the signal handler (uwsgi_profiler_sample, uwsgi_profiler_signal and the trampoline)
+#define UWSGI_PROFILER_SKIP 3
+
+// process-local: cores the signal has been forwarded to
+static volatile sig_atomic_t *profiler_pending;
+// the task of the master (its interval follows the rate)
+static struct uwsgi_master_task *profiler_task;
+// counters at the last reset (used only by the stats server thread)
+static uint64_t *profiler_baseline;
+
+void uwsgi_setup_profiler() {
+	if (!uwsgi.sampling_profiler_rate && !uwsgi.sampling_profiler_stacks) return;
+	if (uwsgi.sampling_profiler_rate < 0 || uwsgi.sampling_profiler_rate > 1000) {
+		uwsgi_log("invalid profiler rate: %d (1-1000 samples per second)\n", uwsgi.sampling_profiler_rate);
+		exit(1);
+	}
+	if (uwsgi.sampling_profiler_stacks <= 0) uwsgi.sampling_profiler_stacks = 4096;
+
+	uwsgi.sampling_profiler = uwsgi_calloc_shared(sizeof(struct uwsgi_profiler) + (sizeof(struct uwsgi_profiler_stack) * uwsgi.sampling_profiler_stacks));
+	uwsgi.sampling_profiler->rate = uwsgi.sampling_profiler_rate;
+	uwsgi.sampling_profiler->stacks_cnt = uwsgi.sampling_profiler_stacks;
+	uwsgi_log("sampling profiler enabled (%d samples per second, %d stacks)\n", uwsgi.sampling_profiler_rate, uwsgi.sampling_profiler_stacks);
+}
+
+static uint64_t profiler_interval() {
+	int rate = uwsgi.sampling_profiler->rate;
+	// paused, check for a new rate every second
+	if (rate <= 0) return 1000;
+	if (rate > 1000) rate = 1000;
+	return 1000 / rate;
+}
+
+// master task: signal the busy workers
+static void profiler_tick() {
+	if (uwsgi.sampling_profiler->rate > 0) {
+		int i;
+		for (i = 1; i <= uwsgi.numproc; i++) {
+			if (uwsgi.workers[i].pid > 0 && !uwsgi.workers[i].cheaped && uwsgi_worker_is_busy(i)) {
+				kill(uwsgi.workers[i].pid, SIGPROF);
+			}
+		}
+	}
+	// applied when the task is rescheduled
+	profiler_task->interval = profiler_interval();
+}
+
+void uwsgi_profiler_register_task() {
+	if (!uwsgi.sampling_profiler) return;
+	profiler_task = uwsgi_master_task_register("profiler", profiler_interval(), profiler_interval(), profiler_tick);
+}
+
+static uint64_t profiler_hash(void **frames, int depth, char *frame, size_t frame_len) {
+	uint64_t hash = 14695981039346656037ULL;
+	uint8_t *ptr = (uint8_t *) frames;
+	size_t i, len = sizeof(void *) * depth;
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ ptr[i]) * 1099511628211ULL;
+	}
+	for (i = 0; i < frame_len; i++) {
+		hash = (hash ^ (uint8_t) frame[i]) * 1099511628211ULL;
+	}
+	// 0 marks the free slots
+	return hash ? hash : 1;
+}
+
+static void profiler_account(void **frames, int depth, char *frame, size_t frame_len) {
+	struct uwsgi_profiler *up = uwsgi.sampling_profiler;
+	uint64_t hash = profiler_hash(frames, depth, frame, frame_len);
+	uint64_t i;
+	__sync_add_and_fetch(&up->samples, 1);
+	// short linear probing, a full table drops the new stacks
+	for (i = 0; i < 32 && i < up->stacks_cnt; i++) {
+		struct uwsgi_profiler_stack *ups = &up->stacks[(hash + i) % up->stacks_cnt];
+		if (ups->hash == hash) {
+			__sync_add_and_fetch(&ups->count, 1);
+			return;
+		}
+		if (ups->hash == 0 && __sync_bool_compare_and_swap(&ups->hash, 0, hash)) {
+			memcpy(ups->frames, frames, sizeof(void *) * depth);
+			ups->depth = depth;
+			memcpy(ups->frame, frame, frame_len);
+			ups->frame_len = frame_len;
+			__sync_synchronize();
+			ups->ready = 1;
+			__sync_add_and_fetch(&ups->count, 1);
+			return;
+		}
+	}
+	__sync_add_and_fetch(&up->dropped, 1);
+}
+
+static void __attribute__ ((noinline)) uwsgi_profiler_sample(int core) {
+	void *frames[UWSGI_PROFILER_DEPTH + UWSGI_PROFILER_SKIP];
+	char frame[UWSGI_PROFILER_FRAME];
+	int depth = 0;
+	size_t frame_len = 0;
+
+#ifdef UWSGI_PROFILER_NATIVE
+	depth = backtrace(frames, UWSGI_PROFILER_DEPTH + UWSGI_PROFILER_SKIP) - UWSGI_PROFILER_SKIP;
+	if (depth < 0) depth = 0;
+#endif
+
+	struct wsgi_request *wsgi_req = &uwsgi.workers[uwsgi.mywid].cores[core].req;
+	if (wsgi_req->uh && uwsgi.p[wsgi_req->uh->modifier1]->profiler_frame) {
+		int ret = uwsgi.p[wsgi_req->uh->modifier1]->profiler_frame(wsgi_req, frame, UWSGI_PROFILER_FRAME);
+		if (ret > 0) frame_len = ret;
+	}
+
+	if (depth == 0 && frame_len == 0) return;
+	profiler_account(frames + UWSGI_PROFILER_SKIP, depth, frame, frame_len);
+}
+
+static void uwsgi_profiler_signal(int signum) {
+	int saved_errno = errno;
+	struct uwsgi_worker *uw = &uwsgi.workers[uwsgi.mywid];
+	int i, me = -1;
+
+	// a single thread (async cores share it)
+	if (uwsgi.threads <= 1) {
+		// landed on a thread of the app
+		if (!pthread_equal(uw->cores[0].thread_id, pthread_self())) {
+			pthread_kill(uw->cores[0].thread_id, SIGPROF);
+			goto end;
+		}
+		for (i = 0; i < uwsgi.cores; i++) {
+			if (uw->cores[i].in_request) {
+				uwsgi_profiler_sample(i);
+				break;
+			}
+		}
+		goto end;
+	}
+
+	pthread_t self = pthread_self();
+	for (i = 0; i < uwsgi.threads; i++) {
+		if (pthread_equal(uw->cores[i].thread_id, self)) {
+			me = i;
+			break;
+		}
+	}
+
+	// forwarded by another thread
+	if (me >= 0 && profiler_pending[me]) {
+		profiler_pending[me] = 0;
+		uwsgi_profiler_sample(me);
+		goto end;
+	}
+
+	// from the master: every busy core is sampled (a thread of the app is not a core)
+	for (i = 0; i < uwsgi.threads; i++) {
+		if (!uw->cores[i].in_request) continue;
+		if (i == me) {
+			uwsgi_profiler_sample(i);
+			continue;
+		}
+		profiler_pending[i] = 1;
+		pthread_kill(uw->cores[i].thread_id, SIGPROF);
+	}
+end:
+	errno = saved_errno;
+}
+
+// called in each worker (after the post-fork hooks)
+void uwsgi_profiler_worker_setup() {
+	if (!uwsgi.sampling_profiler) return;
+
+	profiler_pending = uwsgi_calloc(sizeof(sig_atomic_t) * uwsgi.cores);
+	// the signals landing on the threads of the app are forwarded to the first core
+	if (uwsgi.threads <= 1) {
+		uwsgi.workers[uwsgi.mywid].cores[0].thread_id = pthread_self();
+	}
+#ifdef UWSGI_PROFILER_NATIVE
+	// the first call could load libgcc (not in the signal handler)
+	void *frames[2];
+	backtrace(frames, 2);
+#endif
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = uwsgi_profiler_signal;
+	// interrupted syscalls are restarted
+	sa.sa_flags = SA_RESTART;
+	sigfillset(&sa.sa_mask);
+	if (sigaction(SIGPROF, &sa, NULL)) {
+		uwsgi_error("uwsgi_profiler_worker_setup()/sigaction()");
+	}
+}
+
+static int profiler_symbol(struct uwsgi_buffer *ub, void *addr) {
+	char buf[64];
+	Dl_info info;
+	memset(&info, 0, sizeof(Dl_info));
+	if (dladdr(addr, &info) && info.dli_sname) {
+		return uwsgi_buffer_append(ub, (char *) info.dli_sname, strlen(info.dli_sname));
+	}
+	if (info.dli_fname) {
+		char *base = strrchr(info.dli_fname, '/');
+		base = base ? base + 1 : (char *) info.dli_fname;
+		int ret = snprintf(buf, 64, "+0x%lx", (unsigned long) ((char *) addr - (char *) info.dli_fbase));
+		if (ret <= 0 || ret >= 64) return -1;
+		if (uwsgi_buffer_append(ub, base, strlen(base))) return -1;
+		return uwsgi_buffer_append(ub, buf, ret);
+	}
+	int ret = snprintf(buf, 64, "0x%lx", (unsigned long) addr);
+	if (ret <= 0 || ret >= 64) return -1;
+	return uwsgi_buffer_append(ub, buf, ret);
+}
+
+// frames cannot contain the separator
+static int profiler_append_frame(struct uwsgi_buffer *ub, char *frame, size_t len) {
+	size_t pos = ub->pos;
+	if (uwsgi_buffer_append(ub, frame, len)) return -1;
+	size_t i;
+	for (i = pos; i < ub->pos; i++) {
+		if (ub->buf[i] == ';' || ub->buf[i] == '\n') ub->buf[i] = '_';
+	}
+	return 0;
+}
+
+/*
+	the folded stacks (root first, the language-level frame is the root), called by the stats server thread
+*/
+struct uwsgi_buffer *uwsgi_profiler_folded(char *rate, int reset) {
+	struct uwsgi_profiler *up = uwsgi.sampling_profiler;
+	if (!up) return NULL;
+
+	if (rate) {
+		int new_rate = atoi(rate);
+		if (new_rate >= 0 && new_rate <= 1000) {
+			up->rate = new_rate;
+			uwsgi_log("[uwsgi-profiler] rate set to %d samples per second\n", new_rate);
+		}
+	}
+
+	if (!profiler_baseline) profiler_baseline = uwsgi_calloc(sizeof(uint64_t) * up->stacks_cnt);
+
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	uint64_t i;
+	for (i = 0; i < up->stacks_cnt; i++) {
+		struct uwsgi_profiler_stack *ups = &up->stacks[i];
+		if (!ups->ready) continue;
+		uint64_t count = ups->count;
+		uint64_t delta = count - profiler_baseline[i];
+		if (reset) profiler_baseline[i] = count;
+		if (reset || !delta) continue;
+		int first = 1;
+		if (ups->frame_len > 0) {
+			if (profiler_append_frame(ub, ups->frame, ups->frame_len)) goto error;
+			first = 0;
+		}
+		int j;
+		for (j = ups->depth - 1; j >= 0; j--) {
+			if (!first && uwsgi_buffer_append(ub, ";", 1)) goto error;
+			first = 0;
+			size_t pos = ub->pos;
+			if (profiler_symbol(ub, ups->frames[j])) goto error;
+			// fix the separators of the symbol
+			for (; pos < ub->pos; pos++) {
+				if (ub->buf[pos] == ';' || ub->buf[pos] == ' ') ub->buf[pos] = '_';
+			}
+		}
+		if (uwsgi_buffer_append(ub, " ", 1)) goto error;
+		if (uwsgi_buffer_num64(ub, delta)) goto error;
+		if (uwsgi_buffer_append(ub, "\n", 1)) goto error;
+	}
+	return ub;
+error:
+	uwsgi_buffer_destroy(ub);
+	return NULL;
+}
+
+// "profiler": {"rate": N, "samples": N, "dropped": N, "stacks": N},
+int uwsgi_stats_profiler(struct uwsgi_stats *us) {
+	struct uwsgi_profiler *up = uwsgi.sampling_profiler;
+	if (!up) return 0;
+	uint64_t i, stacks = 0;
+	for (i = 0; i < up->stacks_cnt; i++) {
+		if (up->stacks[i].ready) stacks++;
+	}
+	if (uwsgi_stats_key(us, "profiler")) return -1;
+	if (uwsgi_stats_object_open(us)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "rate", (unsigned long long) (up->rate > 0 ? up->rate : 0))) return -1;
+	if (uwsgi_stats_keylong_comma(us, "samples", (unsigned long long) up->samples)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "dropped", (unsigned long long) up->dropped)) return -1;
+	if (uwsgi_stats_keylong(us, "stacks", (unsigned long long) stacks)) return -1;
+	if (uwsgi_stats_object_close(us)) return -1;
+	return uwsgi_stats_comma(us);
+}
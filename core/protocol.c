@@ -569,6 +569,17 @@ static int uwsgi_proto_check_22(struct wsgi_request *wsgi_req, char *key, char *
 	return 0;
 }
 
+static int uwsgi_proto_check_29(struct wsgi_request *wsgi_req, char *key, char *buf, uint16_t len) {
+
+	if (!uwsgi_proto_key("HTTP_SEC_WEBSOCKET_EXTENSIONS", 29)) {
+		wsgi_req->http_sec_websocket_extensions = buf;
+		wsgi_req->http_sec_websocket_extensions_len = len;
+		return 0;
+	}
+
+	return 0;
+}
+
 static int uwsgi_proto_check_27(struct wsgi_request *wsgi_req, char *key, char *buf, uint16_t len) {
 
         if (!uwsgi_proto_key("HTTP_SEC_WEBSOCKET_PROTOCOL", 27)) {
@@ -599,6 +610,7 @@ void uwsgi_proto_hooks_setup() {
 	uwsgi.proto_hooks[20] = uwsgi_proto_check_20;
 	uwsgi.proto_hooks[22] = uwsgi_proto_check_22;
 	uwsgi.proto_hooks[27] = uwsgi_proto_check_27;
+	uwsgi.proto_hooks[29] = uwsgi_proto_check_29;
 }
 
 
@@ -40,7 +40,8 @@ struct uwsgi_route_var *uwsgi_get_route_var(char *name, uint16_t name_len) {
 	return NULL;
 }
 
-struct uwsgi_buffer *uwsgi_routing_translate(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len, char *data, size_t data_len) {
+// the original two-pass expansion (used for the corner cases the templates cannot cover)
+static struct uwsgi_buffer *uwsgi_routing_translate_slow(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len, char *data, size_t data_len) {
 
 	char *pass1 = data;
 	size_t pass1_len = data_len;
@@ -150,6 +151,361 @@ error:
 	return NULL;
 }
 
+/*
+	route action templates
+
+	the action strings are tokenized on first use (literal segments, $N captures, ${var} and
+	${routevar[args]} lookups) and cached in the route, the expansion is written into a per-core
+	scratch buffer.
+
+	The captures are expanded before the variables (the original behaviour), so templates with
+	captures inside ${...} and captured values containing a '$' are managed by the slow path.
+*/
+
+#define UWSGI_ROUTE_TOKEN_LITERAL 0
+#define UWSGI_ROUTE_TOKEN_CAPTURE 1
+#define UWSGI_ROUTE_TOKEN_VAR 2
+#define UWSGI_ROUTE_TOKEN_ROUTE_VAR 3
+
+// max number of templates cached for each route
+#define UWSGI_ROUTE_TEMPLATES 8
+
+struct uwsgi_route_token {
+	uint8_t type;
+	char *ptr;
+	uint16_t len;
+	int capture;
+	struct uwsgi_route_var *urv;
+};
+
+struct uwsgi_route_template {
+	char *data;
+	size_t data_len;
+	// the content could change (even if it is very unlikely)
+	char *copy;
+	// 0 -> without captures, 1 -> with captures
+	char *text[2];
+	struct uwsgi_route_token *tokens[2];
+	int tokens_cnt[2];
+	uint8_t slow[2];
+	struct uwsgi_route_template *next;
+};
+
+static void uwsgi_route_template_literal(struct uwsgi_route_token *tokens, int *cnt, char *ptr, size_t len) {
+	if (len == 0) return;
+	// merge with the previous literal (they are always contiguous in the copy)
+	if (*cnt > 0 && tokens[*cnt-1].type == UWSGI_ROUTE_TOKEN_LITERAL && tokens[*cnt-1].ptr + tokens[*cnt-1].len == ptr && tokens[*cnt-1].len + len <= 0xffff) {
+		tokens[*cnt-1].len += len;
+		return;
+	}
+	tokens[*cnt].type = UWSGI_ROUTE_TOKEN_LITERAL;
+	tokens[*cnt].ptr = ptr;
+	tokens[*cnt].len = len;
+	(*cnt)++;
+}
+
+/*
+	the first pass (captures) is applied symbolically: the text is built dropping the '$' of $N
+	and cap[] marks the capture positions, then the second pass state machine runs on it
+*/
+static void uwsgi_route_template_tokenize(struct uwsgi_route_template *urt, int captures) {
+	size_t len = urt->data_len;
+	char *src = urt->copy;
+	// every char could be a token
+	struct uwsgi_route_token *tokens = uwsgi_calloc(sizeof(struct uwsgi_route_token) * (len + 2));
+	int cnt = 0;
+	char *pass1 = uwsgi_malloc(len + 1);
+	char *text = pass1;
+	int *cap = uwsgi_malloc(sizeof(int) * (len + 1));
+	size_t p1 = 0;
+	size_t i;
+
+	if (captures) {
+		int dollar = 0;
+		for(i=0;i<len;i++) {
+			if (dollar) {
+				if (isdigit((int) src[i])) {
+					pass1[p1] = 0;
+					cap[p1++] = src[i] - 48;
+				}
+				else {
+					pass1[p1] = '$';
+					cap[p1++] = -1;
+					pass1[p1] = src[i];
+					cap[p1++] = -1;
+				}
+				dollar = 0;
+			}
+			else if (src[i] == '$') {
+				dollar = 1;
+			}
+			else {
+				pass1[p1] = src[i];
+				cap[p1++] = -1;
+			}
+		}
+	}
+	else {
+		for(i=0;i<len;i++) {
+			pass1[p1] = src[i];
+			cap[p1++] = -1;
+		}
+	}
+
+	// from now on literals and keys point to the first pass text
+	src = text;
+
+	int status = 0;
+	size_t literal = 0;
+	size_t key = 0;
+	for(i=0;i<p1;i++) {
+		switch(status) {
+			case 0:
+				if (cap[i] >= 0) {
+					uwsgi_route_template_literal(tokens, &cnt, src + literal, i - literal);
+					tokens[cnt].type = UWSGI_ROUTE_TOKEN_CAPTURE;
+					tokens[cnt].capture = cap[i];
+					cnt++;
+					literal = i + 1;
+					break;
+				}
+				if (src[i] == '$') {
+					uwsgi_route_template_literal(tokens, &cnt, src + literal, i - literal);
+					literal = i;
+					status = 1;
+				}
+				break;
+			case 1:
+				if (cap[i] >= 0) goto slow;
+				if (src[i] == '{') {
+					status = 2;
+					key = i + 1;
+					break;
+				}
+				// "$" and the char are a literal
+				status = 0;
+				break;
+			case 2:
+				if (cap[i] >= 0) goto slow;
+				if (src[i] == '}') {
+					char *k = src + key;
+					size_t keylen = i - key;
+					if (keylen > 0xffff) goto slow;
+					char *bracket = memchr(k, '[', keylen);
+					struct uwsgi_route_var *urv = NULL;
+					if (bracket && keylen > 0 && k[keylen-1] == ']') {
+						urv = uwsgi_get_route_var(k, bracket - k);
+					}
+					if (urv) {
+						tokens[cnt].type = UWSGI_ROUTE_TOKEN_ROUTE_VAR;
+						tokens[cnt].urv = urv;
+						tokens[cnt].ptr = bracket + 1;
+						tokens[cnt].len = keylen - (urv->name_len + 2);
+					}
+					else {
+						tokens[cnt].type = UWSGI_ROUTE_TOKEN_VAR;
+						tokens[cnt].ptr = k;
+						tokens[cnt].len = keylen;
+					}
+					cnt++;
+					literal = i + 1;
+					status = 0;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	// trailing "$" or "${..." are literals
+	uwsgi_route_template_literal(tokens, &cnt, src + literal, p1 - literal);
+
+	free(cap);
+	urt->text[captures] = text;
+	urt->tokens[captures] = tokens;
+	urt->tokens_cnt[captures] = cnt;
+	return;
+slow:
+	free(text);
+	free(cap);
+	free(tokens);
+	urt->slow[captures] = 1;
+}
+
+static struct uwsgi_route_template *uwsgi_route_template_new(char *data, size_t data_len) {
+	struct uwsgi_route_template *urt = uwsgi_calloc(sizeof(struct uwsgi_route_template));
+	urt->data = data;
+	urt->data_len = data_len;
+	urt->copy = uwsgi_malloc(data_len + 1);
+	memcpy(urt->copy, data, data_len);
+	uwsgi_route_template_tokenize(urt, 0);
+	uwsgi_route_template_tokenize(urt, 1);
+	return urt;
+}
+
+static void uwsgi_route_template_free(struct uwsgi_route_template *urt) {
+	int i;
+	for(i=0;i<2;i++) {
+		free(urt->text[i]);
+		free(urt->tokens[i]);
+	}
+	free(urt->copy);
+	free(urt);
+}
+
+// free the templates of a (virtual) route
+void uwsgi_route_free_templates(struct uwsgi_route *ur) {
+	struct uwsgi_route_template *urt = ur->templates;
+	while(urt) {
+		struct uwsgi_route_template *next = urt->next;
+		uwsgi_route_template_free(urt);
+		urt = next;
+	}
+	ur->templates = NULL;
+}
+
+static struct uwsgi_route_template *uwsgi_route_template_get(struct uwsgi_route *ur, char *data, size_t data_len, int *to_free) {
+	int cnt = 0;
+	struct uwsgi_route_template *urt = ur->templates;
+	while(urt) {
+		if (urt->data == data && urt->data_len == data_len && !memcmp(urt->copy, data, data_len)) return urt;
+		cnt++;
+		urt = urt->next;
+	}
+	urt = uwsgi_route_template_new(data, data_len);
+	if (cnt >= UWSGI_ROUTE_TEMPLATES) {
+		*to_free = 1;
+		return urt;
+	}
+	// the routes are shared by the threads of the worker
+	for(;;) {
+		struct uwsgi_route_template *head = ur->templates;
+		urt->next = head;
+		if (__sync_bool_compare_and_swap(&ur->templates, head, urt)) break;
+	}
+	return urt;
+}
+
+// 0 on success, 1 if the slow path is required, -1 on error
+static int uwsgi_route_template_run(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, struct uwsgi_route_template *urt, int captures, char *src, uint16_t src_len, struct uwsgi_buffer *ub) {
+	struct uwsgi_route_token *tokens = urt->tokens[captures];
+	int n = 0;
+	int *ovector = NULL;
+	// virtual routes have no captures
+	if (captures && ur->ovn) {
+		n = ur->ovn[wsgi_req->async_id];
+		ovector = ur->ovector[wsgi_req->async_id];
+	}
+	int i;
+	for(i=0;i<urt->tokens_cnt[captures];i++) {
+		struct uwsgi_route_token *token = &tokens[i];
+		char *value = NULL;
+		uint16_t vallen = 0;
+		switch(token->type) {
+			case UWSGI_ROUTE_TOKEN_LITERAL:
+				if (uwsgi_buffer_append(ub, token->ptr, token->len)) return -1;
+				break;
+			case UWSGI_ROUTE_TOKEN_CAPTURE:
+				if (token->capture > n || !ovector) break;
+				int pos = token->capture * 2;
+				if (ovector[pos] < 0 || ovector[pos + 1] < ovector[pos]) break;
+				value = src + ovector[pos];
+				vallen = ovector[pos + 1] - ovector[pos];
+				// the second pass would expand it
+				if (memchr(value, '$', vallen)) return 1;
+				if (uwsgi_buffer_append(ub, value, vallen)) return -1;
+				break;
+			case UWSGI_ROUTE_TOKEN_VAR:
+				value = uwsgi_get_var(wsgi_req, token->ptr, token->len, &vallen);
+				if (value && uwsgi_buffer_append(ub, value, vallen)) return -1;
+				break;
+			case UWSGI_ROUTE_TOKEN_ROUTE_VAR:
+				value = token->urv->func(wsgi_req, token->ptr, token->len, &vallen);
+				if (value) {
+					int ret = uwsgi_buffer_append(ub, value, vallen);
+					if (token->urv->need_free) free(value);
+					if (ret) return -1;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	return 0;
+}
+
+/*
+	expand the action template in the per-core scratch buffer (valid until the next expansion
+	in the same core), the result is NULL terminated
+*/
+char *uwsgi_routing_translate_scratch(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len, char *data, size_t data_len, size_t *len) {
+	struct uwsgi_buffer *ub = uwsgi.routing_scratch[wsgi_req->async_id];
+	if (!ub) {
+		ub = uwsgi_buffer_new(uwsgi.page_size);
+		uwsgi.routing_scratch[wsgi_req->async_id] = ub;
+	}
+	ub->pos = 0;
+
+	// same logic of the slow path
+	int captures = 0;
+	char *src = subject;
+	uint16_t src_len = subject_len;
+	struct uwsgi_buffer *condition_ub = ur->condition_ub ? ur->condition_ub[wsgi_req->async_id] : NULL;
+	if (condition_ub && ur->ovn[wsgi_req->async_id] > 0) {
+		src = condition_ub->buf;
+		src_len = condition_ub->pos;
+		captures = 1;
+	}
+	else if (subject) {
+		captures = 1;
+	}
+
+	int to_free = 0;
+	struct uwsgi_route_template *urt = uwsgi_route_template_get(ur, data, data_len, &to_free);
+	int ret = 1;
+	if (!urt->slow[captures]) {
+		ret = uwsgi_route_template_run(wsgi_req, ur, urt, captures, src, src_len, ub);
+	}
+	if (to_free) uwsgi_route_template_free(urt);
+	if (ret < 0) return NULL;
+	if (ret > 0) {
+		ub->pos = 0;
+		goto slow;
+	}
+
+	if (uwsgi_buffer_append(ub, "\0", 1)) return NULL;
+	ub->pos--;
+	*len = ub->pos;
+	return ub->buf;
+
+slow:
+	{
+		struct uwsgi_buffer *slow_ub = uwsgi_routing_translate_slow(wsgi_req, ur, subject, subject_len, data, data_len);
+		if (!slow_ub) return NULL;
+		if (uwsgi_buffer_append(ub, slow_ub->buf, slow_ub->pos + 1)) {
+			uwsgi_buffer_destroy(slow_ub);
+			return NULL;
+		}
+		ub->pos--;
+		uwsgi_buffer_destroy(slow_ub);
+		*len = ub->pos;
+		return ub->buf;
+	}
+}
+
+struct uwsgi_buffer *uwsgi_routing_translate(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len, char *data, size_t data_len) {
+	if (!uwsgi.routing_scratch) {
+		return uwsgi_routing_translate_slow(wsgi_req, ur, subject, subject_len, data, data_len);
+	}
+	size_t len = 0;
+	char *value = uwsgi_routing_translate_scratch(wsgi_req, ur, subject, subject_len, data, data_len, &len);
+	if (!value) return NULL;
+	// a single allocation of the exact size
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(len + 1);
+	memcpy(ub->buf, value, len + 1);
+	ub->pos = len;
+	return ub;
+}
+
 static void uwsgi_routing_reset_memory(struct wsgi_request *wsgi_req, struct uwsgi_route *routes) {
 	// free dynamic memory structures
 	if (routes->if_func) {
@@ -166,6 +522,61 @@ static void uwsgi_routing_reset_memory(struct wsgi_request *wsgi_req, struct uws
 
 }
 
+/*
+	compiled routing tables
+
+	the regexp routes are prefiltered (the regexp is still executed to fill the captures):
+
+	- routes whose regexp starts with ^ followed by a literal, are indexed (by their subject)
+	  in a trie: a single walk of the subject marks all of the routes whose prefix matches
+	- runs of consecutive routes (on the same subject) without a literal prefix are combined in
+	  a single alternation, if it does not match, none of them could match
+
+	results are cached per-core and invalidated by a generation counter bumped at every routing
+	pass and after every action (actions could change the subjects), so goto, labels and
+	continue semantics are untouched
+*/
+
+static void uwsgi_route_trie_walk(struct uwsgi_route_trie *urt, char *subject, uint16_t subject_len, int core, uint64_t gen) {
+	struct uwsgi_route_trie_node *nodes = urt->nodes;
+	uint32_t node = 0;
+	uint16_t i;
+	for(i=0;i<subject_len;i++) {
+		unsigned char c = subject[i];
+		uint32_t child = nodes[node].child;
+		while(child && nodes[child].c != c) {
+			child = nodes[child].sibling;
+		}
+		if (!child) return;
+		node = child;
+		struct uwsgi_route *ur = nodes[node].routes;
+		while(ur) {
+			ur->trie_gen[core] = gen;
+			ur = ur->trie_next;
+		}
+	}
+}
+
+// returns 0 if the route cannot match
+static int uwsgi_route_prefilter(struct wsgi_request *wsgi_req, struct uwsgi_route *ur, char *subject, uint16_t subject_len) {
+	int core = wsgi_req->async_id;
+	uint64_t gen = uwsgi.routing_gen[core];
+	if (ur->trie) {
+		struct uwsgi_route_trie *urt = ur->trie;
+		if (urt->gen[core] != gen) {
+			urt->gen[core] = gen;
+			uwsgi_route_trie_walk(urt, subject, subject_len, core, gen);
+		}
+		return ur->trie_gen[core] == gen;
+	}
+	struct uwsgi_route_group *urg = ur->group;
+	if (urg->gen[core] != gen) {
+		urg->gen[core] = gen;
+		urg->matched[core] = uwsgi_regexp_match(urg->pattern, urg->pattern_extra, subject, subject_len) >= 0;
+	}
+	return urg->matched[core];
+}
+
 int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_req, char *subject, uint16_t subject_len) {
 
 	int n = -1;
@@ -189,9 +600,18 @@ int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_
 		r_pc = &wsgi_req->final_route_pc;
 	}
 
+	// invalidate the results of the prefilters
+	if (uwsgi.routing_gen) uwsgi.routing_gen[wsgi_req->async_id]++;
+
 	while (routes) {
 
-		if (routes->label) goto next;
+		if (routes->label) {
+			// only request routes have an id
+			if (routes->label_id && !(*r_goto > 0 && *r_pc < *r_goto)) {
+				wsgi_req->route_label_id = routes->label_id;
+			}
+			goto next;
+		}
 
 		if (*r_goto > 0 && *r_pc < *r_goto) {
 			goto next;
@@ -211,6 +631,9 @@ int uwsgi_apply_routes_do(struct uwsgi_route *routes, struct wsgi_request *wsgi_
 				subject = *subject2 ;
 				subject_len = *subject_len2;
 			}
+			if ((routes->trie || routes->group) && !uwsgi_route_prefilter(wsgi_req, routes, subject, subject_len)) {
+				goto next;
+			}
 			n = uwsgi_regexp_match_ovec(routes->pattern, routes->pattern_extra, subject, subject_len, routes->ovector[wsgi_req->async_id], routes->ovn[wsgi_req->async_id]);
 		}
 		else {
@@ -243,6 +666,8 @@ run:
 			int ret = routes->func(wsgi_req, routes);
 			uwsgi_routing_reset_memory(wsgi_req, routes);
 			wsgi_req->is_routing = 0;
+			// the action could have changed the subjects
+			if (uwsgi.routing_gen) uwsgi.routing_gen[wsgi_req->async_id]++;
 			if (ret == UWSGI_ROUTE_BREAK) {
 				uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].routed_requests++;
 				return ret;
@@ -497,7 +922,204 @@ done:
 	exit(1);
 }
 
-void uwsgi_fixup_routes(struct uwsgi_route *ur) {
+// the literal prefix of a ^ anchored regexp
+static size_t uwsgi_route_literal_prefix(char *re, char *buf) {
+	size_t n = 0;
+	if (re[0] != '^') return 0;
+	// alternations could escape the anchor
+	if (strchr(re, '|')) return 0;
+	char *p = re + 1;
+	while(*p) {
+		size_t last = n;
+		if (*p == '\\') {
+			// classes, backreferences, escapes...
+			if (!p[1] || isalnum((unsigned char) p[1])) break;
+			buf[n++] = p[1];
+			p += 2;
+		}
+		else if (strchr(".^$|?*+()[]{}", *p)) {
+			break;
+		}
+		else {
+			buf[n++] = *p;
+			p++;
+		}
+		// the last char is optional
+		if (*p == '?' || *p == '*' || *p == '{') {
+			n = last;
+			break;
+		}
+		if (*p == '+') break;
+	}
+	return n;
+}
+
+// regexps that can be safely wrapped in a (?:...) alternative
+static int uwsgi_route_combinable(char *re) {
+	char *p = re;
+	while(*p) {
+		if (*p == '\\') {
+			if (!p[1]) return 0;
+			// backreferences
+			if (isdigit((unsigned char) p[1]) || p[1] == 'g' || p[1] == 'k') return 0;
+			p += 2;
+			continue;
+		}
+		if (*p == '(') {
+			// verbs (must be at the start of the pattern)
+			if (p[1] == '*') return 0;
+			if (p[1] == '?') {
+				char c = p[2];
+				// recursion, subroutines, named groups (names could clash) and branch reset
+				if (c == 'P' || c == 'R' || c == '&' || c == '|' || c == '+' || c == '-' || c == '\'' || isdigit((unsigned char) c)) return 0;
+				if (c == '<' && p[3] != '=' && p[3] != '!') return 0;
+			}
+		}
+		p++;
+	}
+	return 1;
+}
+
+static struct uwsgi_route_trie *uwsgi_route_trie_get(struct uwsgi_route_trie **tries, size_t subject) {
+	struct uwsgi_route_trie *urt = *tries, *old_urt = NULL;
+	while(urt) {
+		if (urt->subject == subject) return urt;
+		old_urt = urt;
+		urt = urt->next;
+	}
+	urt = uwsgi_calloc(sizeof(struct uwsgi_route_trie));
+	urt->subject = subject;
+	// the root node
+	urt->nodes = uwsgi_calloc(sizeof(struct uwsgi_route_trie_node));
+	urt->nodes_cnt = 1;
+	urt->gen = uwsgi_calloc(sizeof(uint64_t) * uwsgi.cores);
+	if (old_urt) {
+		old_urt->next = urt;
+	}
+	else {
+		*tries = urt;
+	}
+	return urt;
+}
+
+static void uwsgi_route_trie_add(struct uwsgi_route_trie *urt, struct uwsgi_route *ur, char *prefix, size_t prefix_len) {
+	uint32_t node = 0;
+	size_t i;
+	for(i=0;i<prefix_len;i++) {
+		unsigned char c = prefix[i];
+		uint32_t child = urt->nodes[node].child;
+		while(child && urt->nodes[child].c != c) {
+			child = urt->nodes[child].sibling;
+		}
+		if (!child) {
+			urt->nodes = realloc(urt->nodes, sizeof(struct uwsgi_route_trie_node) * (urt->nodes_cnt + 1));
+			if (!urt->nodes) {
+				uwsgi_error("uwsgi_route_trie_add()/realloc()");
+				exit(1);
+			}
+			child = urt->nodes_cnt++;
+			memset(&urt->nodes[child], 0, sizeof(struct uwsgi_route_trie_node));
+			urt->nodes[child].c = c;
+			urt->nodes[child].sibling = urt->nodes[node].child;
+			urt->nodes[node].child = child;
+		}
+		node = child;
+	}
+	// keep the routes ordered (not required, but easier to debug)
+	struct uwsgi_route **last = &urt->nodes[node].routes;
+	while(*last) last = &(*last)->trie_next;
+	*last = ur;
+	ur->trie = urt;
+	ur->trie_gen = uwsgi_calloc(sizeof(uint64_t) * uwsgi.cores);
+}
+
+#define UWSGI_ROUTE_GROUP_MAX 64
+
+static int uwsgi_route_group_build(struct uwsgi_route *first, int count) {
+	if (count < 2) return 0;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size);
+	struct uwsgi_route *ur = first;
+	int i;
+	for(i=0;i<count;i++) {
+		if (i > 0 && uwsgi_buffer_append(ub, "|", 1)) goto error;
+		if (uwsgi_buffer_append(ub, "(?:", 3)) goto error;
+		if (uwsgi_buffer_append(ub, ur->regexp, strlen(ur->regexp))) goto error;
+		if (uwsgi_buffer_append(ub, ")", 1)) goto error;
+		ur = ur->next;
+	}
+	if (uwsgi_buffer_append(ub, "\0", 1)) goto error;
+
+	struct uwsgi_route_group *urg = uwsgi_calloc(sizeof(struct uwsgi_route_group));
+	if (uwsgi_regexp_build(ub->buf, &urg->pattern, &urg->pattern_extra)) {
+		free(urg);
+		goto error;
+	}
+	urg->gen = uwsgi_calloc(sizeof(uint64_t) * uwsgi.cores);
+	urg->matched = uwsgi_calloc(uwsgi.cores);
+	ur = first;
+	for(i=0;i<count;i++) {
+		ur->group = urg;
+		ur = ur->next;
+	}
+	uwsgi_buffer_destroy(ub);
+	return count;
+error:
+	uwsgi_buffer_destroy(ub);
+	return 0;
+}
+
+static void uwsgi_compile_routes(struct uwsgi_route *routes) {
+	struct uwsgi_route_trie *tries = NULL;
+	int prefixed = 0, grouped = 0;
+	char prefix[UMAX16];
+
+	struct uwsgi_route *ur = routes;
+	while(ur) {
+		if (!ur->if_func && ur->subject && ur->regexp && strlen(ur->regexp) < UMAX16) {
+			size_t prefix_len = uwsgi_route_literal_prefix(ur->regexp, prefix);
+			if (prefix_len > 0) {
+				uwsgi_route_trie_add(uwsgi_route_trie_get(&tries, ur->subject), ur, prefix, prefix_len);
+				prefixed++;
+			}
+		}
+		ur = ur->next;
+	}
+
+	// groups are made of consecutive routes (labels and actions break them)
+	struct uwsgi_route *first = NULL;
+	int count = 0;
+	ur = routes;
+	while(ur) {
+		int candidate = !ur->if_func && ur->subject && ur->regexp && !ur->trie && uwsgi_route_combinable(ur->regexp);
+		if (first && (!candidate || ur->subject != first->subject || count >= UWSGI_ROUTE_GROUP_MAX)) {
+			grouped += uwsgi_route_group_build(first, count);
+			first = NULL;
+			count = 0;
+		}
+		if (candidate) {
+			if (!first) first = ur;
+			count++;
+		}
+		ur = ur->next;
+	}
+	if (first) {
+		grouped += uwsgi_route_group_build(first, count);
+	}
+
+	if (prefixed || grouped) {
+		if (!uwsgi.routing_gen) {
+			uwsgi.routing_gen = uwsgi_calloc(sizeof(uint64_t) * uwsgi.cores);
+		}
+		uwsgi_log("routing table compiled: %d rules indexed by literal prefix, %d rules in combined regexps\n", prefixed, grouped);
+	}
+}
+
+void uwsgi_fixup_routes(struct uwsgi_route *routes) {
+	struct uwsgi_route *ur = routes;
+	// expansion of the action templates
+	if (!uwsgi.routing_scratch) {
+		uwsgi.routing_scratch = uwsgi_calloc(sizeof(struct uwsgi_buffer *) * uwsgi.cores);
+	}
 	while(ur) {
 		// prepare the main pointers
 		ur->ovn = uwsgi_calloc(sizeof(int) * uwsgi.cores);
@@ -520,6 +1142,10 @@ void uwsgi_fixup_routes(struct uwsgi_route *ur) {
 		}
 		ur = ur->next;
         }
+
+	if (!uwsgi.no_routing_compile) {
+		uwsgi_compile_routes(routes);
+	}
 }
 
 int uwsgi_route_api_func(struct wsgi_request *wsgi_req, char *router, char *args) {
@@ -546,6 +1172,7 @@ found:
 	if (ur->free) {
 		ur->free(ur);
 	}
+	uwsgi_route_free_templates(ur);
 	free(ur);
 	free(args);
 	return ret;
@@ -629,10 +1256,10 @@ static int uwsgi_router_simple_math_func(struct wsgi_request *wsgi_req, struct u
 	int64_t value = 1;
 
 	if (ur->data2_len) {
-        	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
-        	if (!ub) return UWSGI_ROUTE_BREAK;
-		value = uwsgi_str_num(ub->buf, ub->pos);
-		uwsgi_buffer_destroy(ub);
+        	size_t translated_len = 0;
+        	char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len, &translated_len);
+        	if (!translated) return UWSGI_ROUTE_BREAK;
+		value = uwsgi_str_num(translated, translated_len);
 	}
 
 	char out[sizeof(UMAX64_STR)+1];
@@ -720,6 +1347,7 @@ static int transform_flush(struct wsgi_request *wsgi_req, struct uwsgi_transform
 	wsgi_req->transformed_chunk = ut->chunk->buf;
 	wsgi_req->transformed_chunk_len = ut->chunk->pos;
 	int ret = uwsgi_response_write_body_do(wsgi_req, ut->chunk->buf, ut->chunk->pos);
+	if (!ret) ret = uwsgi_response_flush(wsgi_req);
 	wsgi_req->transformed_chunk = NULL;
 	wsgi_req->transformed_chunk_len = 0;
 	ut->flushed = 1;
@@ -783,11 +1411,11 @@ static int uwsgi_router_log_func(struct wsgi_request *wsgi_req, struct uwsgi_rou
 	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-	if (!ub) return UWSGI_ROUTE_BREAK;
+	size_t translated_len = 0;
+	char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+	if (!translated) return UWSGI_ROUTE_BREAK;
 
-	uwsgi_log("%.*s\n", ub->pos, ub->buf);
-	uwsgi_buffer_destroy(ub);
+	uwsgi_log("%.*s\n", translated_len, translated);
 	return UWSGI_ROUTE_NEXT;	
 }
 
@@ -824,10 +1452,10 @@ static int uwsgi_router_logvar_func(struct wsgi_request *wsgi_req, struct uwsgi_
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
-	if (!ub) return UWSGI_ROUTE_BREAK;
-	uwsgi_logvar_add(wsgi_req, ur->data, ur->data_len, ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
+	size_t translated_len = 0;
+	char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len, &translated_len);
+	if (!translated) return UWSGI_ROUTE_BREAK;
+	uwsgi_logvar_add(wsgi_req, ur->data, ur->data_len, translated, translated_len);
 
         return UWSGI_ROUTE_NEXT;
 }
@@ -854,8 +1482,9 @@ static int uwsgi_router_goto_func(struct wsgi_request *wsgi_req, struct uwsgi_ro
 	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
+	size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
 	uint32_t *r_goto = &wsgi_req->route_goto;
 	uint32_t *r_pc = &wsgi_req->route_pc;
 
@@ -878,7 +1507,7 @@ static int uwsgi_router_goto_func(struct wsgi_request *wsgi_req, struct uwsgi_ro
         }
 	while(routes) {
 		if (!routes->label) goto next;
-		if (!uwsgi_strncmp(routes->label, routes->label_len, ub->buf, ub->pos)) {
+		if (!uwsgi_strncmp(routes->label, routes->label_len, translated, translated_len)) {
 			*r_goto = routes->pos;
 			goto found;
 		}
@@ -889,7 +1518,6 @@ next:
 	*r_goto = ur->custom;
 	
 found:
-	uwsgi_buffer_destroy(ub);
 	if (*r_goto <= *r_pc) {
 		*r_goto = 0;
 		uwsgi_log("[uwsgi-route] ERROR \"goto\" instruction can only jump forward (check your label !!!)\n");
@@ -912,14 +1540,13 @@ static int uwsgi_router_addvar_func(struct wsgi_request *wsgi_req, struct uwsgi_
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
+	size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data2, ur->data2_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
 
-	if (!uwsgi_req_append(wsgi_req, ur->data, ur->data_len, ub->buf, ub->pos)) {
-		uwsgi_buffer_destroy(ub);
+	if (!uwsgi_req_append(wsgi_req, ur->data, ur->data_len, translated, translated_len)) {
         	return UWSGI_ROUTE_BREAK;
 	}
-	uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 
@@ -945,10 +1572,10 @@ static int uwsgi_router_addheader_func(struct wsgi_request *wsgi_req, struct uws
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-	uwsgi_additional_header_add(wsgi_req, ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
+	size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+	uwsgi_additional_header_add(wsgi_req, translated, translated_len);
         return UWSGI_ROUTE_NEXT;
 }
 
@@ -966,10 +1593,10 @@ static int uwsgi_router_remheader_func(struct wsgi_request *wsgi_req, struct uws
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        uwsgi_remove_header(wsgi_req, ub->buf, ub->pos);
-	uwsgi_buffer_destroy(ub);
+	size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        uwsgi_remove_header(wsgi_req, translated, translated_len);
         return UWSGI_ROUTE_NEXT;
 }
 
@@ -987,15 +1614,14 @@ static int uwsgi_router_clearheaders_func(struct wsgi_request *wsgi_req, struct
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
 
-	if (uwsgi_response_prepare_headers(wsgi_req, ub->buf, ub->pos)) {
-        	uwsgi_buffer_destroy(ub);
+	if (uwsgi_response_prepare_headers(wsgi_req, translated, translated_len)) {
         	return UWSGI_ROUTE_BREAK;
 	}
 	
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 
@@ -1038,14 +1664,13 @@ static int uwsgi_router_chdir_func(struct wsgi_request *wsgi_req, struct uwsgi_r
 	char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-	if (!ub) return UWSGI_ROUTE_BREAK;
-	if (chdir(ub->buf)) {
+        size_t translated_len = 0;
+	char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+	if (!translated) return UWSGI_ROUTE_BREAK;
+	if (chdir(translated)) {
 		uwsgi_req_error("uwsgi_router_chdir_func()/chdir()");
-		uwsgi_buffer_destroy(ub);
 		return UWSGI_ROUTE_BREAK;
 	}
-	uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_chdir(struct uwsgi_route *ur, char *arg) {
@@ -1060,16 +1685,15 @@ static int uwsgi_router_setapp_func(struct wsgi_request *wsgi_req, struct uwsgi_
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-	char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_APPID", 11, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+	char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_APPID", 11, translated, translated_len);
 	if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
 	wsgi_req->appid = ptr;
-	wsgi_req->appid_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+	wsgi_req->appid_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setapp(struct uwsgi_route *ur, char *arg) {
@@ -1084,16 +1708,15 @@ static int uwsgi_router_setscriptname_func(struct wsgi_request *wsgi_req, struct
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "SCRIPT_NAME", 11, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "SCRIPT_NAME", 11, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->script_name = ptr;
-        wsgi_req->script_name_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->script_name_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setscriptname(struct uwsgi_route *ur, char *arg) {
@@ -1108,16 +1731,15 @@ static int uwsgi_router_setmethod_func(struct wsgi_request *wsgi_req, struct uws
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "REQUEST_METHOD", 14, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "REQUEST_METHOD", 14, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->method = ptr;
-        wsgi_req->method_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->method_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setmethod(struct uwsgi_route *ur, char *arg) {
@@ -1132,16 +1754,15 @@ static int uwsgi_router_seturi_func(struct wsgi_request *wsgi_req, struct uwsgi_
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "REQUEST_URI", 11, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "REQUEST_URI", 11, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->uri = ptr;
-        wsgi_req->uri_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->uri_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_seturi(struct uwsgi_route *ur, char *arg) {
@@ -1156,16 +1777,15 @@ static int uwsgi_router_setremoteaddr_func(struct wsgi_request *wsgi_req, struct
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "REMOTE_ADDR", 11, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "REMOTE_ADDR", 11, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->remote_addr = ptr;
-        wsgi_req->remote_addr_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->remote_addr_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setremoteaddr(struct uwsgi_route *ur, char *arg) {
@@ -1181,16 +1801,15 @@ static int uwsgi_router_setdocroot_func(struct wsgi_request *wsgi_req, struct uw
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "DOCUMENT_ROOT", 13, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "DOCUMENT_ROOT", 13, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->document_root = ptr;
-        wsgi_req->document_root_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->document_root_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setdocroot(struct uwsgi_route *ur, char *arg) {
@@ -1206,16 +1825,15 @@ static int uwsgi_router_setpathinfo_func(struct wsgi_request *wsgi_req, struct u
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "PATH_INFO", 9, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "PATH_INFO", 9, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->path_info = ptr;
-        wsgi_req->path_info_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->path_info_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setpathinfo(struct uwsgi_route *ur, char *arg) {
@@ -1251,16 +1869,15 @@ static int uwsgi_router_setscheme_func(struct wsgi_request *wsgi_req, struct uws
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_SCHEME", 12, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_SCHEME", 12, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->scheme = ptr;
-        wsgi_req->scheme_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->scheme_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setscheme(struct uwsgi_route *ur, char *arg) {
@@ -1296,22 +1913,21 @@ static int uwsgi_router_setuser_func(struct wsgi_request *wsgi_req, struct uwsgi
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-	uint16_t user_len = ub->pos;
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+	uint16_t user_len = translated_len;
 	// stop at the first colon (useful for various tricks)
-	char *colon = memchr(ub->buf, ':', ub->pos);
+	char *colon = memchr(translated, ':', translated_len);
 	if (colon) {
-		user_len = colon - ub->buf;
+		user_len = colon - translated;
 	}
-        char *ptr = uwsgi_req_append(wsgi_req, "REMOTE_USER", 11, ub->buf, user_len);
+        char *ptr = uwsgi_req_append(wsgi_req, "REMOTE_USER", 11, translated, user_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->remote_user = ptr;
-        wsgi_req->remote_user_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->remote_user_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setuser(struct uwsgi_route *ur, char *arg) {
@@ -1327,16 +1943,15 @@ static int uwsgi_router_sethome_func(struct wsgi_request *wsgi_req, struct uwsgi
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_HOME", 10, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_HOME", 10, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->home = ptr;
-        wsgi_req->home_len = ub->pos;
-        uwsgi_buffer_destroy(ub);
+        wsgi_req->home_len = translated_len;
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_sethome(struct uwsgi_route *ur, char *arg) {
@@ -1351,17 +1966,16 @@ static int uwsgi_router_setfile_func(struct wsgi_request *wsgi_req, struct uwsgi
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-        char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_HOME", 10, ub->buf, ub->pos);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+        char *ptr = uwsgi_req_append(wsgi_req, "UWSGI_HOME", 10, translated, translated_len);
         if (!ptr) {
-                uwsgi_buffer_destroy(ub);
                 return UWSGI_ROUTE_BREAK;
         }
         wsgi_req->file = ptr;
-        wsgi_req->file_len = ub->pos;
+        wsgi_req->file_len = translated_len;
 	wsgi_req->dynamic = 1;
-        uwsgi_buffer_destroy(ub);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setfile(struct uwsgi_route *ur, char *arg) {
@@ -1377,10 +1991,10 @@ static int uwsgi_router_setprocname_func(struct wsgi_request *wsgi_req, struct u
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len);
-        if (!ub) return UWSGI_ROUTE_BREAK;
-	uwsgi_set_processname(ub->buf);
-        uwsgi_buffer_destroy(ub);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, *subject, *subject_len, ur->data, ur->data_len, &translated_len);
+        if (!translated) return UWSGI_ROUTE_BREAK;
+	uwsgi_set_processname(translated);
         return UWSGI_ROUTE_NEXT;
 }
 static int uwsgi_router_setprocname(struct uwsgi_route *ur, char *arg) {
@@ -1456,24 +2070,22 @@ static int uwsgi_router_send_crnl(struct uwsgi_route *ur, char *arg) {
 }
 
 static int uwsgi_route_condition_exists(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
-	if (!ub) return -1;
-	if (uwsgi_file_exists(ub->buf)) {
-		uwsgi_buffer_destroy(ub);
+	size_t translated_len = 0;
+	char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len, &translated_len);
+	if (!translated) return -1;
+	if (uwsgi_file_exists(translated)) {
 		return 1;
 	}
-	uwsgi_buffer_destroy(ub);
 	return 0;
 }
 
 static int uwsgi_route_condition_isfile(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
-        if (!ub) return -1;
-        if (uwsgi_is_file(ub->buf)) {
-                uwsgi_buffer_destroy(ub);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len, &translated_len);
+        if (!translated) return -1;
+        if (uwsgi_is_file(translated)) {
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
@@ -1520,15 +2132,14 @@ static int uwsgi_route_condition_regexp(struct wsgi_request *wsgi_req, struct uw
 
 static int uwsgi_route_condition_empty(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
 
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
-        if (!ub) return -1;
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len, &translated_len);
+        if (!translated) return -1;
 
-	if (ub->pos == 0) {
-        	uwsgi_buffer_destroy(ub);
+	if (translated_len == 0) {
         	return 1;
 	}
 
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
@@ -1659,10 +2270,10 @@ static int uwsgi_route_condition_lowerequal(struct wsgi_request *wsgi_req, struc
 
 #ifdef UWSGI_SSL
 static int uwsgi_route_condition_lord(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-	struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
-        if (!ub) return -1;
-        int ret = uwsgi_legion_i_am_the_lord(ub->buf);
-        uwsgi_buffer_destroy(ub);
+	size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len, &translated_len);
+        if (!translated) return -1;
+        int ret = uwsgi_legion_i_am_the_lord(translated);
         return ret;
 }
 #endif
@@ -1863,36 +2474,33 @@ zero:
 
 
 static int uwsgi_route_condition_isdir(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
-        if (!ub) return -1;
-        if (uwsgi_is_dir(ub->buf)) {
-                uwsgi_buffer_destroy(ub);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len, &translated_len);
+        if (!translated) return -1;
+        if (uwsgi_is_dir(translated)) {
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
 static int uwsgi_route_condition_islink(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
-        if (!ub) return -1;
-        if (uwsgi_is_link(ub->buf)) {
-                uwsgi_buffer_destroy(ub);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len, &translated_len);
+        if (!translated) return -1;
+        if (uwsgi_is_link(translated)) {
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
 
 static int uwsgi_route_condition_isexec(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-        struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len);
-        if (!ub) return -1;
-        if (!access(ub->buf, X_OK)) {
-                uwsgi_buffer_destroy(ub);
+        size_t translated_len = 0;
+        char *translated = uwsgi_routing_translate_scratch(wsgi_req, ur, NULL, 0, ur->subject_str, ur->subject_str_len, &translated_len);
+        if (!translated) return -1;
+        if (!access(translated, X_OK)) {
                 return 1;
         }
-        uwsgi_buffer_destroy(ub);
         return 0;
 }
 
@@ -57,7 +57,7 @@ already:
 	// implement cow
 	if (uwsgi.mywid == 0) {
 		int i;
-		for(i=1;i<=uwsgi.numproc;i++) {
+		for(i=1;i<=uwsgi.numproc+uwsgi.warm_spares;i++) {
 			uwsgi.shared->rpc_count[i] = uwsgi.shared->rpc_count[0];
 			int pos = (i * uwsgi.rpc_max);
 			memcpy(&uwsgi.rpc_table[pos], uwsgi.rpc_table, sizeof(struct uwsgi_rpc) * uwsgi.rpc_max);
@@ -223,6 +223,15 @@ error2:
 
 
 void uwsgi_rpc_init() {
-	uwsgi.rpc_table = uwsgi_calloc_shared((sizeof(struct uwsgi_rpc) * uwsgi.rpc_max) * (uwsgi.numproc+1));
-	uwsgi.shared->rpc_count = uwsgi_calloc_shared(sizeof(uint64_t) * (uwsgi.numproc+1));
+	// warm spares have their own table too
+	uwsgi.rpc_table = uwsgi_calloc_shared((sizeof(struct uwsgi_rpc) * uwsgi.rpc_max) * (uwsgi.numproc+uwsgi.warm_spares+1));
+	uwsgi.shared->rpc_count = uwsgi_calloc_shared(sizeof(uint64_t) * (uwsgi.numproc+uwsgi.warm_spares+1));
+}
+
+// copy the functions registered in a worker slot to another one (used by warm spares when promoted)
+void uwsgi_rpc_copy(int src, int dst) {
+	uwsgi_lock(uwsgi.rpc_table_lock);
+	memcpy(&uwsgi.rpc_table[dst * uwsgi.rpc_max], &uwsgi.rpc_table[src * uwsgi.rpc_max], sizeof(struct uwsgi_rpc) * uwsgi.rpc_max);
+	uwsgi.shared->rpc_count[dst] = uwsgi.shared->rpc_count[src];
+	uwsgi_unlock(uwsgi.rpc_table_lock);
 }
@@ -35,15 +35,10 @@ ssize_t uwsgi_sendfile_do(int sockfd, int filefd, size_t pos, size_t len) {
 #endif
 
 no_sendfile:
-	if (pos > 0) {
-		if (lseek(filefd, pos, SEEK_SET) < 0) {
-			uwsgi_error("uwsgi_sendfile_do()/seek()");
-			return -1;
-		}
-	}
-	ssize_t rlen = read(filefd, buf, UMIN(len, 8192));
+	// pread() does not touch the file offset (the descriptor could be shared)
+	ssize_t rlen = pread(filefd, buf, UMIN(len, 8192), pos);
 	if (rlen <= 0) {
-		uwsgi_error("uwsgi_sendfile_do()/read()");
+		uwsgi_error("uwsgi_sendfile_do()/pread()");
 		return -1;
 	}
 	return write(sockfd, buf, rlen);
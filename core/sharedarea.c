@@ -26,6 +26,62 @@ struct uwsgi_sharedarea *uwsgi_sharedarea_get_by_id(int id, uint64_t pos) {
 	return sa;
 }
 
+/*
+	ranges of an area can be pinned (while holding the read lock) by offloaded transfers,
+	writers overlapping a pinned range wait for its release. After socket-timeout seconds
+	the range is revoked and the transfer aborted (the peer is probably stuck).
+*/
+int uwsgi_sharedarea_pin(struct uwsgi_sharedarea *sa, uint64_t pos, uint64_t len) {
+	int i;
+	for (i = 0; i < UWSGI_SHAREDAREA_PINS; i++) {
+		struct uwsgi_sharedarea_pin *pin = &sa->pins[i];
+		if (__sync_bool_compare_and_swap(&pin->used, 0, 1)) {
+			pin->pos = pos;
+			pin->len = len;
+			pin->revoked = 0;
+			return i;
+		}
+	}
+	return -1;
+}
+
+void uwsgi_sharedarea_unpin(struct uwsgi_sharedarea *sa, int slot) {
+	sa->pins[slot].len = 0;
+	__sync_synchronize();
+	sa->pins[slot].used = 0;
+}
+
+static int sharedarea_pinned(struct uwsgi_sharedarea *sa, uint64_t pos, uint64_t len) {
+	int i;
+	for (i = 0; i < UWSGI_SHAREDAREA_PINS; i++) {
+		struct uwsgi_sharedarea_pin *pin = &sa->pins[i];
+		if (!pin->used || pin->revoked) continue;
+		if (pos < pin->pos + pin->len && pin->pos < pos + len) return i;
+	}
+	return -1;
+}
+
+static void sharedarea_wlock(struct uwsgi_sharedarea *sa, uint64_t pos, uint64_t len) {
+	int waited = 0;
+	for (;;) {
+		uwsgi_wlock(sa->lock);
+		int slot = sharedarea_pinned(sa, pos, len);
+		if (slot < 0) return;
+		if (waited >= uwsgi.socket_timeout * 1000) {
+			uwsgi_log("[uwsgi-sharedarea] revoking range %llu-%llu of sharedarea %d pinned by an offloaded transfer\n",
+				(unsigned long long) sa->pins[slot].pos, (unsigned long long) (sa->pins[slot].pos + sa->pins[slot].len), sa->id);
+			sa->pins[slot].revoked = 1;
+			uwsgi_rwunlock(sa->lock);
+			continue;
+		}
+		uwsgi_rwunlock(sa->lock);
+		if (uwsgi.wait_milliseconds_hook(1)) {
+			usleep(1000);
+		}
+		waited++;
+	}
+}
+
 int uwsgi_sharedarea_update(int id) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, 0);
         if (!sa) return -1;
@@ -43,7 +99,7 @@ int uwsgi_sharedarea_rlock(int id) {
 int uwsgi_sharedarea_wlock(int id) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, 0);
         if (!sa) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, 0, sa->max_pos + 1);
         return 0;
 }
 
@@ -72,7 +128,7 @@ int uwsgi_sharedarea_write(int id, uint64_t pos, char *blob, uint64_t len) {
 	struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
 	if (!sa) return -1;
 	if (pos + len > sa->max_pos + 1) return -1;
-	uwsgi_wlock(sa->lock);
+	sharedarea_wlock(sa, pos, len);
 	memcpy(sa->area + pos, blob, len);	
 	sa->updates++;
 	uwsgi_rwunlock(sa->lock);
@@ -120,7 +176,7 @@ int uwsgi_sharedarea_inc8(int id, uint64_t pos, int8_t amount) {
 	struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
         if (!sa) return -1;
         if (pos + 1 > sa->max_pos + 1) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, pos, 1);
 	int8_t *n_ptr = (int8_t *) (sa->area + pos);
         *n_ptr+=amount;
         sa->updates++;
@@ -132,7 +188,7 @@ int uwsgi_sharedarea_inc16(int id, uint64_t pos, int16_t amount) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
         if (!sa) return -1;
         if (pos + 2 > sa->max_pos + 1) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, pos, 2);
         int16_t *n_ptr = (int16_t *) (sa->area + pos);
         *n_ptr+=amount;
         sa->updates++;
@@ -144,7 +200,7 @@ int uwsgi_sharedarea_inc32(int id, uint64_t pos, int32_t amount) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
         if (!sa) return -1;
         if (pos + 4 > sa->max_pos + 1) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, pos, 4);
         int32_t *n_ptr = (int32_t *) (sa->area + pos);
         *n_ptr+=amount;
         sa->updates++;
@@ -156,7 +212,7 @@ int uwsgi_sharedarea_inc64(int id, uint64_t pos, int64_t amount) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
         if (!sa) return -1;
         if (pos + 4 > sa->max_pos + 1) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, pos, 8);
         int64_t *n_ptr = (int64_t *) (sa->area + pos);
         *n_ptr+=amount;
         sa->updates++;
@@ -169,7 +225,7 @@ int uwsgi_sharedarea_dec8(int id, uint64_t pos, int8_t amount) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
         if (!sa) return -1;
         if (pos + 1 > sa->max_pos + 1) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, pos, 1);
         int8_t *n_ptr = (int8_t *) (sa->area + pos);
         *n_ptr-=amount;
         sa->updates++;
@@ -181,7 +237,7 @@ int uwsgi_sharedarea_dec16(int id, uint64_t pos, int16_t amount) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
         if (!sa) return -1;
         if (pos + 2 > sa->max_pos + 1) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, pos, 2);
         int16_t *n_ptr = (int16_t *) (sa->area + pos);
         *n_ptr-=amount;
         sa->updates++;
@@ -193,7 +249,7 @@ int uwsgi_sharedarea_dec32(int id, uint64_t pos, int32_t amount) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
         if (!sa) return -1;
         if (pos + 4 > sa->max_pos + 1) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, pos, 4);
         int32_t *n_ptr = (int32_t *) (sa->area + pos);
         *n_ptr-=amount;
         sa->updates++;
@@ -205,7 +261,7 @@ int uwsgi_sharedarea_dec64(int id, uint64_t pos, int64_t amount) {
         struct uwsgi_sharedarea *sa = uwsgi_sharedarea_get_by_id(id, pos);
         if (!sa) return -1;
         if (pos + 4 > sa->max_pos + 1) return -1;
-        uwsgi_wlock(sa->lock);
+        sharedarea_wlock(sa, pos, 8);
         int64_t *n_ptr = (int64_t *) (sa->area + pos);
         *n_ptr-=amount;
         sa->updates++;
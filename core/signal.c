@@ -140,7 +140,7 @@ int uwsgi_register_signal(uint8_t sig, char *receiver, void *handler, uint8_t mo
 	// check for cow
 	if (uwsgi.mywid == 0) {
 		int i;
-                for(i=1;i<=uwsgi.numproc;i++) {
+                for(i=1;i<=uwsgi.numproc+uwsgi.warm_spares;i++) {
                         int pos = (i * 256);
                         memcpy(&uwsgi.shared->signal_table[pos], &uwsgi.shared->signal_table[0], sizeof(struct uwsgi_signal_entry) * 256);
                 }
@@ -151,6 +151,18 @@ int uwsgi_register_signal(uint8_t sig, char *receiver, void *handler, uint8_t mo
 	return 0;
 }
 
+// copy the handlers registered in a worker slot to another one (used by warm spares when promoted)
+void uwsgi_signal_table_copy(int src, int dst) {
+	int i;
+	uwsgi_lock(uwsgi.signal_table_lock);
+	memcpy(&uwsgi.shared->signal_table[dst * 256], &uwsgi.shared->signal_table[src * 256], sizeof(struct uwsgi_signal_entry) * 256);
+	for(i=0;i<256;i++) {
+		struct uwsgi_signal_entry *use = &uwsgi.shared->signal_table[(dst * 256) + i];
+		if (use->wid == src) use->wid = dst;
+	}
+	uwsgi_unlock(uwsgi.signal_table_lock);
+}
+
 
 int uwsgi_add_file_monitor(uint8_t sig, char *filename) {
 
@@ -440,7 +452,7 @@ int uwsgi_signal_wait(struct wsgi_request *wsgi_req, int signum) {
 	pfd[1].events = POLLIN;
 
 cycle:
-	ret = poll(pfd, 2, -1);
+	ret = uwsgi_poll(pfd, 2, -1);
 	if (ret > 0) {
 		if (pfd[0].revents == POLLIN) {
 			if (read(uwsgi.signal_socket, &uwsgi_signal, 1) != 1) {
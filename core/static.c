@@ -2,26 +2,16 @@
 
 extern struct uwsgi_server uwsgi;
 
-int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t *filename_len, struct stat *st) {
-	char can_gzip = 0, can_br = 0;
-
-	// check for filename size
-	if (*filename_len + 4 > PATH_MAX) return 0;
-	// check for supported encodings
-	can_br = uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "br", 2);
-	can_gzip = uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4);
-
-	if(!can_br && !can_gzip)
-		return 0;
-
+// check if the gzip/brotli variants of a file could be served (--static-gzip* options)
+static int uwsgi_static_gzip_allowed(char *filename, size_t filename_len) {
 	// check for 'all'
-	if (uwsgi.static_gzip_all) goto gzip;
+	if (uwsgi.static_gzip_all) return 1;
 
 	// check for dirs/prefix
 	struct uwsgi_string_list *usl = uwsgi.static_gzip_dir;
 	while(usl) {
-		if (!uwsgi_starts_with(filename, *filename_len, usl->value, usl->len)) {
-			goto gzip;
+		if (!uwsgi_starts_with(filename, filename_len, usl->value, usl->len)) {
+			return 1;
 		}
 		usl = usl->next;
 	}
@@ -29,8 +19,8 @@ int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t
 	// check for ext/suffix
 	usl = uwsgi.static_gzip_ext;
 	while(usl) {
-		if (!uwsgi_strncmp(filename + (*filename_len - usl->len), usl->len, usl->value, usl->len)) {
-			goto gzip;
+		if (!uwsgi_strncmp(filename + (filename_len - usl->len), usl->len, usl->value, usl->len)) {
+			return 1;
 		}
 		usl = usl->next;
 	}
@@ -39,15 +29,29 @@ int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t
 	// check for regexp
 	struct uwsgi_regexp_list *url = uwsgi.static_gzip;
 	while(url) {
-		if (uwsgi_regexp_match(url->pattern, url->pattern_extra, filename, *filename_len) >= 0) {
-			goto gzip;
+		if (uwsgi_regexp_match(url->pattern, url->pattern_extra, filename, filename_len) >= 0) {
+			return 1;
 		}
 		url = url->next;
 	}
 #endif
 	return 0;
+}
+
+int uwsgi_static_want_gzip(struct wsgi_request *wsgi_req, char *filename, size_t *filename_len, struct stat *st) {
+	char can_gzip = 0, can_br = 0;
 
-gzip:
+	// check for filename size
+	if (*filename_len + 4 > PATH_MAX) return 0;
+	// check for supported encodings
+	can_br = uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "br", 2);
+	can_gzip = uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4);
+
+	if(!can_br && !can_gzip)
+		return 0;
+
+	if (!uwsgi_static_gzip_allowed(filename, *filename_len))
+		return 0;
 
 	if(can_br) {
 		memcpy(filename + *filename_len, ".br\0", 4);
@@ -457,16 +461,280 @@ void uwsgi_request_fix_range_for_size(struct wsgi_request *wsgi_req, int64_t siz
 			&wsgi_req->range_from, &wsgi_req->range_to, size);
 }
 
-int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st) {
+/*
+	per-worker open-file cache (--static-file-cache <n>)
+
+	Resolved files are kept open with their struct stat, mime type, Last-Modified string
+	and the available gzip/brotli variants, so a hit costs no path syscalls at all.
+
+	Only files under the static directories (check-static, static-map and static-map2) are
+	cached: the master monitors them (recursively) via fsmon and bumps a shared generation
+	counter at every change. Workers drop their whole cache as soon as they see a new generation.
+*/
+static void uwsgi_static_file_cache_invalidate(struct uwsgi_fsmon *fs) {
+	(*uwsgi.static_file_cache_generation)++;
+}
+
+static void uwsgi_static_file_cache_add_root(char *path) {
+	char *real_path = uwsgi_malloc(PATH_MAX + 1);
+	if (!realpath(path, real_path)) {
+		uwsgi_log("[uwsgi-static] unable to monitor %s, its files will not be cached\n", path);
+		free(real_path);
+		return;
+	}
+	uwsgi_string_new_list(&uwsgi.static_file_cache_roots, real_path);
+}
+
+void uwsgi_static_file_cache_init() {
+	if (!uwsgi.static_file_cache) return;
+	uwsgi.static_file_cache_generation = uwsgi_calloc_shared(sizeof(uint64_t));
+	struct uwsgi_dyn_dict *udd;
+	for(udd = uwsgi.check_static; udd; udd = udd->next) {
+		uwsgi_static_file_cache_add_root(udd->key);
+	}
+	for(udd = uwsgi.static_maps; udd; udd = udd->next) {
+		uwsgi_static_file_cache_add_root(udd->value);
+	}
+	for(udd = uwsgi.static_maps2; udd; udd = udd->next) {
+		uwsgi_static_file_cache_add_root(udd->value);
+	}
+}
+
+// called by the master before starting the fsmon subsystem
+void uwsgi_static_file_cache_monitor() {
+	if (!uwsgi.static_file_cache) return;
+	struct uwsgi_string_list *usl;
+	uwsgi_foreach(usl, uwsgi.static_file_cache_roots) {
+		if (uwsgi_is_dir(usl->value)) {
+			uwsgi_register_fsmon_tree(usl->value, uwsgi_static_file_cache_invalidate, NULL);
+			continue;
+		}
+		// mapped files are monitored via their directory (they could be replaced)
+		char *dir = uwsgi_str(usl->value);
+		char *slash = strrchr(dir, '/');
+		if (slash && slash != dir) *slash = 0;
+		uwsgi_register_fsmon(dir, uwsgi_static_file_cache_invalidate, NULL);
+	}
+	// files cached before the monitors were available could be stale
+	(*uwsgi.static_file_cache_generation)++;
+}
+
+static void uwsgi_static_file_free(struct uwsgi_static_file *usf) {
+	int i;
+	for(i=0;i<3;i++) {
+		if (usf->variants[i].fd > -1) close(usf->variants[i].fd);
+		free(usf->variants[i].filename);
+	}
+	free(usf->key);
+	free(usf);
+}
+
+static void uwsgi_static_file_evict(struct uwsgi_static_file_cache *cache, struct uwsgi_static_file *usf) {
+	struct uwsgi_static_file **ptr = &cache->table[usf->hash & cache->mask];
+	while(*ptr) {
+		if (*ptr == usf) {
+			*ptr = usf->next;
+			break;
+		}
+		ptr = &(*ptr)->next;
+	}
+	if (usf->lru_prev) usf->lru_prev->lru_next = usf->lru_next;
+	else cache->lru_head = usf->lru_next;
+	if (usf->lru_next) usf->lru_next->lru_prev = usf->lru_prev;
+	else cache->lru_tail = usf->lru_prev;
+	cache->items--;
+	usf->evicted = 1;
+	// requests still using it (other threads or async cores) will free it
+	if (usf->refs == 0) uwsgi_static_file_free(usf);
+}
+
+// must be called with lock_static held
+static struct uwsgi_static_file_cache *uwsgi_static_file_cache_get_table() {
+	struct uwsgi_static_file_cache *cache = uwsgi.static_files;
+	uint64_t generation = *uwsgi.static_file_cache_generation;
+	if (!cache) {
+		cache = uwsgi_calloc(sizeof(struct uwsgi_static_file_cache));
+		uint32_t buckets = 1;
+		while(buckets < (uint32_t) uwsgi.static_file_cache * 2) buckets <<= 1;
+		cache->mask = buckets - 1;
+		cache->table = uwsgi_calloc(sizeof(struct uwsgi_static_file *) * buckets);
+		cache->generation = generation;
+		uwsgi.static_files = cache;
+	}
+	// something changed on the filesystem
+	if (cache->generation != generation) {
+		while(cache->lru_head) {
+			uwsgi_static_file_evict(cache, cache->lru_head);
+		}
+		cache->generation = generation;
+	}
+	return cache;
+}
+
+static struct uwsgi_static_file *uwsgi_static_file_cache_get(char *key, size_t key_len) {
+	uint32_t hash = djb33x_hash(key, key_len);
+	if (uwsgi.threads > 1)
+		pthread_mutex_lock(&uwsgi.lock_static);
+	struct uwsgi_static_file_cache *cache = uwsgi_static_file_cache_get_table();
+	struct uwsgi_static_file *usf = cache->table[hash & cache->mask];
+	while(usf) {
+		if (usf->hash == hash && usf->key_len == key_len && !memcmp(usf->key, key, key_len)) {
+			usf->refs++;
+			// move to the head of the lru list
+			if (usf->lru_prev) {
+				usf->lru_prev->lru_next = usf->lru_next;
+				if (usf->lru_next) usf->lru_next->lru_prev = usf->lru_prev;
+				else cache->lru_tail = usf->lru_prev;
+				usf->lru_prev = NULL;
+				usf->lru_next = cache->lru_head;
+				cache->lru_head->lru_prev = usf;
+				cache->lru_head = usf;
+			}
+			break;
+		}
+		usf = usf->next;
+	}
+	if (uwsgi.threads > 1)
+		pthread_mutex_unlock(&uwsgi.lock_static);
+	return usf;
+}
+
+static void uwsgi_static_file_cache_put(struct uwsgi_static_file *usf) {
+	if (uwsgi.threads > 1)
+		pthread_mutex_lock(&uwsgi.lock_static);
+	usf->refs--;
+	if (usf->evicted && usf->refs == 0) uwsgi_static_file_free(usf);
+	if (uwsgi.threads > 1)
+		pthread_mutex_unlock(&uwsgi.lock_static);
+}
+
+static int uwsgi_static_file_variant_open(struct uwsgi_static_file_variant *usfv, char *filename, size_t filename_len, char *suffix) {
+	size_t suffix_len = suffix ? strlen(suffix) : 0;
+	usfv->filename = uwsgi_concat2n(filename, filename_len, suffix ? suffix : "", suffix_len);
+	usfv->filename_len = filename_len + suffix_len;
+	usfv->fd = open(usfv->filename, O_RDONLY);
+	if (usfv->fd < 0) goto error;
+	if (fstat(usfv->fd, &usfv->st) || !S_ISREG(usfv->st.st_mode)) goto error;
+	usfv->last_modified_len = uwsgi_http_date(usfv->st.st_mtime, usfv->last_modified);
+	return 0;
+error:
+	if (usfv->fd > -1) close(usfv->fd);
+	usfv->fd = -1;
+	free(usfv->filename);
+	usfv->filename = NULL;
+	return -1;
+}
+
+static struct uwsgi_static_file *uwsgi_static_file_cache_add(char *key, size_t key_len, char *filename, size_t filename_len, struct uwsgi_string_list *index) {
+	// only files under the monitored directories can be cached
+	struct uwsgi_string_list *root = uwsgi.static_file_cache_roots;
+	while(root) {
+		if (!uwsgi_starts_with(filename, filename_len, root->value, root->len) &&
+			(filename_len == root->len || filename[root->len] == '/' || root->value[root->len-1] == '/')) break;
+		root = root->next;
+	}
+	if (!root) return NULL;
+
+	// changes happening while we build the item
+	uint64_t generation = *uwsgi.static_file_cache_generation;
+
+	struct uwsgi_static_file *usf = uwsgi_calloc(sizeof(struct uwsgi_static_file));
+	int i;
+	for(i=0;i<3;i++) usf->variants[i].fd = -1;
+	if (uwsgi_static_file_variant_open(&usf->variants[0], filename, filename_len, NULL)) {
+		free(usf);
+		return NULL;
+	}
+	usf->mime_type = uwsgi_get_mime_type(filename, filename_len, &usf->mime_type_len);
+	if (filename_len + 4 <= PATH_MAX && uwsgi_static_gzip_allowed(filename, filename_len)) {
+		uwsgi_static_file_variant_open(&usf->variants[1], filename, filename_len, ".gz");
+		uwsgi_static_file_variant_open(&usf->variants[2], filename, filename_len, ".br");
+	}
+	usf->key = uwsgi_concat2n(key, key_len, "", 0);
+	usf->key_len = key_len;
+	usf->hash = djb33x_hash(key, key_len);
+	usf->index = index;
+	usf->refs = 1;
+
+	if (uwsgi.threads > 1)
+		pthread_mutex_lock(&uwsgi.lock_static);
+	struct uwsgi_static_file_cache *cache = uwsgi_static_file_cache_get_table();
+	if (cache->generation != generation) {
+		// use it only for the current request
+		usf->evicted = 1;
+		goto end;
+	}
+	// another thread could have added the same file
+	struct uwsgi_static_file *old_usf = cache->table[usf->hash & cache->mask];
+	while(old_usf) {
+		if (old_usf->hash == usf->hash && old_usf->key_len == key_len && !memcmp(old_usf->key, key, key_len)) {
+			uwsgi_static_file_evict(cache, old_usf);
+			break;
+		}
+		old_usf = old_usf->next;
+	}
+	if (cache->items >= uwsgi.static_file_cache && cache->lru_tail) {
+		uwsgi_static_file_evict(cache, cache->lru_tail);
+	}
+	usf->next = cache->table[usf->hash & cache->mask];
+	cache->table[usf->hash & cache->mask] = usf;
+	usf->lru_next = cache->lru_head;
+	if (cache->lru_head) cache->lru_head->lru_prev = usf;
+	else cache->lru_tail = usf;
+	cache->lru_head = usf;
+	cache->items++;
+end:
+	if (uwsgi.threads > 1)
+		pthread_mutex_unlock(&uwsgi.lock_static);
+	return usf;
+}
+
+// choose the gzip/brotli variant (if available) of a cached file
+static int uwsgi_static_file_encoding(struct wsgi_request *wsgi_req, struct uwsgi_static_file *usf) {
+	if (usf->variants[2].fd > -1 && uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "br", 2)) return 2;
+	if (usf->variants[1].fd > -1 && uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4)) return 1;
+	return 0;
+}
+
+static int uwsgi_real_file_serve_do(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st, struct uwsgi_static_file *usf) {
 
 	size_t mime_type_size = 0;
 	char http_last_modified[49];
 	int use_gzip = 0;
-
-	char *mime_type = uwsgi_get_mime_type(real_filename, real_filename_len, &mime_type_size);
-
-	// here we need to choose if we want the gzip variant;
-	use_gzip = uwsgi_static_want_gzip(wsgi_req, real_filename, &real_filename_len, st);
+	char *mime_type = NULL;
+	struct uwsgi_static_file_variant *usfv = NULL;
+
+	if (usf) {
+		mime_type = usf->mime_type;
+		mime_type_size = usf->mime_type_len;
+		use_gzip = uwsgi_static_file_encoding(wsgi_req, usf);
+		usfv = &usf->variants[use_gzip];
+		real_filename = usfv->filename;
+		real_filename_len = usfv->filename_len;
+		st = &usfv->st;
+	}
+	else {
+		mime_type = uwsgi_get_mime_type(real_filename, real_filename_len, &mime_type_size);
+
+		// here we need to choose if we want the gzip variant;
+		use_gzip = uwsgi_static_want_gzip(wsgi_req, real_filename, &real_filename_len, st);
+	}
+
+	// no precompressed sibling, check the compression store
+	char store_path[PATH_MAX + 1];
+	struct stat store_st;
+	int use_store = 0;
+	if (!use_gzip && uwsgi.static_store && !uwsgi.file_serve_mode && uwsgi_contains_n(wsgi_req->encoding, wsgi_req->encoding_len, "gzip", 4)) {
+		uint64_t compressed_size = uwsgi_static_store_get(real_filename, real_filename_len, st, mime_type, mime_type_size, store_path);
+		if (compressed_size) {
+			// the variant has the same mtime of the original file
+			memcpy(&store_st, st, sizeof(struct stat));
+			store_st.st_size = compressed_size;
+			st = &store_st;
+			use_gzip = 1;
+			use_store = 1;
+		}
+	}
 
 	if (wsgi_req->if_modified_since_len) {
 		time_t ims = parse_http_date(wsgi_req->if_modified_since, wsgi_req->if_modified_since_len);
@@ -533,19 +801,27 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 	// increase static requests counter
 	uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].static_requests++;
 
+	char *last_modified = http_last_modified;
+	int last_modified_len = 0;
+	if (usfv) {
+		last_modified = usfv->last_modified;
+		last_modified_len = usfv->last_modified_len;
+	}
+	else {
+		last_modified_len = uwsgi_http_date(st->st_mtime, http_last_modified);
+	}
+
 	// nginx
 	if (uwsgi.file_serve_mode == 1) {
 		if (uwsgi_response_add_header(wsgi_req, "X-Accel-Redirect", 16, real_filename, real_filename_len)) return -1;
 		// this is the final header (\r\n added)
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
+		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, last_modified, last_modified_len)) return -1;
 	}
 	// apache
 	else if (uwsgi.file_serve_mode == 2) {
 		if (uwsgi_response_add_header(wsgi_req, "X-Sendfile", 10, real_filename, real_filename_len)) return -1;
 		// this is the final header (\r\n added)
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
+		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, last_modified, last_modified_len)) return -1;
 	}
 	// raw
 	else {
@@ -555,8 +831,7 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 			// here use the original size !!!
 			if (uwsgi_response_add_content_range(wsgi_req, wsgi_req->range_from, wsgi_req->range_to, st->st_size)) return -1;
 		}
-		int size = uwsgi_http_date(st->st_mtime, http_last_modified);
-		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, http_last_modified, size)) return -1;
+		if (uwsgi_response_add_header(wsgi_req, "Last-Modified", 13, last_modified, last_modified_len)) return -1;
 
 		// if it is a HEAD request just skip transfer
 		if (!uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
@@ -566,6 +841,22 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 
 		// Ok, the file must be transferred from uWSGI
 		// offloading will be automatically managed
+		if (use_store) {
+			int fd = open(store_path, O_RDONLY);
+			if (fd < 0) {
+				uwsgi_error_open(store_path);
+				return -1;
+			}
+			uwsgi_response_sendfile_do(wsgi_req, fd, wsgi_req->range_from, fsize);
+			wsgi_req->status = 200;
+			return 0;
+		}
+		if (usfv) {
+			// the cached descriptor is never closed here
+			uwsgi_response_sendfile_do_can_close(wsgi_req, usfv->fd, wsgi_req->range_from, fsize, 0);
+			wsgi_req->status = 200;
+			return 0;
+		}
 		int fd = open(real_filename, O_RDONLY);
 		if (fd < 0) return -1;
 		// fd will be closed in the following function
@@ -576,6 +867,44 @@ int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, si
 	return 0;
 }
 
+int uwsgi_real_file_serve(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st) {
+	return uwsgi_real_file_serve_do(wsgi_req, real_filename, real_filename_len, st, NULL);
+}
+
+static int uwsgi_file_serve_found(struct wsgi_request *wsgi_req, char *real_filename, size_t real_filename_len, struct stat *st, struct uwsgi_string_list *index, struct uwsgi_static_file *usf) {
+	if (index) {
+		// if we are here the PATH_INFO need to be changed
+		if (uwsgi_req_append_path_info_with_index(wsgi_req, index->value, index->len)) {
+			return -1;
+		}
+	}
+
+	// skip methods other than GET and HEAD
+	if (uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "GET", 3) && uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
+		return -1;
+	}
+
+	// check for skippable ext
+	struct uwsgi_string_list *sse = uwsgi.static_skip_ext;
+	while (sse) {
+		if (real_filename_len >= sse->len) {
+			if (!uwsgi_strncmp(real_filename + (real_filename_len - sse->len), sse->len, sse->value, sse->len)) {
+				return -1;
+			}
+		}
+		sse = sse->next;
+	}
+
+#ifdef UWSGI_ROUTING
+	// before sending the file, we need to check if some rule applies
+	if (!wsgi_req->is_routing && uwsgi_apply_routes_do(uwsgi.routes, wsgi_req, NULL, 0) == UWSGI_ROUTE_BREAK) {
+		return 0;
+	}
+	wsgi_req->routes_applied = 1;
+#endif
+
+	return uwsgi_real_file_serve_do(wsgi_req, real_filename, real_filename_len, st, usf);
+}
 
 int uwsgi_file_serve(struct wsgi_request *wsgi_req, char *document_root, uint16_t document_root_len, char *path_info, uint16_t path_info_len, int is_a_file) {
 
@@ -586,16 +915,39 @@ int uwsgi_file_serve(struct wsgi_request *wsgi_req, char *document_root, uint16_
 	size_t filename_len = 0;
 
 	struct uwsgi_string_list *index = NULL;
+	struct uwsgi_static_file *usf = NULL;
+	int ret = -1;
 
 	if (!is_a_file) {
-		filename = uwsgi_concat3n(document_root, document_root_len, "/", 1, path_info, path_info_len);
 		filename_len = document_root_len + 1 + path_info_len;
 	}
 	else {
-		filename = uwsgi_concat2n(document_root, document_root_len, "", 0);
 		filename_len = document_root_len;
 	}
 
+	// the open-file cache is keyed by the requested path (before any syscall)
+	if (uwsgi.static_file_cache && filename_len <= PATH_MAX) {
+		char key[PATH_MAX + 1];
+		memcpy(key, document_root, document_root_len);
+		if (!is_a_file) {
+			key[document_root_len] = '/';
+			memcpy(key + document_root_len + 1, path_info, path_info_len);
+		}
+		usf = uwsgi_static_file_cache_get(key, filename_len);
+		if (usf) {
+			ret = uwsgi_file_serve_found(wsgi_req, usf->variants[0].filename, usf->variants[0].filename_len, &usf->variants[0].st, usf->index, usf);
+			uwsgi_static_file_cache_put(usf);
+			return ret;
+		}
+	}
+
+	if (!is_a_file) {
+		filename = uwsgi_concat3n(document_root, document_root_len, "/", 1, path_info, path_info_len);
+	}
+	else {
+		filename = uwsgi_concat2n(document_root, document_root_len, "", 0);
+	}
+
 #ifdef UWSGI_DEBUG
 	uwsgi_log("[uwsgi-fileserve] checking for %s\n", filename);
 #endif
@@ -630,7 +982,6 @@ int uwsgi_file_serve(struct wsgi_request *wsgi_req, char *document_root, uint16_
 	}
 
 found:
-	free(filename);
 
 	if (uwsgi_starts_with(real_filename, real_filename_len, document_root, document_root_len)) {
 		struct uwsgi_string_list *safe = uwsgi.static_safe;
@@ -641,47 +992,26 @@ found:
 			safe = safe->next;
 		}
 		uwsgi_log("[uwsgi-fileserve] security error: %s is not under %.*s or a safe path\n", real_filename, document_root_len, document_root);
+		free(filename);
 		return -1;
 	}
 
 safe:
 
 	if (!uwsgi_static_stat(wsgi_req, real_filename, &real_filename_len, &st, &index)) {
-
-		if (index) {
-			// if we are here the PATH_INFO need to be changed
-			if (uwsgi_req_append_path_info_with_index(wsgi_req, index->value, index->len)) {
-				return -1;
-			}
-		}
-
-		// skip methods other than GET and HEAD
-		if (uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "GET", 3) && uwsgi_strncmp(wsgi_req->method, wsgi_req->method_len, "HEAD", 4)) {
-			return -1;
-		}
-
-		// check for skippable ext
-		struct uwsgi_string_list *sse = uwsgi.static_skip_ext;
-		while (sse) {
-			if (real_filename_len >= sse->len) {
-				if (!uwsgi_strncmp(real_filename + (real_filename_len - sse->len), sse->len, sse->value, sse->len)) {
-					return -1;
-				}
-			}
-			sse = sse->next;
+		if (uwsgi.static_file_cache && filename_len <= PATH_MAX) {
+			usf = uwsgi_static_file_cache_add(filename, filename_len, real_filename, real_filename_len, index);
 		}
-
-#ifdef UWSGI_ROUTING
-		// before sending the file, we need to check if some rule applies
-		if (!wsgi_req->is_routing && uwsgi_apply_routes_do(uwsgi.routes, wsgi_req, NULL, 0) == UWSGI_ROUTE_BREAK) {
-			return 0;
+		free(filename);
+		if (usf) {
+			ret = uwsgi_file_serve_found(wsgi_req, real_filename, real_filename_len, &usf->variants[0].st, index, usf);
+			uwsgi_static_file_cache_put(usf);
+			return ret;
 		}
-		wsgi_req->routes_applied = 1;
-#endif
-
-		return uwsgi_real_file_serve(wsgi_req, real_filename, real_filename_len, &st);
+		return uwsgi_file_serve_found(wsgi_req, real_filename, real_filename_len, &st, index, NULL);
 	}
 
+	free(filename);
 	return -1;
 
 }
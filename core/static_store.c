@@ -0,0 +1,460 @@
+#include "uwsgi.h"
+
+extern struct uwsgi_server uwsgi;
+
+/*
+	on-demand compression store for static files (--static-compress-store <dir>)
+
+	When a compressible file (by mime type and size) is requested by a client accepting gzip
+	and no .gz sibling is available, the store is checked: if a compressed variant is ready
+	it is sent (via sendfile) instead of the original, otherwise the compression thread of the
+	worker is asked to build it and the original file is served.
+
+	Variants are named <dev>-<inode>-<mtime>-<size>.gz, so a modified file gets a new one.
+	The index lives in shared memory (every worker sees the same items) and the least recently
+	used variants are removed when the store exceeds its size limit.
+
+	Only gzip variants are generated (no brotli library is available in the core).
+*/
+
+#ifdef UWSGI_ZLIB
+
+#define UWSGI_STATIC_STORE_EMPTY 0
+#define UWSGI_STATIC_STORE_PENDING 1
+#define UWSGI_STATIC_STORE_READY 2
+// the compressed file is not smaller enough
+#define UWSGI_STATIC_STORE_SKIP 3
+#define UWSGI_STATIC_STORE_DELETED 4
+
+struct uwsgi_static_store_job {
+	uint64_t dev;
+	uint64_t ino;
+	int64_t mtime;
+	uint64_t size;
+	char filename[PATH_MAX + 1];
+};
+
+static char *static_store_default_types[] = {
+	"text/",
+	"application/javascript",
+	"application/x-javascript",
+	"application/json",
+	"application/xml",
+	"application/wasm",
+	"image/svg+xml",
+	NULL,
+};
+
+static uint64_t static_store_hash(uint64_t dev, uint64_t ino, int64_t mtime, uint64_t size) {
+	uint64_t h = dev * 0x9E3779B97F4A7C15ULL;
+	h ^= ino + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+	h ^= (uint64_t) mtime + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+	h ^= size + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+	return h;
+}
+
+static int static_store_item_is(struct uwsgi_static_store_item *item, uint64_t dev, uint64_t ino, int64_t mtime, uint64_t size) {
+	return item->dev == dev && item->ino == ino && item->mtime == mtime && item->size == size;
+}
+
+// linear probing, deleted items are tombstones (must be called with the lock held)
+static struct uwsgi_static_store_item *static_store_find(uint64_t dev, uint64_t ino, int64_t mtime, uint64_t size, int create) {
+	struct uwsgi_static_store *uss = uwsgi.static_store;
+	struct uwsgi_static_store_item *tombstone = NULL;
+	uint64_t pos = static_store_hash(dev, ino, mtime, size) & uss->mask;
+	uint64_t i;
+	for(i=0;i<=uss->mask;i++) {
+		struct uwsgi_static_store_item *item = &uss->table[(pos + i) & uss->mask];
+		if (item->status == UWSGI_STATIC_STORE_EMPTY) {
+			if (!create) return NULL;
+			return tombstone ? tombstone : item;
+		}
+		if (item->status == UWSGI_STATIC_STORE_DELETED) {
+			if (!tombstone) tombstone = item;
+			continue;
+		}
+		if (static_store_item_is(item, dev, ino, mtime, size)) return item;
+	}
+	return create ? tombstone : NULL;
+}
+
+static void static_store_path(char *buf, uint64_t dev, uint64_t ino, int64_t mtime, uint64_t size) {
+	snprintf(buf, PATH_MAX + 1, "%s/%llx-%llx-%lld-%llu.gz", uwsgi.static_store_dir, (unsigned long long) dev, (unsigned long long) ino, (long long) mtime, (unsigned long long) size);
+}
+
+// remove the least recently used variants (must be called with the lock held)
+static void static_store_evict(void) {
+	struct uwsgi_static_store *uss = uwsgi.static_store;
+	char path[PATH_MAX + 1];
+	if (!uwsgi.static_store_max_size) return;
+	while(uss->bytes > uwsgi.static_store_max_size) {
+		struct uwsgi_static_store_item *lru = NULL;
+		uint64_t i;
+		for(i=0;i<=uss->mask;i++) {
+			struct uwsgi_static_store_item *item = &uss->table[i];
+			if (item->status != UWSGI_STATIC_STORE_READY) continue;
+			// the file could be just going to be sent
+			if (item->last_hit >= uwsgi_now() - 1) continue;
+			if (!lru || item->last_hit < lru->last_hit) lru = item;
+		}
+		if (!lru) break;
+		static_store_path(path, lru->dev, lru->ino, lru->mtime, lru->size);
+		unlink(path);
+		uss->bytes -= lru->compressed_size;
+		uss->items--;
+		uss->evicted++;
+		lru->status = UWSGI_STATIC_STORE_DELETED;
+	}
+}
+
+static int static_store_write(int fd, char *buf, size_t len) {
+	while(len > 0) {
+		ssize_t wlen = write(fd, buf, len);
+		if (wlen <= 0) {
+			if (wlen < 0 && errno == EINTR) continue;
+			return -1;
+		}
+		buf += wlen;
+		len -= wlen;
+	}
+	return 0;
+}
+
+static int static_store_job_is(struct uwsgi_static_store_job *job, struct stat *st) {
+	return job->dev == (uint64_t) st->st_dev && job->ino == (uint64_t) st->st_ino && job->mtime == (int64_t) st->st_mtime && job->size == (uint64_t) st->st_size;
+}
+
+// returns the compressed size, 0 if compression is not worth, -1 on error
+static int64_t static_store_compress(struct uwsgi_static_store_job *job, char *path) {
+	int64_t ret = -1;
+	z_stream z;
+	int z_ready = 0;
+	char in[32768];
+	char out[32768];
+	struct stat st;
+	char *tmp = NULL;
+	int out_fd = -1;
+
+	int fd = open(job->filename, O_RDONLY);
+	if (fd < 0) return -1;
+	if (fstat(fd, &st)) goto end;
+	// the file changed since the request
+	if (!static_store_job_is(job, &st)) goto end;
+
+	// every worker has its own thread
+	tmp = uwsgi_malloc(strlen(path) + 32);
+	sprintf(tmp, "%s.%d.tmp", path, (int) getpid());
+	out_fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0) {
+		uwsgi_error_open(tmp);
+		goto end;
+	}
+
+	memset(&z, 0, sizeof(z_stream));
+	// 16 + window bits generates the gzip header and trailer
+	if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) goto end;
+	z_ready = 1;
+
+	uint64_t compressed = 0;
+	int flush = Z_NO_FLUSH;
+	while(flush != Z_FINISH) {
+		ssize_t rlen = read(fd, in, sizeof(in));
+		if (rlen < 0) {
+			if (errno == EINTR) continue;
+			goto end;
+		}
+		if (rlen == 0) flush = Z_FINISH;
+		z.next_in = (unsigned char *) in;
+		z.avail_in = rlen;
+		do {
+			z.next_out = (unsigned char *) out;
+			z.avail_out = sizeof(out);
+			if (deflate(&z, flush) == Z_STREAM_ERROR) goto end;
+			size_t dlen = sizeof(out) - z.avail_out;
+			if (static_store_write(out_fd, out, dlen)) goto end;
+			compressed += dlen;
+		} while(z.avail_out == 0);
+	}
+
+	// check again for changes during compression
+	if (fstat(fd, &st) || !static_store_job_is(job, &st)) goto end;
+
+	// at least 10% smaller
+	if (compressed >= job->size - (job->size / 10)) {
+		ret = 0;
+		goto end;
+	}
+
+	// the variant keeps the mtime of the original file (used for Last-Modified)
+	struct timeval tv[2];
+	tv[0].tv_sec = st.st_mtime;
+	tv[0].tv_usec = 0;
+	tv[1].tv_sec = st.st_mtime;
+	tv[1].tv_usec = 0;
+	if (futimes(out_fd, tv)) goto end;
+
+	if (rename(tmp, path)) {
+		uwsgi_error("static_store_compress()/rename()");
+		goto end;
+	}
+	free(tmp);
+	tmp = NULL;
+	ret = compressed;
+end:
+	if (z_ready) deflateEnd(&z);
+	if (out_fd > -1) close(out_fd);
+	if (tmp) {
+		unlink(tmp);
+		free(tmp);
+	}
+	close(fd);
+	return ret;
+}
+
+static void static_store_loop(struct uwsgi_thread *ut) {
+	struct uwsgi_static_store *uss = uwsgi.static_store;
+	struct uwsgi_static_store_job job;
+	char path[PATH_MAX + 1];
+	for(;;) {
+		int interesting_fd = -1;
+		int ret = event_queue_wait(ut->queue, -1, &interesting_fd);
+		if (ret <= 0 || interesting_fd != ut->pipe[1]) continue;
+		ssize_t len = read(ut->pipe[1], &job, sizeof(struct uwsgi_static_store_job));
+		if (len <= (ssize_t) offsetof(struct uwsgi_static_store_job, filename)) continue;
+		job.filename[len - offsetof(struct uwsgi_static_store_job, filename) - 1] = 0;
+
+		static_store_path(path, job.dev, job.ino, job.mtime, job.size);
+		int64_t compressed = static_store_compress(&job, path);
+
+		uwsgi_lock(uss->lock);
+		struct uwsgi_static_store_item *item = static_store_find(job.dev, job.ino, job.mtime, job.size, 0);
+		if (item && item->status == UWSGI_STATIC_STORE_PENDING) {
+			if (compressed > 0) {
+				item->status = UWSGI_STATIC_STORE_READY;
+				item->compressed_size = compressed;
+				uss->bytes += compressed;
+				uss->compressed++;
+				static_store_evict();
+			}
+			else if (compressed == 0) {
+				item->status = UWSGI_STATIC_STORE_SKIP;
+				uss->skipped++;
+			}
+			else {
+				// will be retried
+				item->status = UWSGI_STATIC_STORE_DELETED;
+				uss->items--;
+				uss->errors++;
+			}
+		}
+		else if (compressed > 0) {
+			unlink(path);
+		}
+		uwsgi_unlock(uss->lock);
+	}
+}
+
+static int static_store_compressible(char *mime_type, size_t mime_type_len) {
+	if (!mime_type || !mime_type_len) return 0;
+	struct uwsgi_string_list *usl = uwsgi.static_store_types;
+	if (usl) {
+		while(usl) {
+			if (!uwsgi_starts_with(mime_type, mime_type_len, usl->value, usl->len)) return 1;
+			usl = usl->next;
+		}
+		return 0;
+	}
+	char **type = static_store_default_types;
+	while(*type) {
+		if (!uwsgi_starts_with(mime_type, mime_type_len, *type, strlen(*type))) return 1;
+		type++;
+	}
+	return 0;
+}
+
+static void static_store_enqueue(struct stat *st, char *filename, size_t filename_len) {
+	if (!uwsgi.static_store_thread) {
+		if (uwsgi.threads > 1)
+			pthread_mutex_lock(&uwsgi.lock_static);
+		if (!uwsgi.static_store_thread) {
+			uwsgi.static_store_thread = uwsgi_thread_new(static_store_loop);
+		}
+		if (uwsgi.threads > 1)
+			pthread_mutex_unlock(&uwsgi.lock_static);
+	}
+
+	if (uwsgi.static_store_thread) {
+		struct uwsgi_static_store_job job;
+		job.dev = st->st_dev;
+		job.ino = st->st_ino;
+		job.mtime = st->st_mtime;
+		job.size = st->st_size;
+		memcpy(job.filename, filename, filename_len);
+		job.filename[filename_len] = 0;
+		size_t len = offsetof(struct uwsgi_static_store_job, filename) + filename_len + 1;
+		if (write(uwsgi.static_store_thread->pipe[0], &job, len) == (ssize_t) len) return;
+	}
+
+	// the job has not been queued, allow another try
+	struct uwsgi_static_store *uss = uwsgi.static_store;
+	uwsgi_lock(uss->lock);
+	struct uwsgi_static_store_item *item = static_store_find(st->st_dev, st->st_ino, st->st_mtime, st->st_size, 0);
+	if (item && item->status == UWSGI_STATIC_STORE_PENDING) {
+		item->status = UWSGI_STATIC_STORE_DELETED;
+		uss->items--;
+	}
+	uwsgi_unlock(uss->lock);
+}
+
+/*
+	returns the size of the compressed variant of the file (its path is written in "path")
+	or 0 if not available
+*/
+uint64_t uwsgi_static_store_get(char *filename, size_t filename_len, struct stat *st, char *mime_type, size_t mime_type_len, char *path) {
+	struct uwsgi_static_store *uss = uwsgi.static_store;
+	if ((uint64_t) st->st_size < uwsgi.static_store_min_size) return 0;
+	if (filename_len > PATH_MAX) return 0;
+	if (!static_store_compressible(mime_type, mime_type_len)) return 0;
+
+	uint64_t compressed_size = 0;
+	int enqueue = 0;
+	uwsgi_lock(uss->lock);
+	struct uwsgi_static_store_item *item = static_store_find(st->st_dev, st->st_ino, st->st_mtime, st->st_size, 1);
+	if (!item) {
+		// the index is full
+		uss->misses++;
+	}
+	else if (item->status == UWSGI_STATIC_STORE_READY) {
+		item->last_hit = uwsgi_now();
+		compressed_size = item->compressed_size;
+		uss->hits++;
+	}
+	else if (item->status == UWSGI_STATIC_STORE_EMPTY || item->status == UWSGI_STATIC_STORE_DELETED) {
+		item->dev = st->st_dev;
+		item->ino = st->st_ino;
+		item->mtime = st->st_mtime;
+		item->size = st->st_size;
+		item->compressed_size = 0;
+		item->last_hit = uwsgi_now();
+		item->status = UWSGI_STATIC_STORE_PENDING;
+		uss->items++;
+		uss->misses++;
+		enqueue = 1;
+	}
+	else if (item->status == UWSGI_STATIC_STORE_PENDING) {
+		uss->misses++;
+	}
+	uwsgi_unlock(uss->lock);
+
+	if (enqueue) {
+		static_store_enqueue(st, filename, filename_len);
+		return 0;
+	}
+
+	if (compressed_size) {
+		static_store_path(path, st->st_dev, st->st_ino, st->st_mtime, st->st_size);
+	}
+	return compressed_size;
+}
+
+void uwsgi_static_store_init() {
+	if (!uwsgi.static_store_dir) return;
+
+	if (mkdir(uwsgi.static_store_dir, 0755) && errno != EEXIST) {
+		uwsgi_error("uwsgi_static_store_init()/mkdir()");
+		exit(1);
+	}
+
+	if (!uwsgi.static_store_min_size) uwsgi.static_store_min_size = 1024;
+	if (!uwsgi.static_store_items) uwsgi.static_store_items = 4096;
+
+	uint64_t slots = 1;
+	while(slots < (uint64_t) uwsgi.static_store_items) slots <<= 1;
+
+	struct uwsgi_static_store *uss = uwsgi_calloc_shared(sizeof(struct uwsgi_static_store));
+	uss->table = uwsgi_calloc_shared(sizeof(struct uwsgi_static_store_item) * slots);
+	uss->mask = slots - 1;
+	uss->lock = uwsgi_lock_init("static compress store");
+	uwsgi.static_store = uss;
+
+	// import the variants generated by previous instances (they are the first ones to be evicted)
+	DIR *dir = opendir(uwsgi.static_store_dir);
+	if (!dir) {
+		uwsgi_error("uwsgi_static_store_init()/opendir()");
+		exit(1);
+	}
+	struct dirent *de;
+	char path[PATH_MAX + 1];
+	while ((de = readdir(dir)) != NULL) {
+		unsigned long long dev, ino, size;
+		long long mtime;
+		int consumed = 0;
+		if (sscanf(de->d_name, "%llx-%llx-%lld-%llu.gz%n", &dev, &ino, &mtime, &size, &consumed) != 4 || de->d_name[consumed] != 0) {
+			// partial files of a dead thread
+			if (uwsgi_endswith(de->d_name, ".tmp")) {
+				snprintf(path, PATH_MAX + 1, "%s/%s", uwsgi.static_store_dir, de->d_name);
+				unlink(path);
+			}
+			continue;
+		}
+		struct stat st;
+		static_store_path(path, dev, ino, mtime, size);
+		if (stat(path, &st)) continue;
+		struct uwsgi_static_store_item *item = static_store_find(dev, ino, mtime, size, 1);
+		if (!item) break;
+		if (item->status != UWSGI_STATIC_STORE_EMPTY) continue;
+		item->dev = dev;
+		item->ino = ino;
+		item->mtime = mtime;
+		item->size = size;
+		item->compressed_size = st.st_size;
+		item->status = UWSGI_STATIC_STORE_READY;
+		uss->items++;
+		uss->bytes += st.st_size;
+	}
+	closedir(dir);
+	static_store_evict();
+
+	uwsgi_log("[uwsgi-static] compression store %s: %llu items, %llu bytes\n", uwsgi.static_store_dir, (unsigned long long) uss->items, (unsigned long long) uss->bytes);
+}
+
+/*
+	"static_compress_store": {"items": N, "bytes": N, "hits": N, "misses": N, ...},
+*/
+int uwsgi_stats_static_store(struct uwsgi_stats *us) {
+	struct uwsgi_static_store *uss = uwsgi.static_store;
+	if (!uss) return 0;
+	if (uwsgi_stats_key(us, "static_compress_store")) return -1;
+	if (uwsgi_stats_object_open(us)) return -1;
+	if (uwsgi_stats_keyval_comma(us, "dir", uwsgi.static_store_dir)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "items", uss->items)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "bytes", uss->bytes)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "max_bytes", uwsgi.static_store_max_size)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "hits", uss->hits)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "misses", uss->misses)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "compressed", uss->compressed)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "skipped", uss->skipped)) return -1;
+	if (uwsgi_stats_keylong_comma(us, "evicted", uss->evicted)) return -1;
+	if (uwsgi_stats_keylong(us, "errors", uss->errors)) return -1;
+	if (uwsgi_stats_object_close(us)) return -1;
+	if (uwsgi_stats_comma(us)) return -1;
+	return 0;
+}
+
+#else
+
+uint64_t uwsgi_static_store_get(char *filename, size_t filename_len, struct stat *st, char *mime_type, size_t mime_type_len, char *path) {
+	return 0;
+}
+
+void uwsgi_static_store_init() {
+	if (!uwsgi.static_store_dir) return;
+	uwsgi_log("[uwsgi-static] the compression store requires zlib support\n");
+	exit(1);
+}
+
+int uwsgi_stats_static_store(struct uwsgi_stats *us) {
+	return 0;
+}
+
+#endif
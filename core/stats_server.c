@@ -0,0 +1,778 @@
+#include "uwsgi.h"
+
+extern struct uwsgi_server uwsgi;
+
+/*
+	the stats server thread
+
+	the stats socket is managed by a dedicated thread of the master (the master loop is never
+	blocked by slow or numerous clients), every client is served in non-blocking mode.
+	The classic json document walks structures owned by the master (daemons, cheaper state...),
+	so the thread asks the master for it over its pipe and the clients arriving meanwhile share it.
+
+	Beside the classic json document, the counters of the instance (global, workers, cores and metrics)
+	are kept in a flat snapshot (read directly from the shared memory areas) that can be encoded as:
+
+	json		the classic document (or a flat list of counters when a delta is requested)
+	binary		a compact big endian encoding (see below)
+	prometheus	the prometheus text exposition format
+
+	every snapshot gets a sequence number and every counter remembers the sequence of its last
+	change, a client passing "since=<seq>" receives only the counters changed after it (the sequence
+	of the response is reported in the X-uWSGI-Stats-Seq header and in the body). If the layout of
+	the snapshot changed (or the sequence is unknown) the whole snapshot is sent.
+
+	--stats-format sets the default encoding, with --stats-http the query string of the request
+	can choose it (?format=prometheus&since=120), a request for /metrics defaults to prometheus.
+	With --sampling-profiler /profile returns the folded stacks of the sampling profiler.
+
+	binary encoding:
+
+	"uWST" | version (u8, 1) | flags (u8, 1 = delta) | seq (u64) | families (u8)
+	for each family: name_len (u8) | name
+	counters (u32)
+	for each counter: family (u8) | worker (u16) | core (u16) | name_len (u16) | name | value (s64)
+
+	worker and core are 0xffff when not applicable, the name is used only by metrics and master tasks.
+*/
+
+#define UWSGI_STATS_FORMAT_JSON 0
+#define UWSGI_STATS_FORMAT_BINARY 1
+#define UWSGI_STATS_FORMAT_PROMETHEUS 2
+
+#define UWSGI_STATS_NONE 0xffff
+
+#define UWSGI_STATS_CLIENT_BUFSIZE 4096
+
+struct uwsgi_stats_family {
+	char *name;
+	char *type;
+	char *help;
+};
+
+enum {
+	US_LISTEN_QUEUE,
+	US_LISTEN_QUEUE_ERRORS,
+	US_SIGNAL_QUEUE,
+	US_LOAD,
+	US_WORKER_PID,
+	US_WORKER_ACCEPTING,
+	US_WORKER_BUSY,
+	US_WORKER_REQUESTS,
+	US_WORKER_EXCEPTIONS,
+	US_WORKER_HARAKIRI,
+	US_WORKER_SIGNALS,
+	US_WORKER_RSS,
+	US_WORKER_VSZ,
+	US_WORKER_USS,
+	US_WORKER_PSS,
+	US_WORKER_SHARED,
+	US_WORKER_SWAP,
+	US_WORKER_RUNNING_TIME,
+	US_WORKER_AVG_RT,
+	US_WORKER_TX,
+	US_WORKER_RESPAWNS,
+	US_CORE_REQUESTS,
+	US_CORE_STATIC_REQUESTS,
+	US_CORE_ROUTED_REQUESTS,
+	US_CORE_OFFLOADED_REQUESTS,
+	US_CORE_WRITE_ERRORS,
+	US_CORE_READ_ERRORS,
+	US_CORE_IN_REQUEST,
+	US_METRIC,
+	US_MASTER_TASK_RUNS,
+	US_MASTER_TASK_USECS,
+	US_MASTER_TASK_MAX_USECS,
+	US_FAMILIES,
+};
+
+static struct uwsgi_stats_family uwsgi_stats_families[] = {
+	{"uwsgi_listen_queue", "gauge", "connections waiting in the listen queue"},
+	{"uwsgi_listen_queue_errors", "counter", "listen queue overflows"},
+	{"uwsgi_signal_queue", "gauge", "bytes waiting in the signal queue"},
+	{"uwsgi_load", "gauge", "busy cores"},
+	{"uwsgi_worker_pid", "gauge", "pid of the worker"},
+	{"uwsgi_worker_accepting", "gauge", "the worker is accepting requests"},
+	{"uwsgi_worker_busy", "gauge", "the worker is managing a request"},
+	{"uwsgi_worker_requests", "counter", "requests managed by the worker"},
+	{"uwsgi_worker_exceptions", "counter", "exceptions raised in the worker"},
+	{"uwsgi_worker_harakiri", "counter", "harakiri of the worker"},
+	{"uwsgi_worker_signals", "counter", "signals managed by the worker"},
+	{"uwsgi_worker_rss_bytes", "gauge", "resident memory of the worker"},
+	{"uwsgi_worker_vsz_bytes", "gauge", "virtual memory of the worker"},
+	{"uwsgi_worker_uss_bytes", "gauge", "private memory of the worker"},
+	{"uwsgi_worker_pss_bytes", "gauge", "proportional set size of the worker"},
+	{"uwsgi_worker_shared_bytes", "gauge", "memory shared with other processes"},
+	{"uwsgi_worker_swap_bytes", "gauge", "swapped out memory of the worker"},
+	{"uwsgi_worker_running_time_usecs", "counter", "time spent managing requests"},
+	{"uwsgi_worker_avg_response_time_usecs", "gauge", "average response time"},
+	{"uwsgi_worker_tx_bytes", "counter", "bytes sent by the worker"},
+	{"uwsgi_worker_respawns", "counter", "respawns of the worker"},
+	{"uwsgi_core_requests", "counter", "requests managed by the core"},
+	{"uwsgi_core_static_requests", "counter", "static files served by the core"},
+	{"uwsgi_core_routed_requests", "counter", "requests managed by the internal routing"},
+	{"uwsgi_core_offloaded_requests", "counter", "requests offloaded by the core"},
+	{"uwsgi_core_write_errors", "counter", "write errors of the core"},
+	{"uwsgi_core_read_errors", "counter", "read errors of the core"},
+	{"uwsgi_core_in_request", "gauge", "the core is managing a request"},
+	{"uwsgi_metric", "untyped", "uWSGI metrics"},
+	{"uwsgi_master_task_runs", "counter", "runs of the periodic task of the master"},
+	{"uwsgi_master_task_usecs", "counter", "time spent running the periodic task of the master"},
+	{"uwsgi_master_task_max_usecs", "gauge", "slowest run of the periodic task of the master"},
+};
+
+struct uwsgi_stats_counter {
+	uint8_t family;
+	uint16_t wid;
+	uint16_t core;
+	// only for metrics and master tasks (they are never freed)
+	char *name;
+	int64_t value;
+	// seq of the last change
+	uint64_t changed;
+};
+
+struct uwsgi_stats_snapshot {
+	struct uwsgi_stats_counter *counters;
+	uint64_t n;
+	uint64_t size;
+	// position while collecting
+	uint64_t pos;
+	int building;
+	uint64_t seq;
+	// seq of the last layout change, older sequences get the whole snapshot
+	uint64_t layout_seq;
+	int numproc;
+	int cores;
+	uint64_t metrics;
+	uint64_t master_tasks;
+	int no_cores;
+};
+
+struct uwsgi_stats_client {
+	int fd;
+	// 0 reading the request, 1 sending the response, 2 waiting for the json document of the master
+	int status;
+	char buf[UWSGI_STATS_CLIENT_BUFSIZE];
+	size_t buf_pos;
+	struct uwsgi_buffer *ub;
+	size_t written;
+	time_t deadline;
+	struct uwsgi_stats_client *prev;
+	struct uwsgi_stats_client *next;
+};
+
+static int uwsgi_stats_format(char *name) {
+	if (!name) return -1;
+	if (!strcmp(name, "json")) return UWSGI_STATS_FORMAT_JSON;
+	if (!strcmp(name, "binary")) return UWSGI_STATS_FORMAT_BINARY;
+	if (!strcmp(name, "prometheus")) return UWSGI_STATS_FORMAT_PROMETHEUS;
+	return -1;
+}
+
+static void uwsgi_stats_counter(struct uwsgi_stats_snapshot *uss, uint8_t family, int wid, int core, char *name, int64_t value) {
+	if (uss->building) {
+		if (uss->n >= uss->size) {
+			uss->size = uss->size ? uss->size * 2 : 256;
+			struct uwsgi_stats_counter *counters = realloc(uss->counters, sizeof(struct uwsgi_stats_counter) * uss->size);
+			if (!counters) {
+				uwsgi_error("uwsgi_stats_counter()/realloc()");
+				exit(1);
+			}
+			uss->counters = counters;
+		}
+		struct uwsgi_stats_counter *c = &uss->counters[uss->n++];
+		c->family = family;
+		c->wid = wid;
+		c->core = core;
+		c->name = name;
+		c->value = value;
+		c->changed = uss->seq;
+		return;
+	}
+	// the layout is checked before collecting
+	if (uss->pos >= uss->n) return;
+	struct uwsgi_stats_counter *c = &uss->counters[uss->pos++];
+	if (c->value != value) {
+		c->value = value;
+		c->changed = uss->seq;
+	}
+}
+
+static void uwsgi_stats_snapshot_collect(struct uwsgi_stats_snapshot *uss) {
+	int i, j;
+
+	uss->seq++;
+
+	uint64_t metrics = 0;
+	struct uwsgi_metric *um = NULL;
+	if (uwsgi.has_metrics && !uwsgi.stats_no_metrics) {
+		uwsgi_rlock(uwsgi.metrics_lock);
+		um = uwsgi.metrics;
+		while(um) {
+			metrics++;
+			um = um->next;
+		}
+		uwsgi_rwunlock(uwsgi.metrics_lock);
+	}
+
+	// the tasks are registered by the master at startup
+	uint64_t master_tasks = 0;
+	struct uwsgi_master_task *umt = uwsgi.master_tasks;
+	while(umt) {
+		master_tasks++;
+		umt = umt->next;
+	}
+
+	if (!uss->counters || uss->numproc != uwsgi.numproc || uss->cores != uwsgi.cores || uss->metrics != metrics || uss->master_tasks != master_tasks || uss->no_cores != uwsgi.stats_no_cores) {
+		uss->building = 1;
+		uss->n = 0;
+		uss->numproc = uwsgi.numproc;
+		uss->cores = uwsgi.cores;
+		uss->metrics = metrics;
+		uss->master_tasks = master_tasks;
+		uss->no_cores = uwsgi.stats_no_cores;
+		uss->layout_seq = uss->seq;
+	}
+	uss->pos = 0;
+
+#ifdef __linux__
+	uwsgi_stats_counter(uss, US_LISTEN_QUEUE, UWSGI_STATS_NONE, UWSGI_STATS_NONE, NULL, uwsgi.shared->backlog);
+	uwsgi_stats_counter(uss, US_LISTEN_QUEUE_ERRORS, UWSGI_STATS_NONE, UWSGI_STATS_NONE, NULL, uwsgi.shared->backlog_errors);
+#endif
+	int signal_queue = 0;
+	if (ioctl(uwsgi.shared->worker_signal_pipe[1], FIONREAD, &signal_queue)) {
+		signal_queue = 0;
+	}
+	uwsgi_stats_counter(uss, US_SIGNAL_QUEUE, UWSGI_STATS_NONE, UWSGI_STATS_NONE, NULL, signal_queue);
+	uwsgi_stats_counter(uss, US_LOAD, UWSGI_STATS_NONE, UWSGI_STATS_NONE, NULL, uwsgi.shared->load);
+
+	for(i=1;i<=uss->numproc;i++) {
+		struct uwsgi_worker *uw = &uwsgi.workers[i];
+		uwsgi_stats_counter(uss, US_WORKER_PID, i, UWSGI_STATS_NONE, NULL, uw->pid);
+		uwsgi_stats_counter(uss, US_WORKER_ACCEPTING, i, UWSGI_STATS_NONE, NULL, uw->accepting);
+		uwsgi_stats_counter(uss, US_WORKER_BUSY, i, UWSGI_STATS_NONE, NULL, uwsgi_worker_is_busy(i));
+		uwsgi_stats_counter(uss, US_WORKER_REQUESTS, i, UWSGI_STATS_NONE, NULL, uw->requests);
+		uwsgi_stats_counter(uss, US_WORKER_EXCEPTIONS, i, UWSGI_STATS_NONE, NULL, uwsgi_worker_exceptions(i));
+		uwsgi_stats_counter(uss, US_WORKER_HARAKIRI, i, UWSGI_STATS_NONE, NULL, uw->harakiri_count);
+		uwsgi_stats_counter(uss, US_WORKER_SIGNALS, i, UWSGI_STATS_NONE, NULL, uw->signals);
+		uwsgi_stats_counter(uss, US_WORKER_RSS, i, UWSGI_STATS_NONE, NULL, uw->rss_size);
+		uwsgi_stats_counter(uss, US_WORKER_VSZ, i, UWSGI_STATS_NONE, NULL, uw->vsz_size);
+		uwsgi_stats_counter(uss, US_WORKER_USS, i, UWSGI_STATS_NONE, NULL, uw->uss_size);
+		uwsgi_stats_counter(uss, US_WORKER_PSS, i, UWSGI_STATS_NONE, NULL, uw->pss_size);
+		uwsgi_stats_counter(uss, US_WORKER_SHARED, i, UWSGI_STATS_NONE, NULL, uw->shared_size);
+		uwsgi_stats_counter(uss, US_WORKER_SWAP, i, UWSGI_STATS_NONE, NULL, uw->swap_size);
+		uwsgi_stats_counter(uss, US_WORKER_RUNNING_TIME, i, UWSGI_STATS_NONE, NULL, uw->running_time);
+		uwsgi_stats_counter(uss, US_WORKER_AVG_RT, i, UWSGI_STATS_NONE, NULL, uw->avg_response_time);
+		uwsgi_stats_counter(uss, US_WORKER_TX, i, UWSGI_STATS_NONE, NULL, uw->tx);
+		uwsgi_stats_counter(uss, US_WORKER_RESPAWNS, i, UWSGI_STATS_NONE, NULL, uw->respawn_count);
+		if (uss->no_cores) continue;
+		for(j=0;j<uss->cores;j++) {
+			struct uwsgi_core *uc = &uw->cores[j];
+			uwsgi_stats_counter(uss, US_CORE_REQUESTS, i, j, NULL, uc->requests);
+			uwsgi_stats_counter(uss, US_CORE_STATIC_REQUESTS, i, j, NULL, uc->static_requests);
+			uwsgi_stats_counter(uss, US_CORE_ROUTED_REQUESTS, i, j, NULL, uc->routed_requests);
+			uwsgi_stats_counter(uss, US_CORE_OFFLOADED_REQUESTS, i, j, NULL, uc->offloaded_requests);
+			uwsgi_stats_counter(uss, US_CORE_WRITE_ERRORS, i, j, NULL, uc->write_errors);
+			uwsgi_stats_counter(uss, US_CORE_READ_ERRORS, i, j, NULL, uc->read_errors);
+			uwsgi_stats_counter(uss, US_CORE_IN_REQUEST, i, j, NULL, uc->in_request);
+		}
+	}
+
+	if (metrics) {
+		uint64_t n = 0;
+		uwsgi_rlock(uwsgi.metrics_lock);
+		um = uwsgi.metrics;
+		// metrics registered after the count are catched by the next snapshot
+		while(um && n < metrics) {
+			uwsgi_stats_counter(uss, US_METRIC, UWSGI_STATS_NONE, UWSGI_STATS_NONE, um->name, *um->value);
+			n++;
+			um = um->next;
+		}
+		uwsgi_rwunlock(uwsgi.metrics_lock);
+	}
+
+	uint64_t n = 0;
+	umt = uwsgi.master_tasks;
+	while(umt && n < master_tasks) {
+		uwsgi_stats_counter(uss, US_MASTER_TASK_RUNS, UWSGI_STATS_NONE, UWSGI_STATS_NONE, umt->name, umt->runs);
+		uwsgi_stats_counter(uss, US_MASTER_TASK_USECS, UWSGI_STATS_NONE, UWSGI_STATS_NONE, umt->name, umt->total_usecs);
+		uwsgi_stats_counter(uss, US_MASTER_TASK_MAX_USECS, UWSGI_STATS_NONE, UWSGI_STATS_NONE, umt->name, umt->max_usecs);
+		n++;
+		umt = umt->next;
+	}
+
+	uss->building = 0;
+}
+
+static int uwsgi_stats_prometheus_labels(struct uwsgi_buffer *ub, struct uwsgi_stats_counter *c) {
+	if (c->name) {
+		if (c->family == US_METRIC) {
+			if (uwsgi_buffer_append(ub, "{name=\"", 7)) return -1;
+		}
+		else if (uwsgi_buffer_append(ub, "{task=\"", 7)) return -1;
+		if (uwsgi_buffer_append(ub, c->name, strlen(c->name))) return -1;
+		return uwsgi_buffer_append(ub, "\"}", 2);
+	}
+	if (c->wid == UWSGI_STATS_NONE) return 0;
+	if (uwsgi_buffer_append(ub, "{worker=\"", 9)) return -1;
+	if (uwsgi_buffer_num64(ub, c->wid)) return -1;
+	if (c->core != UWSGI_STATS_NONE) {
+		if (uwsgi_buffer_append(ub, "\",core=\"", 8)) return -1;
+		if (uwsgi_buffer_num64(ub, c->core)) return -1;
+	}
+	return uwsgi_buffer_append(ub, "\"}", 2);
+}
+
+static int uwsgi_stats_encode_prometheus(struct uwsgi_stats_snapshot *uss, struct uwsgi_buffer *ub, uint64_t since) {
+	uint64_t i;
+	int f;
+	if (uwsgi_buffer_append(ub, "# uwsgi stats seq ", 18)) return -1;
+	if (uwsgi_buffer_num64(ub, uss->seq)) return -1;
+	if (uwsgi_buffer_append(ub, "\n", 1)) return -1;
+	for(f=0;f<US_FAMILIES;f++) {
+		struct uwsgi_stats_family *usf = &uwsgi_stats_families[f];
+		int header = 0;
+		for(i=0;i<uss->n;i++) {
+			struct uwsgi_stats_counter *c = &uss->counters[i];
+			if (c->family != f || c->changed <= since) continue;
+			if (!header) {
+				if (uwsgi_buffer_append(ub, "# HELP ", 7)) return -1;
+				if (uwsgi_buffer_append(ub, usf->name, strlen(usf->name))) return -1;
+				if (uwsgi_buffer_append(ub, " ", 1)) return -1;
+				if (uwsgi_buffer_append(ub, usf->help, strlen(usf->help))) return -1;
+				if (uwsgi_buffer_append(ub, "\n# TYPE ", 8)) return -1;
+				if (uwsgi_buffer_append(ub, usf->name, strlen(usf->name))) return -1;
+				if (uwsgi_buffer_append(ub, " ", 1)) return -1;
+				if (uwsgi_buffer_append(ub, usf->type, strlen(usf->type))) return -1;
+				if (uwsgi_buffer_append(ub, "\n", 1)) return -1;
+				header = 1;
+			}
+			if (uwsgi_buffer_append(ub, usf->name, strlen(usf->name))) return -1;
+			if (uwsgi_stats_prometheus_labels(ub, c)) return -1;
+			if (uwsgi_buffer_append(ub, " ", 1)) return -1;
+			if (uwsgi_buffer_num64(ub, c->value)) return -1;
+			if (uwsgi_buffer_append(ub, "\n", 1)) return -1;
+		}
+	}
+	return 0;
+}
+
+static int uwsgi_stats_encode_binary(struct uwsgi_stats_snapshot *uss, struct uwsgi_buffer *ub, uint64_t since) {
+	uint64_t i;
+	int f;
+	if (uwsgi_buffer_append(ub, "uWST", 4)) return -1;
+	if (uwsgi_buffer_u8(ub, 1)) return -1;
+	if (uwsgi_buffer_u8(ub, since ? 1 : 0)) return -1;
+	if (uwsgi_buffer_u64be(ub, uss->seq)) return -1;
+	if (uwsgi_buffer_u8(ub, US_FAMILIES)) return -1;
+	for(f=0;f<US_FAMILIES;f++) {
+		size_t len = strlen(uwsgi_stats_families[f].name);
+		if (uwsgi_buffer_u8(ub, len)) return -1;
+		if (uwsgi_buffer_append(ub, uwsgi_stats_families[f].name, len)) return -1;
+	}
+	// the number of counters is fixed later
+	size_t count_pos = ub->pos;
+	if (uwsgi_buffer_u32be(ub, 0)) return -1;
+	uint32_t count = 0;
+	for(i=0;i<uss->n;i++) {
+		struct uwsgi_stats_counter *c = &uss->counters[i];
+		if (c->changed <= since) continue;
+		size_t name_len = c->name ? strlen(c->name) : 0;
+		if (uwsgi_buffer_u8(ub, c->family)) return -1;
+		if (uwsgi_buffer_u16be(ub, c->wid)) return -1;
+		if (uwsgi_buffer_u16be(ub, c->core)) return -1;
+		if (uwsgi_buffer_u16be(ub, name_len)) return -1;
+		if (name_len && uwsgi_buffer_append(ub, c->name, name_len)) return -1;
+		if (uwsgi_buffer_u64be(ub, (uint64_t) c->value)) return -1;
+		count++;
+	}
+	size_t pos = ub->pos;
+	ub->pos = count_pos;
+	if (uwsgi_buffer_u32be(ub, count)) return -1;
+	ub->pos = pos;
+	return 0;
+}
+
+static int uwsgi_stats_encode_json(struct uwsgi_stats_snapshot *uss, struct uwsgi_buffer *ub, uint64_t since) {
+	uint64_t i;
+	struct uwsgi_stats *us = uwsgi_stats_new(8192);
+	if (uwsgi_stats_keylong_comma(us, "seq", uss->seq)) goto error;
+	if (uwsgi_stats_keylong_comma(us, "delta", since ? 1 : 0)) goto error;
+	if (uwsgi_stats_key(us, "counters")) goto error;
+	if (uwsgi_stats_list_open(us)) goto error;
+	int first = 1;
+	for(i=0;i<uss->n;i++) {
+		struct uwsgi_stats_counter *c = &uss->counters[i];
+		if (c->changed <= since) continue;
+		if (!first && uwsgi_stats_comma(us)) goto error;
+		first = 0;
+		if (uwsgi_stats_object_open(us)) goto error;
+		if (uwsgi_stats_keyval_comma(us, "name", uwsgi_stats_families[c->family].name)) goto error;
+		if (c->name && uwsgi_stats_keyval_comma(us, c->family == US_METRIC ? "metric" : "task", c->name)) goto error;
+		if (c->wid != UWSGI_STATS_NONE && uwsgi_stats_keylong_comma(us, "worker", c->wid)) goto error;
+		if (c->core != UWSGI_STATS_NONE && uwsgi_stats_keylong_comma(us, "core", c->core)) goto error;
+		if (uwsgi_stats_keyslong(us, "value", c->value)) goto error;
+		if (uwsgi_stats_object_close(us)) goto error;
+	}
+	if (uwsgi_stats_list_close(us)) goto error;
+	if (uwsgi_stats_object_close(us)) goto error;
+	if (uwsgi_buffer_append(ub, us->base, us->pos)) goto error;
+	free(us->base);
+	free(us);
+	return 0;
+error:
+	free(us->base);
+	free(us);
+	return -1;
+}
+
+/*
+	build the whole response (headers included for http clients)
+
+	the classic json document walks the structures owned by the master, so it is generated
+	by the master (see uwsgi_stats_server_generate()) and passed as document, when it is
+	needed but not available *need_document is set and NULL is returned
+*/
+static struct uwsgi_buffer *uwsgi_stats_response(struct uwsgi_stats_snapshot *uss, int http, int format, char *since_str, struct uwsgi_stats *document, int *need_document) {
+	struct uwsgi_buffer *body = NULL;
+	uint64_t since = 0;
+
+	// the classic document
+	if (format == UWSGI_STATS_FORMAT_JSON && !since_str) {
+		if (!document) {
+			*need_document = 1;
+			return NULL;
+		}
+		body = uwsgi_buffer_new(document->pos);
+		if (uwsgi_buffer_append(body, document->base, document->pos)) goto error;
+	}
+	else {
+		uwsgi_stats_snapshot_collect(uss);
+		if (since_str) {
+			since = strtoull(since_str, NULL, 10);
+			// unknown or too old, send the whole snapshot
+			if (since >= uss->seq || since < uss->layout_seq) since = 0;
+		}
+		body = uwsgi_buffer_new(uwsgi.page_size);
+		int ret = -1;
+		switch(format) {
+			case UWSGI_STATS_FORMAT_BINARY:
+				ret = uwsgi_stats_encode_binary(uss, body, since);
+				break;
+			case UWSGI_STATS_FORMAT_PROMETHEUS:
+				ret = uwsgi_stats_encode_prometheus(uss, body, since);
+				break;
+			default:
+				ret = uwsgi_stats_encode_json(uss, body, since);
+				break;
+		}
+		if (ret) goto error;
+	}
+
+	if (!http) return body;
+
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size + body->pos);
+	if (uwsgi_buffer_append(ub, "HTTP/1.0 200 OK\r\nConnection: close\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: ", 82)) goto error2;
+	switch(format) {
+		case UWSGI_STATS_FORMAT_BINARY:
+			if (uwsgi_buffer_append(ub, "application/octet-stream", 24)) goto error2;
+			break;
+		case UWSGI_STATS_FORMAT_PROMETHEUS:
+			if (uwsgi_buffer_append(ub, "text/plain; version=0.0.4", 25)) goto error2;
+			break;
+		default:
+			if (uwsgi_buffer_append(ub, "application/json", 16)) goto error2;
+			break;
+	}
+	if (uwsgi_buffer_append(ub, "\r\nContent-Length: ", 18)) goto error2;
+	if (uwsgi_buffer_num64(ub, body->pos)) goto error2;
+	if (format != UWSGI_STATS_FORMAT_JSON || since_str) {
+		if (uwsgi_buffer_append(ub, "\r\nX-uWSGI-Stats-Seq: ", 21)) goto error2;
+		if (uwsgi_buffer_num64(ub, uss->seq)) goto error2;
+	}
+	if (uwsgi_buffer_append(ub, "\r\n\r\n", 4)) goto error2;
+	if (uwsgi_buffer_append(ub, body->buf, body->pos)) goto error2;
+	uwsgi_buffer_destroy(body);
+	return ub;
+
+error2:
+	uwsgi_buffer_destroy(ub);
+error:
+	uwsgi_buffer_destroy(body);
+	return NULL;
+}
+
+// the folded stacks of the sampling profiler (see core/profiler.c)
+static struct uwsgi_buffer *uwsgi_stats_profile_response(char *qs, size_t qs_len) {
+	char *rate_str = NULL;
+	char *reset_str = NULL;
+	if (qs && uwsgi_kvlist_parse(qs, qs_len, '&', '=', "rate", &rate_str, "reset", &reset_str, NULL)) return NULL;
+
+	struct uwsgi_buffer *body = uwsgi_profiler_folded(rate_str, reset_str ? atoi(reset_str) : 0);
+	if (rate_str) free(rate_str);
+	if (reset_str) free(reset_str);
+	if (!body) return NULL;
+
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(uwsgi.page_size + body->pos);
+	if (uwsgi_buffer_append(ub, "HTTP/1.0 200 OK\r\nConnection: close\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/plain", 92)) goto error;
+	if (uwsgi_buffer_append(ub, "\r\nContent-Length: ", 18)) goto error;
+	if (uwsgi_buffer_num64(ub, body->pos)) goto error;
+	if (uwsgi_buffer_append(ub, "\r\n\r\n", 4)) goto error;
+	if (uwsgi_buffer_append(ub, body->buf, body->pos)) goto error;
+	uwsgi_buffer_destroy(body);
+	return ub;
+error:
+	uwsgi_buffer_destroy(ub);
+	uwsgi_buffer_destroy(body);
+	return NULL;
+}
+
+/*
+	parse the request line of an http client: GET /metrics?format=binary&since=30 HTTP/1.0
+	(GET /profile?rate=100 returns the folded stacks of the profiler)
+*/
+static struct uwsgi_buffer *uwsgi_stats_http_response(struct uwsgi_stats_snapshot *uss, struct uwsgi_stats_client *usc, int default_format, struct uwsgi_stats *document, int *need_document) {
+	char *format_str = NULL;
+	char *since_str = NULL;
+	int format = default_format;
+
+	char *path = memchr(usc->buf, ' ', usc->buf_pos);
+	if (!path) return NULL;
+	path++;
+	char *path_end = memchr(path, ' ', (usc->buf + usc->buf_pos) - path);
+	if (!path_end) return NULL;
+
+	char *qs = memchr(path, '?', path_end - path);
+	size_t path_len = (qs ? qs : path_end) - path;
+	if (uwsgi.sampling_profiler && !uwsgi_strncmp(path, path_len, "/profile", 8)) {
+		return uwsgi_stats_profile_response(qs ? qs + 1 : NULL, qs ? path_end - (qs + 1) : 0);
+	}
+	if (!uwsgi_strncmp(path, path_len, "/metrics", 8)) {
+		format = UWSGI_STATS_FORMAT_PROMETHEUS;
+	}
+
+	if (qs) {
+		qs++;
+		if (uwsgi_kvlist_parse(qs, path_end - qs, '&', '=', "format", &format_str, "since", &since_str, NULL)) return NULL;
+		if (format_str) {
+			int requested = uwsgi_stats_format(format_str);
+			if (requested >= 0) format = requested;
+		}
+	}
+
+	struct uwsgi_buffer *ub = uwsgi_stats_response(uss, 1, format, since_str, document, need_document);
+	if (format_str) free(format_str);
+	if (since_str) free(since_str);
+	return ub;
+}
+
+static void uwsgi_stats_client_close(struct uwsgi_stats_client **head, struct uwsgi_stats_client *usc) {
+	close(usc->fd);
+	if (usc->ub) uwsgi_buffer_destroy(usc->ub);
+	if (usc->prev) usc->prev->next = usc->next;
+	else *head = usc->next;
+	if (usc->next) usc->next->prev = usc->prev;
+	free(usc);
+}
+
+static int uwsgi_stats_request_complete(struct uwsgi_stats_client *usc) {
+	size_t i;
+	for(i=3;i<usc->buf_pos;i++) {
+		if (!memcmp(usc->buf + i - 3, "\r\n\r\n", 4)) return 1;
+	}
+	return 0;
+}
+
+// returns 0 when the whole response has been sent
+static int uwsgi_stats_client_write(struct uwsgi_stats_client *usc) {
+	while(usc->written < usc->ub->pos) {
+		ssize_t wlen = write(usc->fd, usc->ub->buf + usc->written, usc->ub->pos - usc->written);
+		if (wlen < 0) {
+			if (uwsgi_is_again()) return 1;
+			uwsgi_error("uwsgi_stats_client_write()/write()");
+			return -1;
+		}
+		if (wlen == 0) return -1;
+		usc->written += wlen;
+	}
+	return 0;
+}
+
+/*
+	run by the master when the stats thread asks for the json document: the document is
+	passed (by pointer) to the thread, that frees it
+*/
+void uwsgi_stats_server_generate(struct uwsgi_thread *ut) {
+	char buf[64];
+	// requests are coalesced by the thread (one in flight)
+	while (read(ut->pipe[0], buf, sizeof(buf)) > 0);
+	struct uwsgi_stats *us = uwsgi_master_generate_stats();
+	if (write(ut->pipe[0], &us, sizeof(struct uwsgi_stats *)) != sizeof(struct uwsgi_stats *)) {
+		uwsgi_error("uwsgi_stats_server_generate()/write()");
+		if (us) {
+			free(us->base);
+			free(us);
+		}
+	}
+}
+
+// ask the master for a fresh json document (if not already in flight)
+static void uwsgi_stats_request_document(struct uwsgi_thread *ut, int *requested) {
+	if (*requested) return;
+	char byte = 0;
+	if (write(ut->pipe[1], &byte, 1) != 1) {
+		uwsgi_error("uwsgi_stats_request_document()/write()");
+		return;
+	}
+	*requested = 1;
+}
+
+// start sending the response, returns 0 when the client can be closed
+static int uwsgi_stats_client_start(struct uwsgi_thread *ut, struct uwsgi_stats_client *usc) {
+	usc->status = 1;
+	int ret = usc->ub ? uwsgi_stats_client_write(usc) : -1;
+	if (ret <= 0) return 0;
+	event_queue_add_fd_write(ut->queue, usc->fd);
+	return 1;
+}
+
+void uwsgi_stats_server_loop(struct uwsgi_thread *ut) {
+	struct uwsgi_stats_snapshot uss;
+	struct uwsgi_stats_client *clients = NULL;
+	int document_requested = 0;
+	memset(&uss, 0, sizeof(struct uwsgi_stats_snapshot));
+
+	int default_format = UWSGI_STATS_FORMAT_JSON;
+	if (uwsgi.stats_format) {
+		default_format = uwsgi_stats_format(uwsgi.stats_format);
+		if (default_format < 0) {
+			uwsgi_log("[uwsgi-stats] unknown format \"%s\", using json\n", uwsgi.stats_format);
+			default_format = UWSGI_STATS_FORMAT_JSON;
+		}
+	}
+
+	uwsgi_socket_nb(uwsgi.stats_fd);
+	event_queue_add_fd_read(ut->queue, uwsgi.stats_fd);
+
+	void *events = event_queue_alloc(64);
+	for (;;) {
+		int nevents = event_queue_wait_multi(ut->queue, 1, events, 64);
+		if (nevents < 0) {
+			if (errno == EINTR) continue;
+			uwsgi_log_verbose("ending the stats server thread...\n");
+			return;
+		}
+
+		time_t now = uwsgi_now();
+		int i;
+		for(i=0;i<nevents;i++) {
+			int interesting_fd = event_queue_interesting_fd(events, i);
+			if (interesting_fd == ut->pipe[1]) {
+				struct uwsgi_stats *document = NULL;
+				ssize_t len = read(interesting_fd, &document, sizeof(struct uwsgi_stats *));
+				if (len <= 0) {
+					uwsgi_log("[uwsgi-stats] goodbye...\n");
+					return;
+				}
+				if (len != sizeof(struct uwsgi_stats *)) continue;
+				document_requested = 0;
+				// serve the clients waiting for the document
+				struct uwsgi_stats_client *usc = clients;
+				while(usc) {
+					struct uwsgi_stats_client *next = usc->next;
+					if (usc->status == 2) {
+						int need_document = 0;
+						if (!document) usc->ub = NULL;
+						else if (uwsgi.stats_http) usc->ub = uwsgi_stats_http_response(&uss, usc, default_format, document, &need_document);
+						else usc->ub = uwsgi_stats_response(&uss, 0, default_format, NULL, document, &need_document);
+						if (!uwsgi_stats_client_start(ut, usc)) uwsgi_stats_client_close(&clients, usc);
+					}
+					usc = next;
+				}
+				if (document) {
+					free(document->base);
+					free(document);
+				}
+				continue;
+			}
+
+			if (interesting_fd == uwsgi.stats_fd) {
+				struct sockaddr_un client_src;
+				socklen_t client_src_len = sizeof(struct sockaddr_un);
+				int client_fd = accept(uwsgi.stats_fd, (struct sockaddr *) &client_src, &client_src_len);
+				if (client_fd < 0) {
+					if (!uwsgi_is_again()) uwsgi_error("uwsgi_stats_server_loop()/accept()");
+					continue;
+				}
+				uwsgi_socket_nb(client_fd);
+				struct uwsgi_stats_client *usc = uwsgi_calloc(sizeof(struct uwsgi_stats_client));
+				usc->fd = client_fd;
+				usc->deadline = now + uwsgi.socket_timeout;
+				usc->next = clients;
+				if (clients) clients->prev = usc;
+				clients = usc;
+				if (uwsgi.stats_http) {
+					event_queue_add_fd_read(ut->queue, client_fd);
+					continue;
+				}
+				// raw clients get the response immediately
+				int need_document = 0;
+				usc->ub = uwsgi_stats_response(&uss, 0, default_format, NULL, NULL, &need_document);
+				if (need_document) {
+					usc->status = 2;
+					uwsgi_stats_request_document(ut, &document_requested);
+					continue;
+				}
+				if (!uwsgi_stats_client_start(ut, usc)) uwsgi_stats_client_close(&clients, usc);
+				continue;
+			}
+
+			struct uwsgi_stats_client *usc = clients;
+			while(usc) {
+				if (usc->fd == interesting_fd) break;
+				usc = usc->next;
+			}
+			if (!usc) continue;
+
+			if (usc->status == 0) {
+				ssize_t rlen = read(usc->fd, usc->buf + usc->buf_pos, UWSGI_STATS_CLIENT_BUFSIZE - usc->buf_pos);
+				if (rlen < 0 && uwsgi_is_again()) continue;
+				if (rlen <= 0) {
+					uwsgi_stats_client_close(&clients, usc);
+					continue;
+				}
+				usc->buf_pos += rlen;
+				// wait for the end of the headers (the request line is all we need)
+				if (!uwsgi_stats_request_complete(usc) && usc->buf_pos < UWSGI_STATS_CLIENT_BUFSIZE) continue;
+				int need_document = 0;
+				usc->ub = uwsgi_stats_http_response(&uss, usc, default_format, NULL, &need_document);
+				// stop reading, the fd is polled for writing when the response is ready
+				event_queue_del_fd(ut->queue, usc->fd, event_queue_read());
+				if (need_document) {
+					usc->status = 2;
+					uwsgi_stats_request_document(ut, &document_requested);
+					continue;
+				}
+				if (!uwsgi_stats_client_start(ut, usc)) uwsgi_stats_client_close(&clients, usc);
+				continue;
+			}
+			// waiting for the document
+			if (usc->status == 2) continue;
+
+			if (uwsgi_stats_client_write(usc) <= 0) {
+				uwsgi_stats_client_close(&clients, usc);
+			}
+		}
+
+		// slow clients
+		struct uwsgi_stats_client *usc = clients;
+		while(usc) {
+			struct uwsgi_stats_client *next = usc->next;
+			if (usc->deadline <= now) {
+				uwsgi_stats_client_close(&clients, usc);
+			}
+			usc = next;
+		}
+	}
+}
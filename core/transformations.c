@@ -8,6 +8,10 @@
 
 	some of them supports streaming, other requires buffering
 
+	zero_copy transformations do not use the chunk buffer: they receive the previous
+	output (input/input_len) and expose their own buffer (output/output_len), they are
+	called again (with last_round set) in the final chain
+
 	at the end of the request the "final chain" is called (and the whole chain freed)
 
 	Transformations (if required) could completely swallow already set headers
@@ -25,6 +29,19 @@ int uwsgi_apply_transformations(struct wsgi_request *wsgi_req, char *buf, size_t
 	size_t t_len = len;
 	uint8_t flushed = 0;
 	while(ut) {
+		if (ut->zero_copy) {
+			if (ut->is_final) goto next;
+			ut->input = t_buf;
+			ut->input_len = t_len;
+			ut->round++;
+			if (ut->func(wsgi_req, ut)) {
+				return -1;
+			}
+			if (ut->flushed) flushed = 1;
+			t_buf = ut->output;
+			t_len = ut->output_len;
+			goto next;
+		}
 		// allocate the buffer (if needed)
 		if (!ut->chunk) {
 			ut->chunk = uwsgi_buffer_new(t_len);
@@ -76,11 +93,44 @@ int uwsgi_apply_final_transformations(struct wsgi_request *wsgi_req) {
 	size_t t_len = 0;
 	uint8_t flushed = 0;
 	int found_nostream = 0;
+	// the last round of a zero_copy transformation generated data for the streaming ones
+	int zero_copy_output = 0;
 	while(ut) {
+		if (ut->zero_copy) {
+			ut->input = t_buf;
+			ut->input_len = t_len;
+			ut->last_round = 1;
+			ut->round++;
+			if (ut->func(wsgi_req, ut)) {
+				return -1;
+			}
+			if (ut->flushed) flushed = 1;
+			t_buf = ut->output;
+			t_len = ut->output_len;
+			if (!found_nostream && t_len > 0) zero_copy_output = 1;
+			goto next;
+		}
 		if (!found_nostream) {
 			if (!ut->can_stream) {
 				found_nostream = 1;
 			}
+			else if (zero_copy_output) {
+				// stream the trailing data (like the gzip footer) as a normal chunk
+				if (!ut->chunk) {
+					ut->chunk = uwsgi_buffer_new(t_len);
+				}
+				if (uwsgi_buffer_append(ut->chunk, t_buf, t_len)) {
+					return -1;
+				}
+				ut->round++;
+				if (ut->func(wsgi_req, ut)) {
+					return -1;
+				}
+				if (ut->flushed) flushed = 1;
+				t_buf = ut->chunk->buf;
+				t_len = ut->chunk->pos;
+				goto next;
+			}
 			else {
 				// stop the chain if no chunk is available
 				if (!ut->chunk) return 0;
@@ -1058,6 +1058,9 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 	uint64_t uss = 0, pss = 0;
 #endif
 
+	// stop the websockets hub deliveries before the socket is closed
+	uwsgi_websocket_unsubscribe_all(wsgi_req);
+
 	// apply transformations
 	if (wsgi_req->transformations) {
 		if (uwsgi_apply_final_transformations(wsgi_req) == 0) {
@@ -1068,6 +1071,9 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 		uwsgi_free_transformations(wsgi_req);
 	}
 
+	// write the coalesced response (if any)
+	uwsgi_response_flush(wsgi_req);
+
 	// check if headers should be sent
 	if (wsgi_req->headers) {
 		if (!wsgi_req->headers_sent && !wsgi_req->headers_size && !wsgi_req->response_size) {
@@ -1085,6 +1091,12 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 		uwsgi.workers[uwsgi.mywid].avg_response_time = (uwsgi.workers[uwsgi.mywid].avg_response_time + tmp_rt) / 2;
 	}
 
+	if (uwsgi.latency_hist && !wsgi_req->do_not_account) {
+		uwsgi_latency_account(wsgi_req, wsgi_req->end_of_request - wsgi_req->start_of_request);
+	}
+
+	uwsgi_request_accounting_end(wsgi_req);
+
 	// get memory usage
 	if (uwsgi.logging_options.memory_report || uwsgi.force_get_memusage) {
 		get_memusage(&rss, &vsz);
@@ -1094,9 +1106,12 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 
 #ifdef __linux__
 	if (uwsgi.logging_options.memory_report || uwsgi.reload_on_uss || uwsgi.reload_on_pss) {
-		get_memusage_extra(&uss, &pss);
+		uint64_t shared = 0, swap = 0;
+		get_memusage_extra(0, &uss, &pss, &shared, &swap);
 		uwsgi.workers[uwsgi.mywid].uss_size = uss;
 		uwsgi.workers[uwsgi.mywid].pss_size = pss;
+		uwsgi.workers[uwsgi.mywid].shared_size = shared;
+		uwsgi.workers[uwsgi.mywid].swap_size = swap;
 	}
 #endif
 
@@ -1139,6 +1154,10 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 		set_harakiri(wsgi_req, 0);
 	}
 
+	if (wsgi_req->deadline) {
+		uwsgi_deadline_clear(wsgi_req);
+	}
+
 	// leave user harakiri mode
 	if (uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].user_harakiri > 0) {
 		set_user_harakiri(wsgi_req, 0);
@@ -1200,6 +1219,9 @@ void uwsgi_close_request(struct wsgi_request *wsgi_req) {
 	if (wsgi_req->websocket_send_buf) {
 		uwsgi_buffer_destroy(wsgi_req->websocket_send_buf);
 	}
+	if (wsgi_req->websocket_deflate) {
+		uwsgi_websocket_deflate_destroy(wsgi_req);
+	}
 
 
 	// reset request
@@ -1415,6 +1437,7 @@ int wsgi_req_async_recv(struct wsgi_request *wsgi_req) {
 
 	wsgi_req->start_of_request = uwsgi_micros();
 	wsgi_req->start_of_request_in_sec = wsgi_req->start_of_request / 1000000;
+	uwsgi_request_accounting_start(wsgi_req);
 
 	if (!wsgi_req->do_not_add_to_async_queue) {
 		if (event_queue_add_fd_read(uwsgi.async_queue, wsgi_req->fd) < 0)
@@ -1439,6 +1462,7 @@ int wsgi_req_recv(int queue, struct wsgi_request *wsgi_req) {
 
 	wsgi_req->start_of_request = uwsgi_micros();
 	wsgi_req->start_of_request_in_sec = wsgi_req->start_of_request / 1000000;
+	uwsgi_request_accounting_start(wsgi_req);
 
 	// edge triggered sockets get the whole request during accept() phase
 	if (!wsgi_req->socket->edge_trigger) {
@@ -1461,6 +1485,10 @@ int wsgi_req_recv(int queue, struct wsgi_request *wsgi_req) {
 		set_harakiri(wsgi_req, uwsgi.harakiri_options.workers);
 	}
 
+	// the budget of the client could be already exhausted
+	if (uwsgi_deadline_set(wsgi_req))
+		return 0;
+
 #ifdef UWSGI_ROUTING
 	if (uwsgi_apply_routes(wsgi_req) == UWSGI_ROUTE_BREAK)
 		return 0;
@@ -3191,6 +3219,9 @@ pid_t uwsgi_fork(char *name) {
 	pid_t pid = fork();
 	if (pid == 0) {
 
+		// the master could have a SIGCHLD handler (for warm spares)
+		signal(SIGCHLD, SIG_DFL);
+
 #ifndef __CYGWIN__
 		if (uwsgi.never_swap) {
 			if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
@@ -3495,7 +3526,7 @@ struct uwsgi_app *uwsgi_add_app(int id, uint8_t modifier1, char *mountpoint, int
 	// check if we need to emulate fork() COW
 	int i;
 	if (uwsgi.mywid == 0) {
-		for (i = 1; i <= uwsgi.numproc; i++) {
+		for (i = 1; i <= uwsgi.numproc + uwsgi.warm_spares; i++) {
 			memcpy(&uwsgi.workers[i].apps[id], &uwsgi.workers[0].apps[id], sizeof(struct uwsgi_app));
 			uwsgi.workers[i].apps_cnt = uwsgi_apps_cnt;
 		}
@@ -3653,7 +3684,7 @@ void uwsgi_emulate_cow_for_apps(int id) {
 	int i;
 	// check if we need to emulate fork() COW
 	if (uwsgi.mywid == 0) {
-		for (i = 1; i <= uwsgi.numproc; i++) {
+		for (i = 1; i <= uwsgi.numproc + uwsgi.warm_spares; i++) {
 			memcpy(&uwsgi.workers[i].apps[id], &uwsgi.workers[0].apps[id], sizeof(struct uwsgi_app));
 			uwsgi.workers[i].apps_cnt = uwsgi_apps_cnt;
 		}
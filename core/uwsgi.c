@@ -82,6 +82,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"thunder-lock", no_argument, 0, "serialize accept() usage (if possible)", uwsgi_opt_true, &uwsgi.use_thunder_lock, 0},
 	{"thunder-lock-watchdog", no_argument, 0, "watchdog for buggy pthread robust mutexes", uwsgi_opt_true, &uwsgi.use_thunder_lock_watchdog, 0},
 	{"harakiri", required_argument, 't', "set harakiri timeout", uwsgi_opt_set_int, &uwsgi.harakiri_options.workers, 0},
+	{"request-deadline", required_argument, 0, "destroy the worker if a request runs for more than the specified milliseconds (checked by the worker itself)", uwsgi_opt_set_64bit, &uwsgi.request_deadline, UWSGI_OPT_MASTER},
+	{"request-deadline-header", required_argument, 0, "honour the time budget (in milliseconds) sent by the client in the specified header", uwsgi_opt_set_str, &uwsgi.request_deadline_header, UWSGI_OPT_MASTER},
 	{"harakiri-verbose", no_argument, 0, "enable verbose mode for harakiri", uwsgi_opt_true, &uwsgi.harakiri_verbose, 0},
 	{"harakiri-no-arh", no_argument, 0, "do not enable harakiri during after-request-hook", uwsgi_opt_true, &uwsgi.harakiri_no_arh, 0},
 	{"no-harakiri-arh", no_argument, 0, "do not enable harakiri during after-request-hook", uwsgi_opt_true, &uwsgi.harakiri_no_arh, 0},
@@ -164,6 +166,10 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"ignore-sigpipe", no_argument, 0, "do not report (annoying) SIGPIPE", uwsgi_opt_true, &uwsgi.ignore_sigpipe, 0},
 	{"ignore-write-errors", no_argument, 0, "do not report (annoying) write()/writev() errors", uwsgi_opt_true, &uwsgi.ignore_write_errors, 0},
 	{"write-errors-tolerance", required_argument, 0, "set the maximum number of allowed write errors (default: no tolerance)", uwsgi_opt_set_64bit, &uwsgi.write_errors_tolerance, 0},
+	{"response-coalesce", required_argument, 0, "buffer up to <n> bytes of small response writes and send them (with the headers) in a single writev() (streamed chunks are delayed until the buffer is full)", uwsgi_opt_set_64bit, &uwsgi.response_coalesce, 0},
+#ifdef __linux__
+	{"zerocopy-threshold", required_argument, 0, "send responses writes of at least <n> bytes with MSG_ZEROCOPY (tcp sockets only)", uwsgi_opt_set_64bit, &uwsgi.zerocopy_threshold, 0},
+#endif
 	{"write-errors-exception-only", no_argument, 0, "only raise an exception on write errors giving control to the app itself", uwsgi_opt_true, &uwsgi.write_errors_exception_only, 0},
 	{"disable-write-exception", no_argument, 0, "disable exception generation on write()/writev()", uwsgi_opt_true, &uwsgi.disable_write_exception, 0},
 
@@ -570,6 +576,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 #ifdef __linux__
 	{"reload-on-uss", required_argument, 0, "reload if uss memory is higher than specified megabytes", uwsgi_opt_set_megabytes, &uwsgi.reload_on_uss, UWSGI_OPT_MEMORY},
 	{"reload-on-pss", required_argument, 0, "reload if pss memory is higher than specified megabytes", uwsgi_opt_set_megabytes, &uwsgi.reload_on_pss, UWSGI_OPT_MEMORY},
+	{"memory-sharing-report", no_argument, 0, "let the master refresh the uss/pss/shared/swap memory of each worker every cycle", uwsgi_opt_true, &uwsgi.memory_sharing_report, UWSGI_OPT_MASTER},
 #endif
 	{"evil-reload-on-as", required_argument, 0, "force the master to reload a worker if its address space is higher than specified megabytes", uwsgi_opt_set_megabytes, &uwsgi.evil_reload_on_as, UWSGI_OPT_MASTER | UWSGI_OPT_MEMORY},
 	{"evil-reload-on-rss", required_argument, 0, "force the master to reload a worker if its rss memory is higher than specified megabytes", uwsgi_opt_set_megabytes, &uwsgi.evil_reload_on_rss, UWSGI_OPT_MASTER | UWSGI_OPT_MEMORY},
@@ -636,6 +643,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"metric-dir", required_argument, 0, "export metrics as text files to the specified directory", uwsgi_opt_set_str, &uwsgi.metrics_dir, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
 	{"metric-dir-restore", no_argument, 0, "restore last value taken from the metrics dir", uwsgi_opt_true, &uwsgi.metrics_dir_restore, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
 	{"metrics-no-cores", no_argument, 0, "disable generation of cores-related metrics", uwsgi_opt_true, &uwsgi.metrics_no_cores, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
+	{"metrics-http", required_argument, 0, "expose the metrics in the OpenMetrics format on the specified address", uwsgi_opt_set_str, &uwsgi.metrics_http, UWSGI_OPT_METRICS|UWSGI_OPT_MASTER},
 
 	{"udp", required_argument, 0, "run the udp server on the specified address", uwsgi_opt_set_str, &uwsgi.udp_socket, UWSGI_OPT_MASTER},
 	{"stats", required_argument, 0, "enable the stats server on the specified address", uwsgi_opt_set_str, &uwsgi.stats, UWSGI_OPT_MASTER},
@@ -647,6 +655,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"stats-pusher-default-freq", required_argument, 0, "set the default frequency of stats pushers", uwsgi_opt_set_int, &uwsgi.stats_pusher_default_freq, UWSGI_OPT_MASTER},
 	{"stats-pushers-default-freq", required_argument, 0, "set the default frequency of stats pushers", uwsgi_opt_set_int, &uwsgi.stats_pusher_default_freq, UWSGI_OPT_MASTER},
 	{"stats-no-cores", no_argument, 0, "disable generation of cores-related stats", uwsgi_opt_true, &uwsgi.stats_no_cores, UWSGI_OPT_MASTER},
+	{"stats-format", required_argument, 0, "set the default encoding of the stats server (json, binary, prometheus)", uwsgi_opt_set_str, &uwsgi.stats_format, UWSGI_OPT_MASTER},
 	{"stats-no-metrics", no_argument, 0, "do not include metrics in stats output", uwsgi_opt_true, &uwsgi.stats_no_metrics, UWSGI_OPT_MASTER},
 	{"multicast", required_argument, 0, "subscribe to specified multicast group", uwsgi_opt_set_str, &uwsgi.multicast_group, UWSGI_OPT_MASTER},
 	{"multicast-ttl", required_argument, 0, "set multicast ttl", uwsgi_opt_set_int, &uwsgi.multicast_ttl, 0},
@@ -759,6 +768,14 @@ static struct uwsgi_option uwsgi_base_options[] = {
 
 	{"worker-log-encoder", required_argument, 0, "add an item in the log encoder chain", uwsgi_opt_add_string_list, &uwsgi.requested_log_encoders, 0},
 	{"worker-log-req-encoder", required_argument, 0, "add an item in the log req encoder chain", uwsgi_opt_add_string_list, &uwsgi.requested_log_req_encoders, 0},
+
+	{"latency-histograms", no_argument, 0, "keep per-worker and per-route-label latency histograms", uwsgi_opt_true, &uwsgi.latency_histograms, UWSGI_OPT_MASTER},
+	{"latency-traces", required_argument, 0, "trace the N slowest requests of each interval (implies --latency-histograms)", uwsgi_opt_set_int, &uwsgi.latency_traces, UWSGI_OPT_MASTER},
+	{"latency-traces-interval", required_argument, 0, "set the interval (in seconds) of --latency-traces (default 60)", uwsgi_opt_set_int, &uwsgi.latency_traces_interval, 0},
+	{"request-accounting", no_argument, 0, "account the cpu time, context switches and minor faults of every request (per core and route label)", uwsgi_opt_true, &uwsgi.request_accounting, 0},
+	{"sampling-profiler", required_argument, 0, "enable the sampling profiler of the busy workers (samples per second, the folded stacks are served by --stats-http at /profile)", uwsgi_opt_set_int, &uwsgi.sampling_profiler_rate, UWSGI_OPT_MASTER},
+	{"sampling-profiler-stacks", required_argument, 0, "set the number of distinct stacks accounted by the sampling profiler (default 4096)", uwsgi_opt_set_int, &uwsgi.sampling_profiler_stacks, UWSGI_OPT_MASTER},
+	{"log-rotate-columnar", no_argument, 0, "convert the rotated files of the binary request loggers to the compressed columnar format", uwsgi_opt_true, &uwsgi.log_rotate_columnar, 0},
 	
 
 #ifdef UWSGI_PCRE
@@ -795,6 +812,8 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"log-master-bufsize", required_argument, 0, "set the buffer size for the master logger. bigger log messages will be truncated", uwsgi_opt_set_64bit, &uwsgi.log_master_bufsize, 0},
 	{"log-master-stream", no_argument, 0, "create the master logpipe as SOCK_STREAM", uwsgi_opt_true, &uwsgi.log_master_stream, 0},
 	{"log-master-req-stream", no_argument, 0, "create the master requests logpipe as SOCK_STREAM", uwsgi_opt_true, &uwsgi.log_master_req_stream, 0},
+	{"req-log-ring", required_argument, 0, "pass request loglines to the master via a per-worker shared memory ring of the specified size (in bytes)", uwsgi_opt_set_64bit, &uwsgi.req_log_ring_size, UWSGI_OPT_REQ_LOG_MASTER},
+	{"req-log-ring-wait", required_argument, 0, "set the max time (in milliseconds) a worker waits for space in a full request log ring before dropping the line (default 100)", uwsgi_opt_set_int, &uwsgi.req_log_ring_wait, 0},
 	{"log-reopen", no_argument, 0, "reopen log after reload", uwsgi_opt_true, &uwsgi.log_reopen, 0},
 	{"log-truncate", no_argument, 0, "truncate log on startup", uwsgi_opt_true, &uwsgi.log_truncate, 0},
 	{"log-maxsize", required_argument, 0, "set maximum logfile size", uwsgi_opt_set_64bit, &uwsgi.log_maxsize, UWSGI_OPT_MASTER|UWSGI_OPT_LOG_MASTER},
@@ -824,13 +843,17 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"chdir2", required_argument, 0, "chdir to specified directory after apps loading", uwsgi_opt_set_str, &uwsgi.chdir2, 0},
 	{"lazy", no_argument, 0, "set lazy mode (load apps in workers instead of master)", uwsgi_opt_true, &uwsgi.lazy, 0},
 	{"lazy-apps", no_argument, 0, "load apps in each worker instead of the master", uwsgi_opt_true, &uwsgi.lazy_apps, 0},
+	{"freeze-heaps", no_argument, 0, "ask the language plugins to collect and freeze their heaps in the master before forking a worker", uwsgi_opt_true, &uwsgi.freeze_heaps, UWSGI_OPT_MASTER},
+	{"warm-spares", required_argument, 0, "keep N pre-forked and initialized workers ready to replace the respawned ones", uwsgi_opt_set_int, &uwsgi.warm_spares, UWSGI_OPT_MASTER},
 	{"cheap", no_argument, 0, "set cheap mode (spawn workers only after the first request)", uwsgi_opt_true, &uwsgi.status.is_cheap, UWSGI_OPT_MASTER},
 	{"cheaper", required_argument, 0, "set cheaper mode (adaptive process spawning)", uwsgi_opt_set_int, &uwsgi.cheaper_count, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
 	{"cheaper-initial", required_argument, 0, "set the initial number of processes to spawn in cheaper mode", uwsgi_opt_set_int, &uwsgi.cheaper_initial, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
 	{"cheaper-algo", required_argument, 0, "choose to algorithm used for adaptive process spawning", uwsgi_opt_set_str, &uwsgi.requested_cheaper_algo, UWSGI_OPT_MASTER},
 	{"cheaper-step", required_argument, 0, "number of additional processes to spawn at each overload", uwsgi_opt_set_int, &uwsgi.cheaper_step, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
 	{"cheaper-overload", required_argument, 0, "increase workers after specified overload", uwsgi_opt_set_64bit, &uwsgi.cheaper_overload, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
-	{"cheaper-idle", required_argument, 0, "decrease workers after specified idle (algo: spare2) (default: 10)", uwsgi_opt_set_int, &uwsgi.cheaper_idle, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
+	{"cheaper-idle", required_argument, 0, "decrease workers after specified idle (algo: spare2, predictive) (default: 10)", uwsgi_opt_set_int, &uwsgi.cheaper_idle, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
+	{"cheaper-predictive-utilization", required_argument, 0, "set the max percentage of busy cores the predictive cheaper algorithm plans for (default: 75)", uwsgi_opt_set_int, &uwsgi.cheaper_predictive_utilization, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
+	{"cheaper-predictive-horizon", required_argument, 0, "set how many seconds ahead the predictive cheaper algorithm forecasts the load (default: the measured spawn time of workers)", uwsgi_opt_set_int, &uwsgi.cheaper_predictive_horizon, UWSGI_OPT_MASTER | UWSGI_OPT_CHEAPER},
 	{"cheaper-algo-list", no_argument, 0, "list enabled cheapers algorithms", uwsgi_opt_true, &uwsgi.cheaper_algo_list, 0},
 	{"cheaper-algos-list", no_argument, 0, "list enabled cheapers algorithms", uwsgi_opt_true, &uwsgi.cheaper_algo_list, 0},
 	{"cheaper-list", no_argument, 0, "list enabled cheapers algorithms", uwsgi_opt_true, &uwsgi.cheaper_algo_list, 0},
@@ -863,6 +886,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"route-if", required_argument, 0, "add a route based on condition", uwsgi_opt_add_route, "if", 0},
 	{"route-if-not", required_argument, 0, "add a route based on condition (negate version)", uwsgi_opt_add_route, "if-not", 0},
 	{"route-run", required_argument, 0, "always run the specified route action", uwsgi_opt_add_route, "run", 0},
+	{"no-routing-compile", no_argument, 0, "do not compile the routing tables (literal prefix tries and combined regexps)", uwsgi_opt_true, &uwsgi.no_routing_compile, 0},
 
 
 
@@ -926,6 +950,17 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"websockets-max-size", required_argument, 0, "set the max allowed size of websocket messages (in Kbytes, default 1024)", uwsgi_opt_set_64bit, &uwsgi.websockets_max_size, 0},
 	{"websocket-max-size", required_argument, 0, "set the max allowed size of websocket messages (in Kbytes, default 1024)", uwsgi_opt_set_64bit, &uwsgi.websockets_max_size, 0},
 
+	{"websockets-deflate", no_argument, 0, "enable the permessage-deflate websockets extension", uwsgi_opt_true, &uwsgi.websockets_deflate, 0},
+	{"websockets-deflate-level", required_argument, 0, "set the compression level of websockets messages", uwsgi_opt_set_int, &uwsgi.websockets_deflate_level, 0},
+	{"websockets-deflate-no-context-takeover", no_argument, 0, "reset the websockets compression contexts after every message", uwsgi_opt_true, &uwsgi.websockets_deflate_no_context_takeover, 0},
+	{"websockets-deflate-memory", required_argument, 0, "set the max memory (in bytes) of the compression contexts of a websocket, the window sizes are lowered to fit it", uwsgi_opt_set_64bit, &uwsgi.websockets_deflate_memory, 0},
+
+	{"websockets-mask-kernel", required_argument, 0, "force the kernel used for unmasking websockets frames (byte, word, sse2, avx2, neon, default: the fastest supported by the cpu)", uwsgi_opt_set_str, &uwsgi.websockets_mask_kernel, 0},
+
+	{"websockets-channels", required_argument, 0, "enable the websockets channels hub with the specified max number of channels (requires offload threads)", uwsgi_opt_set_int, &uwsgi.websockets_channels, 0},
+	{"websockets-hub-slots", required_argument, 0, "set the number of messages kept by the websockets hub (default 64)", uwsgi_opt_set_64bit, &uwsgi.websockets_hub_slots, 0},
+	{"websockets-hub-message-size", required_argument, 0, "set the max size (in bytes, frame header included) of websockets hub messages (default 65536)", uwsgi_opt_set_64bit, &uwsgi.websockets_hub_message_size, 0},
+
 	{"chunked-input-limit", required_argument, 0, "set the max size of a chunked input part (default 1MB, in bytes)", uwsgi_opt_set_64bit, &uwsgi.chunked_input_limit, 0},
 	{"chunked-input-timeout", required_argument, 0, "set default timeout for chunked input", uwsgi_opt_set_int, &uwsgi.chunked_input_timeout, 0},
 
@@ -952,6 +987,7 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"static-safe", required_argument, 0, "skip security checks if the file is under the specified path", uwsgi_opt_add_string_list, &uwsgi.static_safe, UWSGI_OPT_MIME},
 	{"static-cache-paths", required_argument, 0, "put resolved paths in the uWSGI cache for the specified amount of seconds", uwsgi_opt_set_int, &uwsgi.use_static_cache_paths, UWSGI_OPT_MIME|UWSGI_OPT_MASTER},
 	{"static-cache-paths-name", required_argument, 0, "use the specified cache for static paths", uwsgi_opt_set_str, &uwsgi.static_cache_paths_name, UWSGI_OPT_MIME|UWSGI_OPT_MASTER},
+	{"static-file-cache", required_argument, 0, "keep up to <n> static files open (with their metadata) in every worker, invalidated by the master via filesystem monitoring", uwsgi_opt_set_int, &uwsgi.static_file_cache, UWSGI_OPT_MIME|UWSGI_OPT_MASTER},
 #ifdef __APPLE__
 	{"mimefile", required_argument, 0, "set mime types file path (default /etc/apache2/mime.types)", uwsgi_opt_add_string_list, &uwsgi.mime_file, UWSGI_OPT_MIME},
 	{"mime-file", required_argument, 0, "set mime types file path (default /etc/apache2/mime.types)", uwsgi_opt_add_string_list, &uwsgi.mime_file, UWSGI_OPT_MIME},
@@ -979,11 +1015,17 @@ static struct uwsgi_option uwsgi_base_options[] = {
 	{"static-gzip-prefix", required_argument, 0, "check for a gzip version of all requested static files in the specified dir/prefix", uwsgi_opt_add_string_list, &uwsgi.static_gzip_dir, UWSGI_OPT_MIME},
 	{"static-gzip-ext", required_argument, 0, "check for a gzip version of all requested static files with the specified ext/suffix", uwsgi_opt_add_string_list, &uwsgi.static_gzip_ext, UWSGI_OPT_MIME},
 	{"static-gzip-suffix", required_argument, 0, "check for a gzip version of all requested static files with the specified ext/suffix", uwsgi_opt_add_string_list, &uwsgi.static_gzip_ext, UWSGI_OPT_MIME},
+	{"static-compress-store", required_argument, 0, "compress static files in background and keep the gzip variants in the specified directory", uwsgi_opt_set_str, &uwsgi.static_store_dir, UWSGI_OPT_MIME},
+	{"static-compress-min-size", required_argument, 0, "do not compress static files smaller than the specified size (default 1024)", uwsgi_opt_set_64bit, &uwsgi.static_store_min_size, UWSGI_OPT_MIME},
+	{"static-compress-max-size", required_argument, 0, "limit the size of the compression store (least recently used variants are removed)", uwsgi_opt_set_64bit, &uwsgi.static_store_max_size, UWSGI_OPT_MIME},
+	{"static-compress-items", required_argument, 0, "set the max number of items in the compression store (default 4096)", uwsgi_opt_set_int, &uwsgi.static_store_items, UWSGI_OPT_MIME},
+	{"static-compress-type", required_argument, 0, "compress static files with the specified mime type prefix (default text/ and common text based formats)", uwsgi_opt_add_string_list, &uwsgi.static_store_types, UWSGI_OPT_MIME},
 
 	{"honour-range", no_argument, 0, "enable support for the HTTP Range header", uwsgi_opt_true, &uwsgi.honour_range, 0},
 
 	{"offload-threads", required_argument, 0, "set the number of offload threads to spawn (per-worker, default 0)", uwsgi_opt_set_int, &uwsgi.offload_threads, 0},
 	{"offload-thread", required_argument, 0, "set the number of offload threads to spawn (per-worker, default 0)", uwsgi_opt_set_int, &uwsgi.offload_threads, 0},
+	{"offload-threads-queue", required_argument, 0, "set the size of the queue of tasks shared by the offload threads (per-worker, default 1024)", uwsgi_opt_set_int, &uwsgi.offload_threads_queue, 0},
 
 	{"file-serve-mode", required_argument, 0, "set static file serving mode", uwsgi_opt_fileserve_mode, NULL, UWSGI_OPT_MIME},
 	{"fileserve-mode", required_argument, 0, "set static file serving mode", uwsgi_opt_fileserve_mode, NULL, UWSGI_OPT_MIME},
@@ -1426,6 +1468,7 @@ void grace_them_all(int signum) {
 	int i;
 
 	if (uwsgi.lazy) {
+		uwsgi_warm_spares_kill();
 		for (i = 1; i <= uwsgi.numproc; i++) {
 			if (uwsgi.workers[i].pid > 0) {
 				uwsgi_curse(i, SIGHUP);
@@ -1995,6 +2038,11 @@ check:
 			break;
 		}
 	}
+
+	// drain the request log rings
+	if (uwsgi.req_log_ring_fd[0] > -1) {
+		uwsgi_master_req_log_ring();
+	}
 }
 
 static void plugins_list(void) {
@@ -2429,6 +2477,7 @@ configure:
 	uwsgi_register_cheaper_algo("spare", uwsgi_cheaper_algo_spare);
 	uwsgi_register_cheaper_algo("spare2", uwsgi_cheaper_algo_spare2);
 	uwsgi_register_cheaper_algo("backlog", uwsgi_cheaper_algo_backlog);
+	uwsgi_register_cheaper_algo("predictive", uwsgi_cheaper_algo_predictive);
 	uwsgi_register_cheaper_algo("manual", uwsgi_cheaper_algo_manual);
 
 	// setup imperial monitors
@@ -2652,7 +2701,7 @@ configure:
 
 int uwsgi_start(void *v_argv) {
 
-	int i, j;
+	int i;
 
 #ifdef __linux__
 	uwsgi_set_cgroup();
@@ -2912,6 +2961,9 @@ int uwsgi_start(void *v_argv) {
 		}
         }
 
+	uwsgi_static_file_cache_init();
+	uwsgi_static_store_init();
+
         // initialize the alarm subsystem
         uwsgi_alarms_init();
 
@@ -3189,19 +3241,17 @@ unsafe:
 	uwsgi_setup_metrics();
 
 	// cores are allocated, lets allocate logformat (if required)
-	if (uwsgi.logformat) {
+	if (uwsgi.log_req_binary) {
+		if (uwsgi.logformat) {
+			uwsgi_log("the binary request log encoder is enabled, --log-format will be ignored\n");
+		}
+		uwsgi_setup_log_binary();
+		uwsgi.logit = uwsgi_logit_binary;
+	}
+	else if (uwsgi.logformat) {
+		// the format is compiled and the per-core vectors allocated
 		uwsgi_build_log_format(uwsgi.logformat);
 		uwsgi.logit = uwsgi_logit_lf;
-		// TODO check it
-		//if (uwsgi.logformat_strftime) {
-			//uwsgi.logit = uwsgi_logit_lf_strftime;
-		//}
-		uwsgi.logvectors = uwsgi_malloc(sizeof(struct iovec *) * uwsgi.cores);
-		for (j = 0; j < uwsgi.cores; j++) {
-			uwsgi.logvectors[j] = uwsgi_malloc(sizeof(struct iovec) * uwsgi.logformat_vectors);
-			uwsgi.logvectors[j][uwsgi.logformat_vectors - 1].iov_base = "\n";
-			uwsgi.logvectors[j][uwsgi.logformat_vectors - 1].iov_len = 1;
-		}
 	}
 
 	// initialize locks and socket as soon as possible, as the master could enqueue tasks
@@ -3437,6 +3487,37 @@ void *mem_collector(void *foobar) {
 	return NULL;
 }
 
+// the per-worker setup depending on the worker id
+static void uwsgi_worker_setup_wid() {
+	if (uwsgi.evil_reload_on_rss || uwsgi.evil_reload_on_as) {
+		pthread_t t;
+		pthread_create(&t, NULL, mem_collector, NULL);
+	}
+
+
+	// eventually maps (or disable) sockets for the  worker
+	uwsgi_map_sockets();
+
+	// eventually set cpu affinity policies (OS-dependent)
+	uwsgi_set_cpu_affinity();
+}
+
+static void uwsgi_worker_start_offload_threads() {
+	int i;
+	if (uwsgi.offload_threads > 0) {
+		uwsgi.offload_thread = uwsgi_malloc(sizeof(struct uwsgi_thread *) * uwsgi.offload_threads);
+		for(i=0;i<uwsgi.offload_threads;i++) {
+			uwsgi.offload_thread[i] = uwsgi_offload_thread_start();
+			if (!uwsgi.offload_thread[i]) {
+				uwsgi_log("unable to start offload thread %d for worker %d !!!\n", i, uwsgi.mywid);
+				uwsgi.offload_threads = i;
+				break;
+			}
+		}
+		uwsgi_log("spawned %d offload threads for uWSGI worker %d\n", uwsgi.offload_threads, uwsgi.mywid);
+	}
+}
+
 int uwsgi_run() {
 
 	// !!! from now on, we could be in the master or in a worker !!!
@@ -3463,18 +3544,11 @@ int uwsgi_run() {
 	}
 #endif
 
-	if (uwsgi.evil_reload_on_rss || uwsgi.evil_reload_on_as) {
-		pthread_t t;
-		pthread_create(&t, NULL, mem_collector, NULL);
+	// a warm spare does it when promoted
+	if (!uwsgi.i_am_a_warm_spare) {
+		uwsgi_worker_setup_wid();
 	}
 
-
-	// eventually maps (or disable) sockets for the  worker
-	uwsgi_map_sockets();
-
-	// eventually set cpu affinity policies (OS-dependent)
-	uwsgi_set_cpu_affinity();
-
 	if (uwsgi.worker_exec) {
 		char *w_argv[2];
 		w_argv[0] = uwsgi.worker_exec;
@@ -3505,17 +3579,10 @@ int uwsgi_run() {
 	// set default wsgi_req (for loading apps);
 	uwsgi.wsgi_req = &uwsgi.workers[uwsgi.mywid].cores[0].req;
 
-	if (uwsgi.offload_threads > 0) {
-		uwsgi.offload_thread = uwsgi_malloc(sizeof(struct uwsgi_thread *) * uwsgi.offload_threads);
-		for(i=0;i<uwsgi.offload_threads;i++) {
-			uwsgi.offload_thread[i] = uwsgi_offload_thread_start();
-			if (!uwsgi.offload_thread[i]) {
-				uwsgi_log("unable to start offload thread %d for worker %d !!!\n", i, uwsgi.mywid);
-				uwsgi.offload_threads = i;
-				break;
-			}
-		}
-		uwsgi_log("spawned %d offload threads for uWSGI worker %d\n", uwsgi.offload_threads, uwsgi.mywid);
+	if (!uwsgi.i_am_a_warm_spare) {
+		uwsgi_worker_start_offload_threads();
+		uwsgi_deadlines_start();
+		uwsgi_profiler_worker_setup();
 	}
 
 	// must be run before running apps
@@ -3555,6 +3622,18 @@ int uwsgi_run() {
                 exit(1);
         }
 
+	if (uwsgi.i_am_a_warm_spare) {
+		if (uwsgi.lazy || uwsgi.lazy_apps) {
+			uwsgi_init_all_apps();
+		}
+		// park until the master needs a worker
+		uwsgi_warm_spare_wait();
+		uwsgi_worker_setup_wid();
+		uwsgi_worker_start_offload_threads();
+		uwsgi_deadlines_start();
+		uwsgi_profiler_worker_setup();
+	}
+
 	// must be run before running apps
 
 	// check for worker override
@@ -3584,7 +3663,8 @@ void uwsgi_worker_run() {
 
 	int i;
 
-	if (uwsgi.lazy || uwsgi.lazy_apps) {
+	// warm spares load them before being promoted
+	if ((uwsgi.lazy || uwsgi.lazy_apps) && !uwsgi.i_am_a_warm_spare) {
 		uwsgi_init_all_apps();
 	}
 
@@ -12,6 +12,252 @@ extern struct uwsgi_server uwsgi;
 
 #define REQ_DATA wsgi_req->method_len, wsgi_req->method, wsgi_req->uri_len, wsgi_req->uri, wsgi_req->remote_addr_len, wsgi_req->remote_addr 
 
+static int uwsgi_websocket_header(struct uwsgi_buffer *ub, size_t len, uint8_t opcode) {
+	if (uwsgi_buffer_u8(ub, opcode)) return -1;
+	if (len < 126) {
+		if (uwsgi_buffer_u8(ub, len)) return -1;
+	}
+	else if (len <= (uint16_t) 0xffff) {
+		if (uwsgi_buffer_u8(ub, 126)) return -1;
+		if (uwsgi_buffer_u16be(ub, len)) return -1;
+	}
+	else {
+		if (uwsgi_buffer_u8(ub, 127)) return -1;
+                if (uwsgi_buffer_u64be(ub, len)) return -1;
+	}
+	return 0;
+}
+
+#ifdef UWSGI_ZLIB
+/*
+	permessage-deflate (RFC 7692)
+
+	the contexts are created on the first compressed message, their zlib memory
+	is bounded by --websockets-deflate-memory lowering the window sizes and the deflate memLevel
+*/
+struct uwsgi_websocket_deflate {
+	z_stream deflate;
+	z_stream inflate;
+	uint8_t deflate_ready;
+	uint8_t inflate_ready;
+	int server_bits;
+	int client_bits;
+	int mem_level;
+	uint8_t server_bits_offered;
+	uint8_t client_bits_offered;
+	uint8_t server_no_context_takeover;
+	uint8_t client_no_context_takeover;
+	// compressed message
+	struct uwsgi_buffer *ub;
+};
+
+// see zconf.h
+#define UWSGI_DEFLATE_MEMORY(bits, level) ((1ULL << ((bits) + 2)) + (1ULL << ((level) + 9)))
+#define UWSGI_INFLATE_MEMORY(bits) ((1ULL << (bits)) + 7168)
+
+static char *uwsgi_websocket_trim(char *ptr, size_t *len) {
+	while (*len > 0 && (*ptr == ' ' || *ptr == '\t')) {
+		ptr++;
+		(*len)--;
+	}
+	while (*len > 0 && (ptr[*len - 1] == ' ' || ptr[*len - 1] == '\t')) {
+		(*len)--;
+	}
+	return ptr;
+}
+
+static int uwsgi_websocket_deflate_bits(char *value, size_t len, int *bits) {
+	if (len >= 2 && value[0] == '"' && value[len - 1] == '"') {
+		value++;
+		len -= 2;
+	}
+	int n = uwsgi_str_num(value, len);
+	// 8 bits windows are not supported by zlib raw streams
+	if (n < 9 || n > 15) return -1;
+	*bits = n;
+	return 0;
+}
+
+// parse an offer, returns 0 if it can be accepted
+static int uwsgi_websocket_deflate_offer(struct uwsgi_websocket_deflate *uwd, char *offer, size_t len) {
+	memset(uwd, 0, sizeof(struct uwsgi_websocket_deflate));
+	uwd->server_bits = 15;
+	uwd->client_bits = 15;
+	uwd->mem_level = 8;
+	uwd->server_no_context_takeover = uwsgi.websockets_deflate_no_context_takeover;
+	uwd->client_no_context_takeover = uwsgi.websockets_deflate_no_context_takeover;
+
+	int first = 1;
+	char *ptr = offer;
+	char *end = offer + len;
+	while (ptr <= end) {
+		char *semicolon = memchr(ptr, ';', end - ptr);
+		size_t tlen = (semicolon ? semicolon : end) - ptr;
+		char *token = uwsgi_websocket_trim(ptr, &tlen);
+		char *value = memchr(token, '=', tlen);
+		size_t vlen = 0;
+		if (value) {
+			vlen = (token + tlen) - (value + 1);
+			tlen = value - token;
+			token = uwsgi_websocket_trim(token, &tlen);
+			value = uwsgi_websocket_trim(value + 1, &vlen);
+		}
+
+		if (first) {
+			if (value || uwsgi_strncmp(token, tlen, "permessage-deflate", 18)) return -1;
+			first = 0;
+		}
+		else if (!uwsgi_strncmp(token, tlen, "server_no_context_takeover", 26)) {
+			uwd->server_no_context_takeover = 1;
+		}
+		else if (!uwsgi_strncmp(token, tlen, "client_no_context_takeover", 26)) {
+			uwd->client_no_context_takeover = 1;
+		}
+		else if (!uwsgi_strncmp(token, tlen, "server_max_window_bits", 22)) {
+			if (!value || uwsgi_websocket_deflate_bits(value, vlen, &uwd->server_bits)) return -1;
+			uwd->server_bits_offered = 1;
+		}
+		else if (!uwsgi_strncmp(token, tlen, "client_max_window_bits", 22)) {
+			if (value && uwsgi_websocket_deflate_bits(value, vlen, &uwd->client_bits)) return -1;
+			uwd->client_bits_offered = 1;
+		}
+		else {
+			return -1;
+		}
+		if (!semicolon) break;
+		ptr = semicolon + 1;
+	}
+
+	if (!uwsgi.websockets_deflate_memory) return 0;
+	// the window of the client can be lowered only if it offered client_max_window_bits
+	while (UWSGI_DEFLATE_MEMORY(uwd->server_bits, uwd->mem_level) + UWSGI_INFLATE_MEMORY(uwd->client_bits) > uwsgi.websockets_deflate_memory) {
+		if (uwd->client_bits_offered && uwd->client_bits > 9 && uwd->client_bits >= uwd->server_bits) {
+			uwd->client_bits--;
+		}
+		else if (uwd->server_bits > 9) {
+			uwd->server_bits--;
+		}
+		else if (uwd->mem_level > 1) {
+			uwd->mem_level--;
+		}
+		else if (uwd->client_bits_offered && uwd->client_bits > 9) {
+			uwd->client_bits--;
+		}
+		else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int uwsgi_websocket_deflate_response(struct wsgi_request *wsgi_req, struct uwsgi_websocket_deflate *uwd) {
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(128);
+	if (uwsgi_buffer_append(ub, "permessage-deflate", 18)) goto error;
+	if (uwd->server_no_context_takeover) {
+		if (uwsgi_buffer_append(ub, "; server_no_context_takeover", 28)) goto error;
+	}
+	if (uwd->client_no_context_takeover) {
+		if (uwsgi_buffer_append(ub, "; client_no_context_takeover", 28)) goto error;
+	}
+	// a smaller window is always fine for the client, it has to be announced only if requested
+	if (uwd->server_bits_offered) {
+		if (uwsgi_buffer_append(ub, "; server_max_window_bits=", 25)) goto error;
+		if (uwsgi_buffer_num64(ub, uwd->server_bits)) goto error;
+	}
+	if (uwd->client_bits_offered && uwd->client_bits < 15) {
+		if (uwsgi_buffer_append(ub, "; client_max_window_bits=", 25)) goto error;
+		if (uwsgi_buffer_num64(ub, uwd->client_bits)) goto error;
+	}
+	if (uwsgi_response_add_header(wsgi_req, "Sec-WebSocket-Extensions", 24, ub->buf, ub->pos)) goto error;
+	uwsgi_buffer_destroy(ub);
+	return 0;
+error:
+	uwsgi_buffer_destroy(ub);
+	return -1;
+}
+
+// accept the first acceptable offer
+static int uwsgi_websocket_deflate_negotiate(struct wsgi_request *wsgi_req) {
+	struct uwsgi_websocket_deflate *uwd = uwsgi_malloc(sizeof(struct uwsgi_websocket_deflate));
+	char *ptr = wsgi_req->http_sec_websocket_extensions;
+	char *end = ptr + wsgi_req->http_sec_websocket_extensions_len;
+	while (ptr < end) {
+		char *comma = memchr(ptr, ',', end - ptr);
+		if (!uwsgi_websocket_deflate_offer(uwd, ptr, (comma ? comma : end) - ptr)) {
+			if (uwsgi_websocket_deflate_response(wsgi_req, uwd)) {
+				free(uwd);
+				return -1;
+			}
+			wsgi_req->websocket_deflate = uwd;
+			return 0;
+		}
+		if (!comma) break;
+		ptr = comma + 1;
+	}
+	free(uwd);
+	return 0;
+}
+
+static struct uwsgi_buffer *uwsgi_websocket_message_deflate(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub, char *msg, size_t len, uint8_t opcode) {
+	struct uwsgi_websocket_deflate *uwd = wsgi_req->websocket_deflate;
+	if (!uwd->deflate_ready) {
+		int level = uwsgi.websockets_deflate_level > 0 ? uwsgi.websockets_deflate_level : Z_DEFAULT_COMPRESSION;
+		if (uwsgi_deflate_init_raw(&uwd->deflate, level, uwd->server_bits, uwd->mem_level)) return NULL;
+		uwd->deflate_ready = 1;
+		uwd->ub = uwsgi_buffer_new(uwsgi.page_size);
+	}
+	uwd->ub->pos = 0;
+	if (uwsgi_deflate_buffer(&uwd->deflate, msg, len, Z_SYNC_FLUSH, uwd->ub)) return NULL;
+	// strip the 0x00 0x00 0xff 0xff tail of the sync flush
+	if (uwd->ub->pos >= 4) uwd->ub->pos -= 4;
+	if (uwd->server_no_context_takeover) {
+		if (deflateReset(&uwd->deflate) != Z_OK) return NULL;
+	}
+	// RSV1 marks a compressed message
+	if (uwsgi_websocket_header(ub, uwd->ub->pos, opcode | 0x40)) return NULL;
+	if (uwsgi_buffer_append(ub, uwd->ub->buf, uwd->ub->pos)) return NULL;
+	return ub;
+}
+
+static struct uwsgi_buffer *uwsgi_websocket_inflate(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	struct uwsgi_websocket_deflate *uwd = wsgi_req->websocket_deflate;
+	if (!uwd->inflate_ready) {
+		if (uwsgi_inflate_init_raw(&uwd->inflate, uwd->client_bits)) return NULL;
+		uwd->inflate_ready = 1;
+	}
+	size_t max = uwsgi.websockets_max_size * 1024;
+	struct uwsgi_buffer *ub = uwsgi_buffer_new(len * 4 + 64);
+	if (uwsgi_inflate_buffer(&uwd->inflate, buf, len, ub, max)) goto error;
+	if (wsgi_req->websocket_fin) {
+		if (uwsgi_inflate_buffer(&uwd->inflate, "\0\0\xff\xff", 4, ub, max)) goto error;
+		if (uwd->client_no_context_takeover) {
+			if (inflateReset(&uwd->inflate) != Z_OK) goto error;
+		}
+	}
+	return ub;
+error:
+	uwsgi_log("[uwsgi-websocket] \"%.*s %.*s\" (%.*s) unable to inflate message (max size %llu) !!!\n", REQ_DATA, (unsigned long long) max);
+	uwsgi_buffer_destroy(ub);
+	return NULL;
+}
+
+void uwsgi_websocket_deflate_destroy(struct wsgi_request *wsgi_req) {
+	struct uwsgi_websocket_deflate *uwd = wsgi_req->websocket_deflate;
+	if (uwd->deflate_ready) {
+		deflateEnd(&uwd->deflate);
+		uwsgi_buffer_destroy(uwd->ub);
+	}
+	if (uwd->inflate_ready) {
+		inflateEnd(&uwd->inflate);
+	}
+	free(uwd);
+	wsgi_req->websocket_deflate = NULL;
+}
+#else
+void uwsgi_websocket_deflate_destroy(struct wsgi_request *wsgi_req) {
+}
+#endif
+
 static struct uwsgi_buffer *uwsgi_websocket_message(struct wsgi_request *wsgi_req, char *msg, size_t len, uint8_t opcode) {
 	struct uwsgi_buffer *ub = wsgi_req->websocket_send_buf;
 	if (!ub) {
@@ -22,18 +268,13 @@ static struct uwsgi_buffer *uwsgi_websocket_message(struct wsgi_request *wsgi_re
 		// reset the buffer
 		ub->pos = 0;
 	}
-	if (uwsgi_buffer_u8(ub, opcode)) goto error;
-	if (len < 126) {
-		if (uwsgi_buffer_u8(ub, len)) goto error;
-	}
-	else if (len <= (uint16_t) 0xffff) {
-		if (uwsgi_buffer_u8(ub, 126)) goto error;
-		if (uwsgi_buffer_u16be(ub, len)) goto error;
-	}
-	else {
-		if (uwsgi_buffer_u8(ub, 127)) goto error;
-                if (uwsgi_buffer_u64be(ub, len)) goto error;
+#ifdef UWSGI_ZLIB
+	// only data frames are compressed
+	if (wsgi_req->websocket_deflate && len > 0 && (opcode == 0x81 || opcode == 0x82)) {
+		return uwsgi_websocket_message_deflate(wsgi_req, ub, msg, len, opcode);
 	}
+#endif
+	if (uwsgi_websocket_header(ub, len, opcode)) goto error;
 
 	if (uwsgi_buffer_append(ub, msg, len)) goto error;
 	return ub;
@@ -42,8 +283,492 @@ error:
 	return NULL;
 }
 
+void uwsgi_websockets_setup_mask() {
+	struct uwsgi_websocket_mask_kernel *kernel = uwsgi_websocket_mask_kernel(uwsgi.websockets_mask_kernel);
+	if (!kernel) {
+		uwsgi_log("unknown or unsupported websockets mask kernel: %s\n", uwsgi.websockets_mask_kernel);
+		exit(1);
+	}
+	if (uwsgi.websockets_mask_kernel) {
+		uwsgi_log("websockets mask kernel: %s\n", kernel->name);
+	}
+}
+
+/*
+	messages from a sharedarea and from the channels hub are sent by the offload threads (using a dup() of the socket),
+	only one writer per core (the core itself or an offload thread) owns the connection, the others wait for it
+*/
+void uwsgi_websockets_setup_offload() {
+	if (uwsgi.offload_threads <= 0) return;
+	uwsgi.websockets_offload = uwsgi_calloc(sizeof(struct uwsgi_websocket_offload) * uwsgi.cores);
+}
+
+static int uwsgi_websocket_offload_ready(struct uwsgi_websocket_offload *uwo) {
+	if (uwo->ready) return 0;
+	if (pipe(uwo->pipe)) {
+		uwsgi_error("uwsgi_websocket_offload_ready()/pipe()");
+		return -1;
+	}
+	uwsgi_socket_nb(uwo->pipe[0]);
+	uwsgi_socket_nb(uwo->pipe[1]);
+	uwo->ready = 1;
+	return 0;
+}
+
+static void uwsgi_websockets_hub_wakeup(int wid) {
+	char byte = 0;
+	// a full socket already holds a pending wakeup
+	if (write(uwsgi.websockets_hub->pipes[wid * 2], &byte, 1) != 1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		uwsgi_error("uwsgi_websockets_hub_wakeup()/write()");
+	}
+}
+
+static int uwsgi_websocket_acquire(struct wsgi_request *wsgi_req) {
+	if (!uwsgi.websockets_offload) return 0;
+	struct uwsgi_websocket_offload *uwo = &uwsgi.websockets_offload[wsgi_req->async_id];
+	char buf[64];
+	while (!__sync_bool_compare_and_swap(&uwo->pending, 0, 1)) {
+		int ret = uwsgi.wait_read_hook(uwo->pipe[0], uwsgi.socket_timeout);
+		if (ret <= 0) {
+			uwsgi_log("[uwsgi-websocket] \"%.*s %.*s\" (%.*s) timeout waiting for an offloaded message !!!\n", REQ_DATA);
+			return -1;
+		}
+		while (read(uwo->pipe[0], buf, sizeof(buf)) > 0);
+	}
+	return 0;
+}
+
+static void uwsgi_websocket_offload_release(struct uwsgi_websocket_offload *uwo, int notify) {
+	__sync_bool_compare_and_swap(&uwo->pending, 1, 0);
+	if (notify) {
+		char byte = 0;
+		if (write(uwo->pipe[1], &byte, 1) != 1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			uwsgi_error("uwsgi_websocket_offload_release()/write()");
+		}
+	}
+	// messages published while the connection was busy
+	if (uwsgi.websockets_hub && uwo->subscriptions > 0 && uwo->cursor < uwsgi.websockets_hub->seq) {
+		uwsgi_websockets_hub_wakeup(uwsgi.mywid);
+	}
+}
+
+static void uwsgi_websocket_release(struct wsgi_request *wsgi_req) {
+	if (!uwsgi.websockets_offload) return;
+	uwsgi_websocket_offload_release(&uwsgi.websockets_offload[wsgi_req->async_id], 0);
+}
+
+static void uwsgi_websocket_offload_done(struct uwsgi_offload_request *uor) {
+	uwsgi_sharedarea_unpin((struct uwsgi_sharedarea *) uor->data, uor->custom1);
+	uwsgi_websocket_offload_release(&uwsgi.websockets_offload[uor->custom3], 1);
+}
+
+// returns 1 when the message cannot be offloaded
+static int uwsgi_websocket_offload_sharedarea(struct wsgi_request *wsgi_req, struct uwsgi_sharedarea *sa, uint64_t pos, uint64_t len, uint8_t opcode) {
+	struct uwsgi_websocket_offload *uwo = &uwsgi.websockets_offload[wsgi_req->async_id];
+	if (uwsgi_websocket_offload_ready(uwo)) return 1;
+
+	uwsgi_rlock(sa->lock);
+	int slot = uwsgi_sharedarea_pin(sa, pos, len);
+	if (slot >= 0) sa->hits++;
+	uwsgi_rwunlock(sa->lock);
+	if (slot < 0) return 1;
+
+	// keep messages ordered
+	if (uwsgi_websocket_acquire(wsgi_req)) {
+		uwsgi_sharedarea_unpin(sa, slot);
+		return -1;
+	}
+
+	struct uwsgi_offload_request uor;
+	uwsgi_offload_setup(uwsgi.offload_engine_sharedarea, &uor, wsgi_req, 1);
+	uor.s = dup(wsgi_req->fd);
+	if (uor.s < 0) {
+		uwsgi_error("uwsgi_websocket_offload_sharedarea()/dup()");
+		goto error;
+	}
+	uor.ubuf = uwsgi_buffer_new(10);
+	if (uwsgi_websocket_header(uor.ubuf, len, opcode)) goto error;
+	uor.data = sa;
+	uor.custom1 = slot;
+	uor.custom2 = pos;
+	uor.custom3 = wsgi_req->async_id;
+	uor.len = len;
+	uor.free = uwsgi_websocket_offload_done;
+	if (uwsgi_offload_run(wsgi_req, &uor, NULL)) {
+		goto error;
+	}
+	// the offload thread owns only the dup() of the socket
+	wsgi_req->fd_closed = 0;
+	return 0;
+
+error:
+	if (uor.ubuf) uwsgi_buffer_destroy(uor.ubuf);
+	if (uor.s >= 0) close(uor.s);
+	uwsgi_sharedarea_unpin(sa, slot);
+	uwsgi_websocket_release(wsgi_req);
+	return 1;
+}
+
+/*
+
+	channels hub
+
+	a published message is framed once in a slot of a shared ring, every worker is woken up
+	and its first offload thread queues a delivery (an offload task writing the slot to a dup() of the socket)
+	for every subscribed core. Every core has a cursor in the ring, a subscriber lagging more than
+	--websockets-hub-slots messages loses the oldest ones (accounted as dropped in the channels stats).
+
+	Publishers (workers, mules, the master...) do not need a request and never wait: a slot still being sent
+	to a slow subscriber is skipped (accounted as an overflow of the channel), when every slot is busy the
+	message is dropped.
+
+*/
+
+void uwsgi_websockets_setup_hub() {
+	if (uwsgi.websockets_channels <= 0) return;
+	if (uwsgi.offload_threads <= 0) {
+		uwsgi_log("[uwsgi-websocket] --websockets-channels requires --offload-threads\n");
+		exit(1);
+	}
+	if (!uwsgi.websockets_hub_slots) uwsgi.websockets_hub_slots = 64;
+	if (!uwsgi.websockets_hub_message_size) uwsgi.websockets_hub_message_size = 65536;
+
+	struct uwsgi_websocket_hub *hub = uwsgi_calloc_shared(sizeof(struct uwsgi_websocket_hub));
+	hub->lock = uwsgi_lock_init("websockets hub");
+	hub->channels = uwsgi_calloc_shared(sizeof(struct uwsgi_websocket_channel) * uwsgi.websockets_channels);
+	hub->messages = uwsgi_calloc_shared(sizeof(struct uwsgi_websocket_hub_message) * uwsgi.websockets_hub_slots);
+	char *area = uwsgi_calloc_shared(uwsgi.websockets_hub_message_size * uwsgi.websockets_hub_slots);
+	uint64_t i;
+	for (i = 0; i < uwsgi.websockets_hub_slots; i++) {
+		hub->messages[i].buf = area + (i * uwsgi.websockets_hub_message_size);
+	}
+	hub->pipes = uwsgi_calloc(sizeof(int) * 2 * (uwsgi.numproc + 1));
+	for (i = 1; i <= (uint64_t) uwsgi.numproc; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, &hub->pipes[i * 2])) {
+			uwsgi_error("uwsgi_websockets_setup_hub()/socketpair()");
+			exit(1);
+		}
+		uwsgi_socket_nb(hub->pipes[i * 2]);
+		uwsgi_socket_nb(hub->pipes[(i * 2) + 1]);
+	}
+	uwsgi.websockets_hub = hub;
+	uwsgi_log("websockets hub: %d channels, %llu slots of %llu bytes\n", uwsgi.websockets_channels,
+		(unsigned long long) uwsgi.websockets_hub_slots, (unsigned long long) uwsgi.websockets_hub_message_size);
+}
+
+// hub lock must be held
+static int uwsgi_websockets_hub_channel(struct uwsgi_websocket_hub *hub, char *name, uint16_t name_len, int create) {
+	int i, free_slot = -1;
+	for (i = 0; i < uwsgi.websockets_channels; i++) {
+		struct uwsgi_websocket_channel *channel = &hub->channels[i];
+		if (!channel->name_len) {
+			if (free_slot < 0) free_slot = i;
+			continue;
+		}
+		if (!uwsgi_strncmp(channel->name, channel->name_len, name, name_len)) return i;
+	}
+	if (!create || free_slot < 0) return -1;
+	memcpy(hub->channels[free_slot].name, name, name_len);
+	hub->channels[free_slot].name_len = name_len;
+	return free_slot;
+}
+
+static int uwsgi_websocket_subscribed(struct uwsgi_websocket_offload *uwo, int id) {
+	int i;
+	for (i = 0; i < uwo->subscriptions; i++) {
+		if (uwo->channels[i] == id + 1) return i;
+	}
+	return -1;
+}
+
+int uwsgi_websocket_subscribe(struct wsgi_request *wsgi_req, char *name, uint16_t name_len) {
+	struct uwsgi_websocket_hub *hub = uwsgi.websockets_hub;
+	if (!hub) {
+		uwsgi_log("[uwsgi-websocket] channels are not enabled (use --websockets-channels)\n");
+		return -1;
+	}
+	if (!name_len || name_len >= UWSGI_WEBSOCKET_CHANNEL_NAMELEN) return -1;
+
+	struct uwsgi_websocket_offload *uwo = &uwsgi.websockets_offload[wsgi_req->async_id];
+	if (uwsgi_websocket_offload_ready(uwo)) return -1;
+
+	uwsgi_wlock(hub->lock);
+	int id = uwsgi_websockets_hub_channel(hub, name, name_len, 1);
+	uwsgi_rwunlock(hub->lock);
+	if (id < 0) {
+		uwsgi_log("[uwsgi-websocket] \"%.*s %.*s\" (%.*s) unable to subscribe to %.*s, no more channels available !!!\n", REQ_DATA, name_len, name);
+		return -1;
+	}
+
+	if (uwsgi_websocket_subscribed(uwo, id) >= 0) return 0;
+	if (uwo->subscriptions >= UWSGI_WEBSOCKET_SUBSCRIPTIONS) return -1;
+
+	if (uwsgi_websocket_acquire(wsgi_req)) return -1;
+	if (!uwo->subscriptions) {
+		uwo->fd = wsgi_req->fd;
+		uwo->cursor = hub->seq;
+	}
+	uwo->channels[uwo->subscriptions] = id + 1;
+	uwo->subscriptions++;
+	__sync_add_and_fetch(&hub->channels[id].subscribers, 1);
+	uwsgi_websocket_release(wsgi_req);
+	return 0;
+}
+
+int uwsgi_websocket_unsubscribe(struct wsgi_request *wsgi_req, char *name, uint16_t name_len) {
+	struct uwsgi_websocket_hub *hub = uwsgi.websockets_hub;
+	if (!hub) return -1;
+	struct uwsgi_websocket_offload *uwo = &uwsgi.websockets_offload[wsgi_req->async_id];
+
+	uwsgi_rlock(hub->lock);
+	int id = uwsgi_websockets_hub_channel(hub, name, name_len, 0);
+	uwsgi_rwunlock(hub->lock);
+	if (id < 0) return -1;
+
+	int i = uwsgi_websocket_subscribed(uwo, id);
+	if (i < 0) return -1;
+
+	if (uwsgi_websocket_acquire(wsgi_req)) return -1;
+	uwo->subscriptions--;
+	uwo->channels[i] = uwo->channels[uwo->subscriptions];
+	__sync_sub_and_fetch(&hub->channels[id].subscribers, 1);
+	uwsgi_websocket_release(wsgi_req);
+	return 0;
+}
+
+// called at the end of the request, before the socket is closed
+void uwsgi_websocket_unsubscribe_all(struct wsgi_request *wsgi_req) {
+	struct uwsgi_websocket_hub *hub = uwsgi.websockets_hub;
+	if (!hub) return;
+	struct uwsgi_websocket_offload *uwo = &uwsgi.websockets_offload[wsgi_req->async_id];
+	if (!uwo->subscriptions) return;
+	// on timeout the in-flight message has its own dup() of the socket
+	int acquired = !uwsgi_websocket_acquire(wsgi_req);
+	int i;
+	for (i = 0; i < uwo->subscriptions; i++) {
+		__sync_sub_and_fetch(&hub->channels[uwo->channels[i] - 1].subscribers, 1);
+	}
+	uwo->subscriptions = 0;
+	uwo->fd = -1;
+	if (acquired) uwsgi_websocket_release(wsgi_req);
+}
+
+int uwsgi_websocket_publish(char *name, uint16_t name_len, char *msg, size_t len, uint8_t opcode) {
+	struct uwsgi_websocket_hub *hub = uwsgi.websockets_hub;
+	if (!hub) {
+		uwsgi_log("[uwsgi-websocket] channels are not enabled (use --websockets-channels)\n");
+		return -1;
+	}
+
+	struct uwsgi_buffer *header = uwsgi_buffer_new(10);
+	if (uwsgi_websocket_header(header, len, opcode)) goto error;
+	if (header->pos + len > uwsgi.websockets_hub_message_size) {
+		uwsgi_log("[uwsgi-websocket] message for channel %.*s too big (%llu bytes), increase --websockets-hub-message-size\n",
+			name_len, name, (unsigned long long) len);
+		goto error;
+	}
+
+	uwsgi_wlock(hub->lock);
+	int id = uwsgi_websockets_hub_channel(hub, name, name_len, 0);
+	// nobody ever subscribed
+	if (id < 0) {
+		uwsgi_rwunlock(hub->lock);
+		uwsgi_buffer_destroy(header);
+		return 0;
+	}
+
+	uint64_t seq = hub->seq;
+	struct uwsgi_websocket_hub_message *uwhm = NULL;
+	uint64_t i;
+	for (i = 0; i < uwsgi.websockets_hub_slots; i++) {
+		seq++;
+		struct uwsgi_websocket_hub_message *slot = &hub->messages[seq % uwsgi.websockets_hub_slots];
+		// still being sent, its sequence is skipped (readers will not find it in the slot)
+		if (__sync_add_and_fetch(&slot->refs, 0) > 0) continue;
+		// invalidate the slot, a delivery starting now will discard it
+		slot->seq = 0;
+		__sync_synchronize();
+		if (__sync_add_and_fetch(&slot->refs, 0) > 0) continue;
+		uwhm = slot;
+		break;
+	}
+	if (i > 0) hub->channels[id].overflows += i;
+
+	if (!uwhm) {
+		hub->channels[id].dropped++;
+		uwsgi_rwunlock(hub->lock);
+		uwsgi_buffer_destroy(header);
+		uwsgi_log("[uwsgi-websocket] every hub slot is being sent to slow subscribers, message for channel %.*s dropped\n", name_len, name);
+		return -1;
+	}
+
+	memcpy(uwhm->buf, header->buf, header->pos);
+	memcpy(uwhm->buf + header->pos, msg, len);
+	uwhm->len = header->pos + len;
+	uwhm->channel = id;
+	__sync_synchronize();
+	uwhm->seq = seq;
+	hub->seq = seq;
+	hub->channels[id].published++;
+	uwsgi_rwunlock(hub->lock);
+	uwsgi_buffer_destroy(header);
+
+	int w;
+	for (w = 1; w <= uwsgi.numproc; w++) {
+		uwsgi_websockets_hub_wakeup(w);
+	}
+	return 0;
+
+error:
+	uwsgi_buffer_destroy(header);
+	return -1;
+}
+
+static void uwsgi_websockets_hub_done(struct uwsgi_offload_request *uor) {
+	struct uwsgi_websocket_hub *hub = uwsgi.websockets_hub;
+	struct uwsgi_websocket_hub_delivery *uwhd = (struct uwsgi_websocket_hub_delivery *) uor->buf;
+	uint64_t sent = uor->written;
+	int i;
+	for (i = 0; i < uwhd->count; i++) {
+		struct uwsgi_websocket_channel *channel = &hub->channels[uwhd->channels[i]];
+		uint64_t len = uwhd->messages[i]->len;
+		if (sent >= len) {
+			__sync_add_and_fetch(&channel->delivered, 1);
+			__sync_add_and_fetch(&channel->bytes, len);
+			sent -= len;
+		}
+		else {
+			__sync_add_and_fetch(&channel->bytes, sent);
+			sent = 0;
+		}
+		__sync_sub_and_fetch(&uwhd->messages[i]->refs, 1);
+	}
+	uwsgi_websocket_offload_release(&uwsgi.websockets_offload[uwhd->core], 1);
+}
+
+// the caller owns the connection, returns 1 if the pending messages have been offloaded
+static int uwsgi_websockets_hub_deliver(struct uwsgi_websocket_hub *hub, struct uwsgi_websocket_offload *uwo, int core) {
+	int i;
+	if (!uwo->subscriptions) return 0;
+	struct uwsgi_websocket_hub_delivery *uwhd = uwsgi_calloc(sizeof(struct uwsgi_websocket_hub_delivery));
+	uwhd->core = core;
+	size_t len = 0;
+	uint64_t last = hub->seq;
+	while (uwo->cursor < last && uwhd->count < UWSGI_WEBSOCKET_HUB_BATCH) {
+		uint64_t seq = uwo->cursor + 1;
+		// lagging behind the ring
+		if (last - seq >= uwsgi.websockets_hub_slots) {
+			seq = last - uwsgi.websockets_hub_slots + 1;
+			for (i = 0; i < uwo->subscriptions; i++) {
+				__sync_add_and_fetch(&hub->channels[uwo->channels[i] - 1].dropped, 1);
+			}
+		}
+		uwo->cursor = seq;
+		struct uwsgi_websocket_hub_message *uwhm = &hub->messages[seq % uwsgi.websockets_hub_slots];
+		__sync_add_and_fetch(&uwhm->refs, 1);
+		if (uwhm->seq != seq || uwsgi_websocket_subscribed(uwo, uwhm->channel) < 0) {
+			__sync_sub_and_fetch(&uwhm->refs, 1);
+			continue;
+		}
+		uwhd->messages[uwhd->count] = uwhm;
+		uwhd->seqs[uwhd->count] = seq;
+		uwhd->channels[uwhd->count] = uwhm->channel;
+		uwhd->count++;
+		len += uwhm->len;
+	}
+	if (!uwhd->count) {
+		free(uwhd);
+		return 0;
+	}
+
+	struct uwsgi_offload_request uor;
+	memset(&uor, 0, sizeof(struct uwsgi_offload_request));
+	uor.engine = uwsgi.offload_engine_websocket;
+	uor.fd = -1;
+	uor.fd2 = -1;
+	uor.pipe[0] = -1;
+	uor.pipe[1] = -1;
+	uor.takeover = 1;
+	uor.s = dup(uwo->fd);
+	if (uor.s < 0) {
+		uwsgi_error("uwsgi_websockets_hub_deliver()/dup()");
+		goto error;
+	}
+	uor.data = hub;
+	uor.buf = (char *) uwhd;
+	uor.len = len;
+	uor.free = uwsgi_websockets_hub_done;
+	if (uwsgi_offload_push(&uor)) {
+		close(uor.s);
+		goto error;
+	}
+	return 1;
+
+error:
+	for (i = 0; i < uwhd->count; i++) {
+		__sync_sub_and_fetch(&uwhd->messages[i]->refs, 1);
+	}
+	free(uwhd);
+	return 0;
+}
+
+// run by the first offload thread of the worker
+void uwsgi_websockets_hub_dispatch() {
+	struct uwsgi_websocket_hub *hub = uwsgi.websockets_hub;
+	char buf[64];
+	while (read(hub->pipes[(uwsgi.mywid * 2) + 1], buf, sizeof(buf)) > 0);
+	int i;
+	for (i = 0; i < uwsgi.cores; i++) {
+		struct uwsgi_websocket_offload *uwo = &uwsgi.websockets_offload[i];
+		if (!uwo->subscriptions || uwo->cursor >= hub->seq) continue;
+		// the core (or a previous message) is writing, the new messages will be sent on release
+		if (!__sync_bool_compare_and_swap(&uwo->pending, 0, 1)) continue;
+		if (!uwsgi_websockets_hub_deliver(hub, uwo, i)) {
+			__sync_bool_compare_and_swap(&uwo->pending, 1, 0);
+			char byte = 0;
+			if (write(uwo->pipe[1], &byte, 1) != 1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				uwsgi_error("uwsgi_websockets_hub_dispatch()/write()");
+			}
+		}
+	}
+}
+
+/*
+	"websockets_channels": [{"name": "foo", "subscribers": N, "published": N, "delivered": N, "dropped": N, "overflows": N, "bytes": N}, ...],
+*/
+int uwsgi_stats_websockets_hub(struct uwsgi_stats *us) {
+	struct uwsgi_websocket_hub *hub = uwsgi.websockets_hub;
+	if (!hub) return 0;
+	if (uwsgi_stats_key(us, "websockets_channels")) return -1;
+	if (uwsgi_stats_list_open(us)) return -1;
+	int i, first = 1;
+	for (i = 0; i < uwsgi.websockets_channels; i++) {
+		struct uwsgi_websocket_channel *channel = &hub->channels[i];
+		if (!channel->name_len) continue;
+		if (!first) {
+			if (uwsgi_stats_comma(us)) return -1;
+		}
+		first = 0;
+		if (uwsgi_stats_object_open(us)) return -1;
+		if (uwsgi_stats_keyvaln_comma(us, "name", channel->name, channel->name_len)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "subscribers", (unsigned long long) channel->subscribers)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "published", (unsigned long long) channel->published)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "delivered", (unsigned long long) channel->delivered)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "dropped", (unsigned long long) channel->dropped)) return -1;
+		if (uwsgi_stats_keylong_comma(us, "overflows", (unsigned long long) channel->overflows)) return -1;
+		if (uwsgi_stats_keylong(us, "bytes", (unsigned long long) channel->bytes)) return -1;
+		if (uwsgi_stats_object_close(us)) return -1;
+	}
+	if (uwsgi_stats_list_close(us)) return -1;
+	if (uwsgi_stats_comma(us)) return -1;
+	return 0;
+}
+
 static int uwsgi_websockets_ping(struct wsgi_request *wsgi_req) {
-        if (uwsgi_response_write_body_do(wsgi_req, uwsgi.websockets_ping->buf, uwsgi.websockets_ping->pos)) {
+	if (uwsgi_websocket_acquire(wsgi_req)) return -1;
+	int ret = uwsgi_response_write_body_do(wsgi_req, uwsgi.websockets_ping->buf, uwsgi.websockets_ping->pos);
+	uwsgi_websocket_release(wsgi_req);
+	if (ret) {
 		return -1;
 	}
 	wsgi_req->websocket_last_ping = uwsgi_now();
@@ -51,7 +776,10 @@ static int uwsgi_websockets_ping(struct wsgi_request *wsgi_req) {
 }
 
 static int uwsgi_websockets_pong(struct wsgi_request *wsgi_req) {
-        return uwsgi_response_write_body_do(wsgi_req, uwsgi.websockets_pong->buf, uwsgi.websockets_pong->pos);
+	if (uwsgi_websocket_acquire(wsgi_req)) return -1;
+	int ret = uwsgi_response_write_body_do(wsgi_req, uwsgi.websockets_pong->buf, uwsgi.websockets_pong->pos);
+	uwsgi_websocket_release(wsgi_req);
+	return ret;
 }
 
 static int uwsgi_websockets_check_pingpong(struct wsgi_request *wsgi_req) {
@@ -79,7 +807,10 @@ static int uwsgi_websocket_send_do(struct wsgi_request *wsgi_req, char *msg, siz
 	struct uwsgi_buffer *ub = uwsgi_websocket_message(wsgi_req, msg, len, opcode);
 	if (!ub) return -1;
 
-	return uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+	if (uwsgi_websocket_acquire(wsgi_req)) return -1;
+	int ret = uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+	uwsgi_websocket_release(wsgi_req);
+	return ret;
 }
 
 static int uwsgi_websocket_send_from_sharedarea_do(struct wsgi_request *wsgi_req, int id, uint64_t pos, uint64_t len, uint8_t opcode) {
@@ -88,13 +819,21 @@ static int uwsgi_websocket_send_from_sharedarea_do(struct wsgi_request *wsgi_req
 	if (!len) {
 		len = sa->honour_used ? sa->used-pos : ((sa->max_pos+1)-pos);
 	}
+	if (pos + len > sa->max_pos + 1) return -1;
+	if (uwsgi.websockets_offload && wsgi_req->socket->can_offload && len > 0) {
+		int ret = uwsgi_websocket_offload_sharedarea(wsgi_req, sa, pos, len, opcode);
+		if (ret <= 0) return ret;
+	}
 	uwsgi_rlock(sa->lock);
 	sa->hits++;
-        struct uwsgi_buffer *ub = uwsgi_websocket_message(wsgi_req, sa->area, len, opcode);
+        struct uwsgi_buffer *ub = uwsgi_websocket_message(wsgi_req, sa->area + pos, len, opcode);
 	uwsgi_rwunlock(sa->lock);
         if (!ub) return -1;
 
-        return uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+	if (uwsgi_websocket_acquire(wsgi_req)) return -1;
+	int ret = uwsgi_response_write_body_do(wsgi_req, ub->buf, ub->pos);
+	uwsgi_websocket_release(wsgi_req);
+	return ret;
 }
 
 int uwsgi_websocket_send(struct wsgi_request *wsgi_req, char *msg, size_t len) {
@@ -145,6 +884,8 @@ static void uwsgi_websocket_parse_header(struct wsgi_request *wsgi_req) {
 	uint8_t byte1 = wsgi_req->websocket_buf->buf[0];
 	uint8_t byte2 = wsgi_req->websocket_buf->buf[1];
 	wsgi_req->websocket_opcode = byte1 & 0xf;
+	wsgi_req->websocket_fin = byte1 >> 7;
+	wsgi_req->websocket_rsv1 = (byte1 >> 6) & 1;
 	wsgi_req->websocket_has_mask = byte2 >> 7;
 	wsgi_req->websocket_size = byte2 & 0x7f;
 }
@@ -152,17 +893,32 @@ static void uwsgi_websocket_parse_header(struct wsgi_request *wsgi_req) {
 static struct uwsgi_buffer *uwsgi_websockets_parse(struct wsgi_request *wsgi_req) {
 	// de-mask buffer
 	uint8_t *ptr = (uint8_t *) (wsgi_req->websocket_buf->buf + (wsgi_req->websocket_pktsize - wsgi_req->websocket_size));
-	size_t i;
 
-	if (wsgi_req->websocket_has_mask) {
-		uint8_t *mask = ptr-4;
-		for(i=0;i<wsgi_req->websocket_size;i++) {
-			ptr[i] = ptr[i] ^ mask[i%4];	
+	// RSV1 is set only in the first frame of a compressed message
+	if (wsgi_req->websocket_opcode != 0) {
+		wsgi_req->websocket_compressed = wsgi_req->websocket_rsv1;
+	}
+	struct uwsgi_buffer *ub = NULL;
+	if (wsgi_req->websocket_compressed) {
+#ifdef UWSGI_ZLIB
+		if (wsgi_req->websocket_deflate) {
+			if (wsgi_req->websocket_has_mask) {
+				uwsgi_websocket_mask(ptr, ptr, wsgi_req->websocket_size, ptr-4);
+			}
+			ub = uwsgi_websocket_inflate(wsgi_req, (char *) ptr, wsgi_req->websocket_size);
 		}
+#endif
+		if (!ub) return NULL;
+	}
+	else {
+		ub = uwsgi_buffer_new(wsgi_req->websocket_size);
+		// unmask while copying the payload
+		if (wsgi_req->websocket_has_mask) {
+			uwsgi_websocket_mask((uint8_t *) ub->buf, ptr, wsgi_req->websocket_size, ptr-4);
+			ub->pos = wsgi_req->websocket_size;
+		}
+		else if (uwsgi_buffer_append(ub, (char *) ptr, wsgi_req->websocket_size)) goto error;
 	}
-
-	struct uwsgi_buffer *ub = uwsgi_buffer_new(wsgi_req->websocket_size);
-	if (uwsgi_buffer_append(ub, (char *) ptr, wsgi_req->websocket_size)) goto error;	
 	if (uwsgi_buffer_decapitate(wsgi_req->websocket_buf, wsgi_req->websocket_pktsize)) goto error;
 	wsgi_req->websocket_phase = 0;
 	wsgi_req->websocket_need = 2;
@@ -363,6 +1119,7 @@ struct uwsgi_buffer *uwsgi_websocket_recv_nb(struct wsgi_request *wsgi_req) {
 
 
 ssize_t uwsgi_websockets_simple_send(struct wsgi_request *wsgi_req, struct uwsgi_buffer *ub) {
+	if (uwsgi_response_flush(wsgi_req)) return -1;
 	ssize_t len = wsgi_req->socket->proto_write(wsgi_req, ub->buf, ub->pos);
 	if (wsgi_req->write_errors > 0) {
 		return -1;
@@ -415,8 +1172,18 @@ int uwsgi_websocket_handshake(struct wsgi_request *wsgi_req, char *key, uint16_t
 	}
 	free(b64);
 
+#ifdef UWSGI_ZLIB
+	if (uwsgi.websockets_deflate && wsgi_req->http_sec_websocket_extensions_len > 0) {
+		if (uwsgi_websocket_deflate_negotiate(wsgi_req)) return -1;
+	}
+#endif
+
 	wsgi_req->websocket_last_pong = uwsgi_now();
 
+	// the frames (and the hub/offload writes on the socket) must not wait for a flush
+	if (uwsgi_response_flush(wsgi_req)) return -1;
+	wsgi_req->no_coalesce = 1;
+
 	return uwsgi_response_write_headers_do(wsgi_req);
 #else
 	uwsgi_log("you need to build uWSGI with SSL support to use the websocket handshake api function !!!\n");
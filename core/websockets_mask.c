@@ -0,0 +1,190 @@
+#include "uwsgi.h"
+
+/*
+	websockets (un)masking kernels
+
+	the payload of every frame sent by a client is xored with a 4 bytes key, the kernels
+	xor "len" bytes of "src" into "dst" (they can be the same memory area), so the
+	unmasking can be merged with the copy of the message.
+
+	the word kernel works with 64bit words and is available everywhere, the others are
+	chosen at runtime when the cpu supports them (the best one is used by default,
+	--websockets-mask-kernel forces one). Payloads are never aligned (the frame header
+	has a variable size) so only unaligned loads/stores are used.
+
+	the file has no dependencies on the uwsgi_server structure, t/websockets/mask_bench.c
+	links it directly.
+*/
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define UWSGI_WEBSOCKET_MASK_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+static int uwsgi_websocket_mask_always(void) {
+	return 1;
+}
+
+// the original implementation, used for the tails and as the reference
+static void uwsgi_websocket_mask_byte(uint8_t *dst, uint8_t *src, size_t len, uint8_t *mask) {
+	size_t i;
+	for(i=0;i<len;i++) {
+		dst[i] = src[i] ^ mask[i & 3];
+	}
+}
+
+static void uwsgi_websocket_mask_word(uint8_t *dst, uint8_t *src, size_t len, uint8_t *mask) {
+	uint64_t key;
+	uint64_t w0, w1, w2, w3;
+	// every block is a multiple of 4 bytes, so the key never needs to be rotated
+	memcpy(&key, mask, 4);
+	memcpy(((uint8_t *) &key) + 4, mask, 4);
+	size_t i = 0;
+	for(;i+32<=len;i+=32) {
+		memcpy(&w0, src+i, 8);
+		memcpy(&w1, src+i+8, 8);
+		memcpy(&w2, src+i+16, 8);
+		memcpy(&w3, src+i+24, 8);
+		w0 ^= key; w1 ^= key; w2 ^= key; w3 ^= key;
+		memcpy(dst+i, &w0, 8);
+		memcpy(dst+i+8, &w1, 8);
+		memcpy(dst+i+16, &w2, 8);
+		memcpy(dst+i+24, &w3, 8);
+	}
+	for(;i+8<=len;i+=8) {
+		memcpy(&w0, src+i, 8);
+		w0 ^= key;
+		memcpy(dst+i, &w0, 8);
+	}
+	uwsgi_websocket_mask_byte(dst+i, src+i, len-i, mask);
+}
+
+#if defined(__SSE2__)
+static void uwsgi_websocket_mask_sse2(uint8_t *dst, uint8_t *src, size_t len, uint8_t *mask) {
+	int32_t key32;
+	memcpy(&key32, mask, 4);
+	__m128i key = _mm_set1_epi32(key32);
+	size_t i = 0;
+	for(;i+64<=len;i+=64) {
+		__m128i v0 = _mm_loadu_si128((__m128i *) (src+i));
+		__m128i v1 = _mm_loadu_si128((__m128i *) (src+i+16));
+		__m128i v2 = _mm_loadu_si128((__m128i *) (src+i+32));
+		__m128i v3 = _mm_loadu_si128((__m128i *) (src+i+48));
+		_mm_storeu_si128((__m128i *) (dst+i), _mm_xor_si128(v0, key));
+		_mm_storeu_si128((__m128i *) (dst+i+16), _mm_xor_si128(v1, key));
+		_mm_storeu_si128((__m128i *) (dst+i+32), _mm_xor_si128(v2, key));
+		_mm_storeu_si128((__m128i *) (dst+i+48), _mm_xor_si128(v3, key));
+	}
+	for(;i+16<=len;i+=16) {
+		__m128i v = _mm_loadu_si128((__m128i *) (src+i));
+		_mm_storeu_si128((__m128i *) (dst+i), _mm_xor_si128(v, key));
+	}
+	uwsgi_websocket_mask_word(dst+i, src+i, len-i, mask);
+}
+#endif
+
+#ifdef UWSGI_WEBSOCKET_MASK_AVX2
+static int uwsgi_websocket_mask_avx2_supported(void) {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void uwsgi_websocket_mask_avx2(uint8_t *dst, uint8_t *src, size_t len, uint8_t *mask) {
+	int32_t key32;
+	memcpy(&key32, mask, 4);
+	__m256i key = _mm256_set1_epi32(key32);
+	size_t i = 0;
+	for(;i+128<=len;i+=128) {
+		__m256i v0 = _mm256_loadu_si256((__m256i *) (src+i));
+		__m256i v1 = _mm256_loadu_si256((__m256i *) (src+i+32));
+		__m256i v2 = _mm256_loadu_si256((__m256i *) (src+i+64));
+		__m256i v3 = _mm256_loadu_si256((__m256i *) (src+i+96));
+		_mm256_storeu_si256((__m256i *) (dst+i), _mm256_xor_si256(v0, key));
+		_mm256_storeu_si256((__m256i *) (dst+i+32), _mm256_xor_si256(v1, key));
+		_mm256_storeu_si256((__m256i *) (dst+i+64), _mm256_xor_si256(v2, key));
+		_mm256_storeu_si256((__m256i *) (dst+i+96), _mm256_xor_si256(v3, key));
+	}
+	for(;i+32<=len;i+=32) {
+		__m256i v = _mm256_loadu_si256((__m256i *) (src+i));
+		_mm256_storeu_si256((__m256i *) (dst+i), _mm256_xor_si256(v, key));
+	}
+	// the compiler does not clear the upper registers before a tail call, legacy sse code would pay for it
+	_mm256_zeroupper();
+	uwsgi_websocket_mask_word(dst+i, src+i, len-i, mask);
+}
+#endif
+
+#ifdef __ARM_NEON
+static void uwsgi_websocket_mask_neon(uint8_t *dst, uint8_t *src, size_t len, uint8_t *mask) {
+	uint32_t key32;
+	memcpy(&key32, mask, 4);
+	uint8x16_t key = vreinterpretq_u8_u32(vdupq_n_u32(key32));
+	size_t i = 0;
+	for(;i+64<=len;i+=64) {
+		uint8x16_t v0 = vld1q_u8(src+i);
+		uint8x16_t v1 = vld1q_u8(src+i+16);
+		uint8x16_t v2 = vld1q_u8(src+i+32);
+		uint8x16_t v3 = vld1q_u8(src+i+48);
+		vst1q_u8(dst+i, veorq_u8(v0, key));
+		vst1q_u8(dst+i+16, veorq_u8(v1, key));
+		vst1q_u8(dst+i+32, veorq_u8(v2, key));
+		vst1q_u8(dst+i+48, veorq_u8(v3, key));
+	}
+	for(;i+16<=len;i+=16) {
+		vst1q_u8(dst+i, veorq_u8(vld1q_u8(src+i), key));
+	}
+	uwsgi_websocket_mask_word(dst+i, src+i, len-i, mask);
+}
+#endif
+
+// from the slowest to the fastest
+struct uwsgi_websocket_mask_kernel uwsgi_websocket_mask_kernels[] = {
+	{"byte", uwsgi_websocket_mask_always, uwsgi_websocket_mask_byte},
+	{"word", uwsgi_websocket_mask_always, uwsgi_websocket_mask_word},
+#if defined(__SSE2__)
+	{"sse2", uwsgi_websocket_mask_always, uwsgi_websocket_mask_sse2},
+#endif
+#ifdef __ARM_NEON
+	{"neon", uwsgi_websocket_mask_always, uwsgi_websocket_mask_neon},
+#endif
+#ifdef UWSGI_WEBSOCKET_MASK_AVX2
+	{"avx2", uwsgi_websocket_mask_avx2_supported, uwsgi_websocket_mask_avx2},
+#endif
+	{NULL, NULL, NULL},
+};
+
+static void (*uwsgi_websocket_mask_func)(uint8_t *, uint8_t *, size_t, uint8_t *) = uwsgi_websocket_mask_word;
+
+void uwsgi_websocket_mask(uint8_t *dst, uint8_t *src, size_t len, uint8_t *mask) {
+	uwsgi_websocket_mask_func(dst, src, len, mask);
+}
+
+/*
+	set the kernel used by uwsgi_websocket_mask(), NULL chooses the fastest one supported by the cpu,
+	NULL is returned if the kernel is unknown or not supported
+*/
+struct uwsgi_websocket_mask_kernel *uwsgi_websocket_mask_kernel(char *name) {
+	struct uwsgi_websocket_mask_kernel *best = NULL;
+	struct uwsgi_websocket_mask_kernel *kernel = uwsgi_websocket_mask_kernels;
+	while(kernel->name) {
+		if (kernel->supported()) {
+			if (!name) {
+				best = kernel;
+			}
+			else if (!strcmp(kernel->name, name)) {
+				best = kernel;
+				break;
+			}
+		}
+		kernel++;
+	}
+	if (best) uwsgi_websocket_mask_func = best->func;
+	return best;
+}
@@ -1,5 +1,10 @@
 #include "uwsgi.h"
 
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#define UWSGI_ZEROCOPY 1
+#endif
+
 extern struct uwsgi_server uwsgi;
 
 int uwsgi_response_add_content_length(struct wsgi_request *wsgi_req, uint64_t cl) {
@@ -271,6 +276,255 @@ int uwsgi_response_write_headers_do(struct wsgi_request *wsgi_req) {
         return UWSGI_OK;
 }
 
+// remove "bytes" from the head of an iovec array
+static void uwsgi_iovec_consume(struct iovec *iov, size_t *iov_len, size_t bytes) {
+	size_t i = 0;
+	while(i < *iov_len && bytes >= iov[i].iov_len) {
+		bytes -= iov[i].iov_len;
+		i++;
+	}
+	if (i < *iov_len) {
+		iov[i].iov_base += bytes;
+		iov[i].iov_len -= bytes;
+	}
+	memmove(iov, iov + i, sizeof(struct iovec) * (*iov_len - i));
+	*iov_len -= i;
+}
+
+#ifdef UWSGI_ZEROCOPY
+/*
+	with MSG_ZEROCOPY the kernel references the pages of the response instead of copying them,
+	so we cannot give back the memory to the plugin until all of the completion notifications
+	have been read from the socket error queue
+*/
+static int uwsgi_response_zerocopy_wait(struct wsgi_request *wsgi_req, uint32_t pending) {
+	char control[128];
+	while(pending > 0) {
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(struct msghdr));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(wsgi_req->fd, &msg, MSG_ERRQUEUE) < 0) {
+			if (errno == EINTR) continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				uwsgi_req_error("uwsgi_response_zerocopy_wait()/recvmsg()");
+				return -1;
+			}
+			// POLLERR is always reported when the error queue is not empty
+			struct pollfd upoll;
+			upoll.fd = wsgi_req->fd;
+			upoll.events = 0;
+			upoll.revents = 0;
+			int ret = uwsgi_poll(&upoll, 1, uwsgi.socket_timeout * 1000);
+			if (ret < 0) {
+				uwsgi_req_error("uwsgi_response_zerocopy_wait()/poll()");
+				return -1;
+			}
+			if (ret == 0) {
+				uwsgi_log("uwsgi_response_zerocopy_wait() TIMEOUT !!!\n");
+				return -1;
+			}
+			continue;
+		}
+		struct cmsghdr *cmsg;
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+				!(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) continue;
+			struct sock_extended_err *serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+			if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+			// [ee_info, ee_data] is the range of completed sendmsg() calls
+			uint32_t completed = serr->ee_data - serr->ee_info + 1;
+			pending = completed >= pending ? 0 : pending - completed;
+			// the kernel copied the data anyway (like on loopback), stop paying for the notifications
+			if ((serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && !wsgi_req->socket->no_zerocopy) {
+				wsgi_req->socket->no_zerocopy = 1;
+				uwsgi_log("MSG_ZEROCOPY is not effective on socket %s, disabling it\n", wsgi_req->socket->name);
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+	returns 0 when the whole iovec has been sent, 1 if the remaining part
+	must be sent with the standard (copying) path, -1 on error
+*/
+static int uwsgi_response_zerocopy(struct wsgi_request *wsgi_req, struct iovec *iov, size_t *iov_len, char *fname) {
+	int on = 1;
+	if (setsockopt(wsgi_req->fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(int))) {
+		wsgi_req->socket->no_zerocopy = 1;
+		return 1;
+	}
+
+	int ret = 1;
+	uint32_t calls = 0;
+	while(*iov_len > 0) {
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(struct msghdr));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = *iov_len;
+		errno = 0;
+		ssize_t wlen = sendmsg(wsgi_req->fd, &msg, MSG_ZEROCOPY);
+		if (wlen > 0) {
+			calls++;
+			wsgi_req->write_pos += wlen;
+			uwsgi_iovec_consume(iov, iov_len, wlen);
+			continue;
+		}
+		if (wlen < 0 && errno == EINTR) continue;
+		if (wlen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			int wret = uwsgi_wait_write_req(wsgi_req);
+			if (wret > 0) continue;
+			if (wret == 0) {
+				uwsgi_log("%s TIMEOUT !!!\n", fname);
+			}
+			ret = -1;
+			break;
+		}
+		// ENOBUFS (optmem limit): the remaining part will be copied
+		if (wlen < 0 && errno == ENOBUFS) break;
+		if (!uwsgi.ignore_write_errors) {
+			uwsgi_req_error(fname);
+		}
+		ret = -1;
+		break;
+	}
+
+	if (ret > 0 && *iov_len == 0) ret = 0;
+	if (calls > 0 && uwsgi_response_zerocopy_wait(wsgi_req, calls)) ret = -1;
+	return ret;
+}
+#endif
+
+// write a group of (at most IOV_MAX) iovecs with the protocol writev hook
+static int uwsgi_response_writev_window(struct wsgi_request *wsgi_req, struct iovec *iov, size_t iov_len, size_t bytes, char *fname) {
+
+#ifdef UWSGI_ZEROCOPY
+	if (uwsgi.zerocopy_threshold && bytes >= uwsgi.zerocopy_threshold && !wsgi_req->socket->no_zerocopy &&
+		wsgi_req->socket->proto_writev == uwsgi_proto_base_writev &&
+		(wsgi_req->socket->family == AF_INET || wsgi_req->socket->family == AF_INET6)) {
+		int ret = uwsgi_response_zerocopy(wsgi_req, iov, &iov_len, fname);
+		if (ret <= 0) return ret;
+	}
+#endif
+
+	for(;;) {
+		errno = 0;
+		int ret = wsgi_req->socket->proto_writev(wsgi_req, iov, &iov_len);
+		if (ret < 0) {
+			if (!uwsgi.ignore_write_errors) {
+				uwsgi_req_error(fname);
+			}
+			return -1;
+		}
+		if (ret == UWSGI_OK) {
+			break;
+		}
+		if (!uwsgi_is_again()) continue;
+		ret = uwsgi_wait_write_req(wsgi_req);
+		if (ret < 0) return -1;
+		if (ret == 0) {
+			uwsgi_log("%s TIMEOUT !!!\n", fname);
+			return -1;
+		}
+	}
+	return UWSGI_OK;
+}
+
+/*
+	write the (optional) headers and a list of body chunks with the minimum amount of syscalls.
+
+	Only the iovec references are copied (to the per-core wvec array, so the caller's one is not
+	touched), every writev() gets up to IOV_MAX of them. Counters are updated on success.
+*/
+static int uwsgi_response_writev_do(struct wsgi_request *wsgi_req, struct uwsgi_buffer *headers, struct iovec *iov, size_t iov_len, char *fname) {
+	struct iovec *wvec = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].wvec;
+	size_t i = 0;
+	wsgi_req->write_pos = 0;
+	while(headers || i < iov_len) {
+		size_t n = 0, bytes = 0;
+		if (headers) {
+			wvec[n].iov_base = headers->buf;
+			wvec[n].iov_len = headers->pos;
+			bytes += headers->pos;
+			n++;
+		}
+		while(i < iov_len && n < IOV_MAX) {
+			if (iov[i].iov_len > 0) {
+				wvec[n] = iov[i];
+				bytes += iov[i].iov_len;
+				n++;
+			}
+			i++;
+		}
+		if (n > 0 && uwsgi_response_writev_window(wsgi_req, wvec, n, bytes, fname)) {
+			wsgi_req->write_errors++;
+			return -1;
+		}
+		if (headers) {
+			wsgi_req->headers_size += headers->pos;
+			wsgi_req->write_pos -= headers->pos;
+			headers = NULL;
+		}
+	}
+	wsgi_req->response_size += wsgi_req->write_pos;
+	// reset for the next write
+	wsgi_req->write_pos = 0;
+	return UWSGI_OK;
+}
+
+/*
+	response coalescing (--response-coalesce <n>)
+
+	small body chunks are copied in a per-core buffer, while the headers are left in wsgi_req->headers
+	(they are marked as sent, so they cannot be changed anymore). Everything is written with a single
+	writev() when a chunk does not fit in the buffer (that chunk is referenced, not copied), before
+	any other kind of write (sendfile, offloading...) and at the end of the request.
+	After a websocket handshake the writes are no longer coalesced.
+*/
+static int uwsgi_response_coalesce(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	if (!wsgi_req->headers_sent) {
+		int ret = uwsgi_response_write_headers_do0(wsgi_req);
+		if (ret == UWSGI_AGAIN) {
+			wsgi_req->headers_sent = 1;
+			wsgi_req->headers_coalesced = 1;
+		}
+		else if (ret != UWSGI_OK) {
+			wsgi_req->write_errors++;
+			return -1;
+		}
+	}
+
+	if (len < uwsgi.response_coalesce - wsgi_req->coalesced) {
+		memcpy(uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].coalesce_buf + wsgi_req->coalesced, buf, len);
+		wsgi_req->coalesced += len;
+		return UWSGI_OK;
+	}
+
+	struct iovec iov[2];
+	iov[0].iov_base = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].coalesce_buf;
+	iov[0].iov_len = wsgi_req->coalesced;
+	iov[1].iov_base = buf;
+	iov[1].iov_len = len;
+	struct uwsgi_buffer *headers = wsgi_req->headers_coalesced ? wsgi_req->headers : NULL;
+	wsgi_req->headers_coalesced = 0;
+	wsgi_req->coalesced = 0;
+	return uwsgi_response_writev_do(wsgi_req, headers, iov, 2, "uwsgi_response_write_body_do()");
+}
+
+// write the coalesced headers and body chunks (if any)
+int uwsgi_response_flush(struct wsgi_request *wsgi_req) {
+	if (!wsgi_req->headers_coalesced && !wsgi_req->coalesced) return UWSGI_OK;
+	if (wsgi_req->write_errors) return -1;
+	struct iovec iov;
+	iov.iov_base = uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].coalesce_buf;
+	iov.iov_len = wsgi_req->coalesced;
+	struct uwsgi_buffer *headers = wsgi_req->headers_coalesced ? wsgi_req->headers : NULL;
+	wsgi_req->headers_coalesced = 0;
+	wsgi_req->coalesced = 0;
+	return uwsgi_response_writev_do(wsgi_req, headers, &iov, 1, "uwsgi_response_flush()");
+}
+
 /*
 	private function for highly optimized writes (1 single syscall for headers and body)
 */
@@ -405,6 +659,10 @@ int uwsgi_response_write_body_do(struct wsgi_request *wsgi_req, char *buf, size_
 	}
 
 write:
+	if (uwsgi.response_coalesce && !wsgi_req->no_coalesce && wsgi_req->socket->proto_writev) {
+		return uwsgi_response_coalesce(wsgi_req, buf, len);
+	}
+
 	// send headers if not already sent
 	if (!wsgi_req->headers_sent) {
 		if (wsgi_req->socket->proto_writev && len > 0 && wsgi_req->headers) {
@@ -472,108 +730,30 @@ int uwsgi_response_writev_body_do(struct wsgi_request *wsgi_req, struct iovec *i
 #endif
 
 	size_t i;
-	int buffering = 0;
-	// transformations apply to every vector
-	for(i=0;i<len;i++) {	
-        	// if the transformation chain returns 1, we are in buffering mode
-        	if (wsgi_req->transformed_chunk_len == 0 && wsgi_req->transformations) {
-                	int t_ret = uwsgi_apply_transformations(wsgi_req, iov[i].iov_base, iov[i].iov_len);
-                	if (t_ret == 0) {
-                        	iov[i].iov_base = wsgi_req->transformed_chunk;
-                        	iov[i].iov_len = wsgi_req->transformed_chunk_len;
-                        	// reset transformation
-                        	wsgi_req->transformed_chunk = NULL;
-                        	wsgi_req->transformed_chunk_len = 0;
-                        	goto write;
-                	}
-                	if (t_ret == 1) {
-				buffering = 1;
-				continue;
-                	}
-                	wsgi_req->write_errors++;
-                	return -1;
+	// transformations and coalescing work on single chunks, as the protocols without vector based I/O
+	if (wsgi_req->transformations || uwsgi.response_coalesce || !wsgi_req->socket->proto_writev) {
+		for(i=0;i<len;i++) {
+			int ret = uwsgi_response_write_body_do(wsgi_req, iov[i].iov_base, iov[i].iov_len);
+			if (ret) return ret;
 		}
-        }
-
-	if (buffering) return UWSGI_OK;
-
-write:
-        // send headers if not already sent
-        if (!wsgi_req->headers_sent) {
-                int ret = uwsgi_response_write_headers_do(wsgi_req);
-                if (ret == UWSGI_OK) goto sendbody;
-                if (ret == UWSGI_AGAIN) return UWSGI_AGAIN;
-                wsgi_req->write_errors++;
-                return -1;
-        }
-
-sendbody:
-
-        if (len == 0) return UWSGI_OK;
-	// unfortunately vector based I/O cannot be accomplished on all protocols
-	if (!wsgi_req->socket->proto_writev) goto fallback;
-
-	// we use a copy to avoid mess
-	size_t iov_len = len;
-	for(;;) {
-        	errno = 0;
-                int ret = wsgi_req->socket->proto_writev(wsgi_req, iov, &iov_len);
-                if (ret < 0) {
-                	if (!uwsgi.ignore_write_errors) {
-                        	uwsgi_req_error("uwsgi_response_writev_body_do()");
-                        }
-                        wsgi_req->write_errors++;
-                        return -1;
-                }
-                if (ret == UWSGI_OK) {
-                	break;
-                }
-                if (!uwsgi_is_again()) continue;
-                ret = uwsgi_wait_write_req(wsgi_req);
-                if (ret < 0) { wsgi_req->write_errors++; return -1;}
-                if (ret == 0) {
-                	uwsgi_log("uwsgi_response_writev_body_do() TIMEOUT !!!\n");
-                        wsgi_req->write_errors++;
-                        return -1;
-                }
+		return UWSGI_OK;
 	}
 
-	goto done;
-
-fallback:
-
-	for(i=0;i<len;i++) {
-        	for(;;) {
-                	errno = 0;
-                	int ret = wsgi_req->socket->proto_write(wsgi_req, iov[i].iov_base, iov[i].iov_len);
-                	if (ret < 0) {
-                        	if (!uwsgi.ignore_write_errors) {
-                                	uwsgi_req_error("uwsgi_response_writev_body_do()");
-                        	}
-                        	wsgi_req->write_errors++;
-                        	return -1;
-                	}
-                	if (ret == UWSGI_OK) {
-                        	break;
-                	}
-                	if (!uwsgi_is_again()) continue;
-                	ret = uwsgi_wait_write_req(wsgi_req);
-                	if (ret < 0) { wsgi_req->write_errors++; return -1;}
-                	if (ret == 0) {
-                        	uwsgi_log("uwsgi_response_writev_body_do() TIMEOUT !!!\n");
-                        	wsgi_req->write_errors++;
-                        	return -1;
-                	}
+	struct uwsgi_buffer *headers = NULL;
+        // send headers (in the same writev) if not already sent
+        if (!wsgi_req->headers_sent) {
+		int ret = uwsgi_response_write_headers_do0(wsgi_req);
+		if (ret == UWSGI_AGAIN) {
+			headers = wsgi_req->headers;
+			wsgi_req->headers_sent = 1;
+		}
+		else if (ret != UWSGI_OK) {
+                	wsgi_req->write_errors++;
+                	return -1;
 		}
         }
 
-done:
-
-        wsgi_req->response_size += wsgi_req->write_pos;
-        // reset for the next write
-        wsgi_req->write_pos = 0;
-
-        return UWSGI_OK;
+	return uwsgi_response_writev_do(wsgi_req, headers, iov, len, "uwsgi_response_writev_body_do()");
 }
 
 
@@ -595,6 +775,11 @@ int uwsgi_response_sendfile_do_can_close(struct wsgi_request *wsgi_req, int fd,
 		return UWSGI_OK;
 	}
 
+	if (uwsgi_response_flush(wsgi_req)) {
+		if (can_close) close(fd);
+		return -1;
+	}
+
 	if (!wsgi_req->headers_sent) {
 		int ret = uwsgi_response_write_headers_do(wsgi_req);
 		if (ret == UWSGI_OK) goto sendfile;
@@ -692,7 +877,7 @@ int uwsgi_simple_wait_write_hook(int fd, int timeout) {
         upoll.fd = fd;
         upoll.events = POLLOUT;
         upoll.revents = 0;
-        int ret = poll(&upoll, 1, timeout);
+        int ret = uwsgi_poll(&upoll, 1, timeout);
 
         if (ret > 0) {
                 if (upoll.revents & POLLOUT) {
@@ -713,6 +898,8 @@ int uwsgi_simple_wait_write_hook(int fd, int timeout) {
 */
 int uwsgi_simple_write(struct wsgi_request *wsgi_req, char *buf, size_t len) {
 
+	if (uwsgi_response_flush(wsgi_req)) return -1;
+
 	wsgi_req->write_pos = 0;
 
 	for(;;) {
@@ -110,6 +110,63 @@ int uwsgi_inflate_init(z_stream *z, char *dict, size_t dict_len) {
         return 0;
 }
 
+// raw streams (no zlib/gzip wrapper), as used by the websockets permessage-deflate extension
+int uwsgi_deflate_init_raw(z_stream *z, int level, int window_bits, int mem_level) {
+	z->zalloc = Z_NULL;
+	z->zfree = Z_NULL;
+	z->opaque = Z_NULL;
+	if (deflateInit2(z, level, Z_DEFLATED, -window_bits, mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return -1;
+	}
+	return 0;
+}
+
+int uwsgi_inflate_init_raw(z_stream *z, int window_bits) {
+	z->zalloc = Z_NULL;
+	z->zfree = Z_NULL;
+	z->opaque = Z_NULL;
+	z->next_in = Z_NULL;
+	z->avail_in = 0;
+	if (inflateInit2(z, -window_bits) != Z_OK) {
+		return -1;
+	}
+	return 0;
+}
+
+// compress buf appending the output to ub
+int uwsgi_deflate_buffer(z_stream *z, char *buf, size_t len, int flush, struct uwsgi_buffer *ub) {
+	z->next_in = (Bytef *) buf;
+	z->avail_in = len;
+	for (;;) {
+		if (uwsgi_buffer_ensure(ub, len + 64)) return -1;
+		z->next_out = (Bytef *) ub->buf + ub->pos;
+		z->avail_out = ub->len - ub->pos;
+		size_t avail = z->avail_out;
+		if (deflate(z, flush) == Z_STREAM_ERROR) return -1;
+		ub->pos += avail - z->avail_out;
+		if (z->avail_in == 0 && z->avail_out > 0) break;
+	}
+	return 0;
+}
+
+// decompress buf appending the output to ub, fails if the output exceeds max bytes
+int uwsgi_inflate_buffer(z_stream *z, char *buf, size_t len, struct uwsgi_buffer *ub, size_t max) {
+	z->next_in = (Bytef *) buf;
+	z->avail_in = len;
+	for (;;) {
+		if (uwsgi_buffer_ensure(ub, 8192)) return -1;
+		z->next_out = (Bytef *) ub->buf + ub->pos;
+		z->avail_out = ub->len - ub->pos;
+		size_t avail = z->avail_out;
+		int ret = inflate(z, Z_SYNC_FLUSH);
+		if (ret == Z_STREAM_ERROR || ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) return -1;
+		ub->pos += avail - z->avail_out;
+		if (ub->pos > max) return -1;
+		if (ret == Z_STREAM_END || z->avail_out > 0) break;
+	}
+	return 0;
+}
+
 int uwsgi_gzip_prepare(z_stream *z, char *dict, size_t dict_len, uint32_t *crc32) {
 	uwsgi_crc32(crc32, NULL, 0);
 	if (uwsgi_deflate_init(z, NULL, 0)) return -1;
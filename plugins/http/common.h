@@ -51,6 +51,9 @@ struct uwsgi_http {
 
 	int proto_http;
 
+	// default time budget (milliseconds) forwarded to the backends
+	uint64_t request_deadline;
+
 }; 
 
 struct http_session {
@@ -145,6 +148,9 @@ struct http_session {
         uint16_t proxy_src_len;
         uint16_t proxy_src_port_len;
 
+	// the client sent a time budget (--request-deadline-header)
+	int has_deadline;
+
 };
 
 
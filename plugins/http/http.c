@@ -55,6 +55,7 @@ struct uwsgi_option http_options[] = {
 	{"http-stats-server", required_argument, 0, "run the http router stats server", uwsgi_opt_set_str, &uhttp.cr.stats_server, 0},
 	{"http-ss", required_argument, 0, "run the http router stats server", uwsgi_opt_set_str, &uhttp.cr.stats_server, 0},
 	{"http-harakiri", required_argument, 0, "enable http router harakiri", uwsgi_opt_set_int, &uhttp.cr.harakiri, 0},
+	{"http-request-deadline", required_argument, 0, "forward the specified time budget (milliseconds) in the --request-deadline-header (the budget of the client is honoured if lower)", uwsgi_opt_set_64bit, &uhttp.request_deadline, 0},
 	{"http-stud-prefix", required_argument, 0, "expect a stud prefix (1byte family + 4/16 bytes address) on connections from the specified address", uwsgi_opt_add_addr_list, &uhttp.stud_prefix, 0},
 	{"http-uid", required_argument, 0, "drop http router privileges to the specified uid", uwsgi_opt_uid, &uhttp.cr.uid, 0 },
 	{"http-gid", required_argument, 0, "drop http router privileges to the specified gid", uwsgi_opt_gid, &uhttp.cr.gid, 0 },
@@ -303,6 +304,21 @@ static int http_add_uwsgi_header(struct corerouter_peer *peer, char *hh, size_t
 		}
 	}
 
+	// forward the budget of the client (capped by the router one)
+	else if (uwsgi.request_deadline_var && !uwsgi_strncmp(uwsgi.request_deadline_var + 5, uwsgi.request_deadline_var_len - 5, hh, keylen)) {
+		hr->has_deadline = 1;
+		uint64_t budget = uwsgi_deadline_parse(val, vallen);
+		if (uhttp.request_deadline && (!budget || budget > uhttp.request_deadline * 1000)) {
+			char *num = uwsgi_64bit2str(uhttp.request_deadline);
+			if (uwsgi_buffer_append_keyval(out, uwsgi.request_deadline_var, uwsgi.request_deadline_var_len, num, strlen(num))) {
+				free(num);
+				return -1;
+			}
+			free(num);
+			return 0;
+		}
+	}
+
 #ifdef UWSGI_ZLIB
 	else if (uhttp.auto_gzip && !uwsgi_strncmp("ACCEPT_ENCODING", 15, hh, keylen)) {
 		if ( uwsgi_contains_n(val, vallen, "gzip", 4) ) {
@@ -598,6 +614,8 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 	struct uwsgi_buffer *out = peer->out;
 	int found = 0;
 
+	hr->has_deadline = 0;
+
 	// REQUEST_METHOD 
 	while (ptr < watermark) {
 		if (*ptr == ' ') {
@@ -815,6 +833,15 @@ int http_headers_parse(struct corerouter_peer *peer, int skip) {
 
 	if (broken) return -1;
 
+	if (!hr->has_deadline && uhttp.request_deadline && uwsgi.request_deadline_var) {
+		char *num = uwsgi_64bit2str(uhttp.request_deadline);
+		if (uwsgi_buffer_append_keyval(out, uwsgi.request_deadline_var, uwsgi.request_deadline_var_len, num, strlen(num))) {
+			free(num);
+			return -1;
+		}
+		free(num);
+	}
+
 	struct uwsgi_string_list *hv = uhttp.http_vars;
 	while (hv) {
 		char *equal = strchr(hv->value, '=');
@@ -1426,6 +1453,10 @@ int http_init() {
 
 	uhttp.cr.session_size = sizeof(struct http_session);
 	uhttp.cr.alloc_session = http_alloc_session;
+	if (uhttp.request_deadline && !uwsgi.request_deadline_header) {
+		uwsgi_log("you have to specify the header with --request-deadline-header to use --http-request-deadline\n");
+		exit(1);
+	}
 	if (uhttp.cr.has_sockets && !uwsgi_corerouter_has_backends(&uhttp.cr)) {
 		if (!uwsgi.sockets) {
 			uwsgi_new_socket(uwsgi_concat2("127.0.0.1:0", ""));
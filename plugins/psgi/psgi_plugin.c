@@ -787,6 +787,22 @@ void uwsgi_perl_enable_threads(void) {
 #endif
 }
 
+/*
+	the current file:line of the interpreter running the request (for the sampling profiler),
+	called in a signal handler: only the current cop is read
+*/
+static int uwsgi_perl_profiler_frame(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	if (wsgi_req->app_id < 0 || wsgi_req->app_id >= uwsgi_apps_cnt) return 0;
+	struct uwsgi_app *wi = &uwsgi_apps[wsgi_req->app_id];
+	if (wi->modifier1 != psgi_plugin.modifier1 || !wi->interpreter) return 0;
+	PerlInterpreter *my_perl = ((PerlInterpreter **)wi->interpreter)[uwsgi.threads > 1 ? wsgi_req->async_id : 0];
+	if (!my_perl || !PL_curcop) return 0;
+	char *file = CopFILE(PL_curcop);
+	int ret = snprintf(buf, len, "%s:%u", file ? file : "-", (unsigned int) CopLINE(PL_curcop));
+	if (ret <= 0 || ret >= (int) len) return 0;
+	return ret;
+}
+
 static int uwsgi_perl_signal_handler(uint8_t sig, void *handler) {
 
 	int ret = 0;
@@ -1037,4 +1053,6 @@ struct uwsgi_plugin psgi_plugin = {
 
 	.spooler = uwsgi_perl_spooler,
 	.on_load = uwsgi_perl_register_features,
+
+	.profiler_frame = uwsgi_perl_profiler_frame,
 };
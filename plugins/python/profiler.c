@@ -1,6 +1,8 @@
 #include "uwsgi_python.h"
 
 extern struct uwsgi_server uwsgi;
+extern struct uwsgi_python up;
+extern struct uwsgi_plugin python_plugin;
 
 #ifdef HAS_NOT_PyFrame_GetLineNumber
 int PyFrame_GetLineNumber(PyFrameObject *frame) {
@@ -74,3 +76,39 @@ int uwsgi_python_tracer(PyObject *obj, PyFrameObject *frame, int what, PyObject
         return 0;
 }
 
+
+// the characters of a str object without allocating (ascii only on python3)
+static char *uwsgi_python_profiler_str(PyObject *o) {
+	if (!o) return "?";
+#ifdef PYTHREE
+	if (!PyUnicode_Check(o) || !PyUnicode_IS_COMPACT_ASCII(o)) return "?";
+	return (char *) PyUnicode_DATA(o);
+#else
+	if (!PyString_Check(o)) return "?";
+	return PyString_AS_STRING(o);
+#endif
+}
+
+/*
+	the current python frame of the thread for the sampling profiler (--sampling-profiler),
+	run in a signal handler: the frame of the thread state is only read
+	(without threads the thread state is the one of the interpreter of the app)
+*/
+int uwsgi_python_profiler_frame(struct wsgi_request *wsgi_req, char *buf, size_t len) {
+	PyThreadState *tstate = NULL;
+	if (uwsgi.has_threads) {
+		tstate = (PyThreadState *) pthread_getspecific(up.upt_gil_key);
+	}
+	else {
+		if (wsgi_req->app_id < 0 || wsgi_req->app_id >= uwsgi_apps_cnt) return 0;
+		struct uwsgi_app *wi = &uwsgi_apps[wsgi_req->app_id];
+		if (wi->modifier1 != python_plugin.modifier1) return 0;
+		tstate = (PyThreadState *) wi->interpreter;
+	}
+	if (!tstate || !tstate->frame) return 0;
+	PyFrameObject *frame = tstate->frame;
+	int ret = snprintf(buf, len, "%s (%s:%d)", uwsgi_python_profiler_str(frame->f_code->co_name),
+		uwsgi_python_profiler_str(frame->f_code->co_filename), PyFrame_GetLineNumber(frame));
+	if (ret <= 0 || ret >= (int) len) return 0;
+	return ret;
+}
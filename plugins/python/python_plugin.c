@@ -1326,6 +1326,47 @@ void uwsgi_python_master_fixup(int step) {
 	}
 }
 
+/*
+	called by the master before forking a worker (--freeze-heaps): the garbage is collected
+	and the survivors are moved to the permanent generation (python >= 3.7), so the
+	collector of the workers does not touch (and copy) the pages inherited from the master
+*/
+void uwsgi_python_freeze_heap() {
+
+	if (uwsgi.has_threads) {
+		UWSGI_GET_GIL;
+	}
+
+	PyObject *gc = PyImport_ImportModule("gc");
+	if (!gc) {
+		PyErr_Print();
+		goto end;
+	}
+
+	PyObject *ret = PyObject_CallMethod(gc, "collect", NULL);
+	if (!ret) {
+		PyErr_Print();
+		goto clear;
+	}
+	Py_DECREF(ret);
+
+	if (PyObject_HasAttrString(gc, "freeze")) {
+		ret = PyObject_CallMethod(gc, "freeze", NULL);
+		if (!ret) {
+			PyErr_Print();
+			goto clear;
+		}
+		Py_DECREF(ret);
+	}
+
+clear:
+	Py_DECREF(gc);
+end:
+	if (uwsgi.has_threads) {
+		UWSGI_RELEASE_GIL;
+	}
+}
+
 void uwsgi_python_enable_threads() {
 
 	PyEval_InitThreads();
@@ -2134,4 +2175,8 @@ struct uwsgi_plugin python_plugin = {
 
 	.worker = uwsgi_python_worker,
 
+	.freeze_heap = uwsgi_python_freeze_heap,
+
+	.profiler_frame = uwsgi_python_profiler_frame,
+
 };
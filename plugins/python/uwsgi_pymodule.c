@@ -1177,6 +1177,69 @@ PyObject *py_uwsgi_websocket_send_binary(PyObject * self, PyObject * args, PyObj
 }
 
 
+PyObject *py_uwsgi_websocket_subscribe(PyObject * self, PyObject * args) {
+	char *channel = NULL;
+	Py_ssize_t channel_len = 0;
+
+	if (!PyArg_ParseTuple(args, "s#:websocket_subscribe", &channel, &channel_len)) {
+		return NULL;
+	}
+
+	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_websocket_subscribe(wsgi_req, channel, channel_len);
+	UWSGI_GET_GIL
+	if (ret) {
+		return PyErr_Format(PyExc_IOError, "unable to subscribe to websocket channel");
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyObject *py_uwsgi_websocket_unsubscribe(PyObject * self, PyObject * args) {
+	char *channel = NULL;
+	Py_ssize_t channel_len = 0;
+
+	if (!PyArg_ParseTuple(args, "s#:websocket_unsubscribe", &channel, &channel_len)) {
+		return NULL;
+	}
+
+	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_websocket_unsubscribe(wsgi_req, channel, channel_len);
+	UWSGI_GET_GIL
+	if (ret) {
+		return PyErr_Format(PyExc_IOError, "unable to unsubscribe from websocket channel");
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+// can be called by mules, spoolers and rpc functions too
+PyObject *py_uwsgi_websocket_publish(PyObject * self, PyObject * args) {
+	char *channel = NULL;
+	Py_ssize_t channel_len = 0;
+	char *message = NULL;
+	Py_ssize_t message_len = 0;
+	int binary = 0;
+
+	if (!PyArg_ParseTuple(args, "s#s#|i:websocket_publish", &channel, &channel_len, &message, &message_len, &binary)) {
+		return NULL;
+	}
+
+	UWSGI_RELEASE_GIL
+	int ret = uwsgi_websocket_publish(channel, channel_len, message, message_len, binary ? 0x82 : 0x81);
+	UWSGI_GET_GIL
+	if (ret) {
+		return PyErr_Format(PyExc_IOError, "unable to publish websocket message");
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
 PyObject *py_uwsgi_chunked_read(PyObject * self, PyObject * args) {
 	int timeout = 0; 
 	if (!PyArg_ParseTuple(args, "|i:chunked_read", &timeout)) {
@@ -2588,6 +2651,17 @@ PyObject *py_uwsgi_request_id(PyObject * self, PyObject * args) {
 	return PyLong_FromUnsignedLongLong(uwsgi.workers[uwsgi.mywid].cores[wsgi_req->async_id].requests);
 }
 
+// remaining time budget of the current request in seconds (None if it has no deadline)
+PyObject *py_uwsgi_request_deadline(PyObject * self, PyObject * args) {
+	struct wsgi_request *wsgi_req = py_current_wsgi_req();
+	int64_t remaining = uwsgi_deadline_remaining(wsgi_req);
+	if (remaining < 0) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	return PyFloat_FromDouble(remaining / 1000000.0);
+}
+
 PyObject *py_uwsgi_worker_id(PyObject * self, PyObject * args) {
 	return PyInt_FromLong(uwsgi.mywid);
 }
@@ -2798,6 +2872,7 @@ static PyMethodDef uwsgi_advanced_methods[] = {
 	{"masterpid", py_uwsgi_masterpid, METH_VARARGS, ""},
 	{"total_requests", py_uwsgi_total_requests, METH_VARARGS, ""},
 	{"request_id", py_uwsgi_request_id, METH_VARARGS, ""},
+	{"request_deadline", py_uwsgi_request_deadline, METH_VARARGS, ""},
 	{"worker_id", py_uwsgi_worker_id, METH_VARARGS, ""},
 	{"mule_id", py_uwsgi_mule_id, METH_VARARGS, ""},
 	{"mule_msg_recv_size", py_uwsgi_mule_msg_recv_size, METH_VARARGS, ""},
@@ -2884,6 +2959,9 @@ static PyMethodDef uwsgi_advanced_methods[] = {
 	{"websocket_send", (PyCFunction)(void *)py_uwsgi_websocket_send, METH_VARARGS|METH_KEYWORDS, ""},
 	{"websocket_send_binary", (PyCFunction)(void *)py_uwsgi_websocket_send_binary, METH_VARARGS|METH_KEYWORDS, ""},
 	{"websocket_handshake", py_uwsgi_websocket_handshake, METH_VARARGS, ""},
+	{"websocket_subscribe", py_uwsgi_websocket_subscribe, METH_VARARGS, ""},
+	{"websocket_unsubscribe", py_uwsgi_websocket_unsubscribe, METH_VARARGS, ""},
+	{"websocket_publish", py_uwsgi_websocket_publish, METH_VARARGS, ""},
 
 	{"chunked_read", py_uwsgi_chunked_read, METH_VARARGS, ""},
 	{"chunked_read_nb", py_uwsgi_chunked_read_nb, METH_VARARGS, ""},
@@ -3561,13 +3639,11 @@ PyObject *py_uwsgi_metric_inc(PyObject * self, PyObject * args) {
         int64_t value = 1;
         if (!PyArg_ParseTuple(args, "s|l:metric_inc", &key, &value)) return NULL;
 
-        UWSGI_RELEASE_GIL
+        // lock-free, the GIL is not released
         if (uwsgi_metric_inc(key, NULL, value)) {
-                UWSGI_GET_GIL
                 Py_INCREF(Py_None);
                 return Py_None;
         }
-        UWSGI_GET_GIL
         Py_INCREF(Py_True);
         return Py_True;
 
@@ -3578,13 +3654,11 @@ PyObject *py_uwsgi_metric_dec(PyObject * self, PyObject * args) {
         int64_t value = 1;
         if (!PyArg_ParseTuple(args, "s|l:metric_dec", &key, &value)) return NULL;
 
-        UWSGI_RELEASE_GIL
+        // lock-free, the GIL is not released
         if (uwsgi_metric_dec(key, NULL, value)) {
-                UWSGI_GET_GIL
                 Py_INCREF(Py_None);
                 return Py_None;
         }
-        UWSGI_GET_GIL
         Py_INCREF(Py_True);
         return Py_True;
 
@@ -3685,6 +3759,21 @@ PyObject *py_uwsgi_metric_set_min(PyObject * self, PyObject * args) {
 
 }
 
+PyObject *py_uwsgi_metric_observe(PyObject * self, PyObject * args) {
+        char *key;
+        int64_t value = 0;
+        if (!PyArg_ParseTuple(args, "sl:metric_observe", &key, &value)) return NULL;
+
+        // lock-free, the GIL is not released
+        if (uwsgi_metric_observe(key, NULL, value)) {
+                Py_INCREF(Py_None);
+                return Py_None;
+        }
+        Py_INCREF(Py_True);
+        return Py_True;
+
+}
+
 
 static PyMethodDef uwsgi_metrics_methods[] = {
 	{"metric_inc", py_uwsgi_metric_inc, METH_VARARGS, ""},
@@ -3695,6 +3784,7 @@ static PyMethodDef uwsgi_metrics_methods[] = {
 	{"metric_set", py_uwsgi_metric_set, METH_VARARGS, ""},
 	{"metric_set_max", py_uwsgi_metric_set_max, METH_VARARGS, ""},
 	{"metric_set_min", py_uwsgi_metric_set_min, METH_VARARGS, ""},
+	{"metric_observe", py_uwsgi_metric_observe, METH_VARARGS, ""},
 	{NULL, NULL},
 };
 
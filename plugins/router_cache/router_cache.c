@@ -172,7 +172,32 @@ static int uwsgi_routing_func_cache(struct wsgi_request *wsgi_req, struct uwsgi_
 
 	uint64_t valsize = 0;
 	uint64_t expires = 0;
-	char *value = uwsgi_cache_magic_get(ub->buf, ub->pos, &valsize, &expires, urcc->name);
+	char *value = NULL;
+	// items of local caches are streamed directly by the offload threads (no copy)
+	struct uwsgi_cache *uc = NULL;
+	uint64_t index = 0;
+	// a miss of the local cache is not looked up again
+	int ref_lookup = 0;
+	int can_offload = wsgi_req->socket->can_offload && !ur->custom && !urcc->no_offload;
+	if (can_offload) {
+		uc = urcc->name ? uwsgi_cache_by_name(urcc->name) : uwsgi.caches;
+		if (uc && uc->refs) {
+			if (uc->purge_lru)
+				uwsgi_wlock(uc->lock);
+			else
+				uwsgi_rlock(uc->lock);
+			value = uwsgi_cache_get_ref(uc, ub->buf, ub->pos, &valsize, &expires, &index);
+			uwsgi_rwunlock(uc->lock);
+			ref_lookup = 1;
+			if (!value) uc = NULL;
+		}
+		else {
+			uc = NULL;
+		}
+	}
+	if (!ref_lookup) {
+		value = uwsgi_cache_magic_get(ub->buf, ub->pos, &valsize, &expires, urcc->name);
+	}
 	if (urcc->mime && value) {
 		mime_type = uwsgi_get_mime_type(ub->buf, ub->pos, &mime_type_len);	
 	}
@@ -194,7 +219,17 @@ static int uwsgi_routing_func_cache(struct wsgi_request *wsgi_req, struct uwsgi_
 		if (!urcc->no_cl) {
 			if (uwsgi_response_add_content_length(wsgi_req, valsize)) goto error;
 		}
-		if (wsgi_req->socket->can_offload && !ur->custom && !urcc->no_offload) {
+		// the offload threads transfer only the body
+		if (uc || can_offload) {
+			if (uwsgi_response_write_headers_do(wsgi_req)) goto error;
+		}
+		if (uc) {
+                	if (!uwsgi_offload_request_cache_do(wsgi_req, uc, index, value, valsize)) {
+                        	wsgi_req->via = UWSGI_VIA_OFFLOAD;
+                        	return UWSGI_ROUTE_BREAK;
+                	}
+		}
+		else if (can_offload) {
                 	if (!uwsgi_offload_request_memory_do(wsgi_req, value, valsize)) {
                         	wsgi_req->via = UWSGI_VIA_OFFLOAD;
                         	return UWSGI_ROUTE_BREAK;
@@ -202,7 +237,10 @@ static int uwsgi_routing_func_cache(struct wsgi_request *wsgi_req, struct uwsgi_
 		}
 
 		uwsgi_response_write_body_do(wsgi_req, value, valsize);
-		free(value);
+		if (uc)
+			uwsgi_cache_unref(uc, index);
+		else
+			free(value);
 		if (ur->custom)
 			return UWSGI_ROUTE_NEXT;
 		return UWSGI_ROUTE_BREAK;
@@ -210,7 +248,10 @@ static int uwsgi_routing_func_cache(struct wsgi_request *wsgi_req, struct uwsgi_
 	
 	return UWSGI_ROUTE_NEXT;
 error:
-	free(value);
+	if (uc)
+		uwsgi_cache_unref(uc, index);
+	else
+		free(value);
 	return UWSGI_ROUTE_BREAK;
 }
 
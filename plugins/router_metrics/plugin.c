@@ -13,9 +13,13 @@ struct uwsgi_router_metric_conf {
 	size_t value_len;
 
 	int (*func)(char *, char *, int64_t);
+
+	// lock-free operations on a metric without vars in its name are resolved once
+	int (*handle_func)(struct uwsgi_metric *, int64_t);
+	struct uwsgi_metric *handle;
 };
 
-// metricinc/metricdec/metricmul/metricdiv/metricset
+// metricinc/metricdec/metricmul/metricdiv/metricset/metricobserve
 static int uwsgi_routing_func_metricmath(struct wsgi_request *wsgi_req, struct uwsgi_route *ur){
 
         struct uwsgi_router_metric_conf *urmc = (struct uwsgi_router_metric_conf *) ur->data2;
@@ -23,6 +27,21 @@ static int uwsgi_routing_func_metricmath(struct wsgi_request *wsgi_req, struct u
         char **subject = (char **) (((char *)(wsgi_req))+ur->subject);
         uint16_t *subject_len = (uint16_t *)  (((char *)(wsgi_req))+ur->subject_len);
 
+	if (urmc->handle_func && !memchr(urmc->name, '$', urmc->name_len)) {
+		if (!urmc->handle) {
+			char *name = uwsgi_concat2n(urmc->name, urmc->name_len, "", 0);
+			urmc->handle = uwsgi_metric_handle(name, NULL);
+			free(name);
+			if (!urmc->handle) return UWSGI_ROUTE_BREAK;
+		}
+		struct uwsgi_buffer *ub_val = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, urmc->value, urmc->value_len);
+		if (!ub_val) return UWSGI_ROUTE_BREAK;
+		int64_t num = strtol(ub_val->buf, NULL, 10);
+		uwsgi_buffer_destroy(ub_val);
+		if (urmc->handle_func(urmc->handle, num)) return UWSGI_ROUTE_BREAK;
+		return UWSGI_ROUTE_NEXT;
+	}
+
         struct uwsgi_buffer *ub = uwsgi_routing_translate(wsgi_req, ur, *subject, *subject_len, urmc->name, urmc->name_len);
         if (!ub) return UWSGI_ROUTE_BREAK;
 
@@ -72,6 +91,7 @@ static int uwsgi_router_metricinc(struct uwsgi_route *ur, char *args) {
 	struct uwsgi_router_metric_conf *urmc = uwsgi_router_metricmath(ur, args);
 	if (!urmc) return -1;
 	urmc->func = uwsgi_metric_inc;
+	urmc->handle_func = uwsgi_metric_handle_inc;
 	return 0;
 }
 
@@ -79,6 +99,7 @@ static int uwsgi_router_metricdec(struct uwsgi_route *ur, char *args) {
         struct uwsgi_router_metric_conf *urmc = uwsgi_router_metricmath(ur, args);
         if (!urmc) return -1;
 	urmc->func = uwsgi_metric_dec;
+	urmc->handle_func = uwsgi_metric_handle_dec;
         return 0;
 }
 
@@ -104,6 +125,14 @@ static int uwsgi_router_metricset(struct uwsgi_route *ur, char *args) {
         return 0;
 }
 
+static int uwsgi_router_metricobserve(struct uwsgi_route *ur, char *args) {
+        struct uwsgi_router_metric_conf *urmc = uwsgi_router_metricmath(ur, args);
+        if (!urmc) return -1;
+	urmc->func = uwsgi_metric_observe;
+	urmc->handle_func = uwsgi_metric_handle_observe;
+        return 0;
+}
+
 static char *uwsgi_route_var_metric(struct wsgi_request *wsgi_req, char *key, uint16_t keylen, uint16_t *vallen) {
         int64_t metric = uwsgi_metric_getn(key, keylen, NULL, 0);
         char *ret = uwsgi_64bit2str(metric);
@@ -117,6 +146,7 @@ static void router_metrics_register() {
 	uwsgi_register_router("metricmul", uwsgi_router_metricmul);
 	uwsgi_register_router("metricdiv", uwsgi_router_metricdiv);
 	uwsgi_register_router("metricset", uwsgi_router_metricset);
+	uwsgi_register_router("metricobserve", uwsgi_router_metricobserve);
 
         struct uwsgi_route_var *urv = uwsgi_register_route_var("metric", uwsgi_route_var_metric);
         urv->need_free = 1;
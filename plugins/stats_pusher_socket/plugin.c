@@ -87,9 +87,7 @@ static void stats_pusher_socket(struct uwsgi_stats_pusher_instance *uspi, time_t
 		socket_send_metric(ub, uspi, um);
 		uwsgi_rwunlock(uwsgi.metrics_lock);
 		if (um->reset_after_push){
-			uwsgi_wlock(uwsgi.metrics_lock);
-			*um->value = um->initial_value;
-			uwsgi_rwunlock(uwsgi.metrics_lock);
+			uwsgi_metric_store(um, um->initial_value);
 		}
 		um = um->next;
 	}
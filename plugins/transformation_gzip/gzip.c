@@ -2,77 +2,290 @@
 
 #if defined(UWSGI_ROUTING) && defined(UWSGI_ZLIB)
 
+extern struct uwsgi_server uwsgi;
+
 /*
 
 	gzip transformations add content-encoding to your headers and changes the final size !!!
 
 	remember to fix the content_length (or use chunked encoding) !!!
 
+	the body is deflated (in streaming) directly into a buffer owned by the core, the zlib stream
+	is reused between requests (deflateReset() instead of a new allocation for each response).
+
+	--route-run gzip:level=6,min_level=1,flush=16384,cpu=2000
+
+	level		compression level (default 6)
+	flush		do not flush the compressor until the specified amount of body has been passed
+			(default 0, flush on every chunk)
+	cpu		when the cpu time (usecs) spent compressing a response crosses the value,
+			lower the level (down to min_level) for the next responses of the core,
+			it is raised again when the cost goes under the half of it
+	min_level	(default 1)
+
+	already compressed content types (images, audio, video, archives...) and responses
+	with a Content-Encoding are not compressed
+
 */
 
+struct uwsgi_transformation_gzip_conf {
+	char *level_str;
+	char *min_level_str;
+	char *flush_str;
+	char *cpu_str;
+	int level;
+	int min_level;
+	size_t flush;
+	uint64_t cpu;
+};
+
 struct uwsgi_transformation_gzip {
 	z_stream z;
-	uint32_t crc32;
-	size_t len;
-	uint8_t header;
+	uint8_t z_ready;
+	int z_level;
+	struct uwsgi_buffer *ub;
+	struct uwsgi_transformation_gzip_conf *conf;
+	uint8_t started;
+	uint8_t skip;
+	size_t pending;
+	// cpu usecs spent on the current response and its moving average
+	uint64_t cpu;
+	uint64_t cpu_avg;
+	int penalty;
 };
 
-extern char gzheader[];
+// one for each core
+static struct uwsgi_transformation_gzip *gzip_cores;
 
-static int transform_gzip(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
-	struct uwsgi_transformation_gzip *utgz = (struct uwsgi_transformation_gzip *) ut->data;
-	struct uwsgi_buffer *ub = ut->chunk;
+#define UWSGI_GZIP_BUFFER 16384
+// buffers bigger than this are not reused
+#define UWSGI_GZIP_MAX_BUFFER (1024*1024)
+
+static char *gzip_skip_types[] = {
+	"image/",
+	"audio/",
+	"video/",
+	"font/woff",
+	"application/zip",
+	"application/gzip",
+	"application/x-gzip",
+	"application/x-bzip2",
+	"application/x-xz",
+	"application/x-7z-compressed",
+	"application/x-rar-compressed",
+	"application/zstd",
+	NULL,
+};
+
+static uint64_t gzip_cpu_micros() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+	if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+		return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+	}
+#endif
+	return uwsgi_micros();
+}
 
-	if (ut->is_final) {
-		if (utgz->len > 0 && uwsgi_gzip_fix(&utgz->z, utgz->crc32, ub, utgz->len)) {
-			free(utgz);
-			return -1;
+static char *gzip_response_header(struct wsgi_request *wsgi_req, char *key, size_t keylen, size_t *vlen) {
+	if (!wsgi_req->headers) return NULL;
+	char *ptr = wsgi_req->headers->buf;
+	char *end = ptr + wsgi_req->headers->pos;
+	while(ptr < end) {
+		char *eol = memchr(ptr, '\n', end - ptr);
+		if (!eol) eol = end;
+		size_t len = eol - ptr;
+		if (len > 0 && ptr[len-1] == '\r') len--;
+		if (len > keylen && ptr[keylen] == ':' && !strncasecmp(ptr, key, keylen)) {
+			char *value = ptr + keylen + 1;
+			len -= keylen + 1;
+			while(len > 0 && *value == ' ') {
+				value++;
+				len--;
+			}
+			*vlen = len;
+			return value;
 		}
-		free(utgz);
+		ptr = eol + 1;
+	}
+	return NULL;
+}
+
+static int gzip_must_skip(struct wsgi_request *wsgi_req) {
+	// too late for Content-Encoding
+	if (wsgi_req->headers_sent) return 1;
+	size_t vlen = 0;
+	if (gzip_response_header(wsgi_req, "Content-Encoding", 16, &vlen)) return 1;
+	char *content_type = gzip_response_header(wsgi_req, "Content-Type", 12, &vlen);
+	if (!content_type) return 0;
+	if (!uwsgi_starts_with(content_type, vlen, "image/svg", 9)) return 0;
+	char **type = gzip_skip_types;
+	while(*type) {
+		if (!uwsgi_starts_with(content_type, vlen, *type, strlen(*type))) return 1;
+		type++;
+	}
+	return 0;
+}
+
+static int gzip_start(struct uwsgi_transformation_gzip *utgz) {
+	int level = utgz->conf->level - utgz->penalty;
+	if (level < utgz->conf->min_level) level = utgz->conf->min_level;
+
+	if (!utgz->ub || utgz->ub->len > UWSGI_GZIP_MAX_BUFFER) {
+		if (utgz->ub) uwsgi_buffer_destroy(utgz->ub);
+		utgz->ub = uwsgi_buffer_new(UWSGI_GZIP_BUFFER);
+	}
+
+	if (!utgz->z_ready) {
+		memset(&utgz->z, 0, sizeof(z_stream));
+		// 16 + window bits generates the gzip header and trailer
+		if (deflateInit2(&utgz->z, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+		utgz->z_ready = 1;
+		utgz->z_level = level;
 		return 0;
 	}
 
-	if (ub->pos == 0) {
+	if (deflateReset(&utgz->z) != Z_OK) return -1;
+	if (utgz->z_level != level) {
+		if (deflateParams(&utgz->z, level, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+		utgz->z_level = level;
+	}
+	return 0;
+}
+
+static int gzip_deflate(struct uwsgi_transformation_gzip *utgz, char *buf, size_t len, int flush) {
+	struct uwsgi_buffer *ub = utgz->ub;
+	utgz->z.next_in = (Bytef *) buf;
+	utgz->z.avail_in = len;
+	for(;;) {
+		if (ub->len - ub->pos < 4096) {
+			if (uwsgi_buffer_ensure(ub, ub->len)) return -1;
+		}
+		utgz->z.next_out = (Bytef *) ub->buf + ub->pos;
+		utgz->z.avail_out = ub->len - ub->pos;
+		size_t avail = utgz->z.avail_out;
+		int ret = deflate(&utgz->z, flush);
+		if (ret == Z_STREAM_ERROR) return -1;
+		ub->pos += avail - utgz->z.avail_out;
+		if (flush == Z_FINISH) {
+			if (ret == Z_STREAM_END) break;
+		}
+		else if (utgz->z.avail_in == 0 && utgz->z.avail_out > 0) {
+			break;
+		}
+	}
+	return 0;
+}
+
+static void gzip_adapt(struct uwsgi_transformation_gzip *utgz) {
+	struct uwsgi_transformation_gzip_conf *conf = utgz->conf;
+	utgz->cpu_avg = utgz->cpu_avg ? ((utgz->cpu_avg * 7) + utgz->cpu) / 8 : utgz->cpu;
+	if (!conf->cpu) return;
+	if (utgz->cpu_avg > conf->cpu) {
+		if (conf->level - utgz->penalty > conf->min_level) utgz->penalty++;
+	}
+	else if (utgz->cpu_avg < conf->cpu / 2 && utgz->penalty > 0) {
+		utgz->penalty--;
+	}
+}
+
+static int transform_gzip(struct wsgi_request *wsgi_req, struct uwsgi_transformation *ut) {
+	struct uwsgi_transformation_gzip *utgz = (struct uwsgi_transformation_gzip *) ut->data;
+
+	ut->output = NULL;
+	ut->output_len = 0;
+
+	if (!utgz->started) {
 		// Don't try to compress empty responses.
+		if (ut->input_len == 0) return 0;
+		utgz->started = 1;
+		utgz->skip = gzip_must_skip(wsgi_req);
+		if (!utgz->skip) {
+			if (gzip_start(utgz)) return -1;
+			// do not check for errors !!!
+			uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "gzip", 4);
+		}
+	}
+
+	if (utgz->skip) {
+		ut->output = ut->input;
+		ut->output_len = ut->input_len;
 		return 0;
 	}
 
-	size_t dlen = 0;
-	char *gzipped = uwsgi_gzip_chunk(&utgz->z, &utgz->crc32, ub->buf, ub->pos, &dlen);
-	if (!gzipped) return -1;
-	utgz->len += ub->pos;
-	uwsgi_buffer_map(ub, gzipped, dlen);
-	if (!utgz->header) {
-		// do not check for errors !!!
-		uwsgi_response_add_header(wsgi_req, "Content-Encoding", 16, "gzip", 4);
-		utgz->header = 1;
-		if (uwsgi_buffer_insert(ub, 0, gzheader, 10)) {
-			return -1;
+	int flush = Z_SYNC_FLUSH;
+	if (ut->last_round) {
+		flush = Z_FINISH;
+	}
+	else if (utgz->conf->flush > 0) {
+		utgz->pending += ut->input_len;
+		if (utgz->pending < utgz->conf->flush) {
+			flush = Z_NO_FLUSH;
+		}
+		else {
+			utgz->pending = 0;
 		}
 	}
 
+	uint64_t now = gzip_cpu_micros();
+	utgz->ub->pos = 0;
+	int ret = gzip_deflate(utgz, ut->input, ut->input_len, flush);
+	utgz->cpu += gzip_cpu_micros() - now;
+	if (ret) return -1;
+
+	if (ut->last_round) gzip_adapt(utgz);
+
+	ut->output = utgz->ub->buf;
+	ut->output_len = utgz->ub->pos;
 	return 0;
 }
 
 static int uwsgi_routing_func_gzip(struct wsgi_request *wsgi_req, struct uwsgi_route *ur) {
-	struct uwsgi_transformation_gzip *utgz = uwsgi_calloc(sizeof(struct uwsgi_transformation_gzip));
-	if (uwsgi_gzip_prepare(&utgz->z, NULL, 0, &utgz->crc32)) {
-		free(utgz);
-		return UWSGI_ROUTE_BREAK;
+	if (!gzip_cores) return UWSGI_ROUTE_NEXT;
+	struct uwsgi_transformation *ut = wsgi_req->transformations;
+	// the stream state is per-core, compress only once
+	while(ut) {
+		if (ut->func == transform_gzip) return UWSGI_ROUTE_NEXT;
+		ut = ut->next;
 	}
-	struct uwsgi_transformation *ut = uwsgi_add_transformation(wsgi_req, transform_gzip, utgz);
-	ut->can_stream = 1;
-	// this is the transformation clearing the memory
+	struct uwsgi_transformation_gzip *utgz = &gzip_cores[wsgi_req->async_id];
+	utgz->conf = (struct uwsgi_transformation_gzip_conf *) ur->data2;
+	utgz->started = 0;
+	utgz->skip = 0;
+	utgz->pending = 0;
+	utgz->cpu = 0;
 	ut = uwsgi_add_transformation(wsgi_req, transform_gzip, utgz);
-	ut->is_final = 1;
+	ut->can_stream = 1;
+	ut->zero_copy = 1;
 	return UWSGI_ROUTE_NEXT;
 }
 
 static int uwsgi_router_gzip(struct uwsgi_route *ur, char *args) {
 	ur->func = uwsgi_routing_func_gzip;
+	struct uwsgi_transformation_gzip_conf *conf = uwsgi_calloc(sizeof(struct uwsgi_transformation_gzip_conf));
+	if (uwsgi_kvlist_parse(args, strlen(args), ',', '=',
+			"level", &conf->level_str,
+			"min_level", &conf->min_level_str,
+			"flush", &conf->flush_str,
+			"cpu", &conf->cpu_str, NULL)) {
+		uwsgi_log("invalid gzip route syntax: %s\n", args);
+		free(conf);
+		return -1;
+	}
+	conf->level = conf->level_str ? atoi(conf->level_str) : 6;
+	conf->min_level = conf->min_level_str ? atoi(conf->min_level_str) : 1;
+	if (conf->level < 1 || conf->level > 9) conf->level = 6;
+	if (conf->min_level < 1 || conf->min_level > conf->level) conf->min_level = 1;
+	if (conf->flush_str) conf->flush = strtoul(conf->flush_str, NULL, 10);
+	if (conf->cpu_str) conf->cpu = strtoul(conf->cpu_str, NULL, 10);
+	ur->data2 = conf;
 	return 0;
 }
 
+static void router_gzip_post_fork(void) {
+	gzip_cores = uwsgi_calloc(sizeof(struct uwsgi_transformation_gzip) * uwsgi.cores);
+}
+
 static void router_gzip_register(void) {
 	uwsgi_register_router("gzip", uwsgi_router_gzip);
 }
@@ -80,6 +293,7 @@ static void router_gzip_register(void) {
 struct uwsgi_plugin transformation_gzip_plugin = {
 	.name = "transformation_gzip",
 	.on_load = router_gzip_register,
+	.post_fork = router_gzip_post_fork,
 };
 #else
 struct uwsgi_plugin transformation_gzip_plugin = {
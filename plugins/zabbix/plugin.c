@@ -96,9 +96,7 @@ static void stats_pusher_zabbix(struct uwsgi_stats_pusher_instance *uspi, time_t
 		if (uwsgi_buffer_append(zn->ub, "\"}", 2)) { error = 1; goto end;} 	
 		if (um->reset_after_push){
 			uwsgi_rwunlock(uwsgi.metrics_lock);
-			uwsgi_wlock(uwsgi.metrics_lock);
-			*um->value = um->initial_value;
-			uwsgi_rwunlock(uwsgi.metrics_lock);
+			uwsgi_metric_store(um, um->initial_value);
 			uwsgi_rlock(uwsgi.metrics_lock);
 		}
 		um = um->next;
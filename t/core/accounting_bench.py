@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+"""
+measure the worker cpu cost of --request-accounting
+
+it spawns a single worker instance (with the notfound plugin) with and without
+--request-accounting (and with the accounting values in the request log), sends
+the same amount of requests and reads the worker cpu time from /proc.
+The cpu time of the run without accounting is subtracted to get the cost
+of the sampling (two clock_gettime() and two getrusage() calls per request).
+Runs are interleaved and repeated, the best one of every mode is reported.
+
+usage: python t/core/accounting_bench.py [requests] [uwsgi binary] [plugins dir] [rounds]
+"""
+import os
+import socket
+import subprocess
+import sys
+import time
+
+REQUESTS = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+UWSGI = sys.argv[2] if len(sys.argv) > 2 else './uwsgi'
+PLUGINS_DIR = sys.argv[3] if len(sys.argv) > 3 else '.'
+ROUNDS = int(sys.argv[4]) if len(sys.argv) > 4 else 3
+ADDR = ('127.0.0.1', 9999)
+
+MODES = (
+    ('disabled', ['--disable-logging']),
+    ('accounting', ['--disable-logging', '--request-accounting']),
+    ('logged', ['--notfound-log', '--logto', os.devnull, '--request-accounting',
+                '--log-format', '%(uri) %(micros) %(cpu) %(offcpu) %(vcsw) %(ivcsw) %(minflt)']),
+    ('log-only', ['--notfound-log', '--logto', os.devnull,
+                  '--log-format', '%(uri) %(micros) %(cpu) %(offcpu) %(vcsw) %(ivcsw) %(minflt)']),
+)
+
+
+def cpu_time(pid):
+    # nanoseconds resolution
+    with open('/proc/%d/schedstat' % pid) as f:
+        return int(f.read().split()[0]) / 1000000000.0
+
+
+def worker_pid(master):
+    out = subprocess.check_output(['pgrep', '-P', str(master)])
+    return int(out.split()[0])
+
+
+def hammer(n):
+    req = b'GET /foo/bar?a=1 HTTP/1.0\r\nHost: localhost\r\nUser-Agent: bench\r\n\r\n'
+    for i in range(n):
+        s = socket.create_connection(ADDR)
+        s.sendall(req)
+        while s.recv(4096):
+            pass
+        s.close()
+
+
+def run(name, args):
+    cmd = [UWSGI, '--master', '--workers', '1', '--http-socket', '%s:%d' % ADDR,
+           '--plugin-dir', PLUGINS_DIR, '--plugin', 'notfound'] + args
+    env = dict(os.environ, UWSGI_NEED_APP='false')
+    p = subprocess.Popen(cmd, stdout=open(os.devnull, 'w'), stderr=subprocess.STDOUT, env=env)
+    try:
+        time.sleep(1)
+        pid = worker_pid(p.pid)
+        # warm up
+        hammer(1000)
+        before = cpu_time(pid)
+        t0 = time.time()
+        hammer(REQUESTS)
+        elapsed = time.time() - t0
+        spent = cpu_time(pid) - before
+    finally:
+        p.terminate()
+        p.wait()
+    return spent, elapsed
+
+
+def main():
+    results = {}
+    for i in range(ROUNDS):
+        for name, args in MODES:
+            r = run(name, args)
+            if name not in results or r[0] < results[name][0]:
+                results[name] = r
+    print('%-12s %12s %14s %14s' % ('mode', 'worker cpu', 'usec/request', 'overhead'))
+    for name, args in MODES:
+        spent, elapsed = results[name]
+        # the logged run is compared with the same log line without the accounting
+        base = results['log-only' if name == 'logged' else 'disabled'][0]
+        if name in ('disabled', 'log-only'):
+            print('%-12s %11.3fs %14.2f %14s' % (name, spent, spent / REQUESTS * 1000000, '-'))
+            continue
+        print('%-12s %11.3fs %14.2f %13.2f%%' % (name, spent, spent / REQUESTS * 1000000, (spent - base) / base * 100))
+
+
+if __name__ == '__main__':
+    main()
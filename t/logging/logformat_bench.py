@@ -0,0 +1,107 @@
+#!/usr/bin/env python
+"""
+measure the worker cpu cost of request logging
+
+it spawns a single worker instance (with the notfound plugin logging to /dev/null)
+for every log format, sends the same amount of requests and reads
+the worker cpu time from /proc. The cpu time of a run with logging disabled is
+subtracted to get the cost (and the throughput) of the log line generation.
+Runs are interleaved and repeated, the best one of every format is reported.
+
+usage: python t/logging/logformat_bench.py [requests] [uwsgi binary] [plugins dir] [rounds]
+"""
+import os
+import socket
+import subprocess
+import sys
+import time
+
+REQUESTS = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+UWSGI = sys.argv[2] if len(sys.argv) > 2 else './uwsgi'
+PLUGINS_DIR = sys.argv[3] if len(sys.argv) > 3 else '.'
+ROUNDS = int(sys.argv[4]) if len(sys.argv) > 4 else 3
+ADDR = ('127.0.0.1', 9999)
+
+JSON20 = '{' + ','.join([
+    '"addr":"%(addr)"', '"user":"%(user)"', '"method":"%(method)"', '"uri":"%(uri)"',
+    '"proto":"%(proto)"', '"host":"%(host)"', '"uagent":"%(uagent)"', '"referer":"%(referer)"',
+    '"status":%(status)', '"size":%(size)', '"rsize":%(rsize)', '"hsize":%(hsize)',
+    '"cl":%(cl)', '"msecs":%(msecs)', '"micros":%(micros)', '"ltime":"%(ltime)"',
+    '"pid":%(pid)', '"wid":%(wid)', '"core":%(core)', '"headers":%(headers)',
+]) + '}'
+
+FORMATS = (
+    ('disabled', ['--disable-logging']),
+    ('default', []),
+    ('json20', ['--log-format', JSON20]),
+    # records are sent to the log master (the worker pays for the transport)
+    ('binary', ['--log-req-encoder', 'binary']),
+)
+
+
+def cpu_time(pid):
+    # nanoseconds resolution
+    with open('/proc/%d/schedstat' % pid) as f:
+        return int(f.read().split()[0]) / 1000000000.0
+
+
+def worker_pid(master):
+    out = subprocess.check_output(['pgrep', '-P', str(master)])
+    return int(out.split()[0])
+
+
+def hammer(n):
+    req = b'GET /foo/bar?a=1 HTTP/1.0\r\nHost: localhost\r\nUser-Agent: bench\r\n\r\n'
+    for i in range(n):
+        s = socket.create_connection(ADDR)
+        s.sendall(req)
+        while s.recv(4096):
+            pass
+        s.close()
+
+
+def run(name, args):
+    cmd = [UWSGI, '--master', '--workers', '1', '--http-socket', '%s:%d' % ADDR,
+           '--plugin-dir', PLUGINS_DIR, '--plugin', 'notfound', '--notfound-log'] + args
+    env = dict(os.environ, UWSGI_NEED_APP='false')
+    p = subprocess.Popen(cmd, stdout=open(os.devnull, 'w'), stderr=subprocess.STDOUT, env=env)
+    try:
+        time.sleep(1)
+        pid = worker_pid(p.pid)
+        # warm up
+        hammer(1000)
+        before = cpu_time(pid)
+        t0 = time.time()
+        hammer(REQUESTS)
+        elapsed = time.time() - t0
+        spent = cpu_time(pid) - before
+    finally:
+        p.terminate()
+        p.wait()
+    return spent, elapsed
+
+
+def main():
+    results = {}
+    for i in range(ROUNDS):
+        for name, args in FORMATS:
+            r = run(name, args)
+            if name not in results or r[0] < results[name][0]:
+                results[name] = r
+    base = results['disabled'][0]
+    print('%-10s %12s %14s %14s' % ('format', 'worker cpu', 'usec/line', 'lines/sec'))
+    for name, args in FORMATS:
+        spent, elapsed = results[name]
+        if name == 'disabled':
+            print('%-10s %11.3fs %14s %14s' % (name, spent, '-', '-'))
+            continue
+        if spent <= base:
+            # lost in the noise, retry with more requests
+            print('%-10s %11.3fs %14s %14s' % (name, spent, '?', '?'))
+            continue
+        cost = (spent - base) / REQUESTS
+        print('%-10s %11.3fs %14.2f %14d' % (name, spent, cost * 1000000, 1 / cost))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,17 @@
+# the app of t/memory/pss_bench.py: a big heap of small objects created in the master
+# (like the modules/caches of a real framework) and a request handler triggering the collector
+
+import gc
+
+HEAP = [{'id': i, 'name': 'object%d' % i, 'tags': ['a', 'b', str(i)]} for i in range(300000)]
+
+
+def application(environ, start_response):
+    # garbage with reference cycles, the collector will scan the inherited objects too
+    for i in range(100):
+        a = {}
+        b = {'a': a}
+        a['b'] = b
+    gc.collect()
+    start_response('200 OK', [('Content-Type', 'text/plain')])
+    return [str(len(HEAP)).encode()]
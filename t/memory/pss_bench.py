@@ -0,0 +1,76 @@
+#!/usr/bin/env python
+"""
+copy-on-write friendliness of the workers
+
+it spawns 64 workers (preforking, apps loaded in the master) running
+t/memory/cow_app.py with and without --freeze-heaps, sends a batch of requests
+(every one triggers a full collection in the worker) and reports the total
+pss, uss and shared memory of the workers as refreshed by the master
+(--memory-sharing-report) in the stats server.
+
+usage: python t/memory/pss_bench.py [requests] [uwsgi binary]
+"""
+import json
+import os
+import socket
+import subprocess
+import sys
+import time
+
+REQUESTS = int(sys.argv[1]) if len(sys.argv) > 1 else 1000
+UWSGI = sys.argv[2] if len(sys.argv) > 2 else './uwsgi'
+WORKERS = 64
+ADDR = ('127.0.0.1', 9999)
+STATS = ('127.0.0.1', 9998)
+APP = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'cow_app.py')
+
+
+def get(path):
+    s = socket.create_connection(ADDR)
+    s.sendall(('GET %s HTTP/1.0\r\nHost: localhost\r\n\r\n' % path).encode())
+    while s.recv(4096):
+        pass
+    s.close()
+
+
+def stats():
+    s = socket.create_connection(STATS)
+    data = b''
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+    s.close()
+    return json.loads(data.decode())
+
+
+def run(args):
+    cmd = [UWSGI, '--master', '--workers', str(WORKERS), '--http-socket', '%s:%d' % ADDR,
+           '--stats', '%s:%d' % STATS, '--memory-sharing-report', '--disable-logging',
+           '--wsgi-file', APP] + args
+    p = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(5)
+        for i in range(REQUESTS):
+            get('/')
+        # give the master a couple of cycles to refresh the values
+        time.sleep(3)
+        workers = stats()['workers']
+        return [sum(w[key] for w in workers) for key in ('pss', 'uss', 'shared', 'swap')]
+    finally:
+        # SIGTERM stops the workers too (SIGKILL would leave them bound to the sockets)
+        p.terminate()
+        p.wait()
+
+
+def main():
+    mb = 1024.0 * 1024
+    print('%-10s %12s %12s %12s %12s' % ('mode', 'pss MB', 'uss MB', 'shared MB', 'swap MB'))
+    for name, args in (('default', []), ('frozen', ['--freeze-heaps'])):
+        pss, uss, shared, swap = run(args)
+        print('%-10s %12.1f %12.1f %12.1f %12.1f' % (name, pss / mb, uss / mb, shared / mb, swap / mb))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python
+"""
+cost of the internal routing table
+
+it generates a table of 300 rules (literal prefixes, extensions and host
+regexps, a goto/label pair), spawns a single worker with and without
+--no-routing-compile and reports the requests per second and the cpu time
+consumed by the worker for each request. The responses of the two instances
+are compared for a set of paths.
+
+usage: python t/routing/routing_bench.py [requests] [uwsgi binary]
+"""
+import os
+import socket
+import subprocess
+import sys
+import time
+
+REQUESTS = int(sys.argv[1]) if len(sys.argv) > 1 else 3000
+UWSGI = sys.argv[2] if len(sys.argv) > 2 else './uwsgi'
+ADDR = ('127.0.0.1', 9999)
+
+PATHS = ['/', '/static/dir7/x.css', '/api/v1/users/42', '/api/v1/users/x', '/old/file.bak17',
+         '/section99/foo', '/section100/foo', '/jump/here', '/nothing/matches/here/at/all']
+
+
+def routes():
+    args = []
+    for i in range(150):
+        args += ['--route', '^/static/dir%d/ return:2%02d' % (i, i % 100)]
+    for i in range(50):
+        args += ['--route', '\\.bak%d$ return:403' % i]
+    for i in range(50):
+        args += ['--route-host', '^host%d\\.example\\.com$ return:404' % i]
+    args += ['--route', '^/jump/ goto:jumped']
+    for i in range(48):
+        args += ['--route', '^/section%d/ return:3%02d' % (i * 3, i)]
+    args += ['--route', '^/api/v1/users/(\\d+)$ return:201']
+    args += ['--route-run', 'return:200']
+    args += ['--route-label', 'jumped']
+    args += ['--route-run', 'return:202']
+    return args
+
+
+def cpu_ticks(pid):
+    with open('/proc/%d/stat' % pid) as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+    # utime and stime
+    return int(fields[11]) + int(fields[12])
+
+
+def worker_pid(master):
+    out = subprocess.check_output(['pgrep', '-P', str(master)])
+    return int(out.split()[0])
+
+
+def get(path):
+    s = socket.create_connection(ADDR)
+    s.sendall(('GET %s HTTP/1.0\r\nHost: localhost\r\n\r\n' % path).encode())
+    data = b''
+    while True:
+        chunk = s.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+    s.close()
+    return data.split(b'\r\n', 1)[0]
+
+
+def run(args):
+    cmd = [UWSGI, '--master', '--workers', '1', '--http-socket', '%s:%d' % ADDR,
+           '--disable-logging'] + routes() + args
+    # only routing, no apps
+    env = dict(os.environ, UWSGI_NEED_APP='false')
+    p = subprocess.Popen(cmd, env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(1)
+        pid = worker_pid(p.pid)
+        responses = [get(path) for path in PATHS]
+        c0 = cpu_ticks(pid)
+        t0 = time.time()
+        for i in range(REQUESTS):
+            get(PATHS[i % len(PATHS)])
+        elapsed = time.time() - t0
+        c1 = cpu_ticks(pid)
+        hz = os.sysconf('SC_CLK_TCK')
+        return responses, REQUESTS / elapsed, (c1 - c0) * 1000000.0 / hz / REQUESTS
+    finally:
+        p.kill()
+        p.wait()
+
+
+def main():
+    print('%-12s %10s %14s' % ('table', 'req/s', 'cpu usecs/req'))
+    results = []
+    for name, args in (('linear', ['--no-routing-compile']), ('compiled', [])):
+        responses, rps, cpu = run(args)
+        results.append(responses)
+        print('%-12s %10.1f %14.1f' % (name, rps, cpu))
+    if results[0] != results[1]:
+        for path, a, b in zip(PATHS, results[0], results[1]):
+            if a != b:
+                print('MISMATCH %s: %r != %r' % (path, a, b))
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
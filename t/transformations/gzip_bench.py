@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+"""
+throughput and cpu cost of the gzip transformation
+
+it spawns a single worker instance for every scenario, the body (a text file,
+default 1MB of log-like lines) is served from a cache via routing and compressed
+by the gzip transformation. For every scenario the uncompressed MB/s, the
+compression ratio and the cpu time (user + system) consumed by the worker for
+each response are reported.
+
+scenarios:
+
+  level=1       fastest compression
+  level=6       default
+  level=9       best compression
+  flush=65536   default level, the compressor is not flushed for every chunk
+  adaptive      level=9 lowered when a response costs more than 2ms of cpu
+
+usage: python t/transformations/gzip_bench.py [requests] [uwsgi binary] [body file]
+"""
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+REQUESTS = int(sys.argv[1]) if len(sys.argv) > 1 else 200
+UWSGI = sys.argv[2] if len(sys.argv) > 2 else './uwsgi'
+BODY = sys.argv[3] if len(sys.argv) > 3 else None
+ADDR = ('127.0.0.1', 9999)
+
+SCENARIOS = (
+    ('level=1', 'gzip:level=1'),
+    ('level=6', 'gzip:'),
+    ('level=9', 'gzip:level=9'),
+    ('flush=65536', 'gzip:flush=65536'),
+    ('adaptive', 'gzip:level=9,cpu=2000'),
+)
+
+
+def body_file():
+    if BODY:
+        return BODY
+    f = tempfile.NamedTemporaryFile(mode='w', suffix='.log', delete=False)
+    i = 0
+    while f.tell() < 1024 * 1024:
+        f.write('127.0.0.1 - - [19/Oct/2026:10:%02d:%02d] "GET /item/%d HTTP/1.1" 200 %d "-" "bench"\n' % (
+            i % 60, i % 59, i, (i * 7919) % 100000))
+        i += 1
+    f.close()
+    return f.name
+
+
+def cpu_ticks(pid):
+    with open('/proc/%d/stat' % pid) as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+    # utime and stime
+    return int(fields[11]) + int(fields[12])
+
+
+def worker_pid(master):
+    out = subprocess.check_output(['pgrep', '-P', str(master)])
+    return int(out.split()[0])
+
+
+def hammer(n):
+    req = b'GET / HTTP/1.0\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n'
+    received = 0
+    for i in range(n):
+        s = socket.create_connection(ADDR)
+        s.sendall(req)
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            received += len(chunk)
+        s.close()
+    return received
+
+
+def run(route, filename, size):
+    cmd = [UWSGI, '--master', '--workers', '1', '--http-socket', '%s:%d' % ADDR,
+           '--disable-logging', '--cache2', 'name=bench,items=4,blocksize=%d' % (size + 1),
+           '--load-file-in-cache', 'bench %s' % filename,
+           '--route-run', route,
+           '--route-run', 'cache:key=%s,name=bench,content_type=text/plain' % filename]
+    # only routing, no apps
+    env = dict(os.environ, UWSGI_NEED_APP='false')
+    p = subprocess.Popen(cmd, env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(1)
+        pid = worker_pid(p.pid)
+        hammer(10)
+        c0 = cpu_ticks(pid)
+        t0 = time.time()
+        received = hammer(REQUESTS)
+        elapsed = time.time() - t0
+        c1 = cpu_ticks(pid)
+        hz = os.sysconf('SC_CLK_TCK')
+        mbs = (size * REQUESTS) / elapsed / (1024 * 1024)
+        ratio = received / float(size * REQUESTS)
+        cpu_ms = (c1 - c0) * 1000.0 / hz / REQUESTS
+        return mbs, ratio, cpu_ms
+    finally:
+        p.kill()
+        p.wait()
+
+
+def main():
+    filename = body_file()
+    size = os.path.getsize(filename)
+    print('body: %s (%d bytes), %d requests' % (filename, size, REQUESTS))
+    print('%-12s %10s %10s %12s' % ('scenario', 'MB/s', 'ratio', 'cpu ms/resp'))
+    for name, route in SCENARIOS:
+        mbs, ratio, cpu_ms = run(route, filename, size)
+        print('%-12s %10.1f %10.3f %12.2f' % (name, mbs, ratio, cpu_ms))
+    if not BODY:
+        os.unlink(filename)
+
+
+if __name__ == '__main__':
+    main()
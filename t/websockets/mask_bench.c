@@ -0,0 +1,97 @@
+/*
+	throughput of the websockets unmasking kernels (core/websockets_mask.c)
+
+	every kernel supported by the cpu unmasks frames from 1KB to 16MB (the payload starts
+	at an odd offset, like after a real frame header), the output is checked against
+	the byte kernel and the GB/s are reported.
+
+	build (from the root of the sources):
+
+	cc -O2 -I. -o mask_bench t/websockets/mask_bench.c core/websockets_mask.c
+
+	usage: ./mask_bench [MB processed for each size, default 256]
+*/
+
+#include "uwsgi.h"
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+int main(int argc, char *argv[]) {
+	size_t total = (argc > 1 ? strtoul(argv[1], NULL, 10) : 256) * 1024 * 1024;
+	size_t max = 16 * 1024 * 1024;
+	uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+	uint8_t *src = malloc(max + 1);
+	uint8_t *dst = malloc(max + 1);
+	uint8_t *expected = malloc(max + 1);
+	size_t i;
+
+	if (!src || !dst || !expected) {
+		perror("malloc()");
+		return 1;
+	}
+
+	for(i=0;i<max+1;i++) {
+		src[i] = (i * 7919) & 0xff;
+	}
+
+	struct uwsgi_websocket_mask_kernel *kernel;
+	// every length up to a few blocks, to check the tails
+	for(kernel = uwsgi_websocket_mask_kernels; kernel->name; kernel++) {
+		if (!kernel->supported()) continue;
+		for(i=0;i<=520;i++) {
+			uwsgi_websocket_mask_kernels[0].func(expected+1, src+1, i, mask);
+			memset(dst, 0, i + 2);
+			kernel->func(dst+1, src+1, i, mask);
+			if (memcmp(dst+1, expected+1, i) || dst[0] || dst[i+1]) {
+				printf("MISMATCH: %s kernel with %llu bytes\n", kernel->name, (unsigned long long) i);
+				return 1;
+			}
+		}
+	}
+
+	printf("default kernel: %s\n", uwsgi_websocket_mask_kernel(NULL)->name);
+	printf("%-10s", "size");
+	for(kernel = uwsgi_websocket_mask_kernels; kernel->name; kernel++) {
+		if (kernel->supported()) printf(" %10s", kernel->name);
+	}
+	printf("   (GB/s)\n");
+
+	size_t size;
+	for(size=1024;size<=max;size*=4) {
+		size_t rounds = total / size;
+		if (rounds < 4) rounds = 4;
+		uwsgi_websocket_mask_kernels[0].func(expected+1, src+1, size, mask);
+		printf("%-10llu", (unsigned long long) size);
+		for(kernel = uwsgi_websocket_mask_kernels; kernel->name; kernel++) {
+			if (!kernel->supported()) continue;
+			memset(dst, 0, size + 1);
+			kernel->func(dst+1, src+1, size, mask);
+			if (memcmp(dst+1, expected+1, size)) {
+				printf("\nMISMATCH: %s kernel with %llu bytes\n", kernel->name, (unsigned long long) size);
+				return 1;
+			}
+			double t0 = now();
+			for(i=0;i<rounds;i++) {
+				kernel->func(dst+1, src+1, size, mask);
+			}
+			double elapsed = now() - t0;
+			printf(" %10.2f", (size * rounds) / elapsed / (1024 * 1024 * 1024));
+		}
+		printf("\n");
+	}
+
+	// in place (as done before inflating) must give the same result
+	memcpy(dst, src, max + 1);
+	uwsgi_websocket_mask(dst+1, dst+1, max, mask);
+	uwsgi_websocket_mask_kernels[0].func(expected+1, src+1, max, mask);
+	if (memcmp(dst+1, expected+1, max)) {
+		printf("MISMATCH: in place unmasking\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+"""
+count the write/read syscalls done by a worker for every request
+
+it spawns a single worker instance for every scenario, sends the same amount
+of small JSON requests and reads the syscall counters of the worker from
+/proc/<pid>/io (syscw counts write(), writev(), sendmsg()... syscr the reading ones).
+
+scenarios:
+
+  pieces       the response is written in 4 chunks (status line, headers, body)
+  pieces+c     the same with --response-coalesce 4096
+  headers      prepared headers and a single body chunk
+  headers+c    the same with --response-coalesce 4096
+
+usage: python t/writer/syscalls_bench.py [requests] [uwsgi binary]
+"""
+import os
+import socket
+import subprocess
+import sys
+import time
+
+REQUESTS = int(sys.argv[1]) if len(sys.argv) > 1 else 5000
+UWSGI = sys.argv[2] if len(sys.argv) > 2 else './uwsgi'
+ADDR = ('127.0.0.1', 9999)
+
+BODY = '{"id":1,"name":"uwsgi","tags":["a","b"]}'
+
+PIECES = [
+    '--route-run', 'send-crnl:HTTP/1.0 200 OK',
+    '--route-run', 'send-crnl:Content-Type: application/json',
+    '--route-run', 'send-crnl:',
+    '--route-run', 'send:' + BODY,
+    '--route-run', 'break:',
+]
+
+# the status message is the body
+HEADERS = ['--route-run', 'return:200']
+
+SCENARIOS = (
+    ('pieces', PIECES),
+    ('pieces+c', PIECES + ['--response-coalesce', '4096']),
+    ('headers', HEADERS),
+    ('headers+c', HEADERS + ['--response-coalesce', '4096']),
+)
+
+
+def syscalls(pid):
+    counters = {}
+    with open('/proc/%d/io' % pid) as f:
+        for line in f:
+            key, value = line.split(':')
+            counters[key] = int(value)
+    return counters['syscr'], counters['syscw']
+
+
+def worker_pid(master):
+    out = subprocess.check_output(['pgrep', '-P', str(master)])
+    return int(out.split()[0])
+
+
+def hammer(n):
+    req = b'GET /foo HTTP/1.0\r\nHost: localhost\r\n\r\n'
+    for i in range(n):
+        s = socket.create_connection(ADDR)
+        s.sendall(req)
+        while s.recv(4096):
+            pass
+        s.close()
+
+
+def run(args):
+    cmd = [UWSGI, '--master', '--workers', '1', '--http-socket', '%s:%d' % ADDR,
+           '--disable-logging'] + args
+    # only routing, no apps
+    env = dict(os.environ, UWSGI_NEED_APP='false')
+    p = subprocess.Popen(cmd, env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(1)
+        pid = worker_pid(p.pid)
+        hammer(100)
+        r0, w0 = syscalls(pid)
+        hammer(REQUESTS)
+        r1, w1 = syscalls(pid)
+        return (r1 - r0) / float(REQUESTS), (w1 - w0) / float(REQUESTS)
+    finally:
+        p.kill()
+        p.wait()
+
+
+def main():
+    print('%-12s %10s %10s' % ('scenario', 'reads/req', 'writes/req'))
+    for name, args in SCENARIOS:
+        reads, writes = run(args)
+        print('%-12s %10.2f %10.2f' % (name, reads, writes))
+
+
+if __name__ == '__main__':
+    main()
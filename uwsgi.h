@@ -287,6 +287,9 @@ extern int pivot_root(const char *new_root, const char *put_old);
 
 #include <poll.h>
 #include <sys/uio.h>
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 #include <sys/un.h>
 
 #include <fcntl.h>
@@ -752,6 +755,16 @@ struct uwsgi_hash_algo *uwsgi_hash_algo_get(char *);
 void uwsgi_hash_algo_register(char *, uint32_t(*)(char *, uint64_t));
 void uwsgi_hash_algo_register_all(void);
 
+#define UWSGI_SHAREDAREA_PINS 16
+// writers wait for the release of the pinned ranges they overlap
+struct uwsgi_sharedarea_pin {
+	uint64_t used;
+	uint64_t pos;
+	uint64_t len;
+	// set by a writer tired of waiting, the transfer is aborted
+	uint64_t revoked;
+};
+
 struct uwsgi_sharedarea {
 	int id;
 	int pages;
@@ -764,6 +777,8 @@ struct uwsgi_sharedarea {
 	uint8_t honour_used;
 	uint64_t used;
 	void *obj;
+	// ranges pinned by offloaded transfers
+	struct uwsgi_sharedarea_pin pins[UWSGI_SHAREDAREA_PINS];
 };
 
 // maintain alignment here !!!
@@ -856,6 +871,11 @@ struct uwsgi_cache {
 	int lazy_expire;
 	uint64_t sweep_on_full;
 	int clear_on_full;
+
+	// references to items held by offloaded transfers (one for each item)
+	uint64_t *refs;
+	// size of the value of deleted items still referenced
+	uint64_t *orphans;
 };
 
 struct uwsgi_option {
@@ -1018,6 +1038,8 @@ struct uwsgi_socket {
 	SSL_CTX *ssl_ctx;
 #endif
 
+	// MSG_ZEROCOPY is not supported (or not worth) on this socket
+	int no_zerocopy;
 };
 
 struct uwsgi_protocol {
@@ -1093,6 +1115,12 @@ struct uwsgi_plugin {
 	int (*worker)(void);
 
 	void (*early_post_jail) (void);
+
+	// run in the master before forking a worker (with --freeze-heaps)
+	void (*freeze_heap) (void);
+
+	// the language-level frame of a request for the sampling profiler (run in a signal handler, only read memory)
+	int (*profiler_frame) (struct wsgi_request *, char *, size_t);
 };
 
 #ifdef UWSGI_PCRE
@@ -1188,6 +1216,35 @@ struct uwsgi_spooler {
 // close the request
 #define UWSGI_ROUTE_BREAK 2
 
+struct uwsgi_route;
+struct uwsgi_route_template;
+
+// literal prefixes of the regexp routes on the same subject
+struct uwsgi_route_trie_node {
+	unsigned char c;
+	uint32_t child;
+	uint32_t sibling;
+	struct uwsgi_route *routes;
+};
+
+struct uwsgi_route_trie {
+	size_t subject;
+	struct uwsgi_route_trie_node *nodes;
+	uint32_t nodes_cnt;
+	// one for each core
+	uint64_t *gen;
+	struct uwsgi_route_trie *next;
+};
+
+// consecutive regexp routes on the same subject combined in a single alternation
+struct uwsgi_route_group {
+	pcre *pattern;
+	pcre_extra *pattern_extra;
+	// one for each core
+	uint64_t *gen;
+	uint8_t *matched;
+};
+
 struct uwsgi_route {
 
 	pcre *pattern;
@@ -1238,6 +1295,17 @@ struct uwsgi_route {
 
 	struct uwsgi_route *next;
 
+	// latency histogram slot of a label
+	uint16_t label_id;
+
+	// compiled routing table (prefilters of the regexp)
+	struct uwsgi_route_trie *trie;
+	struct uwsgi_route *trie_next;
+	uint64_t *trie_gen;
+	struct uwsgi_route_group *group;
+
+	// tokenized action templates
+	struct uwsgi_route_template *templates;
 };
 
 struct uwsgi_route_condition {
@@ -1346,6 +1414,87 @@ struct uwsgi_log_encoder {
 	struct uwsgi_log_encoder *next;
 };
 
+/*
+	single-producer/single-consumer ring used by workers for passing request
+	loglines to the log master. Records are a 32bit length followed by the line.
+	head is only written by the consumer, tail only by the producer.
+*/
+/*
+	log-linear (HDR-style) histogram of response times in microseconds:
+	16 sub-buckets for each power of two (about 6% of precision) up to 2^40
+*/
+#define UWSGI_LATENCY_SUB_BITS 4
+#define UWSGI_LATENCY_MAX_BITS 40
+#define UWSGI_LATENCY_BUCKETS ((UWSGI_LATENCY_MAX_BITS - UWSGI_LATENCY_SUB_BITS + 2) * (1 << UWSGI_LATENCY_SUB_BITS))
+struct uwsgi_latency_histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[UWSGI_LATENCY_BUCKETS];
+};
+
+#define UWSGI_LATENCY_TRACE_VARS 4096
+struct uwsgi_latency_trace {
+	// the interval (in units of latency-traces-interval) the trace belongs to
+	uint64_t interval;
+	uint64_t start;
+	uint64_t micros;
+	uint64_t size;
+	uint16_t status;
+	uint16_t core;
+	uint16_t label_id;
+	uint16_t vars_len;
+	// uwsgi packet encoded
+	char vars[UWSGI_LATENCY_TRACE_VARS];
+};
+
+// resources used by the requests (see core/accounting.c)
+struct uwsgi_request_accounting {
+	uint64_t requests;
+	// thread cpu time and wall clock time (microseconds)
+	uint64_t cpu;
+	uint64_t micros;
+	// voluntary/involuntary context switches and minor page faults
+	uint64_t vcsw;
+	uint64_t ivcsw;
+	uint64_t minflt;
+};
+
+// the sampling profiler (see core/profiler.c)
+#define UWSGI_PROFILER_DEPTH 32
+#define UWSGI_PROFILER_FRAME 128
+
+struct uwsgi_profiler_stack {
+	// 0 for a free slot
+	volatile uint64_t hash;
+	volatile uint64_t ready;
+	uint64_t count;
+	uint16_t depth;
+	uint16_t frame_len;
+	void *frames[UWSGI_PROFILER_DEPTH];
+	// the language-level frame
+	char frame[UWSGI_PROFILER_FRAME];
+};
+
+struct uwsgi_profiler {
+	// samples per second (0 = paused), can be changed at runtime
+	volatile int rate;
+	uint64_t samples;
+	uint64_t dropped;
+	uint64_t stacks_cnt;
+	struct uwsgi_profiler_stack stacks[];
+};
+
+struct uwsgi_log_ring {
+	volatile uint64_t head;
+	volatile uint64_t tail;
+	uint64_t size;
+	uint64_t lines;
+	uint64_t dropped;
+	uint64_t blocked;
+	char *buf;
+};
+
 struct uwsgi_transformation {
 	int (*func)(struct wsgi_request *, struct uwsgi_transformation *);
 	struct uwsgi_buffer *chunk;
@@ -1359,6 +1508,13 @@ struct uwsgi_transformation {
 	uint64_t len;
 	uint64_t custom64;
 	struct uwsgi_transformation *next;
+	// zero_copy transformations read from input and expose their own output buffer
+	uint8_t zero_copy;
+	uint8_t last_round;
+	char *input;
+	size_t input_len;
+	char *output;
+	size_t output_len;
 };
 
 enum uwsgi_range {
@@ -1371,6 +1527,8 @@ enum uwsgi_range {
 // avoid name clashes on solaris
 #undef sun
 
+struct uwsgi_websocket_deflate;
+
 struct wsgi_request {
 	int fd;
 	struct uwsgi_header *uh;
@@ -1651,6 +1809,33 @@ struct wsgi_request {
 
 	char * if_range;
 	uint16_t if_range_len;
+
+	// the last route label reached (used by latency histograms)
+	uint16_t route_label_id;
+
+	// response coalescing (headers and body bytes waiting for the flush)
+	uint8_t headers_coalesced;
+	size_t coalesced;
+	// writes are not coalesced (websockets frames must be sent immediately)
+	uint8_t no_coalesce;
+
+	char *http_sec_websocket_extensions;
+	uint16_t http_sec_websocket_extensions_len;
+	// negotiated permessage-deflate contexts
+	struct uwsgi_websocket_deflate *websocket_deflate;
+	uint8_t websocket_rsv1;
+	uint8_t websocket_fin;
+	uint8_t websocket_compressed;
+
+	// absolute deadline (microseconds), 0 if the request has no deadline
+	uint64_t deadline;
+
+	// resources used by the request (--request-accounting), the samples taken at the start are replaced by the deltas at the end
+	uint8_t acct_running;
+	uint64_t acct_cpu;
+	uint64_t acct_vcsw;
+	uint64_t acct_ivcsw;
+	uint64_t acct_minflt;
 };
 
 
@@ -1708,7 +1893,7 @@ struct uwsgi_stats_pusher;
 struct uwsgi_stats_pusher_instance;
 
 #define UWSGI_PROTO_MIN_CHECK 4
-#define UWSGI_PROTO_MAX_CHECK 28
+#define UWSGI_PROTO_MAX_CHECK 30
 
 struct uwsgi_offload_engine;
 
@@ -1766,9 +1951,134 @@ struct uwsgi_fsmon {
 	void *data;
 	void (*func)(struct uwsgi_fsmon *);
 	struct uwsgi_fsmon *next;
+	// new subdirectories are monitored too
+	int tree;
+	int pending;
+};
+
+struct uwsgi_static_file_variant {
+	// -1 if not available
+	int fd;
+	struct stat st;
+	char *filename;
+	size_t filename_len;
+	char last_modified[31];
+	int last_modified_len;
+};
+
+struct uwsgi_static_file {
+	uint32_t hash;
+	char *key;
+	size_t key_len;
+	struct uwsgi_string_list *index;
+	char *mime_type;
+	size_t mime_type_len;
+	// original file, gzip and brotli
+	struct uwsgi_static_file_variant variants[3];
+	int refs;
+	int evicted;
+	struct uwsgi_static_file *next;
+	struct uwsgi_static_file *lru_prev;
+	struct uwsgi_static_file *lru_next;
+};
+
+struct uwsgi_static_file_cache {
+	uint64_t generation;
+	uint32_t mask;
+	int items;
+	struct uwsgi_static_file **table;
+	struct uwsgi_static_file *lru_head;
+	struct uwsgi_static_file *lru_tail;
+};
+
+struct uwsgi_static_store_item {
+	uint64_t dev;
+	uint64_t ino;
+	int64_t mtime;
+	uint64_t size;
+	uint64_t compressed_size;
+	time_t last_hit;
+	int status;
+};
+
+struct uwsgi_static_store {
+	struct uwsgi_lock_item *lock;
+	uint64_t mask;
+	struct uwsgi_static_store_item *table;
+	uint64_t items;
+	uint64_t bytes;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t compressed;
+	uint64_t skipped;
+	uint64_t evicted;
+	uint64_t errors;
 };
 
 struct uwsgi_subscription_client;
+struct uwsgi_offload_queue;
+
+#define UWSGI_WEBSOCKET_SUBSCRIPTIONS 8
+#define UWSGI_WEBSOCKET_CHANNEL_NAMELEN 64
+
+// the offloaded message of a core (frames must not be interleaved)
+struct uwsgi_websocket_offload {
+	int pipe[2];
+	uint8_t ready;
+	uint64_t pending;
+	// channels (id + 1) the websocket of the core is subscribed to
+	int fd;
+	int channels[UWSGI_WEBSOCKET_SUBSCRIPTIONS];
+	int subscriptions;
+	// last hub message examined
+	uint64_t cursor;
+};
+
+struct uwsgi_websocket_channel {
+	char name[UWSGI_WEBSOCKET_CHANNEL_NAMELEN];
+	uint16_t name_len;
+	uint64_t subscribers;
+	uint64_t published;
+	uint64_t delivered;
+	uint64_t dropped;
+	// hub slots skipped by the publishers because still being sent
+	uint64_t overflows;
+	uint64_t bytes;
+};
+
+// an already framed message, the slot is reused after hub_slots publishes
+struct uwsgi_websocket_hub_message {
+	uint64_t seq;
+	uint64_t refs;
+	int channel;
+	uint64_t len;
+	char *buf;
+};
+
+// the messages sent to a subscriber by a single offload task
+#define UWSGI_WEBSOCKET_HUB_BATCH 16
+struct uwsgi_websocket_hub_delivery {
+	int core;
+	int count;
+	struct uwsgi_websocket_hub_message *messages[UWSGI_WEBSOCKET_HUB_BATCH];
+	uint64_t seqs[UWSGI_WEBSOCKET_HUB_BATCH];
+	int channels[UWSGI_WEBSOCKET_HUB_BATCH];
+};
+
+struct uwsgi_websocket_mask_kernel {
+	char *name;
+	int (*supported)(void);
+	void (*func)(uint8_t *, uint8_t *, size_t, uint8_t *);
+};
+
+struct uwsgi_websocket_hub {
+	struct uwsgi_lock_item *lock;
+	uint64_t seq;
+	struct uwsgi_websocket_channel *channels;
+	struct uwsgi_websocket_hub_message *messages;
+	// a socketpair for each worker, publishers write to [0]
+	int *pipes;
+};
 
 struct uwsgi_server {
 
@@ -2921,6 +3231,117 @@ struct uwsgi_server {
 	size_t environ_len;
 
 	int dynamic_apps;
+
+	uint64_t req_log_ring_size;
+	int req_log_ring_wait;
+	int req_log_ring_fd[2];
+	pthread_mutex_t req_log_ring_lock;
+
+	struct uwsgi_logchunk *logformat_ops;
+	int logformat_ops_cnt;
+	char **logformat_scratch;
+
+	char **log_binary_buf;
+	int log_req_binary;
+	int log_rotate_columnar;
+
+	int latency_histograms;
+	int latency_slots;
+	struct uwsgi_string_list *latency_labels;
+	struct uwsgi_latency_histogram *latency_hist;
+	int latency_traces;
+	int latency_traces_interval;
+	struct uwsgi_latency_trace *latency_traces_shm;
+
+	uint64_t response_coalesce;
+	uint64_t zerocopy_threshold;
+
+	int static_file_cache;
+	uint64_t *static_file_cache_generation;
+	struct uwsgi_string_list *static_file_cache_roots;
+	struct uwsgi_static_file_cache *static_files;
+
+	char *static_store_dir;
+	uint64_t static_store_min_size;
+	uint64_t static_store_max_size;
+	int static_store_items;
+	struct uwsgi_string_list *static_store_types;
+	struct uwsgi_static_store *static_store;
+	struct uwsgi_thread *static_store_thread;
+
+#ifdef UWSGI_ROUTING
+	int no_routing_compile;
+	// one for each core, bumped on every routing pass and action
+	uint64_t *routing_gen;
+	// one for each core, used by route templates expansion
+	struct uwsgi_buffer **routing_scratch;
+#endif
+
+	// offload threads task queue and counters
+	int offload_threads_queue;
+	int offload_engines_cnt;
+	struct uwsgi_offload_queue *offload_queue;
+	struct uwsgi_offload_engine_stats *offload_engines_stats;
+	struct uwsgi_offload_thread_stats *offload_threads_stats;
+	struct uwsgi_offload_engine *offload_engine_cache;
+	struct uwsgi_offload_engine *offload_engine_sharedarea;
+	// one for each core, websocket messages offloaded from a sharedarea
+	struct uwsgi_websocket_offload *websockets_offload;
+
+	int websockets_channels;
+	uint64_t websockets_hub_slots;
+	uint64_t websockets_hub_message_size;
+	struct uwsgi_websocket_hub *websockets_hub;
+	struct uwsgi_offload_engine *offload_engine_websocket;
+
+	int websockets_deflate;
+	int websockets_deflate_level;
+	int websockets_deflate_no_context_takeover;
+	uint64_t websockets_deflate_memory;
+
+	char *websockets_mask_kernel;
+
+	char *stats_format;
+	// the stats server thread (the master generates the json document for it)
+	struct uwsgi_thread *stats_thread;
+
+	int cheaper_predictive_utilization;
+	int cheaper_predictive_horizon;
+
+	// pre-forked workers parked in the slots after numproc
+	int warm_spares;
+	// the spare slot this worker was born in
+	int i_am_a_warm_spare;
+
+	int freeze_heaps;
+	int memory_sharing_report;
+
+	// per-request deadlines (milliseconds) and the header with the budget of the client
+	uint64_t request_deadline;
+	char *request_deadline_header;
+	char *request_deadline_var;
+	uint16_t request_deadline_var_len;
+
+	// the periodic work of the master (see core/master_tasks.c)
+	struct uwsgi_master_task *master_tasks;
+
+	// per worker/core slots of the metrics updated by the applications
+	int64_t *metrics_shards;
+	uint64_t metrics_shards_stride;
+	// metrics by name (open addressing)
+	struct uwsgi_metric **metrics_index;
+	uint64_t metrics_index_mask;
+
+	// the OpenMetrics endpoint (see core/openmetrics.c)
+	char *metrics_http;
+
+	// per worker and route label resource usage of the requests
+	int request_accounting;
+	struct uwsgi_request_accounting *request_acct;
+
+	int sampling_profiler_rate;
+	int sampling_profiler_stacks;
+	struct uwsgi_profiler *sampling_profiler;
 };
 
 struct uwsgi_rpc {
@@ -2957,6 +3378,31 @@ struct uwsgi_snmp_server_value {
 	uint64_t *val;
 };
 
+struct uwsgi_master_task {
+	char *name;
+	// milliseconds
+	uint64_t interval;
+	void (*func) (void);
+	// tasks bound to an object (e.g. a cache)
+	void (*func_data) (void *);
+	void *data;
+
+	// timer wheel
+	uint64_t expires;
+	int level;
+	int slot;
+	struct uwsgi_master_task *wheel_next;
+	struct uwsgi_master_task *wheel_prev;
+
+	struct uwsgi_master_task *next;
+
+	// accounting (microseconds)
+	uint64_t runs;
+	uint64_t total_usecs;
+	uint64_t max_usecs;
+	uint64_t last_usecs;
+};
+
 struct uwsgi_cron {
 
 	int minute;
@@ -3077,6 +3523,17 @@ struct uwsgi_core {
 	// uWSGI 2.1
 	time_t harakiri;
 	time_t user_harakiri;
+
+	// iovecs for response writes (IOV_MAX items)
+	struct iovec *wvec;
+	// response coalescing buffer
+	char *coalesce_buf;
+
+	// --request-accounting totals (cpu time in microseconds)
+	uint64_t cpu_time;
+	uint64_t vcsw;
+	uint64_t ivcsw;
+	uint64_t minflt;
 };
 
 struct uwsgi_worker {
@@ -3140,6 +3597,12 @@ struct uwsgi_worker {
 
 	uint64_t uss_size;
 	uint64_t pss_size;
+
+	struct uwsgi_log_ring *req_log_ring;
+
+	// memory shared with other processes and swapped out (Linux only)
+	uint64_t shared_size;
+	uint64_t swap_size;
 };
 
 
@@ -3212,7 +3675,7 @@ void logto(char *);
 void log_request(struct wsgi_request *);
 void get_memusage(uint64_t *, uint64_t *);
 #ifdef __linux__
-void get_memusage_extra(uint64_t *, uint64_t *);
+void get_memusage_extra(pid_t, uint64_t *, uint64_t *, uint64_t *, uint64_t *);
 #endif
 void harakiri(void);
 
@@ -3226,6 +3689,7 @@ void uwsgi_500(struct wsgi_request *);
 void uwsgi_403(struct wsgi_request *);
 void uwsgi_404(struct wsgi_request *);
 void uwsgi_405(struct wsgi_request *);
+void uwsgi_504(struct wsgi_request *);
 void uwsgi_redirect_to_slash(struct wsgi_request *);
 
 void manage_snmp(int, uint8_t *, int, struct sockaddr_in *);
@@ -3370,6 +3834,7 @@ void add_exported_option_do(char *, char *, int, int);
 
 ssize_t uwsgi_send_empty_pkt(int, char *, uint8_t, uint8_t);
 
+int uwsgi_poll(struct pollfd *, nfds_t, int);
 int uwsgi_waitfd_event(int, int, int);
 #define uwsgi_waitfd(a, b) uwsgi_waitfd_event(a, b, POLLIN)
 #define uwsgi_waitfd_write(a, b) uwsgi_waitfd_event(a, b, POLLOUT)
@@ -3396,6 +3861,8 @@ int uwsgi_cache_del2(struct uwsgi_cache *, char *, uint16_t, uint64_t, uint16_t)
 char *uwsgi_cache_get2(struct uwsgi_cache *, char *, uint16_t, uint64_t *);
 char *uwsgi_cache_get3(struct uwsgi_cache *, char *, uint16_t, uint64_t *, uint64_t *);
 char *uwsgi_cache_get4(struct uwsgi_cache *, char *, uint16_t, uint64_t *, uint64_t *);
+char *uwsgi_cache_get_ref(struct uwsgi_cache *, char *, uint16_t, uint64_t *, uint64_t *, uint64_t *);
+void uwsgi_cache_unref(struct uwsgi_cache *, uint64_t);
 uint32_t uwsgi_cache_exists2(struct uwsgi_cache *, char *, uint16_t);
 struct uwsgi_cache *uwsgi_cache_create(char *);
 struct uwsgi_cache *uwsgi_cache_by_name(char *);
@@ -3406,6 +3873,7 @@ void uwsgi_cache_setup_nodes(struct uwsgi_cache *);
 int64_t uwsgi_cache_num2(struct uwsgi_cache *, char *, uint16_t);
 
 void uwsgi_cache_sync_all(void);
+void uwsgi_cache_sync(void *);
 void uwsgi_cache_start_sweepers(void);
 void uwsgi_cache_start_sync_servers(void);
 
@@ -3420,6 +3888,7 @@ int event_queue_add_fd_read(int, int);
 int event_queue_add_fd_write(int, int);
 int event_queue_del_fd(int, int, int);
 int event_queue_wait(int, int, int *);
+int event_queue_wait_ms(int, int, int *);
 int event_queue_wait_multi(int, int, void *, int);
 int event_queue_interesting_fd(void *, int);
 int event_queue_interesting_fd_has_error(void *, int);
@@ -3441,6 +3910,7 @@ struct uwsgi_fmon *event_queue_ack_file_monitor(int, int);
 
 
 int uwsgi_register_signal(uint8_t, char *, void *, uint8_t);
+void uwsgi_signal_table_copy(int, int);
 int uwsgi_add_file_monitor(uint8_t, char *);
 int uwsgi_add_timer(uint8_t, int);
 int uwsgi_add_timer_hr(uint8_t, int, long);
@@ -3455,6 +3925,7 @@ int uwsgi_register_rpc(char *, struct uwsgi_plugin *, uint8_t, void *);
 uint64_t uwsgi_rpc(char *, uint8_t, char **, uint16_t *, char **);
 char *uwsgi_do_rpc(char *, char *, uint8_t, char **, uint16_t *, uint64_t *);
 void uwsgi_rpc_init(void);
+void uwsgi_rpc_copy(int, int);
 
 char *uwsgi_cheap_string(char *, int);
 
@@ -3601,6 +4072,10 @@ char *uwsgi_amqp_consume(int, uint64_t *, char **);
 int uwsgi_file_serve(struct wsgi_request *, char *, uint16_t, char *, uint16_t, int);
 int uwsgi_starts_with(char *, int, char *, int);
 int uwsgi_static_want_gzip(struct wsgi_request *, char *, size_t *, struct stat *);
+void uwsgi_static_file_cache_init(void);
+void uwsgi_static_file_cache_monitor(void);
+void uwsgi_static_store_init(void);
+uint64_t uwsgi_static_store_get(char *, size_t, struct stat *, char *, size_t, char *);
 
 #ifdef __sun__
 time_t timegm(struct tm *);
@@ -4081,6 +4556,8 @@ int uwsgi_apply_routes_do(struct uwsgi_route *, struct wsgi_request *, char *, u
 void uwsgi_register_embedded_routers(void);
 void uwsgi_routing_dump();
 struct uwsgi_buffer *uwsgi_routing_translate(struct wsgi_request *, struct uwsgi_route *, char *, uint16_t, char *, size_t);
+char *uwsgi_routing_translate_scratch(struct wsgi_request *, struct uwsgi_route *, char *, uint16_t, char *, size_t, size_t *);
+void uwsgi_route_free_templates(struct uwsgi_route *);
 int uwsgi_route_api_func(struct wsgi_request *, char *, char *);
 struct uwsgi_route_condition *uwsgi_register_route_condition(char *, int (*) (struct wsgi_request *, struct uwsgi_route *));
 void uwsgi_fixup_routes(struct uwsgi_route *);
@@ -4105,9 +4582,36 @@ int uwsgi_cheaper_algo_spare2(int);
 int uwsgi_cheaper_algo_backlog(int);
 int uwsgi_cheaper_algo_backlog2(int);
 int uwsgi_cheaper_algo_manual(int);
+int uwsgi_cheaper_algo_predictive(int);
+
+int uwsgi_master_check_warm_spares(void);
+int uwsgi_master_check_warm_spares_death(pid_t, int);
+void uwsgi_warm_spares_kill(void);
+void uwsgi_warm_spares_close_pipes(void);
+void uwsgi_warm_spare_wait(void);
+
+void uwsgi_freeze_heaps(void);
+#ifdef __linux__
+void uwsgi_master_check_memory_sharing(void);
+#endif
+
+void uwsgi_deadlines_start(void);
+uint64_t uwsgi_deadline_parse(char *, uint16_t);
+int uwsgi_deadline_set(struct wsgi_request *);
+void uwsgi_deadline_clear(struct wsgi_request *);
+int64_t uwsgi_deadline_remaining(struct wsgi_request *);
+
+struct uwsgi_master_task *uwsgi_master_task_register(char *, uint64_t, uint64_t, void (*)(void));
+struct uwsgi_master_task *uwsgi_master_task_register_data(char *, uint64_t, uint64_t, void (*)(void *), void *);
+void uwsgi_master_task_reschedule(struct uwsgi_master_task *, uint64_t);
+int uwsgi_master_tasks_timeout(void);
+void uwsgi_master_tasks_run(void);
 
 int uwsgi_master_log(void);
 int uwsgi_master_req_log(void);
+void uwsgi_setup_req_log_rings(void);
+int uwsgi_master_req_log_ring(void);
+ssize_t uwsgi_req_log_writev(struct iovec *, int);
 void uwsgi_flush_logs(void);
 
 void uwsgi_register_cheaper_algo(char *, int (*)(int));
@@ -4265,16 +4769,54 @@ struct uwsgi_logchunk {
 	int free;
 	ssize_t(*func) (struct wsgi_request *, char **);
 	struct uwsgi_logchunk *next;
+	int64_t (*num) (struct wsgi_request *);
+	size_t (*date) (time_t, char *, size_t);
+	// offset in the per-core scratch area
+	size_t scratch;
+};
+
+struct uwsgi_logchunk_date {
+	time_t t;
+	size_t len;
+	char buf[64];
 };
 
 void uwsgi_build_log_format(char *);
 
 void uwsgi_add_logchunk(int, int, char *, size_t);
 struct uwsgi_logchunk *uwsgi_register_logchunk(char *, ssize_t (*)(struct wsgi_request *, char **), int);
+struct uwsgi_logchunk *uwsgi_register_logchunk_num(char *, int64_t (*)(struct wsgi_request *));
+struct uwsgi_logchunk *uwsgi_register_logchunk_date(char *, size_t (*)(time_t, char *, size_t));
 
 void uwsgi_logit_simple(struct wsgi_request *);
 void uwsgi_logit_lf(struct wsgi_request *);
 void uwsgi_logit_lf_strftime(struct wsgi_request *);
+void uwsgi_setup_route_labels(void);
+void uwsgi_setup_latency(void);
+void uwsgi_latency_account(struct wsgi_request *, uint64_t);
+int uwsgi_latency_bucket(uint64_t);
+uint64_t uwsgi_latency_bucket_value(int);
+void uwsgi_latency_register_metrics(void);
+int uwsgi_stats_latency(struct uwsgi_stats *);
+int uwsgi_stats_latency_worker(struct uwsgi_stats *, int);
+void uwsgi_setup_request_accounting(void);
+void uwsgi_request_accounting_start(struct wsgi_request *);
+void uwsgi_request_accounting_end(struct wsgi_request *);
+int uwsgi_stats_request_accounting(struct uwsgi_stats *);
+void uwsgi_setup_profiler(void);
+void uwsgi_profiler_register_task(void);
+void uwsgi_profiler_worker_setup(void);
+struct uwsgi_buffer *uwsgi_profiler_folded(char *, int);
+int uwsgi_stats_profiler(struct uwsgi_stats *);
+int uwsgi_stats_static_store(struct uwsgi_stats *);
+int uwsgi_stats_offload(struct uwsgi_stats *);
+int uwsgi_stats_master_tasks(struct uwsgi_stats *);
+int uwsgi_stats_metric_distribution(struct uwsgi_stats *, struct uwsgi_metric *);
+void uwsgi_setup_log_binary(void);
+void uwsgi_logit_binary(struct wsgi_request *);
+char *uwsgi_log_encoder_binary(struct uwsgi_log_encoder *, char *, size_t, size_t *);
+int uwsgi_log_binary_columnar(int, char *);
+void uwsgi_log_binary_columnar_bg(char *);
 
 struct uwsgi_logvar *uwsgi_logvar_get(struct wsgi_request *, char *, uint8_t);
 void uwsgi_logvar_add(struct wsgi_request *, char *, uint8_t, char *, uint8_t);
@@ -4531,6 +5073,9 @@ struct uwsgi_offload_request {
 
 	void *data;
 	void (*free)(struct uwsgi_offload_request *);
+
+	// set when an offload thread starts the task
+	uint64_t started_at;
 };
 
 struct uwsgi_offload_engine {
@@ -4538,6 +5083,25 @@ struct uwsgi_offload_engine {
 	int (*prepare_func)(struct wsgi_request *, struct uwsgi_offload_request *);
 	int (*event_func) (struct uwsgi_thread *, struct uwsgi_offload_request *, int);
 	struct uwsgi_offload_engine *next;	
+	int id;
+};
+
+// counters of an engine (one for each worker, in shared memory)
+struct uwsgi_offload_engine_stats {
+	uint64_t tasks;
+	uint64_t active;
+	uint64_t bytes;
+	uint64_t usecs;
+};
+
+// counters of an offload thread (in shared memory)
+struct uwsgi_offload_thread_stats {
+	uint64_t active;
+	// tasks dispatched to the thread but still in the queue
+	uint64_t queued;
+	uint64_t tasks;
+	// tasks taken from the queue without being dispatched to the thread
+	uint64_t stolen;
 };
 
 struct uwsgi_offload_engine *uwsgi_offload_engine_by_name(char *);
@@ -4545,10 +5109,13 @@ struct uwsgi_offload_engine *uwsgi_offload_register_engine(char *, int (*)(struc
 
 void uwsgi_offload_setup(struct uwsgi_offload_engine *, struct uwsgi_offload_request *, struct wsgi_request *, uint8_t);
 int uwsgi_offload_run(struct wsgi_request *, struct uwsgi_offload_request *, int *);
+int uwsgi_offload_push(struct uwsgi_offload_request *);
 void uwsgi_offload_engines_register_all(void);
+void uwsgi_setup_offload(void);
 
 struct uwsgi_thread *uwsgi_offload_thread_start(void);
 int uwsgi_offload_request_sendfile_do(struct wsgi_request *, int, size_t, size_t);
+int uwsgi_offload_request_cache_do(struct wsgi_request *, struct uwsgi_cache *, uint64_t, char *, size_t);
 int uwsgi_offload_request_net_do(struct wsgi_request *, char *, struct uwsgi_buffer *);
 int uwsgi_offload_request_memory_do(struct wsgi_request *, char *, size_t);
 int uwsgi_offload_request_pipe_do(struct wsgi_request *, int, size_t);
@@ -4667,6 +5234,7 @@ struct uwsgi_buffer *uwsgi_proto_base_prepare_headers(struct wsgi_request *, cha
 struct uwsgi_buffer *uwsgi_proto_base_cgi_prepare_headers(struct wsgi_request *, char *, uint16_t);
 int uwsgi_response_write_body_do(struct wsgi_request *, char *, size_t);
 int uwsgi_response_writev_body_do(struct wsgi_request *, struct iovec *, size_t);
+int uwsgi_response_flush(struct wsgi_request *);
 
 int uwsgi_proto_base_sendfile(struct wsgi_request *, int, size_t, size_t);
 #ifdef UWSGI_SSL
@@ -4801,6 +5369,10 @@ struct uwsgi_buffer *uwsgi_zlib_decompress(char *, size_t);
 int uwsgi_gzip_fix(z_stream *, uint32_t, struct uwsgi_buffer *, size_t);
 char *uwsgi_gzip_chunk(z_stream *, uint32_t *, char *, size_t, size_t *);
 int uwsgi_gzip_prepare(z_stream *, char *, size_t, uint32_t *);
+int uwsgi_deflate_init_raw(z_stream *, int, int, int);
+int uwsgi_inflate_init_raw(z_stream *, int);
+int uwsgi_deflate_buffer(z_stream *, char *, size_t, int, struct uwsgi_buffer *);
+int uwsgi_inflate_buffer(z_stream *, char *, size_t, struct uwsgi_buffer *, size_t);
 #endif
 
 char *uwsgi_get_cookie(struct wsgi_request *, char *, uint16_t, uint16_t *);
@@ -4857,6 +5429,7 @@ int uwsgi_init(int, char **, char **);
 
 int uwsgi_master_check_cron_death(int);
 struct uwsgi_fsmon *uwsgi_register_fsmon(char *, void (*)(struct uwsgi_fsmon *), void *data);
+int uwsgi_register_fsmon_tree(char *, void (*)(struct uwsgi_fsmon *), void *data);
 int uwsgi_fsmon_event(int);
 void uwsgi_fsmon_setup();
 
@@ -4928,6 +5501,24 @@ enum {
 	UWSGI_METRIC_GAUGE,
 	UWSGI_METRIC_ABSOLUTE,
 	UWSGI_METRIC_ALIAS,
+	UWSGI_METRIC_HISTOGRAM,
+	UWSGI_METRIC_SUMMARY,
+};
+
+struct uwsgi_metric_distribution {
+	// histograms: upper bounds of the buckets
+	int64_t *bounds;
+	uint64_t bounds_cnt;
+	// summaries: quantiles (permille)
+	int *quantiles;
+	uint64_t quantiles_cnt;
+
+	// aggregated by the metrics collector
+	int64_t count;
+	int64_t sum;
+	int64_t max;
+	// cumulative counts of the buckets (histograms) or the values of the quantiles (summaries)
+	int64_t *values;
 };
 
 struct uwsgi_metric_child;
@@ -5002,6 +5593,14 @@ struct uwsgi_metric {
 
 	// allow to reset metrics after each push
 	uint8_t reset_after_push;
+
+	// the metrics without a collector are updated in per worker/core slots (see core/metrics.c)
+	int64_t *base;
+	uint64_t shard;
+	uint64_t shard_slots;
+
+	// histograms and summaries
+	struct uwsgi_metric_distribution *dist;
 };
 
 struct uwsgi_metric_child {
@@ -5011,6 +5610,9 @@ struct uwsgi_metric_child {
 
 void uwsgi_setup_metrics(void);
 void uwsgi_metrics_start_collector(void);
+void uwsgi_openmetrics_bind(void);
+void uwsgi_openmetrics_render(void);
+void uwsgi_openmetrics_serve(uint64_t);
 
 int uwsgi_metric_set(char *, char *, int64_t);
 int uwsgi_metric_inc(char *, char *, int64_t);
@@ -5021,8 +5623,17 @@ int64_t uwsgi_metric_get(char *, char *);
 int64_t uwsgi_metric_getn(char *, size_t, char *, size_t);
 int uwsgi_metric_set_max(char *, char *, int64_t);
 int uwsgi_metric_set_min(char *, char *, int64_t);
+int uwsgi_metric_observe(char *, char *, int64_t);
+
+struct uwsgi_metric *uwsgi_metric_handle(char *, char *);
+int uwsgi_metric_handle_inc(struct uwsgi_metric *, int64_t);
+int uwsgi_metric_handle_dec(struct uwsgi_metric *, int64_t);
+int uwsgi_metric_handle_set(struct uwsgi_metric *, int64_t);
+int uwsgi_metric_handle_observe(struct uwsgi_metric *, int64_t);
+void uwsgi_metric_store(struct uwsgi_metric *, int64_t);
 
 struct uwsgi_metric_collector *uwsgi_register_metric_collector(char *, int64_t (*)(struct uwsgi_metric *));
+int64_t uwsgi_metric_collector_latency(struct uwsgi_metric *);
 struct uwsgi_metric *uwsgi_register_metric(char *, char *, uint8_t, char *, void *, uint32_t, void *);
 
 void uwsgi_metrics_collectors_setup(void);
@@ -5075,8 +5686,27 @@ int uwsgi_sharedarea_wlock(int);
 int uwsgi_sharedarea_update(int);
 
 struct uwsgi_sharedarea *uwsgi_sharedarea_get_by_id(int, uint64_t);
+int uwsgi_sharedarea_pin(struct uwsgi_sharedarea *, uint64_t, uint64_t);
+void uwsgi_sharedarea_unpin(struct uwsgi_sharedarea *, int);
 int uwsgi_websocket_send_from_sharedarea(struct wsgi_request *, int, uint64_t, uint64_t);
 int uwsgi_websocket_send_binary_from_sharedarea(struct wsgi_request *, int, uint64_t, uint64_t);
+void uwsgi_websockets_setup_offload(void);
+void uwsgi_websockets_setup_hub(void);
+int uwsgi_websocket_subscribe(struct wsgi_request *, char *, uint16_t);
+int uwsgi_websocket_unsubscribe(struct wsgi_request *, char *, uint16_t);
+void uwsgi_websocket_unsubscribe_all(struct wsgi_request *);
+int uwsgi_websocket_publish(char *, uint16_t, char *, size_t, uint8_t);
+void uwsgi_websockets_hub_dispatch(void);
+int uwsgi_stats_websockets_hub(struct uwsgi_stats *);
+void uwsgi_websocket_deflate_destroy(struct wsgi_request *);
+
+extern struct uwsgi_websocket_mask_kernel uwsgi_websocket_mask_kernels[];
+void uwsgi_websocket_mask(uint8_t *, uint8_t *, size_t, uint8_t *);
+struct uwsgi_websocket_mask_kernel *uwsgi_websocket_mask_kernel(char *);
+void uwsgi_websockets_setup_mask(void);
+
+void uwsgi_stats_server_loop(struct uwsgi_thread *);
+void uwsgi_stats_server_generate(struct uwsgi_thread *);
 
 void uwsgi_register_logchunks(void);
 